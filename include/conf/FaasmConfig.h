@@ -30,16 +30,41 @@ class FaasmConfig
 
     std::string pythonPreload;
     std::string captureStdout;
+    int stdoutCaptureMaxKb;
+    std::string stdoutCapturePolicy;
+    std::string stdoutSink;
 
     int chainedCallTimeout;
 
     std::string wasmVm;
+    int modulePoolSize;
+
+    // Either on, off, or a comma-separated list of user/function
+    std::string hugePages;
+
+    // Either join (dispatch on first join) or eager (dispatch on create, only
+    // to this host)
+    std::string pthreadDispatch;
+    int pthreadBatchWindowUs;
+
+    // Either batch (dispatch each OpenMP region as a batch of threads) or
+    // persistent (keep teams parked on this host between regions)
+    std::string ompTeams;
+
+    // Default limit on nested parallel regions with more than one thread,
+    // which guests can change with omp_set_max_active_levels
+    int ompMaxActiveLevels;
 
     std::string functionDir;
     std::string objectFileDir;
     std::string runtimeFilesDir;
     std::string sharedFilesDir;
 
+    std::string scratchFsPrefix;
+    int scratchFsMaxMb;
+
+    std::string ioEngine;
+
     std::string s3Bucket;
     std::string s3Host;
     std::string s3Port;
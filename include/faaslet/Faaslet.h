@@ -7,6 +7,7 @@
 #include <system/NetworkNamespace.h>
 #include <wasm/WasmModule.h>
 
+#include <atomic>
 #include <string>
 
 namespace faaslet {
@@ -40,6 +41,13 @@ class Faaslet final : public faabric::scheduler::Executor
     std::string localResetSnapshotKey;
 
     std::shared_ptr<isolation::NetworkNamespace> ns;
+
+    // The function this Faaslet is bound to, used to return the module to the
+    // module pool on shutdown
+    faabric::Message poolMsg;
+
+    // Whether the module has executed anything since it was last reset
+    std::atomic<bool> moduleDirty = false;
 };
 
 class FaasletFactory final : public faabric::scheduler::ExecutorFactory
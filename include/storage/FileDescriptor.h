@@ -2,6 +2,7 @@
 
 #include <dirent.h>
 #include <fcntl.h>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -21,7 +22,17 @@
 // The root fd comes after stdin, stdout and stderr
 #define DEFAULT_ROOT_FD 4
 
+// Size of the buffer used to read directory entries from the kernel
+#define DIRENT_BUFFER_SIZE (32 * 1024)
+
+// Directory iterators record the kernel offset every this many entries, so
+// that a cookie can be resumed without rescanning from the start
+#define DIR_CHECKPOINT_INTERVAL 256
+
 namespace storage {
+class PathCache;
+class ScratchFileSystem;
+
 std::string prependRuntimeRoot(const std::string& originalPath);
 
 enum OpenMode
@@ -96,6 +107,10 @@ class FileDescriptor
 
     void iterReset();
 
+    // Moves the iterator to the entry with the given cookie, i.e. the value of
+    // next on the entry before it
+    void seekDir(uint64_t cookie);
+
     size_t copyDirentsToWasiBuffer(uint8_t* buffer, size_t bufferLen);
 
     Stat stat(const std::string& relativePath = "");
@@ -115,8 +130,26 @@ class FileDescriptor
 
     bool updateFlags(int32_t fdFlags);
 
+    ssize_t read(std::vector<::iovec>& nativeIovecs, int iovecCount);
+
     ssize_t write(std::vector<::iovec>& nativeIovecs, int iovecCount);
 
+    // Positional reads and writes don't touch the fd's offset, so concurrent
+    // callers on the same fd don't need to serialise
+    ssize_t pread(std::vector<::iovec>& nativeIovecs,
+                  int iovecCount,
+                  uint64_t offset);
+
+    ssize_t pwrite(std::vector<::iovec>& nativeIovecs,
+                   int iovecCount,
+                   uint64_t offset);
+
+    bool allocate(uint64_t offset, uint64_t len);
+
+    bool setSize(uint64_t size);
+
+    bool sync(bool dataOnly);
+
     void close() const;
 
     bool mkdir(const std::string& dirPath);
@@ -145,14 +178,37 @@ class FileDescriptor
 
     void setPath(const std::string& newPath);
 
-    std::string getPath();
+    std::string getPath() const;
 
     int duplicate(const FileDescriptor& other);
 
+    void setScratchFileSystem(std::shared_ptr<ScratchFileSystem> scratchIn);
+
+    void setPathCache(std::shared_ptr<PathCache> pathCacheIn);
+
+    bool isScratch() const;
+
+    bool openAnonymousScratch(const std::string& name);
+
   private:
     static FileDescriptor stdFdFactory(int stdFd, const std::string& devPath);
 
-    void loadDirContents();
+    // A directory entry pointing into the iterator's buffers
+    struct DirEntView
+    {
+        uint64_t ino;
+        uint8_t type;
+        const char* name;
+        size_t nameLen;
+    };
+
+    void startDirIter();
+
+    bool fillDirentBuffer();
+
+    bool peekDirEnt(DirEntView& view);
+
+    void advanceDirIter();
 
     std::string path;
 
@@ -167,8 +223,30 @@ class FileDescriptor
 
     uint16_t wasiErrno = 0;
 
-    bool dirContentsLoaded = false;
-    std::vector<DirEnt> dirContents;
-    int dirContentsIdx = 0;
+    // Directory iteration state. Entries are read with getdents64 into a
+    // reusable buffer, and cookies are the index of the next entry
+    bool dirIterStarted = false;
+    bool dirIterEof = false;
+    uint64_t dirIterIdx = 0;
+    std::vector<uint8_t> direntBuffer;
+    size_t direntBufferPos = 0;
+    size_t direntBufferLen = 0;
+    int64_t direntReadOffset = 0;
+    int64_t dirLastOffset = 0;
+    int64_t dirPrevOffset = 0;
+    size_t dirPrevEntryPos = 0;
+    bool dirCanStepBack = false;
+    std::vector<int64_t> dirCheckpoints;
+    std::vector<DirEnt> scratchDirContents;
+
+    std::shared_ptr<ScratchFileSystem> scratch = nullptr;
+
+    std::shared_ptr<PathCache> pathCache = nullptr;
+
+    PathCache& getPathCache();
+
+    bool isScratchPath(const std::string& p) const;
+
+    bool scratchPathOpen();
 };
 }
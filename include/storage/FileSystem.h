@@ -1,15 +1,27 @@
 #pragma once
 
 #include "FileDescriptor.h"
+#include "PathCache.h"
+#include "ScratchFileSystem.h"
 
 #include <faabric/proto/faabric.pb.h>
 
+#include <memory>
 #include <unordered_map>
 
 namespace storage {
 class FileSystem
 {
   public:
+    FileSystem();
+
+    // Copies share the host fds of the original, but start with an empty
+    // scratch filesystem, dropping any descriptors that pointed into it. The
+    // path cache is not shared either
+    FileSystem(const FileSystem& other);
+
+    FileSystem& operator=(const FileSystem& other);
+
     void prepareFilesystem();
 
     bool fileDescriptorExists(int fd);
@@ -28,6 +40,14 @@ class FileSystem
 
     int dup(int fd);
 
+    void closeFileDescriptor(int fd);
+
+    int openScratchAnonymous(const std::string& name);
+
+    ScratchFileSystem& getScratchFileSystem();
+
+    PathCacheStats getPathCacheStats();
+
     void tearDown();
 
     std::string getPathForFd(int fd);
@@ -39,6 +59,12 @@ class FileSystem
 
     std::unordered_map<int, storage::FileDescriptor> fileDescriptors;
 
+    std::shared_ptr<ScratchFileSystem> scratch;
+
+    std::shared_ptr<PathCache> pathCache;
+
     int getNewFd();
+
+    void copyFrom(const FileSystem& other);
 };
 }
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <vector>
+
+#define IO_ENGINE_SYSCALL "syscall"
+#define IO_ENGINE_IO_URING "io_uring"
+
+// Entries in each io_uring submission queue
+#define IO_URING_QUEUE_DEPTH 64
+
+struct io_uring_cqe;
+
+namespace storage {
+
+/**
+ * Returns a thread-local buffer with room for at least the given number of
+ * iovecs. The buffer is reused across calls to avoid allocating on every read
+ * and write, so its contents are only valid until the next call on the same
+ * thread.
+ */
+std::vector<::iovec>& getIovecBuffer(size_t iovecCount);
+
+enum class IoOp
+{
+    Read,
+    Write,
+};
+
+/**
+ * A single vectored read or write. An offset of -1 means the fd's current
+ * offset is used (and updated). The result holds the number of bytes
+ * transferred, or -errno on failure.
+ */
+struct IoRequest
+{
+    IoOp op = IoOp::Read;
+    int linuxFd = -1;
+    const ::iovec* iovecs = nullptr;
+    int iovecCount = 0;
+    off_t offset = -1;
+    ssize_t result = 0;
+};
+
+/**
+ * Performs file I/O on behalf of file descriptors. Engines are not
+ * thread-safe, each thread gets its own via getIoEngine().
+ */
+class IoEngine
+{
+  public:
+    virtual ~IoEngine() = default;
+
+    // Returns bytes read or -errno
+    ssize_t readv(int linuxFd, const ::iovec* iovecs, int iovecCount);
+
+    // Returns bytes written or -errno
+    ssize_t writev(int linuxFd, const ::iovec* iovecs, int iovecCount);
+
+    // Positional variants, these leave the fd's offset untouched
+    ssize_t preadv(int linuxFd,
+                   const ::iovec* iovecs,
+                   int iovecCount,
+                   off_t offset);
+
+    ssize_t pwritev(int linuxFd,
+                    const ::iovec* iovecs,
+                    int iovecCount,
+                    off_t offset);
+
+    /**
+     * Submits all the requests, returning once they have all completed.
+     * Requests in a batch may complete in any order, so requests using the
+     * current offset of the same fd should not share a batch.
+     */
+    void submitBatch(std::vector<IoRequest>& requests);
+
+    virtual void submit(IoRequest* requests, size_t nRequests) = 0;
+
+    virtual std::string getName() const = 0;
+};
+
+/**
+ * Plain blocking readv/writev (or preadv/pwritev), one syscall per request.
+ */
+class SyscallIoEngine final : public IoEngine
+{
+  public:
+    void submit(IoRequest* requests, size_t nRequests) override;
+
+    std::string getName() const override;
+};
+
+#ifdef FAASM_IO_URING
+/**
+ * Submits requests through a per-thread io_uring, so a whole batch is
+ * submitted with a single syscall. Fds are not registered with the ring, as
+ * a registration holds the file rather than the fd number, and fds can be
+ * closed and reused by any thread between submissions.
+ */
+class IoUringIoEngine final : public IoEngine
+{
+  public:
+    explicit IoUringIoEngine(unsigned queueDepth = IO_URING_QUEUE_DEPTH);
+
+    ~IoUringIoEngine() override;
+
+    IoUringIoEngine(const IoUringIoEngine& other) = delete;
+
+    IoUringIoEngine& operator=(const IoUringIoEngine& other) = delete;
+
+    // False if the kernel does not support io_uring
+    bool isReady() const;
+
+    void submit(IoRequest* requests, size_t nRequests) override;
+
+    std::string getName() const override;
+
+  private:
+    int ringFd = -1;
+    bool supportsCurrentOffset = false;
+
+    void* sqRingPtr = nullptr;
+    size_t sqRingSize = 0;
+    void* cqRingPtr = nullptr;
+    size_t cqRingSize = 0;
+    void* sqesPtr = nullptr;
+    size_t sqesSize = 0;
+
+    unsigned sqEntries = 0;
+    unsigned* sqTail = nullptr;
+    unsigned* sqMask = nullptr;
+    unsigned* sqArray = nullptr;
+
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned* cqMask = nullptr;
+    ::io_uring_cqe* cqes = nullptr;
+
+    // Reused between submissions to avoid allocating
+    std::vector<IoRequest*> ringRequests;
+
+    void tearDown();
+
+    void submitChunk(IoRequest** requests, unsigned nRequests);
+};
+#endif
+
+// Returns the calling thread's engine, as chosen by the IO_ENGINE config
+IoEngine& getIoEngine();
+}
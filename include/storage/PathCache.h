@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <shared_mutex>
+#include <string>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unordered_map>
+
+// Once this many directories are cached, the cache is emptied and refilled
+#define PATH_CACHE_MAX_DIRS 1024
+
+namespace storage {
+
+struct PathCacheStats
+{
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t bypasses = 0;
+    uint64_t invalidations = 0;
+    size_t cachedDirs = 0;
+
+    double hitRate() const;
+};
+
+/**
+ * Resolves paths relative to the runtime root using cached directory fds.
+ *
+ * Each operation looks up the fd of the path's parent directory, opening and
+ * caching it on a miss, then does the equivalent *at syscall on the final
+ * component. Repeated lookups in the same directory (e.g. a Python import
+ * walking sys.path) therefore only walk one component in the kernel, and
+ * build no absolute path strings.
+ *
+ * Paths containing .. components are not cached, and fall back to resolving
+ * the full path. Operations that change the directory tree invalidate any
+ * cached entries at or below the affected paths.
+ *
+ * Other Faaslets in the process have their own caches. Whenever any cache
+ * renames or removes something, it bumps a generation shared by all of them,
+ * and each cached directory is checked once per generation: if its path now
+ * leads to a different directory (by device and inode) it's dropped. Changes
+ * made outside the Faasm process aren't tracked like this. Directories
+ * deleted that way are detected when a lookup through them fails, but a
+ * directory renamed or replaced from outside the process is only noticed
+ * after the next change made by a cache.
+ *
+ * All operations return a negative errno on failure.
+ */
+class PathCache
+{
+  public:
+    PathCache() = default;
+
+    ~PathCache();
+
+    PathCache(const PathCache& other) = delete;
+
+    PathCache& operator=(const PathCache& other) = delete;
+
+    int open(const std::string& path, int flags, mode_t mode);
+
+    int stat(const std::string& path, struct ::stat* statBuf);
+
+    int mkdir(const std::string& path, mode_t mode);
+
+    int unlink(const std::string& path);
+
+    int rmdir(const std::string& path);
+
+    int rename(const std::string& oldPath, const std::string& newPath);
+
+    ssize_t readLink(const std::string& path, char* buffer, size_t bufferLen);
+
+    // Drops any cached directories at or below the given path
+    void invalidate(const std::string& path);
+
+    void clear();
+
+    PathCacheStats getStats();
+
+  private:
+    struct CachedDir
+    {
+        int fd = -1;
+        dev_t dev = 0;
+        ino_t ino = 0;
+
+        // The tree generation the directory was last checked at
+        uint64_t generation = 0;
+    };
+
+    std::shared_mutex mx;
+
+    std::string rootPath;
+    int rootFd = -1;
+
+    std::unordered_map<std::string, CachedDir> dirs;
+
+    std::atomic<uint64_t> hits = 0;
+    std::atomic<uint64_t> misses = 0;
+    std::atomic<uint64_t> bypasses = 0;
+    std::atomic<uint64_t> invalidations = 0;
+
+    template<typename T, typename Op>
+    T withParent(const std::string& path, Op op);
+
+    int getParentFd(const std::string& parent);
+
+    bool isCurrent(const std::string& parent, CachedDir& dir);
+
+    void dropStaleDir(const std::string& parent, int dirFd);
+
+    void dropDirs(const std::string& key);
+
+    bool checkRoot();
+
+    void closeDirFds();
+
+    void doClear();
+};
+}
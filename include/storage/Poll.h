@@ -0,0 +1,25 @@
+#pragma once
+
+#include <WAVM/WASI/WASIABI.h>
+
+#include <functional>
+
+namespace storage {
+
+/**
+ * Implements WASI poll_oneoff. Clock and fd subscriptions are all waited on
+ * together, returning as soon as any of them fires (i.e. after the earliest
+ * timeout, not the sum of them). Every subscription that is ready at that
+ * point gets an event, written to the events array (which must have room for
+ * one per subscription).
+ *
+ * getLinuxFd maps a wasm fd to a host fd, returning a negative value if the
+ * fd doesn't exist.
+ *
+ * Returns the number of events written.
+ */
+int pollOneoff(const __wasi_subscription_t* subscriptions,
+               __wasi_event_t* events,
+               int nSubs,
+               const std::function<int(int)>& getLinuxFd);
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <storage/FileDescriptor.h>
+
+#include <memory>
+#include <set>
+#include <string>
+#include <sys/stat.h>
+#include <unordered_map>
+#include <vector>
+
+namespace storage {
+
+/**
+ * A single in-memory scratch file. The contents live in an anonymous memfd
+ * owned by this object, which is closed when the last reference goes away.
+ *
+ * The file's size is tracked here, rather than read from the memfd, and is
+ * updated by the filesystem whenever the file may have changed size. The
+ * filesystem also counts the names and fds referring to the file, so it
+ * knows when the file's space is freed.
+ */
+class ScratchFile
+{
+  public:
+    explicit ScratchFile(const std::string& name);
+
+    ~ScratchFile();
+
+    ScratchFile(const ScratchFile& other) = delete;
+
+    ScratchFile& operator=(const ScratchFile& other) = delete;
+
+    int getFd() const;
+
+    size_t getSize() const;
+
+    void setSize(size_t newSize);
+
+    void addLink();
+
+    // Returns the number of links left
+    int removeLink();
+
+  private:
+    int memFd = -1;
+
+    size_t size = 0;
+
+    int links = 0;
+};
+
+/**
+ * Per-Faaslet in-memory filesystem mounted under a fixed prefix (e.g. /tmp).
+ *
+ * Files under the prefix never touch the real disk, they are backed by memfds
+ * so that the existing fd-based operations (readv, writev, lseek, fstat, mmap)
+ * work unchanged. The total size of all files is bounded, and all contents are
+ * discarded when the filesystem is reset, which happens whenever the owning
+ * module is reset from its snapshot.
+ *
+ * Writes are checked against the limit before they're made, and the total is
+ * updated afterwards, so checks don't depend on the number of files. Files
+ * can't grow through mappings, as writable shared mappings of scratch files
+ * are rejected.
+ */
+class ScratchFileSystem
+{
+  public:
+    ScratchFileSystem();
+
+    ScratchFileSystem(const std::string& prefixIn, size_t maxBytesIn);
+
+    ~ScratchFileSystem();
+
+    // Copying a scratch filesystem does not copy its contents, the copy
+    // starts empty with the same prefix and size limit
+    ScratchFileSystem(const ScratchFileSystem& other);
+
+    ScratchFileSystem& operator=(const ScratchFileSystem& other);
+
+    bool isEnabled() const;
+
+    bool isScratchPath(const std::string& path) const;
+
+    std::string normalisePath(const std::string& path) const;
+
+    std::string createTempName(const std::string& namePrefix);
+
+    // Returns a new host fd for the given path, or -errno on failure
+    int open(const std::string& path, int linuxFlags);
+
+    // Returns a new host fd for a file that is not linked into the namespace
+    int openAnonymous(const std::string& name);
+
+    int stat(const std::string& path, struct ::stat* nativeStat);
+
+    int unlink(const std::string& path);
+
+    int rename(const std::string& oldPath, const std::string& newPath);
+
+    int mkdir(const std::string& path);
+
+    int rmdir(const std::string& path);
+
+    int dup(int linuxFd);
+
+    void close(int linuxFd);
+
+    int listDir(const std::string& path, std::vector<DirEnt>& entries);
+
+    // Returns zero if writing the given number of bytes at the given offset
+    // (by default the fd's current offset) keeps the filesystem within its
+    // size limit
+    int checkWrite(int linuxFd, size_t nBytes, off_t offset = -1);
+
+    // Returns zero if resizing the fd's file to the given size keeps the
+    // filesystem within its size limit
+    int checkResize(int linuxFd, size_t newSize);
+
+    // Updates the space used after the fd's file may have changed size, e.g.
+    // after a write, truncation or allocation
+    void updateSize(int linuxFd);
+
+    bool ownsFd(int linuxFd) const;
+
+    size_t getUsedBytes() const;
+
+    size_t getMaxBytes() const;
+
+    size_t getFileCount() const;
+
+    void reset();
+
+  private:
+    std::string prefix;
+    size_t maxBytes = 0;
+
+    int tempNameCounter = 0;
+
+    // Space taken by all files with a name or an open fd
+    size_t usedBytes = 0;
+
+    std::unordered_map<std::string, std::shared_ptr<ScratchFile>> files;
+    std::set<std::string> dirs;
+
+    // Every host fd handed out, along with the file backing it
+    std::unordered_map<int, std::shared_ptr<ScratchFile>> openFds;
+
+    std::string parentPath(const std::string& path) const;
+
+    bool hasChildren(const std::string& path) const;
+
+    int registerFd(const std::shared_ptr<ScratchFile>& file, int linuxFlags);
+
+    void linkFile(const std::shared_ptr<ScratchFile>& file);
+
+    void unlinkFile(const std::shared_ptr<ScratchFile>& file);
+
+    void setFileSize(ScratchFile& file, size_t newSize);
+
+    int checkGrowth(size_t fileSize, size_t newTop) const;
+};
+}
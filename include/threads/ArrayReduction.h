@@ -0,0 +1,69 @@
+#pragma once
+
+#include <faabric/util/snapshot.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace threads {
+
+/**
+ * A reduction over an array that's merged by Faasm, rather than with a
+ * faabric merge region per element. The array is ignored in the threads'
+ * snapshot diffs. Instead, each thread that doesn't share memory with the
+ * thread that forked the batch records its host's part of the reduction in
+ * its own slot, and the forking thread merges the slots into the array once
+ * the batch has finished. The slots are sent back in the usual diffs, as
+ * each is only written by one thread.
+ *
+ * Descriptors are written to wasm memory before the batch's snapshot is
+ * taken, so every host can find them. All pointers are wasm offsets.
+ */
+struct ArrayReduction
+{
+    uint32_t arrayPtr = 0;
+    uint32_t count = 0;
+    int32_t dataType = 0;
+    int32_t mergeOp = 0;
+
+    // The values already recorded by threads on this host
+    uint32_t basePtr = 0;
+
+    // Each slot holds a flag word, padding, then one value per element
+    uint32_t slotsPtr = 0;
+    uint32_t slotSize = 0;
+    int32_t firstIdx = 0;
+    int32_t nSlots = 0;
+};
+
+// Whether arrays of this type can be merged by Faasm with this operation
+bool canMergeArray(faabric::util::SnapshotDataType dataType,
+                   faabric::util::SnapshotMergeOperation mergeOp);
+
+// The size of the array in bytes
+size_t getArrayReductionBytes(const ArrayReduction& r);
+
+// The size of the block holding the given reductions for a batch of nSlots
+// threads
+size_t getArrayReductionsSize(const std::vector<ArrayReduction>& reductions,
+                              int nSlots);
+
+// Writes the reductions to the block at blockPtr, for a batch of threads with
+// group indexes from firstIdx. Returns the offset of the first slot, as
+// everything before it is only read by other hosts.
+uint32_t writeArrayReductions(uint8_t* memoryBase,
+                              uint32_t blockPtr,
+                              const std::vector<ArrayReduction>& reductions,
+                              int firstIdx,
+                              int nSlots);
+
+// Records the host's part of each reduction in the thread's slots. Threads
+// on the same host must not call this at the same time.
+void recordArrayReductions(uint8_t* memoryBase,
+                           uint32_t blockPtr,
+                           int groupIdx);
+
+// Merges all recorded slots into the arrays. Returns the size of the block.
+size_t mergeArrayReductions(uint8_t* memoryBase, uint32_t blockPtr);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+namespace threads {
+
+/**
+ * The lock on this host for an OpenMP critical section. Critical sections are
+ * identified by the wasm address of their name (the kmp_critical_name passed
+ * to __kmpc_critical), so sections with different names don't exclude one
+ * another. The lock is recursive, as with the point-to-point group lock.
+ */
+class CriticalSection
+{
+  public:
+    void lock();
+
+    void unlock();
+
+  private:
+    std::recursive_mutex mx;
+};
+
+/**
+ * The critical sections of a module by name. Names are global to the program,
+ * so sections are shared by all the module's threads and teams, and are
+ * cleared when the function finishes.
+ */
+class CriticalSections
+{
+  public:
+    std::shared_ptr<CriticalSection> get(int32_t crit);
+
+    void clear();
+
+    size_t size();
+
+  private:
+    std::shared_mutex sectionsMx;
+
+    std::unordered_map<int32_t, std::shared_ptr<CriticalSection>> sections;
+};
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+
+// Attempts on an uncontended word before parking on the futex
+#define FUTEX_SPIN_COUNT 100
+
+namespace threads {
+
+/**
+ * Pthread synchronisation primitives whose state lives in the guest's own
+ * pthread structs. All pointers are host addresses into wasm memory, and all
+ * threads of a module share that memory, so a futex on the address is enough
+ * to park and wake them. Uncontended operations are a single atomic and never
+ * enter the kernel.
+ *
+ * Only the leading words of the guest structs are used, and a zeroed struct
+ * (i.e. the static initialisers) is always valid. Mutexes are not recursive.
+ */
+
+// Mutex state is 0 when unlocked, 1 when locked and 2 when locked with
+// waiters
+void futexMutexLock(int32_t* mx);
+
+bool futexMutexTryLock(int32_t* mx);
+
+void futexMutexUnlock(int32_t* mx);
+
+// Condition variables hold a sequence number, bumped on every signal. Waits
+// take the absolute timeout against the realtime clock, and return ETIMEDOUT
+// if it passes.
+int futexCondWait(int32_t* cond,
+                  int32_t* mx,
+                  const struct timespec* absTimeout = nullptr);
+
+void futexCondSignal(int32_t* cond);
+
+void futexCondBroadcast(int32_t* cond);
+
+// Barriers hold their count, the number of arrived threads and a generation
+// in three consecutive words. Wait returns true for exactly one thread.
+void futexBarrierInit(int32_t* barrier, int32_t count);
+
+bool futexBarrierWait(int32_t* barrier);
+}
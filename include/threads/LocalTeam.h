@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+namespace threads {
+
+/**
+ * A team of threads executing a nested OpenMP parallel region. Nested teams
+ * always run on threads local to the host of the thread that forked them, so
+ * they synchronise with local primitives rather than a point-to-point group.
+ */
+class LocalTeam
+{
+  public:
+    LocalTeam(int groupIdIn, int sizeIn);
+
+    const int groupId;
+
+    const int size;
+
+    void barrier();
+
+    // The team lock is recursive, as with the point-to-point group lock
+    void lock();
+
+    void unlock();
+
+  private:
+    int32_t barrierWords[3];
+
+    std::recursive_mutex teamMx;
+};
+
+// The local team of the calling thread, null if it is not part of one
+std::shared_ptr<LocalTeam> getCurrentLocalTeam();
+
+void setCurrentLocalTeam(std::shared_ptr<LocalTeam> team);
+}
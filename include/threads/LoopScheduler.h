@@ -0,0 +1,118 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+
+namespace threads {
+
+enum class LoopSchedule
+{
+    Dynamic,
+    Guided,
+};
+
+/**
+ * The iterations of a loop passed to __kmpc_dispatch_init, whose bounds may be
+ * signed or unsigned, 4 or 8 bytes, and whose increment may be negative.
+ * Bounds are stored sign-extended, so that the same arithmetic works for all
+ * the loop types, and iterations are counted from zero.
+ */
+struct LoopBounds
+{
+    uint64_t lower = 0;
+    uint64_t incr = 0;
+    uint64_t tripCount = 0;
+
+    template<typename T>
+    static LoopBounds fromLoop(T lower,
+                               T upper,
+                               typename std::make_signed<T>::type incr)
+    {
+        typedef typename std::make_unsigned<T>::type UT;
+
+        LoopBounds bounds;
+        bounds.lower = (uint64_t)(int64_t)lower;
+        bounds.incr = (uint64_t)(int64_t)incr;
+
+        // Upper-lower can exceed the limit of the signed type
+        if (incr > 0 && upper >= lower) {
+            bounds.tripCount = ((UT)upper - (UT)lower) / (UT)incr + 1;
+        } else if (incr < 0 && lower >= upper) {
+            bounds.tripCount = ((UT)lower - (UT)upper) / (UT)(-incr) + 1;
+        }
+
+        return bounds;
+    }
+
+    // Gets the first and last (inclusive) values of a chunk of iterations
+    template<typename T>
+    void getChunk(uint64_t start, uint64_t size, T& first, T& last) const
+    {
+        first = (T)(lower + start * incr);
+        last = (T)(lower + (start + size - 1) * incr);
+    }
+};
+
+/**
+ * Returns the number of iterations in the next chunk of a loop with the given
+ * number of iterations remaining. Dynamic loops always hand out the requested
+ * chunk size, while guided loops hand out a share of the remaining iterations
+ * proportional to the number of threads, which shrinks to the chunk size.
+ */
+uint64_t getLoopChunkSize(LoopSchedule schedule,
+                          uint64_t remaining,
+                          uint64_t chunk,
+                          int nThreads);
+
+/**
+ * The shared state of a dynamically scheduled loop, which all threads of a
+ * team on this host claim chunks of iterations from. Iterations are counted
+ * from zero, independent of the loop bounds and increment.
+ */
+class DynamicLoop
+{
+  public:
+    DynamicLoop(LoopSchedule scheduleIn,
+                uint64_t tripCountIn,
+                uint64_t chunkIn,
+                int nThreadsIn);
+
+    const LoopSchedule schedule;
+
+    const uint64_t tripCount;
+
+    const uint64_t chunk;
+
+    const int nThreads;
+
+    // Claims the next chunk of iterations, returning false when there are
+    // none left
+    bool next(uint64_t& start, uint64_t& size);
+
+    // Records a thread as done with the loop, returning true for the last one
+    bool finish();
+
+  private:
+    std::atomic<uint64_t> nextIteration = 0;
+
+    std::atomic<int> nFinished = 0;
+};
+
+/**
+ * Loops are identified by the group of the team executing them, and the
+ * index of the loop within the team's parallel region. The first thread to
+ * reach a loop creates it, and it is removed once all threads have finished.
+ */
+std::shared_ptr<DynamicLoop> getOrCreateDynamicLoop(int groupId,
+                                                    int loopIdx,
+                                                    LoopSchedule schedule,
+                                                    uint64_t tripCount,
+                                                    uint64_t chunk,
+                                                    int nThreads);
+
+void finishDynamicLoop(int groupId, int loopIdx);
+
+void clearDynamicLoops();
+}
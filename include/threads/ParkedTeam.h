@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace threads {
+
+/**
+ * A team of threads on this host which stays alive between jobs, e.g. the
+ * parallel regions of a function. Between jobs, the threads spin briefly and
+ * then park on a futex until the next job is published, so running a job
+ * doesn't create any threads or go through the scheduler.
+ *
+ * Only one job runs at a time, and run must not be called concurrently.
+ */
+class ParkedTeam
+{
+  public:
+    explicit ParkedTeam(int nThreadsIn);
+
+    // Stops and joins all the threads
+    ~ParkedTeam();
+
+    const int nThreads;
+
+    // Runs the job on every thread of the team, passing each its thread
+    // number, and waits for all of them to finish. Rethrows the first
+    // exception thrown by any of the threads.
+    void run(const std::function<void(int)>& job);
+
+  private:
+    std::vector<std::thread> threads;
+
+    // The job currently being run, and any exception thrown by each thread
+    const std::function<void(int)>* currentJob = nullptr;
+    std::vector<std::exception_ptr> errors;
+
+    // Bumped each time a job is published, or when the team stops
+    std::atomic<uint32_t> generation = 0;
+    bool stopping = false;
+
+    // Threads still running the current job
+    std::atomic<int> nRunning = 0;
+
+    void workerLoop(int threadNum);
+};
+}
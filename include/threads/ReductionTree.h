@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace threads {
+
+/**
+ * Combines the private reduction data of the threads of a team on this host
+ * in a binary tree, so a reduction over N threads takes log(N) steps rather
+ * than N serialised updates.
+ *
+ * In the first round, each even thread combines the data of the thread after
+ * it into its own, in the next round each multiple of four combines that of
+ * the thread two after it, and so on, until thread zero holds the combined
+ * data of the whole team. Threads whose data has been taken by another wait
+ * until thread zero releases them, so their data stays valid while it's
+ * being read, and the tree can be reused for the next reduction.
+ */
+class ReductionTree
+{
+  public:
+    explicit ReductionTree(int nThreadsIn);
+
+    const int nThreads;
+
+    // Adds the thread's data to the tree, calling combine(lhs, rhs) to combine
+    // the data of other threads into it. Returns true for thread zero, once
+    // it holds the combined data, and false for all other threads once their
+    // data has been taken.
+    bool reduce(int threadNum,
+                int32_t data,
+                const std::function<void(int32_t, int32_t)>& combine);
+
+    // Called by thread zero once it has finished with the combined data
+    void release();
+
+    // Called by all other threads after reduce to wait for thread zero
+    void awaitRelease(int threadNum);
+
+  private:
+    std::vector<int32_t> threadData;
+
+    // The number of reductions each thread has started, only accessed by
+    // that thread
+    std::vector<uint64_t> threadRounds;
+
+    // The last reduction each thread's subtree has been combined for
+    std::unique_ptr<std::atomic<uint64_t>[]> ready;
+
+    std::atomic<uint64_t> released = 0;
+};
+
+// Trees are shared by the threads of a team on this host, and are removed
+// once none of them hold it
+std::shared_ptr<ReductionTree> getOrCreateReductionTree(int groupId,
+                                                        int nThreads);
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace threads {
+
+/**
+ * Tasks created within a taskgroup region, and all their descendants, count
+ * towards the taskgroup until they complete.
+ */
+class TaskGroup
+{
+  public:
+    explicit TaskGroup(std::shared_ptr<TaskGroup> parentIn);
+
+    // The taskgroup enclosing this one in the same task, if any
+    const std::shared_ptr<TaskGroup> parent;
+
+    std::atomic<int> nIncomplete = 0;
+};
+
+/**
+ * An OpenMP task, whose data (i.e. the kmp_task_t struct, privates and
+ * shareds) lives in wasm memory. Each thread also has an implicit task, with
+ * no data, for the tasks it creates outside of any explicit task.
+ */
+class Task
+{
+  public:
+    Task(int32_t taskPtrIn,
+         std::shared_ptr<Task> parentIn,
+         std::shared_ptr<TaskGroup> groupIn);
+
+    // Wasm pointer to the task data, zero for implicit tasks
+    const int32_t taskPtr;
+
+    // The task that created this one
+    const std::shared_ptr<Task> parent;
+
+    // The taskgroup this task counts towards, if any
+    const std::shared_ptr<TaskGroup> group;
+
+    // Children of this task that have not yet completed
+    std::atomic<int> nIncompleteChildren = 0;
+
+    // The innermost taskgroup opened while executing this task, which new
+    // children count towards. Only accessed by the thread executing the task.
+    std::shared_ptr<TaskGroup> currentGroup;
+};
+
+/**
+ * A double-ended queue of tasks owned by a single thread. The owner pushes
+ * and pops at the back, so executes its most recent tasks first, while other
+ * threads steal the oldest tasks from the front.
+ */
+class TaskDeque
+{
+  public:
+    void push(std::shared_ptr<Task> task);
+
+    std::shared_ptr<Task> pop();
+
+    std::shared_ptr<Task> steal();
+
+  private:
+    std::mutex mx;
+    std::deque<std::shared_ptr<Task>> tasks;
+};
+
+/**
+ * The queued tasks of the threads of a team on this host. Tasks only execute
+ * on the host they were created on.
+ */
+class TaskPool
+{
+  public:
+    explicit TaskPool(int nThreadsIn);
+
+    const int nThreads;
+
+    // Queues a task on the deque of the thread that created it, and counts
+    // it towards its parent and taskgroup
+    void push(int threadNum, std::shared_ptr<Task> task);
+
+    // Returns the thread's most recent task, or one stolen from another
+    // thread, or null if there are none queued
+    std::shared_ptr<Task> next(int threadNum);
+
+    // Called once the task has executed
+    void complete(const std::shared_ptr<Task>& task);
+
+    // Number of tasks queued or executing
+    int getPendingCount();
+
+    // Executes tasks until the predicate holds, checking it before each task
+    void executeUntil(int threadNum,
+                      const std::function<bool()>& done,
+                      const std::function<void(std::shared_ptr<Task>)>& exec);
+
+  private:
+    std::vector<TaskDeque> deques;
+
+    std::atomic<int> nPending = 0;
+};
+
+// Pools are shared by the threads of a team on this host, and are removed
+// once none of them hold it
+std::shared_ptr<TaskPool> getOrCreateTaskPool(int groupId, int nThreads);
+
+/**
+ * The task state of the calling thread, set the first time it uses tasks in a
+ * team, and cleared when it leaves the team.
+ */
+struct ThreadTasks
+{
+    std::shared_ptr<TaskPool> pool = nullptr;
+
+    int groupId = -1;
+
+    int threadNum = 0;
+
+    std::shared_ptr<Task> currentTask = nullptr;
+};
+
+ThreadTasks& getThreadTasks();
+}
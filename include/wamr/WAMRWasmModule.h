@@ -33,6 +33,10 @@ class WAMRWasmModule final
 
     int32_t executeFunction(faabric::Message& msg) override;
 
+    int32_t executePthread(int threadPoolIdx,
+                           uint32_t stackTop,
+                           faabric::Message& msg) override;
+
     // ----- Helper functions -----
     void writeStringToWasmMemory(const std::string& strHost, char* strWasm);
 
@@ -53,7 +57,7 @@ class WAMRWasmModule final
 
     uint32_t mmapMemory(size_t nBytes) override;
 
-    uint32_t mmapFile(uint32_t fp, size_t length) override;
+    void unmapMemory(uint32_t offset, size_t nBytes) override;
 
     size_t getMemorySizeBytes() override;
 
@@ -71,6 +75,16 @@ class WAMRWasmModule final
     WASMModuleCommon* wasmModule;
     WASMModuleInstanceCommon* moduleInstance;
 
+    // Threads run in their own instances, which share the module's memory but
+    // have their own globals, i.e. their own stack pointer. These are created
+    // on first use for each thread pool index.
+    std::mutex threadExecEnvsMx;
+    std::vector<WASMExecEnv*> threadExecEnvs;
+
+    WASMExecEnv* getThreadExecEnv(int threadPoolIdx, uint32_t stackTop);
+
+    void destroyThreadExecEnvs();
+
     int executeWasmFunction(const std::string& funcName);
 
     int executeWasmFunctionFromPointer(int wasmFuncPtr);
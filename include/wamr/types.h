@@ -8,6 +8,12 @@ struct iovec_app_t
     uint32_t buffLen;
 };
 
+struct timespec_app_t
+{
+    int64_t tv_sec;
+    int32_t tv_nsec;
+};
+
 struct wasi_prestat_app_t
 {
     __wasi_preopentype_t pr_type;
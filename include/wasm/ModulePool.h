@@ -0,0 +1,62 @@
+#pragma once
+
+#include <wasm/WasmModule.h>
+
+#include <faabric/proto/faabric.pb.h>
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace wasm {
+
+/**
+ * Host-wide pool of bound modules, kept when a Faaslet shuts down so the next
+ * Faaslet for the same function can take one over rather than binding a new
+ * one. When Faaslets for a function churn, this saves reserving and tearing
+ * down the module's linear memory (and its guard regions) each time.
+ *
+ * Modules are only reused for the same function, and the pool is only filled
+ * as Faaslets shut down, so a burst of Faaslets for a function that hasn't run
+ * yet finds it empty. WAVM reserves memory internally, so reservations can't
+ * be shared between functions or made ahead of time.
+ *
+ * Modules must be reset before they're released. Their host pages are then
+ * released while pooled, but each keeps its whole memory reservation.
+ *
+ * The pool holds at most MODULE_POOL_SIZE modules, and is disabled when that
+ * is zero.
+ */
+class ModulePool
+{
+  public:
+    // Returns a module bound to the given function, or nullptr if none pooled
+    std::unique_ptr<WasmModule> claim(const faabric::Message& msg,
+                                      int threadPoolSize);
+
+    // Returns false if the pool is full, in which case the module is dropped
+    bool release(const faabric::Message& msg,
+                 int threadPoolSize,
+                 std::unique_ptr<WasmModule> module);
+
+    size_t getPooledModuleCount();
+
+    size_t getPooledModuleCount(const faabric::Message& msg,
+                                int threadPoolSize);
+
+    void clear();
+
+  private:
+    std::mutex mx;
+
+    size_t pooledCount = 0;
+
+    std::unordered_map<std::string, std::vector<std::unique_ptr<WasmModule>>>
+      modules;
+};
+
+ModulePool& getModulePool();
+}
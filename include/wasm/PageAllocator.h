@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+
+namespace wasm {
+
+/**
+ * Counters describing how a module's linear memory has grown and been
+ * reclaimed over its lifetime.
+ */
+struct MemoryStats
+{
+    // Growth of the break, including reclaiming already provisioned memory
+    size_t growCount = 0;
+    size_t grownBytes = 0;
+    size_t peakBrk = 0;
+
+    // Mappings served from previously unmapped regions
+    size_t reuseCount = 0;
+    size_t reusedBytes = 0;
+
+    // Unmapped regions, and bytes whose host pages have been released
+    size_t unmapCount = 0;
+    size_t unmappedBytes = 0;
+    size_t releasedBytes = 0;
+
+    // Bytes advised to be backed by transparent huge pages
+    size_t hugePageBytes = 0;
+
+    // Current state of the free list
+    size_t freeBytes = 0;
+    size_t freeRegionCount = 0;
+};
+
+/**
+ * Keeps track of unmapped regions of linear memory below the break so that
+ * later mappings can reuse them. Adjacent regions are coalesced, and
+ * allocations are best-fit to limit fragmentation.
+ *
+ * This is not thread-safe, the owning module must hold its memory lock.
+ */
+class PageAllocator
+{
+  public:
+    // Returns the offset of a free region of nBytes, or zero if none fits
+    uint32_t allocate(size_t nBytes);
+
+    void free(uint32_t offset, size_t nBytes);
+
+    // Removes the given range from the free list, e.g. when it's mapped over
+    void reserve(uint32_t offset, size_t nBytes);
+
+    // If a free region ends at the given break, removes it and returns its
+    // start, otherwise returns the break unchanged
+    uint32_t trimTop(uint32_t brk);
+
+    // Drops any free memory at or above the given offset
+    void truncate(uint32_t top);
+
+    void clear();
+
+    size_t getFreeBytes() const;
+
+    size_t getFreeRegionCount() const;
+
+  private:
+    std::map<uint32_t, size_t> freeRegions;
+
+    size_t freeBytes = 0;
+};
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <sys/uio.h>
+#include <vector>
+
+#define STDOUT_POLICY_HEAD "head"
+#define STDOUT_POLICY_TAIL "tail"
+
+// Sinks with this prefix are unix sockets, others are directories
+#define STDOUT_SINK_UNIX_PREFIX "unix:"
+
+namespace wasm {
+
+/**
+ * Captures a module's stdout in a fixed-size buffer. Once the buffer is full,
+ * the head policy keeps the first bytes written and drops the rest, while the
+ * tail policy keeps the most recent bytes by overwriting the oldest.
+ *
+ * Everything written can also be streamed to a sink, either a unix socket or
+ * a directory holding one file per call, so that the full output is available
+ * even when the buffer truncates it.
+ */
+class StdoutCapture
+{
+  public:
+    StdoutCapture(size_t capacityIn,
+                  const std::string& policyIn,
+                  const std::string& sinkIn = "");
+
+    ~StdoutCapture();
+
+    StdoutCapture(const StdoutCapture& other) = delete;
+
+    StdoutCapture& operator=(const StdoutCapture& other) = delete;
+
+    // Starts a new call, rotating the sink file if there is one
+    void beginCall(const std::string& callName);
+
+    size_t write(const ::iovec* iovecs, int iovecCount);
+
+    size_t write(const char* data, size_t length);
+
+    // Returns the captured output, with a marker if any has been dropped
+    std::string read();
+
+    void clear();
+
+    size_t getSize();
+
+    size_t getDroppedBytes();
+
+    size_t getCapacity() const;
+
+    bool isTail() const;
+
+  private:
+    std::mutex mx;
+
+    size_t capacity = 0;
+    bool tail = true;
+
+    // Ring buffer, start is the oldest byte
+    std::vector<uint8_t> buffer;
+    size_t start = 0;
+    size_t size = 0;
+    size_t droppedBytes = 0;
+
+    std::string sink;
+    int sinkFd = -1;
+
+    void doWrite(const uint8_t* data, size_t length);
+
+    void writeToSink(const ::iovec* iovecs, int iovecCount);
+
+    void openSocketSink();
+
+    void closeSink();
+};
+}
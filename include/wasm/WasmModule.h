@@ -1,5 +1,7 @@
 #pragma once
 
+#include "PageAllocator.h"
+#include "StdoutCapture.h"
 #include "WasmEnvironment.h"
 
 #include <faabric/proto/faabric.pb.h>
@@ -8,12 +10,20 @@
 #include <faabric/util/memory.h>
 #include <faabric/util/queue.h>
 #include <faabric/util/snapshot.h>
+#include <threads/ArrayReduction.h>
+#include <threads/CriticalSection.h>
+#include <threads/ParkedTeam.h>
 #include <threads/ThreadState.h>
 
 #include <atomic>
 #include <exception>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
 #include <mutex>
 #include <string>
+#include <sys/mman.h>
 #include <sys/uio.h>
 #include <thread>
 #include <tuple>
@@ -28,6 +38,14 @@
 
 #define MAX_WASM_MEM (1024L * 1024L * 1024L * 4L)
 
+// Size of transparent huge pages on the host
+#define HUGE_PAGE_SIZE (2L * 1024L * 1024L)
+
+// OpenMP task memory is mapped in chunks of this size, and split into blocks
+// rounded up to the alignment
+#define TASK_MEMORY_CHUNK_SIZE (1024 * 1024)
+#define TASK_MEMORY_ALIGNMENT 16
+
 namespace wasm {
 
 // Note - avoid a zero default on the thread request type otherwise it can
@@ -39,6 +57,16 @@ enum ThreadRequestType
     OPENMP = 2,
 };
 
+// Hints on how regions of memory should be treated in snapshots. Scratch
+// regions may change but their changes are never merged, read-only regions
+// never change so never need diffing.
+enum SnapshotHint
+{
+    NONE = 0,
+    SCRATCH = 1,
+    READ_ONLY = 2,
+};
+
 bool isWasmPageAligned(int32_t offset);
 
 class WasmModule
@@ -105,7 +133,28 @@ class WasmModule
 
     virtual uint32_t mmapMemory(size_t nBytes);
 
-    virtual uint32_t mmapFile(uint32_t fp, size_t length);
+    // Replaces existing memory at the given (page-aligned) address with zeroed
+    // memory. Like the mmap syscall, this returns -errno on failure.
+    uint32_t mmapFixedMemory(uint32_t wasmPtr, size_t length);
+
+    // Maps length bytes of a host file, starting at the given (page-aligned)
+    // offset. When wasmPtr is non-zero the mapping replaces the existing memory
+    // at that address, otherwise new memory is allocated. Writes to MAP_PRIVATE
+    // mappings are copy-on-write, writes to MAP_SHARED mappings reach the file.
+    // Like the mmap syscall, this returns -errno on failure.
+    uint32_t mmapFile(uint32_t fd,
+                      size_t length,
+                      int prot = PROT_READ,
+                      int flags = MAP_SHARED,
+                      off_t offset = 0,
+                      uint32_t wasmPtr = 0);
+
+    // Flushes writes to shared file mappings, returning 0 or -errno
+    int syncMappedFile(uint32_t wasmPtr, size_t length, int flags);
+
+    // Releases the host pages of a clean module that's left idle, e.g. in the
+    // module pool. Memory mapped from the reset snapshot reads back from it.
+    void releaseIdleMemory();
 
     virtual void unmapMemory(uint32_t offset, size_t nBytes);
 
@@ -122,6 +171,8 @@ class WasmModule
 
     virtual uint8_t* getMemoryBase();
 
+    MemoryStats getMemoryStats();
+
     // ----- Snapshot/ restore -----
     std::shared_ptr<faabric::util::SnapshotData> getSnapshotData();
 
@@ -132,21 +183,52 @@ class WasmModule
     void restore(const std::string& snapshotKey);
 
     // ----- Threading -----
-    // Queues a pthread call that will be executed along with all other queued
-    // calls on the first call to await
+    // Queues a pthread call. By default queued calls are executed together on
+    // the first call to await. In eager mode, calls queued within the batch
+    // window are dispatched together in the background, and kept on this
+    // host.
     void queuePthreadCall(threads::PthreadCall call);
 
-    // Executes all queued pthread calls and awaits the call relating to the
+    // Executes any queued pthread calls and awaits the call relating to the
     // given pointer
     int awaitPthreadCall(faabric::Message* msg, int pthreadPtr);
 
+    // Waits for any background pthread dispatches to finish
+    void awaitPthreadDispatchers();
+
+    // Returns the top of the stack for the given thread pool index, allocating
+    // the stack on first use
+    uint32_t getThreadStack(int threadPoolIdx);
+
+    // Allocates the stacks needed by a batch of the given number of threads,
+    // so that they are included in any snapshot taken to execute the batch
+    void provisionThreadStacks(int nThreads);
+
+    // Stack tops by thread pool index, zero if not yet allocated
     std::vector<uint32_t> getThreadStacks();
 
-    // Returns the given pthread mutex and errors if it doesn't exist
-    std::shared_ptr<std::mutex> getPthreadMutex(uint32_t id);
+    // Takes a stack for a thread run outside the thread pool, e.g. one in a
+    // nested OpenMP team. Released stacks are reused by later threads.
+    uint32_t claimNestedThreadStack();
+
+    void releaseNestedThreadStack(uint32_t stackTop);
+
+    // Allocates memory for an OpenMP task. Freed blocks are reused for later
+    // tasks of the same size.
+    uint32_t allocateTaskMemory(uint32_t nBytes);
 
-    // Returns the given pthread mutex, creating it if it doesn't exist
-    std::shared_ptr<std::mutex> getOrCreatePthreadMutex(uint32_t id);
+    void freeTaskMemory(uint32_t wasmPtr);
+
+    // Runs the job on each thread of the module's parked OpenMP team, which
+    // stays alive between parallel regions until the function finishes.
+    // Returns false if the team is already running a job.
+    bool runOnParkedTeam(int nThreads, const std::function<void(int)>& job);
+
+    void stopParkedTeam();
+
+    // The lock for the OpenMP critical section with the given name, shared by
+    // the module's local teams until the function finishes
+    std::shared_ptr<threads::CriticalSection> getCriticalSection(int32_t crit);
 
     // Adds a merge region to be used in the next threaded operation spawned by
     // this module
@@ -156,10 +238,37 @@ class WasmModule
       faabric::util::SnapshotDataType dataType,
       faabric::util::SnapshotMergeOperation mergeOp);
 
+    // Includes the regions for any snapshot hints
     std::vector<faabric::util::SnapshotMergeRegion> getMergeRegions();
 
     void clearMergeRegions();
 
+    // Adds a reduction over an array to the next threaded operation spawned by
+    // this module. Unlike merge regions, these are merged by Faasm.
+    void addArrayReductionForNextThreads(
+      uint32_t wasmPtr,
+      uint32_t count,
+      faabric::util::SnapshotDataType dataType,
+      faabric::util::SnapshotMergeOperation mergeOp);
+
+    // Sets up the array reductions for a batch of threads with group indexes
+    // from firstIdx, before its snapshot is taken. Returns the merge regions
+    // to add for them.
+    std::vector<faabric::util::SnapshotMergeRegion> prepareArrayReductions(
+      int firstIdx,
+      int nThreads);
+
+    // Merges the array reductions of the batch once it's finished, or just
+    // frees their memory if it failed
+    void finishArrayReductions(bool merge);
+
+    // Hints are kept for the lifetime of the module, and applied to every
+    // snapshot and set of merge regions it produces. Hints are keyed on their
+    // offset, and the NONE hint removes any hint at the given offset.
+    void setSnapshotHint(uint32_t wasmPtr, uint32_t length, SnapshotHint hint);
+
+    std::map<uint32_t, std::pair<uint32_t, SnapshotHint>> getSnapshotHints();
+
     virtual int32_t executeOMPThread(int threadPoolIdx,
                                      uint32_t stackTop,
                                      faabric::Message& msg);
@@ -176,6 +285,33 @@ class WasmModule
 
     std::atomic<uint32_t> currentBrk = 0;
 
+    // Unmapped memory below the break, guarded by the module mutex
+    PageAllocator pageAllocator;
+    MemoryStats memoryStats;
+
+    // Memory can grow without the module mutex, so growth is counted
+    // separately
+    std::atomic<size_t> growCount = 0;
+    std::atomic<size_t> grownBytes = 0;
+    std::atomic<size_t> peakBrk = 0;
+
+    void recordMemoryGrowth(size_t nBytes, size_t newBrk);
+
+    void resetMemoryStats();
+
+    // Set when memory is a private mapping of a snapshot rather than
+    // anonymous memory
+    bool memoryFileBacked = false;
+
+    // Releases the host pages backing the range, which then read as zero
+    void releaseMemoryPages(uint32_t wasmPtr, size_t length);
+
+    // Set when the bound function has huge pages enabled
+    bool hugePages = false;
+
+    // Advises the kernel to back the range with huge pages if enabled
+    void adviseHugePages(uint32_t wasmPtr, size_t length);
+
     std::string boundUser;
     std::string boundFunction;
     bool _isBound = false;
@@ -184,31 +320,91 @@ class WasmModule
 
     WasmEnvironment wasmEnvironment;
 
-    int stdoutMemFd = 0;
-    ssize_t stdoutSize = 0;
+    std::mutex stdoutCaptureMx;
+    std::unique_ptr<StdoutCapture> stdoutCapture = nullptr;
 
     int threadPoolSize = 0;
+
+    // Thread stacks are allocated lazily by thread pool index, so their layout
+    // in memory depends on the order they were first used
+    std::mutex threadStacksMx;
     std::vector<uint32_t> threadStacks;
 
+    // The pool's stack tops are also recorded in a table in wasm memory. This
+    // is allocated at bind time, so it's at the same offset on every host, and
+    // is included in snapshots. Hosts restoring a snapshot therefore reuse the
+    // stacks of the host that took it, rather than allocating their own.
+    uint32_t threadStackTablePtr = 0;
+
+    // The word after the thread stack table holds the offset of the array
+    // reductions for the batch of threads in flight, or zero if there are
+    // none. The module that forked the batch keeps the offset and the size
+    // of their memory, guarded by the array reductions mutex.
+    uint32_t arrayReductionsRefPtr = 0;
+    std::mutex arrayReductionsMx;
+    uint32_t forkedArrayReductionsPtr = 0;
+    size_t forkedArrayReductionsSize = 0;
+
+    // Stacks for threads outside the pool, all those allocated and those not
+    // currently claimed, also guarded by the thread stacks mutex
+    std::vector<uint32_t> nestedThreadStacks;
+    std::vector<uint32_t> freeNestedThreadStacks;
+
+    // OpenMP task memory, with the block size of each allocated block, free
+    // blocks by size and the unused part of the current chunk
+    std::mutex taskMemoryMx;
+    std::unordered_map<uint32_t, uint32_t> taskBlockSizes;
+    std::unordered_map<uint32_t, std::vector<uint32_t>> freeTaskBlocks;
+    uint32_t taskChunkNext = 0;
+    uint32_t taskChunkEnd = 0;
+
+    // Parked OpenMP team, replaced when a region needs a different size
+    std::mutex parkedTeamMx;
+    std::unique_ptr<threads::ParkedTeam> parkedTeam = nullptr;
+
+    // OpenMP critical sections entered by local teams
+    threads::CriticalSections criticalSections;
+
     // Argc/argv
     unsigned int argc;
     std::vector<std::string> argv;
     size_t argvBufferSize;
 
     // Threads
-    std::vector<threads::PthreadCall> queuedPthreadCalls;
-    std::unordered_map<int32_t, uint32_t> pthreadPtrsToChainedCalls;
-    std::vector<std::pair<uint32_t, int32_t>> lastPthreadResults;
+    using QueuedPthreadCall =
+      std::pair<threads::PthreadCall, std::promise<int32_t>>;
+
+    // Queued calls and results by pthread pointer, guarded by the pthread
+    // calls mutex
+    std::mutex pthreadCallsMx;
+    std::vector<QueuedPthreadCall> queuedPthreadCalls;
+    std::unordered_map<int32_t, std::shared_future<int32_t>> pthreadResults;
+    int nextPthreadIdx = 1;
+    std::vector<std::thread> pthreadDispatchers;
+    std::vector<std::thread::id> finishedPthreadDispatchers;
+
     std::vector<faabric::util::SnapshotMergeRegion> mergeRegions;
+    std::vector<threads::ArrayReduction> arrayReductions;
+
+    // Snapshot hints, from offset to length and hint
+    std::shared_mutex snapshotHintsMx;
+    std::map<uint32_t, std::pair<uint32_t, SnapshotHint>> snapshotHints;
 
-    std::shared_mutex pthreadLocksMx;
-    std::unordered_map<uint32_t, std::shared_ptr<std::mutex>> pthreadLocks;
+    void addSnapshotHintsToSnapshot(
+      std::shared_ptr<faabric::util::SnapshotData> snap);
 
     // Shared memory regions
     std::shared_mutex sharedMemWasmPtrsMutex;
     std::unordered_map<std::string, uint32_t> sharedMemWasmPtrs;
 
-    int getStdoutFd();
+    // File mappings, from wasm offset to length in bytes
+    std::shared_mutex fileMappingsMutex;
+    std::map<uint32_t, size_t> fileMappings;
+
+    // Replaces any file mappings in the given range with zeroed memory
+    void releaseFileMappings(uint32_t wasmPtr, size_t length);
+
+    StdoutCapture& getStdoutCapture();
 
     void prepareArgcArgv(const faabric::Message& msg);
 
@@ -223,7 +419,31 @@ class WasmModule
     void ignoreThreadStacksInSnapshot(const std::string& snapKey);
 
     // Threads
-    void createThreadStacks();
+    void createThreadStackTable();
+
+    uint32_t createThreadStack();
+
+    // Records this host's part of the array reductions of the batch in
+    // flight, unless this module forked it and so shares its memory
+    void recordArrayReductions(int groupIdx);
+
+    // Executes the given pthread calls as a single batch, fulfilling their
+    // promises with the results. Batches forced to be local are never sent to
+    // other hosts.
+    void dispatchPthreadCalls(std::vector<QueuedPthreadCall> calls,
+                              const faabric::Message& parentMsg,
+                              bool forceLocal);
+
+    // Joins eager dispatchers that have finished, with the pthread calls
+    // mutex held
+    void joinFinishedPthreadDispatchers();
+
+    // Forgets all thread stacks, e.g. when memory is replaced by a snapshot,
+    // apart from those recorded in the stack table
+    void resetThreadStacks();
+
+    // Forgets all task memory, e.g. when memory is replaced by a snapshot
+    void resetTaskMemory();
 };
 
 // Convenience functions
@@ -3,6 +3,7 @@
 #include <faabric/util/bytes.h>
 #include <faabric/util/locks.h>
 
+#include <threads/TaskPool.h>
 #include <threads/ThreadState.h>
 #include <wasm/WasmExecutionContext.h>
 #include <wasm/WasmModule.h>
@@ -70,8 +71,6 @@ class WAVMWasmModule final
 
     uint32_t mmapMemory(size_t nBytes) override;
 
-    uint32_t mmapFile(uint32_t fd, size_t length) override;
-
     void unmapMemory(uint32_t offset, size_t nBytes) override;
 
     uint8_t* wasmPointerToNative(uint32_t wasmPtr) override;
@@ -122,6 +121,9 @@ class WAVMWasmModule final
                                                 const std::string& funcName,
                                                 bool strict);
 
+    // Returns null if the module does not export the given function
+    WAVM::Runtime::Function* getExportedFunction(const std::string& funcName);
+
     WAVM::Runtime::Function* getFunctionFromPtr(int funcPtr) const;
 
     bool resolve(const std::string& moduleName,
@@ -137,6 +139,18 @@ class WAVMWasmModule final
       uint32_t stackTop,
       WAVM::Runtime::ContextRuntimeData* contextRuntimeData);
 
+    // Copies all mutable globals from the parent context, then points the
+    // stack pointer at the given stack
+    static void resetThreadContext(
+      WAVM::Runtime::Context* ctx,
+      uint32_t stackTop,
+      WAVM::Runtime::ContextRuntimeData* contextRuntimeData);
+
+    // Returns the context for the given thread pool index, creating it on
+    // first use and resetting it from the parent context on every use
+    WAVM::Runtime::Context* getThreadContext(int threadPoolIdx,
+                                             uint32_t stackTop);
+
     // ----- Disassembly -----
     std::map<std::string, std::string> buildDisassemblyMap();
 
@@ -170,6 +184,34 @@ class WAVMWasmModule final
                            uint32_t stackTop,
                            faabric::Message& msg) override;
 
+    // Executes an OpenMP thread outside the thread pool, on a stack claimed
+    // with claimNestedThreadStack
+    int32_t executeNestedOMPThread(uint32_t stackTop, faabric::Message& msg);
+
+    // Executes the microtask of an OpenMP region in the given context, with
+    // the calling thread's current OpenMP level
+    int32_t executeOMPMicrotask(WAVM::Runtime::Context* ctx,
+                                int32_t microtaskPtr,
+                                int32_t threadNum);
+
+    // Executes an OpenMP task in the given context as the calling thread's
+    // current task, then frees it and completes it in the pool it was queued
+    // in, if any
+    void executeOMPTask(WAVM::Runtime::Context* ctx,
+                        int32_t gtid,
+                        std::shared_ptr<threads::Task> task,
+                        threads::TaskPool* pool);
+
+    // Executes tasks from the calling thread's task pool until the predicate
+    // holds, stealing from other threads when its own deque is empty
+    void executeOMPTasksUntil(WAVM::Runtime::Context* ctx,
+                              int32_t gtid,
+                              const std::function<bool()>& done);
+
+    // Helps execute any tasks outstanding at the end of a parallel region,
+    // then clears the calling thread's task state
+    void finishOMPTasks(WAVM::Runtime::Context* ctx, int32_t gtid);
+
   private:
     std::shared_mutex resetMx;
     WAVM::Runtime::GCPointer<WAVM::Runtime::Instance> envModule;
@@ -187,8 +229,16 @@ class WAVMWasmModule final
     std::unordered_map<std::string, std::pair<int, bool>> globalOffsetMemoryMap;
     std::unordered_map<std::string, int> missingGlobalOffsetEntries;
 
-    // OpenMP
-    std::vector<WAVM::Runtime::Context*> openMPContexts;
+    // Contexts for pthreads and OpenMP threads, by thread pool index. Each
+    // index only executes one thread at a time, so these aren't locked.
+    std::vector<WAVM::Runtime::Context*> threadContexts;
+
+    // Contexts for threads outside the pool, by stack top
+    std::mutex nestedThreadContextsMx;
+    std::unordered_map<uint32_t, WAVM::Runtime::Context*> nestedThreadContexts;
+
+    // Bumps the break within provisioned memory without the module mutex
+    bool growProvisionedMemory(size_t nBytes, uint32_t& oldBrk);
 
     static WAVM::Runtime::Instance* getEnvModule();
 
@@ -26,8 +26,17 @@ void FaasmConfig::initialise()
 
     pythonPreload = getEnvVar("PYTHON_PRELOAD", "off");
     captureStdout = getEnvVar("CAPTURE_STDOUT", "off");
+    stdoutCaptureMaxKb = this->getIntParam("STDOUT_CAPTURE_MAX_KB", "1024");
+    stdoutCapturePolicy = getEnvVar("STDOUT_CAPTURE_POLICY", "tail");
+    stdoutSink = getEnvVar("STDOUT_SINK", "");
 
     wasmVm = getEnvVar("WASM_VM", "wavm");
+    modulePoolSize = this->getIntParam("MODULE_POOL_SIZE", "0");
+    hugePages = getEnvVar("HUGE_PAGES", "off");
+    pthreadDispatch = getEnvVar("PTHREAD_DISPATCH", "join");
+    pthreadBatchWindowUs = this->getIntParam("PTHREAD_BATCH_WINDOW_US", "500");
+    ompTeams = getEnvVar("OMP_TEAMS", "batch");
+    ompMaxActiveLevels = this->getIntParam("OMP_MAX_ACTIVE_LEVELS", "1");
     chainedCallTimeout = this->getIntParam("CHAINED_CALL_TIMEOUT", "300000");
 
     std::string faasmLocalDir =
@@ -37,6 +46,11 @@ void FaasmConfig::initialise()
     runtimeFilesDir = fmt::format("{}/{}", faasmLocalDir, "runtime_root");
     sharedFilesDir = fmt::format("{}/{}", faasmLocalDir, "shared");
 
+    scratchFsPrefix = getEnvVar("SCRATCH_FS_PREFIX", "");
+    scratchFsMaxMb = this->getIntParam("SCRATCH_FS_MAX_MB", "64");
+
+    ioEngine = getEnvVar("IO_ENGINE", "syscall");
+
     s3Bucket = getEnvVar("S3_BUCKET", "faasm");
     s3Host = getEnvVar("S3_HOST", "minio");
     s3Port = getEnvVar("S3_PORT", "9000");
@@ -66,14 +80,26 @@ void FaasmConfig::print()
 
     SPDLOG_INFO("--- MISC ---");
     SPDLOG_INFO("Capture stdout:       {}", captureStdout);
+    SPDLOG_INFO("Stdout max KB:        {}", stdoutCaptureMaxKb);
+    SPDLOG_INFO("Stdout policy:        {}", stdoutCapturePolicy);
+    SPDLOG_INFO("Stdout sink:          {}", stdoutSink);
     SPDLOG_INFO("Chained call timeout: {}", chainedCallTimeout);
     SPDLOG_INFO("Python preload:       {}", pythonPreload);
     SPDLOG_INFO("Wasm VM:              {}", wasmVm);
+    SPDLOG_INFO("Module pool size:     {}", modulePoolSize);
+    SPDLOG_INFO("Huge pages:           {}", hugePages);
+    SPDLOG_INFO("Pthread dispatch:     {}", pthreadDispatch);
+    SPDLOG_INFO("Pthread window us:    {}", pthreadBatchWindowUs);
+    SPDLOG_INFO("OpenMP teams:         {}", ompTeams);
+    SPDLOG_INFO("OpenMP active levels: {}", ompMaxActiveLevels);
 
     SPDLOG_INFO("--- STORAGE ---");
     SPDLOG_INFO("Function dir:         {}", functionDir);
     SPDLOG_INFO("Object file dir:      {}", objectFileDir);
     SPDLOG_INFO("Runtime files dir:    {}", runtimeFilesDir);
     SPDLOG_INFO("Shared files dir:     {}", sharedFilesDir);
+    SPDLOG_INFO("Scratch fs prefix:    {}", scratchFsPrefix);
+    SPDLOG_INFO("Scratch fs max MB:    {}", scratchFsMaxMb);
+    SPDLOG_INFO("IO engine:            {}", ioEngine);
 }
 }
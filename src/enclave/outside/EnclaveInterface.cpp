@@ -46,12 +46,6 @@ void EnclaveInterface::doBindToFunction(faabric::Message& msg, bool cache)
                                           (uint32_t)wasmBytes.size(),
                                           interfaceId);
     processECallErrors("Unable to enter enclave", status, returnValue);
-
-    // Set up the thread stacks
-    // 28/06/2021 - Threading is not supported in SGX-WAMR. However, the Faasm
-    // runtime expects (asserts) this vector to be non-empty. Change when
-    // in-SGX threading is supported.
-    threadStacks.push_back(-1);
 }
 
 bool EnclaveInterface::unbindFunction()
@@ -5,6 +5,7 @@
 #include <system/NetworkNamespace.h>
 #include <threads/ThreadState.h>
 #include <wamr/WAMRWasmModule.h>
+#include <wasm/ModulePool.h>
 #include <wavm/WAVMWasmModule.h>
 
 #include <faabric/scheduler/Scheduler.h>
@@ -58,8 +59,20 @@ Faaslet::Faaslet(faabric::Message& msg)
 {
     conf::FaasmConfig& conf = conf::getFaasmConfig();
 
+    poolMsg.set_user(msg.user());
+    poolMsg.set_function(msg.function());
+
+    // Take over a pooled module if there is one, which will already be bound
+    // and reset (currently only supported in WAVM)
+    if (conf.wasmVm == "wavm") {
+        module = wasm::getModulePool().claim(poolMsg, threadPoolSize);
+    }
+
     // Instantiate the right wasm module for the chosen runtime
-    if (conf.wasmVm == "sgx") {
+    if (module != nullptr) {
+        SPDLOG_DEBUG("Reusing pooled module for {}",
+                     faabric::util::funcToString(msg, false));
+    } else if (conf.wasmVm == "sgx") {
 #ifndef FAASM_SGX_DISABLED_MODE
         module = std::make_unique<wasm::EnclaveInterface>();
 #else
@@ -79,7 +92,9 @@ Faaslet::Faaslet(faabric::Message& msg)
     }
 
     // Bind to the function
-    module->bindToFunction(msg);
+    if (!module->isBound()) {
+        module->bindToFunction(msg);
+    }
 
     // Create the reset snapshot for this function if it doesn't already exist
     // (currently only supported in WAVM)
@@ -112,6 +127,8 @@ int32_t Faaslet::executeTask(int threadPoolIdx,
         threadIsIsolated = true;
     }
 
+    moduleDirty = true;
+
     int32_t returnValue = module->executeTask(threadPoolIdx, msgIdx, req);
 
     return returnValue;
@@ -120,6 +137,7 @@ int32_t Faaslet::executeTask(int threadPoolIdx,
 void Faaslet::reset(faabric::Message& msg)
 {
     module->reset(msg, localResetSnapshotKey);
+    moduleDirty = false;
 }
 
 void Faaslet::shutdown()
@@ -130,6 +148,13 @@ void Faaslet::shutdown()
     }
 
     Executor::shutdown();
+
+    // Keep clean modules for the next Faaslet bound to the same function
+    const conf::FaasmConfig& conf = conf::getFaasmConfig();
+    if (conf.wasmVm == "wavm" && conf.modulePoolSize > 0 && !moduleDirty) {
+        wasm::getModulePool().release(
+          poolMsg, threadPoolSize, std::move(module));
+    }
 }
 
 std::span<uint8_t> Faaslet::getMemoryView()
@@ -169,6 +194,7 @@ void FaasletFactory::flushHost()
     // WAVM-specific flushing
     const conf::FaasmConfig& conf = conf::getFaasmConfig();
     if (conf.wasmVm == "wavm") {
+        wasm::getModulePool().clear();
         wasm::WAVMWasmModule::clearCaches();
     }
 }
@@ -0,0 +1,88 @@
+#include <wavm/WAVMWasmModule.h>
+
+#include <faabric/util/func.h>
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+#include <faabric/util/timing.h>
+
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace faabric::util;
+
+/**
+ * Measures memory growth from many threads at once, as multithreaded guests
+ * calling sbrk from malloc do. Memory is provisioned up front, so growth only
+ * bumps the break. This is compared with each call serialised on a lock, as
+ * growth used to be.
+ */
+
+static void runBench(wasm::WasmModule& module,
+                     bool locked,
+                     int nThreads,
+                     int nGrowths)
+{
+    std::shared_mutex mx;
+    uint32_t startBrk = module.getCurrentBrk();
+
+    TimePoint start = startTimer();
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < nThreads; t++) {
+        threads.emplace_back([&module, &mx, locked, nGrowths] {
+            for (int i = 0; i < nGrowths; i++) {
+                if (locked) {
+                    FullLock lock(mx);
+                    module.growMemory(WASM_BYTES_PER_PAGE);
+                } else {
+                    module.growMemory(WASM_BYTES_PER_PAGE);
+                }
+            }
+        });
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    long nanos = getTimeDiffNanos(start);
+    long nOps = (long)nThreads * nGrowths;
+
+    SPDLOG_INFO("{:<8} {:>3} threads {:>10.1f} ns/op {:>10.2f} Mops/s",
+                locked ? "locked" : "cas",
+                nThreads,
+                double(nanos) / nOps,
+                (double(nOps) / 1e6) / (double(nanos) / 1e9));
+
+    module.shrinkMemory(module.getCurrentBrk() - startBrk);
+}
+
+int main(int argc, char* argv[])
+{
+    initLogging();
+
+    int maxThreads = argc > 1 ? std::stoi(argv[1]) : 16;
+    int nGrowths = argc > 2 ? std::stoi(argv[2]) : 1000;
+
+    SPDLOG_INFO("Running memory growth with up to {} threads, {} growths each",
+                maxThreads,
+                nGrowths);
+
+    faabric::Message msg = messageFactory("demo", "echo");
+    wasm::WAVMWasmModule module;
+    module.bindToFunction(msg);
+
+    // Provision enough memory up front for the largest run
+    size_t maxBytes = (size_t)maxThreads * nGrowths * WASM_BYTES_PER_PAGE;
+    module.growMemory(maxBytes);
+    module.shrinkMemory(maxBytes);
+
+    for (int nThreads = 1; nThreads <= maxThreads; nThreads *= 2) {
+        runBench(module, true, nThreads, nGrowths);
+        runBench(module, false, nThreads, nGrowths);
+    }
+
+    return 0;
+}
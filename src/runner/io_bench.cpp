@@ -0,0 +1,167 @@
+#include <storage/IoEngine.h>
+
+#include <faabric/util/logging.h>
+#include <faabric/util/timing.h>
+
+#include <fcntl.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#define IO_BENCH_FILE "/tmp/faasm_io_bench"
+#define IO_BENCH_IOVEC_BYTES 512
+#define IO_BENCH_FILE_OPS 1024
+#define IO_BENCH_BATCH_SIZE 32
+
+using namespace faabric::util;
+
+/**
+ * Compares the per-call overhead and throughput of the file I/O paths used by
+ * WASI fd_read/fd_write: the original path (a fresh iovec vector per call,
+ * then a syscall), the syscall engine with reused iovec buffers, and the
+ * io_uring engine (when built), both per call and batched.
+ */
+
+static void printResult(const std::string& name,
+                        const std::string& op,
+                        long nOps,
+                        size_t opBytes,
+                        long nanos)
+{
+    double nanosPerOp = double(nanos) / nOps;
+    double mbPerSec =
+      (double(nOps) * opBytes / (1024 * 1024)) / (double(nanos) / 1e9);
+
+    SPDLOG_INFO("{:<16} {:<6} {:>10.1f} ns/op {:>10.1f} MB/s",
+                name,
+                op,
+                nanosPerOp,
+                mbPerSec);
+}
+
+static long runOriginal(int fd,
+                        storage::IoOp op,
+                        std::vector<uint8_t>& data,
+                        int nIovecs,
+                        long nOps)
+{
+    size_t opBytes = (size_t)nIovecs * IO_BENCH_IOVEC_BYTES;
+
+    TimePoint start = startTimer();
+    for (long i = 0; i < nOps; i++) {
+        std::vector<::iovec> iovecs(nIovecs, (::iovec){});
+        for (int j = 0; j < nIovecs; j++) {
+            iovecs[j] = { .iov_base = data.data() + j * IO_BENCH_IOVEC_BYTES,
+                          .iov_len = IO_BENCH_IOVEC_BYTES };
+        }
+
+        off_t offset = (i % IO_BENCH_FILE_OPS) * opBytes;
+        if (op == storage::IoOp::Read) {
+            ::preadv(fd, iovecs.data(), nIovecs, offset);
+        } else {
+            ::pwritev(fd, iovecs.data(), nIovecs, offset);
+        }
+    }
+
+    return getTimeDiffNanos(start);
+}
+
+static long runEngine(storage::IoEngine& engine,
+                      int fd,
+                      storage::IoOp op,
+                      std::vector<uint8_t>& data,
+                      int nIovecs,
+                      long nOps,
+                      int batchSize)
+{
+    size_t opBytes = (size_t)nIovecs * IO_BENCH_IOVEC_BYTES;
+
+    std::vector<storage::IoRequest> batch(batchSize);
+
+    TimePoint start = startTimer();
+    for (long i = 0; i < nOps; i += batchSize) {
+        std::vector<::iovec>& iovecs = storage::getIovecBuffer(nIovecs);
+        for (int j = 0; j < nIovecs; j++) {
+            iovecs[j] = { .iov_base = data.data() + j * IO_BENCH_IOVEC_BYTES,
+                          .iov_len = IO_BENCH_IOVEC_BYTES };
+        }
+
+        for (int b = 0; b < batchSize; b++) {
+            batch[b].op = op;
+            batch[b].linuxFd = fd;
+            batch[b].iovecs = iovecs.data();
+            batch[b].iovecCount = nIovecs;
+            batch[b].offset = ((i + b) % IO_BENCH_FILE_OPS) * opBytes;
+        }
+
+        engine.submitBatch(batch);
+    }
+
+    return getTimeDiffNanos(start);
+}
+
+static void runAll(storage::IoEngine* engine,
+                   int fd,
+                   std::vector<uint8_t>& data,
+                   int nIovecs,
+                   long nOps)
+{
+    size_t opBytes = (size_t)nIovecs * IO_BENCH_IOVEC_BYTES;
+
+    for (auto op : { storage::IoOp::Write, storage::IoOp::Read }) {
+        std::string opName = op == storage::IoOp::Read ? "read" : "write";
+
+        if (engine == nullptr) {
+            long nanos = runOriginal(fd, op, data, nIovecs, nOps);
+            printResult("original", opName, nOps, opBytes, nanos);
+            continue;
+        }
+
+        long nanos = runEngine(*engine, fd, op, data, nIovecs, nOps, 1);
+        printResult(engine->getName(), opName, nOps, opBytes, nanos);
+
+        nanos =
+          runEngine(*engine, fd, op, data, nIovecs, nOps, IO_BENCH_BATCH_SIZE);
+        printResult(engine->getName() + "-batch", opName, nOps, opBytes, nanos);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    initLogging();
+
+    long nOps = argc > 1 ? std::stol(argv[1]) : 100000;
+    int nIovecs = argc > 2 ? std::stoi(argv[2]) : 4;
+
+    SPDLOG_INFO("Running {} ops of {} x {} byte iovecs",
+                nOps,
+                nIovecs,
+                IO_BENCH_IOVEC_BYTES);
+
+    int fd = ::open(IO_BENCH_FILE, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        SPDLOG_ERROR("Failed to open {}", IO_BENCH_FILE);
+        return 1;
+    }
+
+    std::vector<uint8_t> data(nIovecs * IO_BENCH_IOVEC_BYTES, 1);
+
+    runAll(nullptr, fd, data, nIovecs, nOps);
+
+    storage::SyscallIoEngine syscallEngine;
+    runAll(&syscallEngine, fd, data, nIovecs, nOps);
+
+#ifdef FAASM_IO_URING
+    storage::IoUringIoEngine ioUringEngine;
+    if (ioUringEngine.isReady()) {
+        runAll(&ioUringEngine, fd, data, nIovecs, nOps);
+    } else {
+        SPDLOG_WARN("io_uring not available, skipping");
+    }
+#endif
+
+    ::close(fd);
+    ::unlink(IO_BENCH_FILE);
+
+    return 0;
+}
@@ -0,0 +1,124 @@
+#include <threads/LocalTeam.h>
+#include <wavm/WAVMWasmModule.h>
+
+#include <faabric/util/func.h>
+#include <faabric/util/logging.h>
+#include <faabric/util/timing.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace faabric::util;
+
+/**
+ * Measures nested OpenMP parallel regions, e.g. a BLAS call inside a parallel
+ * loop. Each thread of an outer team repeatedly forks an inner team, whose
+ * threads are started locally, take a nested stack from the module and
+ * synchronise through a LocalTeam, as the fork intrinsic does. The inner
+ * teams split a fixed amount of work, so this shows how nested regions scale
+ * with the size of the inner team, and how much each fork costs.
+ */
+
+static int64_t doWork(int64_t from, int64_t to, int64_t step)
+{
+    int64_t sum = 0;
+    for (int64_t i = from; i < to; i += step) {
+        sum += (i * i) % 7;
+    }
+
+    return sum;
+}
+
+static void runBench(wasm::WasmModule& module,
+                     int nOuter,
+                     int nInner,
+                     int nRegions,
+                     int64_t work,
+                     int64_t expected)
+{
+    std::atomic<int64_t> result = 0;
+
+    TimePoint start = startTimer();
+
+    std::vector<std::thread> outerThreads;
+    for (int o = 0; o < nOuter; o++) {
+        outerThreads.emplace_back([&, o] {
+            for (int r = 0; r < nRegions; r++) {
+                auto team = std::make_shared<threads::LocalTeam>(
+                  o * nRegions + r, nInner);
+
+                std::vector<std::thread> innerThreads;
+                for (int i = 0; i < nInner; i++) {
+                    innerThreads.emplace_back([&, team, i] {
+                        threads::setCurrentLocalTeam(team);
+                        uint32_t stackTop = module.claimNestedThreadStack();
+
+                        int64_t sum = doWork(i, work, nInner);
+                        team->barrier();
+                        result += sum;
+
+                        module.releaseNestedThreadStack(stackTop);
+                        threads::setCurrentLocalTeam(nullptr);
+                    });
+                }
+
+                for (auto& t : innerThreads) {
+                    t.join();
+                }
+            }
+        });
+    }
+
+    for (auto& t : outerThreads) {
+        t.join();
+    }
+
+    long nanos = getTimeDiffNanos(start);
+
+    if (result != expected * nOuter * nRegions) {
+        SPDLOG_ERROR("Nested regions gave {}, expected {}",
+                     result.load(),
+                     expected * nOuter * nRegions);
+        throw std::runtime_error("Nested regions gave wrong result");
+    }
+
+    SPDLOG_INFO("{:>3} x {:>3} threads {:>10.1f} ms {:>10.1f} us/region",
+                nOuter,
+                nInner,
+                double(nanos) / 1e6,
+                double(nanos) / (1e3 * nRegions));
+}
+
+int main(int argc, char* argv[])
+{
+    initLogging();
+
+    int maxOuter = argc > 1 ? std::stoi(argv[1]) : 4;
+    int maxInner = argc > 2 ? std::stoi(argv[2]) : 8;
+    int nRegions = argc > 3 ? std::stoi(argv[3]) : 100;
+    int64_t work = argc > 4 ? std::stol(argv[4]) : 1000000;
+
+    SPDLOG_INFO("Running {} nested regions of {} iterations on up to {} x {} "
+                "threads",
+                nRegions,
+                work,
+                maxOuter,
+                maxInner);
+
+    faabric::Message msg = messageFactory("demo", "echo");
+    wasm::WAVMWasmModule module;
+    module.bindToFunction(msg);
+
+    int64_t expected = doWork(0, work, 1);
+
+    for (int nOuter = 1; nOuter <= maxOuter; nOuter *= 2) {
+        for (int nInner = 1; nInner <= maxInner; nInner *= 2) {
+            runBench(module, nOuter, nInner, nRegions, work, expected);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,110 @@
+#include <conf/FaasmConfig.h>
+#include <faaslet/Faaslet.h>
+#include <storage/S3Wrapper.h>
+
+#include <faabric/redis/Redis.h>
+#include <faabric/runner/FaabricMain.h>
+#include <faabric/scheduler/Scheduler.h>
+#include <faabric/transport/context.h>
+#include <faabric/util/config.h>
+#include <faabric/util/environment.h>
+#include <faabric/util/func.h>
+#include <faabric/util/logging.h>
+#include <faabric/util/timing.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using namespace faabric::util;
+
+/**
+ * Measures the latency of a function which creates and joins pthreads, run
+ * repeatedly on the same Faaslets. Within each run, every thread pool index
+ * creates its thread context once and reuses it for any later threads.
+ */
+
+static int doBench(int argc, char* argv[])
+{
+    initLogging();
+
+    std::string user = argc > 1 ? argv[1] : "demo";
+    std::string function = argc > 2 ? argv[2] : "threads_local";
+    int nRuns = argc > 3 ? std::max(std::stoi(argv[3]), 1) : 100;
+
+    SystemConfig& conf = getSystemConfig();
+    conf.boundTimeout = 120000;
+    conf.globalMessageTimeout = 120000;
+    conf::getFaasmConfig().chainedCallTimeout = 120000;
+
+    // Make sure all the threads fit on this host
+    faabric::HostResources res;
+    res.set_slots(getUsableCores());
+    faabric::scheduler::Scheduler& sch = faabric::scheduler::getScheduler();
+    sch.setThisHostResources(res);
+
+    faabric::redis::Redis::getQueue().flushAll();
+
+    auto fac = std::make_shared<faaslet::FaasletFactory>();
+    faabric::runner::FaabricMain m(fac);
+    m.startRunner();
+
+    SPDLOG_INFO("Running {}/{} {} times", user, function, nRuns);
+
+    std::vector<long> nanos;
+    for (int i = 0; i < nRuns + 1; i++) {
+        std::shared_ptr<faabric::BatchExecuteRequest> req =
+          batchExecFactory(user, function, 1);
+        faabric::Message& msg = req->mutable_messages()->at(0);
+        msg.set_topologyhint("FORCE_LOCAL");
+
+        TimePoint start = startTimer();
+        sch.callFunctions(req);
+        faabric::Message result =
+          sch.getFunctionResult(msg.id(), conf.globalMessageTimeout);
+        long runNanos = getTimeDiffNanos(start);
+
+        if (result.returnvalue() != 0) {
+            SPDLOG_ERROR("Execution failed: {}", result.outputdata());
+            throw std::runtime_error("Executing function failed");
+        }
+
+        // The first run includes binding the module
+        if (i == 0) {
+            SPDLOG_INFO("{:<8} {:>10.1f} us", "first", double(runNanos) / 1e3);
+        } else {
+            nanos.push_back(runNanos);
+        }
+    }
+
+    m.shutdown();
+
+    std::sort(nanos.begin(), nanos.end());
+    double mean = 0;
+    for (long n : nanos) {
+        mean += double(n) / nanos.size();
+    }
+
+    long p50 = nanos.at(nanos.size() / 2);
+    long p99 = nanos.at(nanos.size() * 99 / 100);
+
+    SPDLOG_INFO("{:<8} {:>10.1f} us", "mean", mean / 1e3);
+    SPDLOG_INFO("{:<8} {:>10.1f} us", "p50", double(p50) / 1e3);
+    SPDLOG_INFO("{:<8} {:>10.1f} us", "p99", double(p99) / 1e3);
+
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    storage::initFaasmS3();
+    faabric::transport::initGlobalMessageContext();
+
+    // All 0MQ sockets must be closed before closing the context
+    int result = doBench(argc, argv);
+
+    faabric::transport::closeGlobalMessageContext();
+    storage::shutdownFaasmS3();
+
+    return result;
+}
@@ -0,0 +1,97 @@
+#include <wasm/StdoutCapture.h>
+
+#include <faabric/util/logging.h>
+#include <faabric/util/timing.h>
+
+#include <boost/filesystem.hpp>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define STDOUT_BENCH_SINK_DIR "/tmp/faasm_stdout_bench"
+#define STDOUT_BENCH_CAPACITY (1024 * 1024)
+
+using namespace faabric::util;
+
+/**
+ * Measures the cost of capturing a function's stdout: the original approach
+ * (appending to a memfd and reading it all back), and the bounded capture
+ * buffer with each truncation policy, with and without streaming to a sink.
+ */
+
+static void printResult(const std::string& name,
+                        long nWrites,
+                        size_t outputBytes,
+                        long nanos)
+{
+    SPDLOG_INFO("{:<16} {:>8.1f} ns/write {:>10} bytes output",
+                name,
+                double(nanos) / nWrites,
+                outputBytes);
+}
+
+static void runOriginal(const std::string& line, long nWrites)
+{
+    TimePoint start = startTimer();
+
+    int memFd = memfd_create("stdoutfd", 0);
+    size_t size = 0;
+    for (long i = 0; i < nWrites; i++) {
+        size += ::write(memFd, line.data(), line.size());
+    }
+
+    ::lseek(memFd, 0, SEEK_SET);
+    std::string output(size, '\0');
+    ::read(memFd, output.data(), size);
+    ::close(memFd);
+
+    printResult("original", nWrites, output.size(), getTimeDiffNanos(start));
+}
+
+static void runCapture(const std::string& policy,
+                       const std::string& sink,
+                       const std::string& line,
+                       long nWrites)
+{
+    TimePoint start = startTimer();
+
+    wasm::StdoutCapture capture(STDOUT_BENCH_CAPACITY, policy, sink);
+    capture.beginCall("bench");
+    for (long i = 0; i < nWrites; i++) {
+        capture.write(line.data(), line.size());
+    }
+
+    std::string output = capture.read();
+
+    std::string name = sink.empty() ? policy : policy + "-sink";
+    printResult(name, nWrites, output.size(), getTimeDiffNanos(start));
+}
+
+int main(int argc, char* argv[])
+{
+    initLogging();
+
+    long nWrites = argc > 1 ? std::stol(argv[1]) : 1000000;
+    size_t lineBytes = argc > 2 ? std::stoul(argv[2]) : 64;
+
+    SPDLOG_INFO("Running {} writes of {} bytes ({} byte buffer)",
+                nWrites,
+                lineBytes,
+                STDOUT_BENCH_CAPACITY);
+
+    std::string line(lineBytes - 1, 'x');
+    line += "\n";
+
+    boost::filesystem::create_directories(STDOUT_BENCH_SINK_DIR);
+
+    runOriginal(line, nWrites);
+
+    for (const auto& policy : { STDOUT_POLICY_HEAD, STDOUT_POLICY_TAIL }) {
+        runCapture(policy, "", line, nWrites);
+        runCapture(policy, STDOUT_BENCH_SINK_DIR, line, nWrites);
+    }
+
+    boost::filesystem::remove_all(STDOUT_BENCH_SINK_DIR);
+
+    return 0;
+}
@@ -0,0 +1,129 @@
+#include <threads/TaskPool.h>
+#include <wavm/WAVMWasmModule.h>
+
+#include <faabric/util/func.h>
+#include <faabric/util/logging.h>
+#include <faabric/util/timing.h>
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace faabric::util;
+
+/**
+ * Measures OpenMP-style task parallelism with a recursive fib, where each
+ * call above the cutoff creates a task for each of its two sub-calls and
+ * waits for them. Tasks are allocated in wasm memory and scheduled through a
+ * TaskPool, as the OpenMP task intrinsics do, so this shows how task
+ * throughput scales with the number of threads stealing work.
+ */
+
+static int64_t serialFib(int n)
+{
+    return n < 2 ? n : serialFib(n - 1) + serialFib(n - 2);
+}
+
+static void runBench(wasm::WasmModule& module,
+                     int nThreads,
+                     int n,
+                     int cutoff,
+                     int64_t expected)
+{
+    threads::TaskPool pool(nThreads);
+    std::atomic<int64_t> result = 0;
+    std::atomic<long> nTasks = 0;
+
+    // The fib argument is stored in the task's memory
+    auto newTask = [&module](int fibN, std::shared_ptr<threads::Task> parent) {
+        uint32_t taskPtr = module.allocateTaskMemory(sizeof(int32_t));
+        *reinterpret_cast<int32_t*>(module.wasmPointerToNative(taskPtr)) =
+          fibN;
+        return std::make_shared<threads::Task>(taskPtr, parent, nullptr);
+    };
+
+    std::function<void(int, std::shared_ptr<threads::Task>)> exec =
+      [&](int threadNum, std::shared_ptr<threads::Task> task) {
+          int fibN = *reinterpret_cast<int32_t*>(
+            module.wasmPointerToNative(task->taskPtr));
+
+          if (fibN <= cutoff) {
+              result += serialFib(fibN);
+          } else {
+              pool.push(threadNum, newTask(fibN - 1, task));
+              pool.push(threadNum, newTask(fibN - 2, task));
+
+              pool.executeUntil(
+                threadNum,
+                [&task] { return task->nIncompleteChildren == 0; },
+                [threadNum, &exec](std::shared_ptr<threads::Task> t) {
+                    exec(threadNum, std::move(t));
+                });
+          }
+
+          module.freeTaskMemory(task->taskPtr);
+          nTasks++;
+          pool.complete(task);
+      };
+
+    TimePoint start = startTimer();
+
+    pool.push(0, newTask(n, nullptr));
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < nThreads; i++) {
+        threads.emplace_back([i, &pool, &exec] {
+            pool.executeUntil(
+              i,
+              [&pool] { return pool.getPendingCount() == 0; },
+              [i, &exec](std::shared_ptr<threads::Task> t) {
+                  exec(i, std::move(t));
+              });
+        });
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    long nanos = getTimeDiffNanos(start);
+
+    if (result != expected) {
+        SPDLOG_ERROR("Task fib gave {}, expected {}", result.load(), expected);
+        throw std::runtime_error("Task fib gave wrong result");
+    }
+
+    SPDLOG_INFO("{:>3} threads {:>10.1f} ms {:>10} tasks {:>10.1f} ns/task",
+                nThreads,
+                double(nanos) / 1e6,
+                nTasks.load(),
+                double(nanos) / nTasks.load());
+}
+
+int main(int argc, char* argv[])
+{
+    initLogging();
+
+    int maxThreads = argc > 1 ? std::stoi(argv[1]) : 16;
+    int n = argc > 2 ? std::stoi(argv[2]) : 32;
+    int cutoff = argc > 3 ? std::stoi(argv[3]) : 12;
+
+    SPDLOG_INFO("Running task fib({}) with cutoff {} on up to {} threads",
+                n,
+                cutoff,
+                maxThreads);
+
+    faabric::Message msg = messageFactory("demo", "echo");
+    wasm::WAVMWasmModule module;
+    module.bindToFunction(msg);
+
+    int64_t expected = serialFib(n);
+
+    for (int nThreads = 1; nThreads <= maxThreads; nThreads *= 2) {
+        runBench(module, nThreads, n, cutoff, expected);
+    }
+
+    return 0;
+}
@@ -0,0 +1,104 @@
+#include <conf/FaasmConfig.h>
+#include <wavm/WAVMWasmModule.h>
+
+#include <faabric/util/func.h>
+#include <faabric/util/logging.h>
+#include <faabric/util/timing.h>
+
+#include <random>
+#include <string>
+#include <sys/resource.h>
+
+#define THP_BENCH_RANDOM_ACCESSES (16L * 1024L * 1024L)
+
+using namespace faabric::util;
+
+/**
+ * Compares linear memory with and without transparent huge pages. Memory is
+ * grown by the given amount, then touched once sequentially (dominated by
+ * page faults) and then at random (dominated by TLB misses), as a numeric
+ * kernel working on a large heap would. The same is then done after
+ * restoring a snapshot of the memory.
+ */
+
+static long getMinorFaults()
+{
+    struct ::rusage usage;
+    ::getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_minflt;
+}
+
+static void runKernel(const std::string& name,
+                      wasm::WasmModule& module,
+                      uint32_t offset,
+                      size_t nBytes)
+{
+    uint8_t* data = module.wasmPointerToNative(offset);
+
+    long faultsBefore = getMinorFaults();
+    TimePoint start = startTimer();
+    for (size_t i = 0; i < nBytes; i += HOST_PAGE_SIZE) {
+        data[i] += 1;
+    }
+    long touchNanos = getTimeDiffNanos(start);
+    long faults = getMinorFaults() - faultsBefore;
+
+    std::mt19937_64 gen(0);
+    std::uniform_int_distribution<size_t> dist(0, nBytes - 1);
+    uint64_t sum = 0;
+    start = startTimer();
+    for (long i = 0; i < THP_BENCH_RANDOM_ACCESSES; i++) {
+        sum += data[dist(gen)];
+    }
+    long randomNanos = getTimeDiffNanos(start);
+
+    SPDLOG_INFO("{:<16} {:>8} faults {:>8.1f} ms touch {:>6.1f} ns/access "
+                "({} MB advised, sum {})",
+                name,
+                faults,
+                double(touchNanos) / 1e6,
+                double(randomNanos) / THP_BENCH_RANDOM_ACCESSES,
+                module.getMemoryStats().hugePageBytes / (1024 * 1024),
+                sum);
+}
+
+static void runBench(const std::string& hugePages,
+                     faabric::Message& msg,
+                     size_t nBytes)
+{
+    conf::getFaasmConfig().hugePages = hugePages;
+
+    wasm::WAVMWasmModule module;
+    module.bindToFunction(msg);
+
+    uint32_t offset = module.growMemory(nBytes);
+    runKernel("thp-" + hugePages, module, offset, nBytes);
+
+    std::string snapKey = module.snapshot();
+    module.restore(snapKey);
+    runKernel("thp-" + hugePages + "-restored", module, offset, nBytes);
+
+    faabric::snapshot::getSnapshotRegistry().deleteSnapshot(snapKey);
+}
+
+int main(int argc, char* argv[])
+{
+    initLogging();
+
+    std::string user = argc > 1 ? argv[1] : "demo";
+    std::string function = argc > 2 ? argv[2] : "echo";
+    size_t sizeMb = argc > 3 ? std::stoul(argv[3]) : 1024;
+
+    SPDLOG_INFO("Running huge pages benchmark on {}/{} with {} MB of memory",
+                user,
+                function,
+                sizeMb);
+
+    faabric::Message msg = messageFactory(user, function);
+    size_t nBytes = sizeMb * 1024 * 1024;
+
+    runBench("off", msg, nBytes);
+    runBench("on", msg, nBytes);
+
+    return 0;
+}
@@ -7,16 +7,22 @@
 #include <faabric/util/timing.h>
 
 #include <conf/FaasmConfig.h>
+#include <storage/IoEngine.h>
+#include <storage/PathCache.h>
+#include <storage/ScratchFileSystem.h>
 #include <storage/SharedFiles.h>
 
 #include <WAVM/WASI/WASIABI.h>
 #include <boost/filesystem.hpp>
+#include <cstring>
 #include <dirent.h>
 #include <fcntl.h>
 #include <stdexcept>
 #include <sys/ioctl.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/uio.h>
+#include <unistd.h>
 
 #define WASI_FD_FLAGS                                                          \
     (__WASI_FDFLAG_RSYNC | __WASI_FDFLAG_APPEND | __WASI_FDFLAG_DSYNC |        \
@@ -133,13 +139,37 @@ uint16_t errnoToWasi(int errnoIn)
             return __WASI_EINVAL;
         case EMFILE:
             return __WASI_EMFILE;
+        case ENOSPC:
+            return __WASI_ENOSPC;
+        case EXDEV:
+            return __WASI_EXDEV;
+        case ENOTEMPTY:
+            return __WASI_ENOTEMPTY;
+        case EBUSY:
+            return __WASI_EBUSY;
+        case EAGAIN:
+            return __WASI_EAGAIN;
+        case EINTR:
+            return __WASI_EINTR;
+        case EPIPE:
+            return __WASI_EPIPE;
+        case ESPIPE:
+            return __WASI_ESPIPE;
+        case EFBIG:
+            return __WASI_EFBIG;
+        case ENOTSUP:
+            return __WASI_ENOTSUP;
+        case ENODEV:
+            return __WASI_ENODEV;
+        case EROFS:
+            return __WASI_EROFS;
         default:
             throw std::runtime_error("Unsupported WASI errno: " +
                                      std::to_string(errnoIn));
     }
 }
 
-std::string FileDescriptor::getPath()
+std::string FileDescriptor::getPath() const
 {
     return path;
 }
@@ -191,108 +221,252 @@ FileDescriptor FileDescriptor::stderrFactory()
     return FileDescriptor::stdFdFactory(STDERR_FILENO, "/dev/stderr");
 }
 
+// Layout of the records returned by the getdents64 syscall
+struct LinuxDirent64
+{
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
 void FileDescriptor::iterReset()
 {
-    // Reset iterator state
-    dirContentsLoaded = false;
-    dirContentsIdx = 0;
-    dirContents.clear();
+    // Reset iterator state, keeping the buffer for reuse
+    dirIterStarted = false;
+    dirIterEof = false;
+    dirIterIdx = 0;
+    direntBufferPos = 0;
+    direntBufferLen = 0;
+    direntReadOffset = 0;
+    dirLastOffset = 0;
+    dirPrevOffset = 0;
+    dirPrevEntryPos = 0;
+    dirCanStepBack = false;
+    dirCheckpoints.clear();
+    scratchDirContents.clear();
 }
 
-void FileDescriptor::loadDirContents()
+void FileDescriptor::startDirIter()
 {
+    iterReset();
+    dirIterStarted = true;
+
+    // Scratch directories only exist in memory
+    if (isScratchPath(path)) {
+        int res = scratch->listDir(path, scratchDirContents);
+        if (res < 0) {
+            throw std::runtime_error("Failed to open scratch dir");
+        }
 
-    // Work out the local filesystem path
-    std::string realPath;
-    if (SharedFiles::isPathShared(path)) {
-        int pullErr = SharedFiles::syncSharedFile(path);
+        SPDLOG_DEBUG("Loaded {} entries for scratch dir {}",
+                     scratchDirContents.size(),
+                     path);
+        return;
+    }
+
+    if (linuxFd < 0) {
+        SPDLOG_ERROR("Iterating directory {} with no open fd", path);
+        throw std::runtime_error("Failed to open dir");
+    }
+
+    if (direntBuffer.empty()) {
+        direntBuffer.resize(DIRENT_BUFFER_SIZE);
+    }
+
+    dirCheckpoints.push_back(0);
+}
+
+bool FileDescriptor::fillDirentBuffer()
+{
+    if (dirIterEof) {
+        return false;
+    }
+
+    // Always seek first, as the offset of the underlying fd may be shared
+    if (::lseek(linuxFd, direntReadOffset, SEEK_SET) < 0) {
+        SPDLOG_ERROR("Failed to seek dir {} ({})", path, ::strerror(errno));
+        throw std::runtime_error("Failed to seek dir");
+    }
+
+    long nBytes = ::syscall(
+      SYS_getdents64, linuxFd, direntBuffer.data(), direntBuffer.size());
+    if (nBytes < 0) {
+        SPDLOG_ERROR("Failed to read dir {} ({})", path, ::strerror(errno));
+        throw std::runtime_error("Failed to read dir");
+    }
+
+    // Steps back into the old buffer are no longer possible
+    dirCanStepBack = false;
+    direntBufferPos = 0;
+    direntBufferLen = nBytes;
+
+    if (nBytes == 0) {
+        dirIterEof = true;
+        return false;
+    }
+
+    // Work out where the next read should start from the last record
+    size_t pos = 0;
+    LinuxDirent64* d = nullptr;
+    while (pos < direntBufferLen) {
+        d = reinterpret_cast<LinuxDirent64*>(direntBuffer.data() + pos);
+        pos += d->d_reclen;
+    }
+    direntReadOffset = d->d_off;
+
+    return true;
+}
+
+bool FileDescriptor::peekDirEnt(DirEntView& view)
+{
+    if (!dirIterStarted) {
+        startDirIter();
+    }
 
-        if (pullErr != 0) {
-            throw std::runtime_error("Failed to open shared dir");
+    if (isScratchPath(path)) {
+        if (dirIterIdx >= scratchDirContents.size()) {
+            return false;
         }
 
-        realPath = SharedFiles::realPathForSharedFile(path);
-    } else {
-        realPath = prependRuntimeRoot(path);
+        const DirEnt& ent = scratchDirContents.at(dirIterIdx);
+        view = { .ino = ent.ino,
+                 .type = ent.type,
+                 .name = ent.path.c_str(),
+                 .nameLen = ent.path.size() };
+        return true;
     }
 
-    // Open the directory
-    SPDLOG_DEBUG("Loading dir contents: {}", realPath);
-    DIR* dirPtr = ::opendir(realPath.c_str());
-    if (dirPtr == nullptr) {
-        throw std::runtime_error("Failed to open dir");
+    if (direntBufferPos >= direntBufferLen && !fillDirentBuffer()) {
+        return false;
+    }
+
+    auto* d = reinterpret_cast<LinuxDirent64*>(direntBuffer.data() +
+                                               direntBufferPos);
+    view = { .ino = d->d_ino,
+             .type = d->d_type,
+             .name = d->d_name,
+             .nameLen = ::strlen(d->d_name) };
+    return true;
+}
+
+void FileDescriptor::advanceDirIter()
+{
+    dirIterIdx++;
+
+    if (isScratchPath(path)) {
+        return;
     }
 
-    // Load all directory entries
-    uint64_t nextIdx = 0;
-    struct dirent* direntPtr;
-    while ((direntPtr = ::readdir(dirPtr)) != nullptr) {
-        nextIdx++;
+    auto* d = reinterpret_cast<LinuxDirent64*>(direntBuffer.data() +
+                                               direntBufferPos);
 
-        DirEnt nextEnt;
+    dirPrevEntryPos = direntBufferPos;
+    dirPrevOffset = dirLastOffset;
+    dirCanStepBack = true;
 
-        // We have to set "next" here to specify the offset of this
-        // directory entry. It seems this is only used to be passed
-        // back as the "cookie" value to fd_readdir
-        nextEnt.next = nextIdx;
+    direntBufferPos += d->d_reclen;
+    dirLastOffset = d->d_off;
 
-        nextEnt.type = direntPtr->d_type;
-        nextEnt.ino = direntPtr->d_ino;
-        nextEnt.path = std::string(direntPtr->d_name);
+    // Record the offset at which the next entry starts
+    if (dirIterIdx % DIR_CHECKPOINT_INTERVAL == 0 &&
+        dirIterIdx / DIR_CHECKPOINT_INTERVAL == dirCheckpoints.size()) {
+        dirCheckpoints.push_back(dirLastOffset);
+    }
+}
+
+void FileDescriptor::seekDir(uint64_t cookie)
+{
+    if (!dirIterStarted) {
+        startDirIter();
+    }
+
+    if (cookie == dirIterIdx) {
+        return;
+    }
 
-        dirContents.push_back(nextEnt);
+    if (isScratchPath(path)) {
+        dirIterIdx = std::min<uint64_t>(cookie, scratchDirContents.size());
+        return;
     }
 
-    // Close iterator
-    closedir(dirPtr);
-    SPDLOG_DEBUG("Loaded {} entries for {}", dirContents.size(), realPath);
+    // Stepping back one entry can use the current buffer
+    if (cookie + 1 == dirIterIdx && dirCanStepBack) {
+        dirIterIdx--;
+        direntBufferPos = dirPrevEntryPos;
+        dirLastOffset = dirPrevOffset;
+        dirCanStepBack = false;
+        return;
+    }
 
-    // Set flag
-    dirContentsLoaded = true;
+    // Otherwise restart from the nearest checkpoint and skip forward, unless
+    // we're already between it and the target
+    size_t checkpointIdx = std::min<size_t>(cookie / DIR_CHECKPOINT_INTERVAL,
+                                            dirCheckpoints.size() - 1);
+    uint64_t checkpointEntry = checkpointIdx * DIR_CHECKPOINT_INTERVAL;
+    if (cookie < dirIterIdx || dirIterIdx < checkpointEntry) {
+        dirIterIdx = checkpointEntry;
+        dirIterEof = false;
+        dirCanStepBack = false;
+        direntBufferPos = 0;
+        direntBufferLen = 0;
+        direntReadOffset = dirCheckpoints.at(checkpointIdx);
+        dirLastOffset = direntReadOffset;
+    }
+
+    DirEntView view;
+    while (dirIterIdx < cookie && peekDirEnt(view)) {
+        advanceDirIter();
+    }
 }
 
 void FileDescriptor::iterBack()
 {
-    if (!dirContentsLoaded) {
+    if (!dirIterStarted) {
         throw std::runtime_error("Iterator not started, cannot go back");
     }
 
-    if (dirContentsIdx == 0) {
+    if (dirIterIdx == 0) {
         throw std::runtime_error("Iterator already at zero, cannot go back");
     }
 
-    dirContentsIdx--;
+    seekDir(dirIterIdx - 1);
 }
 
 bool FileDescriptor::iterStarted() const
 {
-    return dirContentsLoaded;
+    return dirIterStarted;
 }
 
 bool FileDescriptor::iterFinished()
 {
-    return dirContentsLoaded && (dirContentsIdx >= dirContents.size());
+    if (!dirIterStarted) {
+        return false;
+    }
+
+    DirEntView view;
+    return !peekDirEnt(view);
 }
 
 DirEnt FileDescriptor::iterNext()
 {
-    // Check if contents are initialised
-    if (!dirContentsLoaded) {
-        loadDirContents();
-    }
-
-    // Check
-    if (iterFinished()) {
+    DirEntView view;
+    if (!peekDirEnt(view)) {
         throw std::runtime_error(
-          fmt::format("Accessing index {} in directory length {}",
-                      dirContentsIdx,
-                      dirContents.size()));
+          fmt::format("Accessing index {} past end of directory {}",
+                      dirIterIdx,
+                      path));
     }
 
-    DirEnt nextEntry = dirContents.at(dirContentsIdx);
+    // The cookie is the index of the entry after this one
+    DirEnt nextEntry;
+    nextEntry.next = dirIterIdx + 1;
+    nextEntry.type = view.type;
+    nextEntry.ino = view.ino;
+    nextEntry.path = std::string(view.name, view.nameLen);
 
-    // Increment the iterator
-    dirContentsIdx++;
+    advanceDirIter();
 
     return nextEntry;
 }
@@ -300,14 +474,12 @@ DirEnt FileDescriptor::iterNext()
 /**
  * Note that this function conforms to the standard readdir interface:
  * - Copy each dirent struct followed by its path string
- * - If the last path string doesn't fit, return the buffer length
- * - If the last dirent doesn't fit, don't copy it and return the buffer length
- *
- * The external libc wrapper should prevent this third point.
+ * - If the last dirent or path string doesn't fit, copy as much of it as fits
+ *   and return the buffer length
  *
- * If the final dirent or path doesn't fit, the caller will expect the next
- * result to contain that same dirent/ path, so we have to step back one in the
- * iterator if that's the case.
+ * Entries are copied straight from the kernel's records without any
+ * intermediate allocation. An entry that doesn't fit is not consumed, so the
+ * next call (or a call with its cookie) will start from that same entry.
  *
  * The caller knows they've reached the end when the buffer is _not_ filled by
  * this call.
@@ -315,51 +487,43 @@ DirEnt FileDescriptor::iterNext()
 size_t FileDescriptor::copyDirentsToWasiBuffer(uint8_t* buffer,
                                                size_t bufferLen)
 {
-
-    // Prepare loop variables
     size_t bytesLeft = bufferLen;
-    bool isBufferFull = false;
-
     size_t wasiDirentSize = sizeof(__wasi_dirent_t);
 
-    while (!iterFinished()) {
-        DirEnt d = iterNext();
-
-        // Create WASI dirent
-        size_t pathSize = d.path.size();
-        __wasi_dirent_t wasmDirEnt{ .d_next = d.next,
-                                    .d_ino = d.ino,
-                                    .d_namlen = (uint32_t)pathSize,
-                                    .d_type = d.type };
-
-        // Drop out if we have no room for the dirent
-        if (bytesLeft < wasiDirentSize) {
-            isBufferFull = true;
-            break;
+    DirEntView view;
+    while (peekDirEnt(view)) {
+        __wasi_dirent_t wasmDirEnt{ .d_next = dirIterIdx + 1,
+                                    .d_ino = view.ino,
+                                    .d_namlen = (uint32_t)view.nameLen,
+                                    .d_type = view.type };
+
+        // Fill the rest of the buffer with a truncated entry if it won't fit
+        size_t entrySize = wasiDirentSize + view.nameLen;
+        if (bytesLeft < entrySize) {
+            auto* direntPtr = BYTES(&wasmDirEnt);
+            size_t headerBytes = std::min(bytesLeft, wasiDirentSize);
+            std::copy(direntPtr, direntPtr + headerBytes, buffer);
+
+            const auto* namePtr = BYTES_CONST(view.name);
+            std::copy(
+              namePtr, namePtr + (bytesLeft - headerBytes), buffer + headerBytes);
+
+            return bufferLen;
         }
 
         auto* direntPtr = BYTES(&wasmDirEnt);
         std::copy(direntPtr, direntPtr + wasiDirentSize, buffer);
-        bytesLeft -= wasiDirentSize;
         buffer += wasiDirentSize;
 
-        // Drop out if we have no room for the path
-        if (bytesLeft < pathSize) {
-            isBufferFull = true;
-            break;
-        }
+        const auto* namePtr = BYTES_CONST(view.name);
+        std::copy(namePtr, namePtr + view.nameLen, buffer);
+        buffer += view.nameLen;
 
-        const auto* pathPtr = BYTES_CONST(d.path.c_str());
-        std::copy(pathPtr, pathPtr + pathSize, buffer);
-        bytesLeft -= pathSize;
-        buffer += pathSize;
+        bytesLeft -= entrySize;
+        advanceDirIter();
     }
 
-    if (isBufferFull) {
-        // Go back one, we've not been able to finish this entry
-        iterBack();
-        return bufferLen;
-    } // Return the number of bytes copied
+    // Return the number of bytes copied
     return bufferLen - bytesLeft;
 }
 
@@ -419,8 +583,12 @@ bool FileDescriptor::pathOpen(uint32_t lookupFlags,
     // More flags
     linuxFlags |= wasiFdFlagsToLinux(fdFlags);
 
+    // Paths under the scratch prefix never touch the disk
+    if (isScratchPath(path)) {
+        return scratchPathOpen();
+    }
+
     bool isShared = SharedFiles::isPathShared(path);
-    std::string realPath;
     if (isShared) {
         // Pull the shared file
         linuxErrno = SharedFiles::syncSharedFile(path);
@@ -443,38 +611,66 @@ bool FileDescriptor::pathOpen(uint32_t lookupFlags,
             }
         }
 
-        realPath = SharedFiles::realPathForSharedFile(path);
+        std::string realPath = SharedFiles::realPathForSharedFile(path);
+        linuxFd = ::open(realPath.c_str(), linuxFlags, linuxMode);
+        if (linuxFd < 0) {
+            linuxErrno = errno;
+        }
     } else {
-        realPath = prependRuntimeRoot(path);
+        // Local files are resolved relative to cached directory fds
+        linuxFd = getPathCache().open(path, linuxFlags, linuxMode);
+        if (linuxFd < 0) {
+            linuxErrno = -1 * linuxFd;
+            linuxFd = -1;
+        }
+    }
+
+    if (linuxFd < 0) {
+        wasiErrno = errnoToWasi(linuxErrno);
+        return false;
     }
 
-    // Attempt to open the local file
-    if (realPath == "/dev/urandom") {
-        // TODO avoid use of system-wide urandom
-        linuxFd = ::open("/dev/urandom", 0, 0);
+    return true;
+}
 
-    } else if (realPath == "/dev/null") {
-        linuxFd = ::open("/dev/null", 0, 0);
-    } else {
-        linuxFd = ::open(realPath.c_str(), linuxFlags, linuxMode);
+bool FileDescriptor::scratchPathOpen()
+{
+    struct ::stat nativeStat
+    {};
+    int res = scratch->stat(path, &nativeStat);
+    if (res == 0 && S_ISDIR(nativeStat.st_mode)) {
+        // Scratch directories have no backing host fd
+        linuxFd = -1;
+        return true;
     }
 
-    if (linuxFd < 0) {
-        linuxErrno = errno;
+    res = scratch->open(path, linuxFlags);
+    if (res < 0) {
+        linuxFd = -1;
+        linuxErrno = -1 * res;
         wasiErrno = errnoToWasi(linuxErrno);
         return false;
     }
 
+    linuxFd = res;
     return true;
 }
 
 bool FileDescriptor::mkdir(const std::string& dirPath)
 {
-    std::string fullPath = prependRuntimeRoot(dirPath);
-    int res = ::mkdir(fullPath.c_str(), 0755);
+    if (isScratchPath(absPath(dirPath))) {
+        int res = scratch->mkdir(absPath(dirPath));
+        if (res < 0) {
+            wasiErrno = errnoToWasi(-1 * res);
+            return false;
+        }
+
+        return true;
+    }
 
+    int res = getPathCache().mkdir(dirPath, 0755);
     if (res < 0) {
-        wasiErrno = errnoToWasi(errno);
+        wasiErrno = errnoToWasi(-1 * res);
         return false;
     }
 
@@ -497,17 +693,52 @@ bool FileDescriptor::updateFlags(int32_t fdFlags)
     return true;
 }
 
+ssize_t FileDescriptor::read(std::vector<::iovec>& nativeIovecs,
+                             int iovecCount)
+{
+    ssize_t bytesRead =
+      getIoEngine().readv(getLinuxFd(), nativeIovecs.data(), iovecCount);
+
+    if (bytesRead < 0) {
+        SPDLOG_ERROR(
+          "readv failed on fd {}: {}", getLinuxFd(), strerror(-1 * bytesRead));
+        wasiErrno = errnoToWasi(-1 * bytesRead);
+        return -1;
+    }
+
+    return bytesRead;
+}
+
 ssize_t FileDescriptor::write(std::vector<::iovec>& nativeIovecs,
                               int iovecCount)
 {
+    // Keep the scratch filesystem within its size limit
+    if (isScratch()) {
+        size_t totalBytes = 0;
+        for (int i = 0; i < iovecCount; i++) {
+            totalBytes += nativeIovecs.at(i).iov_len;
+        }
+
+        int res = scratch->checkWrite(linuxFd, totalBytes);
+        if (res < 0) {
+            wasiErrno = errnoToWasi(-1 * res);
+            return -1;
+        }
+    }
+
     ssize_t bytesWritten =
-      ::writev(getLinuxFd(), nativeIovecs.data(), iovecCount);
+      getIoEngine().writev(getLinuxFd(), nativeIovecs.data(), iovecCount);
 
     if (bytesWritten < 0) {
-        SPDLOG_ERROR(
-          "writev failed on fd {}: {}", getLinuxFd(), strerror(errno));
-        wasiErrno = errnoToWasi(errno);
-        return false;
+        SPDLOG_ERROR("writev failed on fd {}: {}",
+                     getLinuxFd(),
+                     strerror(-1 * bytesWritten));
+        wasiErrno = errnoToWasi(-1 * bytesWritten);
+        return -1;
+    }
+
+    if (isScratch()) {
+        scratch->updateSize(linuxFd);
     }
 
     bool isShared = SharedFiles::isPathShared(path);
@@ -519,9 +750,136 @@ ssize_t FileDescriptor::write(std::vector<::iovec>& nativeIovecs,
     return bytesWritten;
 }
 
+ssize_t FileDescriptor::pread(std::vector<::iovec>& nativeIovecs,
+                              int iovecCount,
+                              uint64_t offset)
+{
+    ssize_t bytesRead = getIoEngine().preadv(
+      getLinuxFd(), nativeIovecs.data(), iovecCount, (off_t)offset);
+
+    if (bytesRead < 0) {
+        SPDLOG_ERROR("preadv failed on fd {} at {}: {}",
+                     getLinuxFd(),
+                     offset,
+                     strerror(-1 * bytesRead));
+        wasiErrno = errnoToWasi(-1 * bytesRead);
+        return -1;
+    }
+
+    return bytesRead;
+}
+
+ssize_t FileDescriptor::pwrite(std::vector<::iovec>& nativeIovecs,
+                               int iovecCount,
+                               uint64_t offset)
+{
+    if (isScratch()) {
+        size_t totalBytes = 0;
+        for (int i = 0; i < iovecCount; i++) {
+            totalBytes += nativeIovecs.at(i).iov_len;
+        }
+
+        int res = scratch->checkWrite(linuxFd, totalBytes, (off_t)offset);
+        if (res < 0) {
+            wasiErrno = errnoToWasi(-1 * res);
+            return -1;
+        }
+    }
+
+    ssize_t bytesWritten = getIoEngine().pwritev(
+      getLinuxFd(), nativeIovecs.data(), iovecCount, (off_t)offset);
+
+    if (bytesWritten < 0) {
+        SPDLOG_ERROR("pwritev failed on fd {} at {}: {}",
+                     getLinuxFd(),
+                     offset,
+                     strerror(-1 * bytesWritten));
+        wasiErrno = errnoToWasi(-1 * bytesWritten);
+        return -1;
+    }
+
+    if (isScratch()) {
+        scratch->updateSize(linuxFd);
+    }
+
+    if (SharedFiles::isPathShared(path)) {
+        SharedFiles::updateSharedFile(path);
+    }
+
+    return bytesWritten;
+}
+
+bool FileDescriptor::allocate(uint64_t offset, uint64_t len)
+{
+    if (isScratch()) {
+        int res = scratch->checkWrite(linuxFd, len, (off_t)offset);
+        if (res < 0) {
+            wasiErrno = errnoToWasi(-1 * res);
+            return false;
+        }
+    }
+
+    // Note, posix_fallocate returns the error rather than setting errno
+    int res = ::posix_fallocate(linuxFd, (off_t)offset, (off_t)len);
+    if (res != 0) {
+        wasiErrno = errnoToWasi(res);
+        return false;
+    }
+
+    if (isScratch()) {
+        scratch->updateSize(linuxFd);
+    }
+
+    if (SharedFiles::isPathShared(path)) {
+        SharedFiles::updateSharedFile(path);
+    }
+
+    return true;
+}
+
+bool FileDescriptor::setSize(uint64_t size)
+{
+    if (isScratch()) {
+        int res = scratch->checkResize(linuxFd, size);
+        if (res < 0) {
+            wasiErrno = errnoToWasi(-1 * res);
+            return false;
+        }
+    }
+
+    int res = ::ftruncate(linuxFd, (off_t)size);
+    if (res < 0) {
+        wasiErrno = errnoToWasi(errno);
+        return false;
+    }
+
+    if (isScratch()) {
+        scratch->updateSize(linuxFd);
+    }
+
+    if (SharedFiles::isPathShared(path)) {
+        SharedFiles::updateSharedFile(path);
+    }
+
+    return true;
+}
+
+bool FileDescriptor::sync(bool dataOnly)
+{
+    int res = dataOnly ? ::fdatasync(linuxFd) : ::fsync(linuxFd);
+    if (res < 0) {
+        wasiErrno = errnoToWasi(errno);
+        return false;
+    }
+
+    return true;
+}
+
 void FileDescriptor::close() const
 {
-    if (linuxFd > 0) {
+    if (isScratch()) {
+        scratch->close(linuxFd);
+    } else if (linuxFd > 0) {
         ::close(linuxFd);
     }
 }
@@ -530,13 +888,16 @@ bool FileDescriptor::unlink(const std::string& relativePath)
 {
     if (SharedFiles::isPathShared(relativePath)) {
         SharedFiles::deleteSharedFile(relativePath);
+    } else if (isScratchPath(absPath(relativePath))) {
+        int res = scratch->unlink(absPath(relativePath));
+        if (res < 0) {
+            wasiErrno = errnoToWasi(-1 * res);
+            return false;
+        }
     } else {
-        std::string fullPath = absPath(relativePath);
-        const std::string maskedPath = prependRuntimeRoot(fullPath);
-        int res = ::unlink(maskedPath.c_str());
-
-        if (res != 0) {
-            wasiErrno = errnoToWasi(errno);
+        int res = getPathCache().unlink(absPath(relativePath));
+        if (res < 0) {
+            wasiErrno = errnoToWasi(-1 * res);
             return false;
         }
     }
@@ -547,11 +908,19 @@ bool FileDescriptor::unlink(const std::string& relativePath)
 bool FileDescriptor::rmdir(const std::string& relativePath)
 {
     std::string fullPath = absPath(relativePath);
-    const std::string maskedPath = prependRuntimeRoot(fullPath);
-    int res = ::rmdir(maskedPath.c_str());
+    if (isScratchPath(fullPath)) {
+        int res = scratch->rmdir(fullPath);
+        if (res < 0) {
+            wasiErrno = errnoToWasi(-1 * res);
+            return false;
+        }
 
-    if (res != 0) {
-        wasiErrno = errnoToWasi(errno);
+        return true;
+    }
+
+    int res = getPathCache().rmdir(fullPath);
+    if (res < 0) {
+        wasiErrno = errnoToWasi(-1 * res);
         return false;
     }
 
@@ -562,12 +931,23 @@ bool FileDescriptor::rename(const std::string& newPath,
                             const std::string& relativePath)
 {
     std::string fullPath = absPath(relativePath);
-    std::string fullOldPath = prependRuntimeRoot(fullPath);
-    std::string fullNewPath = prependRuntimeRoot(newPath);
+    if (isScratchPath(fullPath) || isScratchPath(newPath)) {
+        // Scratch files can only be renamed within the scratch filesystem
+        int res = -EXDEV;
+        if (isScratchPath(fullPath) && isScratchPath(newPath)) {
+            res = scratch->rename(fullPath, newPath);
+        }
+
+        if (res < 0) {
+            wasiErrno = errnoToWasi(-1 * res);
+            return false;
+        }
 
-    int res = ::rename(fullOldPath.c_str(), fullNewPath.c_str());
+        return true;
+    }
 
-    if (res != 0) {
+    int res = getPathCache().rename(fullPath, newPath);
+    if (res < 0) {
         wasiErrno = errnoToWasi(-1 * res);
         return false;
     }
@@ -587,26 +967,29 @@ Stat FileDescriptor::stat(const std::string& relativePath)
         if (result < 0) {
             statErrno = errno;
         }
+    } else if (relativePath.empty() && isScratch()) {
+        // Scratch files may not be linked into the namespace
+        int result = ::fstat(linuxFd, &nativeStat);
+        if (result < 0) {
+            statErrno = errno;
+        }
     } else {
         // Work out whether we're stat-ing a shared path
         std::string statPath = absPath(relativePath);
-        std::string realPath;
         if (SharedFiles::isPathShared(statPath)) {
             statErrno = SharedFiles::syncSharedFile(statPath);
             if (statErrno == 0) {
-                realPath = SharedFiles::realPathForSharedFile(statPath);
+                std::string realPath =
+                  SharedFiles::realPathForSharedFile(statPath);
+                if (::stat(realPath.c_str(), &nativeStat) < 0) {
+                    statErrno = errno;
+                }
             }
+        } else if (isScratchPath(statPath)) {
+            // Scratch files are stat-ed in memory
+            statErrno = -1 * scratch->stat(statPath, &nativeStat);
         } else {
-            realPath = prependRuntimeRoot(statPath);
-        }
-
-        // Do the actual stat
-        int result;
-        if (!realPath.empty()) {
-            result = ::stat(realPath.c_str(), &nativeStat);
-            if (result < 0) {
-                statErrno = errno;
-            }
+            statErrno = -1 * getPathCache().stat(statPath, &nativeStat);
         }
     }
 
@@ -654,14 +1037,20 @@ ssize_t FileDescriptor::readLink(const std::string& relativePath,
                                  char* buffer,
                                  size_t bufferLen)
 {
-    std::string linkPath = prependRuntimeRoot(absPath(relativePath));
+    std::string linkPath = absPath(relativePath);
 
     if (SharedFiles::isPathShared(linkPath)) {
         SPDLOG_ERROR("Readlink on shared not yet supported ({})", path);
         throw std::runtime_error("Readlink on shared file not supported");
     }
 
-    ssize_t bytesRead = ::readlink(linkPath.c_str(), buffer, (size_t)bufferLen);
+    // Keep the readlink convention of returning -1 and setting errno
+    ssize_t bytesRead = getPathCache().readLink(linkPath, buffer, bufferLen);
+    if (bytesRead < 0) {
+        errno = -1 * bytesRead;
+        return -1;
+    }
+
     return bytesRead;
 }
 
@@ -737,7 +1126,13 @@ void FileDescriptor::setActualRights(uint64_t rights, uint64_t inheriting)
 int FileDescriptor::duplicate(const FileDescriptor& other)
 {
     // Duplicate the underlying fd
-    linuxFd = ::dup(other.linuxFd);
+    scratch = other.scratch;
+    pathCache = other.pathCache;
+    if (other.isScratch()) {
+        linuxFd = scratch->dup(other.linuxFd);
+    } else {
+        linuxFd = ::dup(other.linuxFd);
+    }
 
     linuxMode = other.linuxMode;
     linuxFlags = other.linuxFlags;
@@ -749,10 +1144,72 @@ int FileDescriptor::duplicate(const FileDescriptor& other)
     actualRightsBase = other.actualRightsBase;
     actualRightsInheriting = other.actualRightsInheriting;
 
-    dirContentsLoaded = other.dirContentsLoaded;
-    dirContents = other.dirContents;
-    dirContentsIdx = other.dirContentsIdx;
+    // Copy the directory iterator state
+    dirIterStarted = other.dirIterStarted;
+    dirIterEof = other.dirIterEof;
+    dirIterIdx = other.dirIterIdx;
+    direntBuffer = other.direntBuffer;
+    direntBufferPos = other.direntBufferPos;
+    direntBufferLen = other.direntBufferLen;
+    direntReadOffset = other.direntReadOffset;
+    dirLastOffset = other.dirLastOffset;
+    dirPrevOffset = other.dirPrevOffset;
+    dirPrevEntryPos = other.dirPrevEntryPos;
+    dirCanStepBack = other.dirCanStepBack;
+    dirCheckpoints = other.dirCheckpoints;
+    scratchDirContents = other.scratchDirContents;
 
     return linuxFd;
 }
+
+void FileDescriptor::setScratchFileSystem(
+  std::shared_ptr<ScratchFileSystem> scratchIn)
+{
+    scratch = std::move(scratchIn);
+}
+
+void FileDescriptor::setPathCache(std::shared_ptr<PathCache> pathCacheIn)
+{
+    pathCache = std::move(pathCacheIn);
+}
+
+PathCache& FileDescriptor::getPathCache()
+{
+    // Descriptors outside a filesystem get a cache of their own
+    if (pathCache == nullptr) {
+        pathCache = std::make_shared<PathCache>();
+    }
+
+    return *pathCache;
+}
+
+bool FileDescriptor::isScratchPath(const std::string& p) const
+{
+    return scratch != nullptr && scratch->isScratchPath(p);
+}
+
+bool FileDescriptor::isScratch() const
+{
+    return scratch != nullptr && linuxFd >= 0 && scratch->ownsFd(linuxFd);
+}
+
+bool FileDescriptor::openAnonymousScratch(const std::string& name)
+{
+    if (scratch == nullptr || !scratch->isEnabled()) {
+        linuxErrno = ENOENT;
+        wasiErrno = errnoToWasi(linuxErrno);
+        return false;
+    }
+
+    int res = scratch->openAnonymous(name);
+    if (res < 0) {
+        linuxErrno = -1 * res;
+        wasiErrno = errnoToWasi(linuxErrno);
+        return false;
+    }
+
+    linuxFd = res;
+    linuxFlags = O_RDWR;
+    return true;
+}
 }
@@ -10,12 +10,58 @@
 #include <faabric/util/logging.h>
 
 namespace storage {
+FileSystem::FileSystem()
+  : scratch(std::make_shared<ScratchFileSystem>())
+  , pathCache(std::make_shared<PathCache>())
+{}
+
+FileSystem::FileSystem(const FileSystem& other)
+{
+    copyFrom(other);
+}
+
+FileSystem& FileSystem::operator=(const FileSystem& other)
+{
+    if (this != &other) {
+        copyFrom(other);
+    }
+
+    return *this;
+}
+
+void FileSystem::copyFrom(const FileSystem& other)
+{
+    nextFd = other.nextFd;
+
+    // Scratch contents are never carried over, so a copy (e.g. a module reset
+    // from its snapshot) always starts with an empty scratch filesystem
+    scratch = std::make_shared<ScratchFileSystem>(*other.scratch);
+    pathCache = std::make_shared<PathCache>();
+
+    fileDescriptors.clear();
+    for (const auto& [fd, fileDesc] : other.fileDescriptors) {
+        if (fileDesc.isScratch() ||
+            scratch->isScratchPath(fileDesc.getPath())) {
+            continue;
+        }
+
+        FileDescriptor& newDesc = fileDescriptors[fd];
+        newDesc = fileDesc;
+        newDesc.setScratchFileSystem(scratch);
+        newDesc.setPathCache(pathCache);
+    }
+}
+
 void FileSystem::prepareFilesystem()
 {
     // Predefined stdin, stdout and stderr
     fileDescriptors.emplace(0, storage::FileDescriptor::stdinFactory());
     fileDescriptors.emplace(1, storage::FileDescriptor::stdoutFactory());
     fileDescriptors.emplace(2, storage::FileDescriptor::stderrFactory());
+    for (auto& p : fileDescriptors) {
+        p.second.setScratchFileSystem(scratch);
+        p.second.setPathCache(pathCache);
+    }
 
     // Add roots, note that they are predefined as the file descriptors
     // just above the stdxxx's (i.e. > 3)
@@ -30,6 +76,8 @@ void FileSystem::createPreopenedFileDescriptor(int fd, const std::string& path)
 {
     // Open the descriptor as a directory
     storage::FileDescriptor fileDesc;
+    fileDesc.setScratchFileSystem(scratch);
+    fileDesc.setPathCache(pathCache);
     fileDesc.setPath(path);
     fileDesc.setActualRights(DIRECTORY_RIGHTS, INHERITING_DIRECTORY_RIGHTS);
 
@@ -95,6 +143,8 @@ int FileSystem::openFileDescriptor(int rootFd,
     // Initialise the new fd
     int thisFd = getNewFd();
     FileDescriptor& fileDesc = fileDescriptors[thisFd];
+    fileDesc.setScratchFileSystem(scratch);
+    fileDesc.setPathCache(pathCache);
     fileDesc.setPath(fullPath);
 
     // AND requested rights with those of the root file descriptor. Rights for
@@ -142,6 +192,39 @@ int FileSystem::dup(int fd)
     return newFd;
 }
 
+void FileSystem::closeFileDescriptor(int fd)
+{
+    getFileDescriptor(fd).close();
+    fileDescriptors.erase(fd);
+}
+
+int FileSystem::openScratchAnonymous(const std::string& name)
+{
+    FileDescriptor fileDesc;
+    fileDesc.setScratchFileSystem(scratch);
+    fileDesc.setPathCache(pathCache);
+    fileDesc.setPath(name);
+    fileDesc.setActualRights(WASI_RIGHTS_READ | WASI_RIGHTS_WRITE, 0);
+
+    if (!fileDesc.openAnonymousScratch(name)) {
+        return -1 * fileDesc.getWasiErrno();
+    }
+
+    int thisFd = getNewFd();
+    fileDescriptors.emplace(thisFd, fileDesc);
+    return thisFd;
+}
+
+ScratchFileSystem& FileSystem::getScratchFileSystem()
+{
+    return *scratch;
+}
+
+PathCacheStats FileSystem::getPathCacheStats()
+{
+    return pathCache->getStats();
+}
+
 void FileSystem::tearDown()
 {
     for (auto& f : fileDescriptors) {
@@ -150,6 +233,17 @@ void FileSystem::tearDown()
             f.second.close();
         }
     }
+
+    scratch->reset();
+
+    PathCacheStats stats = pathCache->getStats();
+    SPDLOG_DEBUG(
+      "Path cache: {} hits, {} misses, {} bypasses ({:.1f}% hit rate)",
+      stats.hits,
+      stats.misses,
+      stats.bypasses,
+      100 * stats.hitRate());
+    pathCache->clear();
 }
 
 void FileSystem::printDebugInfo()
@@ -158,6 +252,15 @@ void FileSystem::printDebugInfo()
     for (auto& p : fileDescriptors) {
         printf("    %s\n", p.second.getPath().c_str());
     }
+
+    PathCacheStats stats = pathCache->getStats();
+    printf("--- Path cache ---\n");
+    printf("Hits:          %lu\n", stats.hits);
+    printf("Misses:        %lu\n", stats.misses);
+    printf("Bypasses:      %lu\n", stats.bypasses);
+    printf("Invalidations: %lu\n", stats.invalidations);
+    printf("Cached dirs:   %lu\n", stats.cachedDirs);
+    printf("Hit rate:      %.1f%%\n", 100 * stats.hitRate());
 }
 
 }
@@ -0,0 +1,368 @@
+#include "IoEngine.h"
+
+#include <conf/FaasmConfig.h>
+
+#include <faabric/util/logging.h>
+
+#include <cerrno>
+#include <cstring>
+
+#ifdef FAASM_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace storage {
+
+std::vector<::iovec>& getIovecBuffer(size_t iovecCount)
+{
+    static thread_local std::vector<::iovec> iovecBuffer;
+    if (iovecBuffer.size() < iovecCount) {
+        iovecBuffer.resize(iovecCount);
+    }
+
+    return iovecBuffer;
+}
+
+// ---------------------------------
+// Common
+// ---------------------------------
+
+ssize_t IoEngine::readv(int linuxFd, const ::iovec* iovecs, int iovecCount)
+{
+    IoRequest req;
+    req.op = IoOp::Read;
+    req.linuxFd = linuxFd;
+    req.iovecs = iovecs;
+    req.iovecCount = iovecCount;
+
+    submit(&req, 1);
+    return req.result;
+}
+
+ssize_t IoEngine::writev(int linuxFd, const ::iovec* iovecs, int iovecCount)
+{
+    IoRequest req;
+    req.op = IoOp::Write;
+    req.linuxFd = linuxFd;
+    req.iovecs = iovecs;
+    req.iovecCount = iovecCount;
+
+    submit(&req, 1);
+    return req.result;
+}
+
+ssize_t IoEngine::preadv(int linuxFd,
+                         const ::iovec* iovecs,
+                         int iovecCount,
+                         off_t offset)
+{
+    IoRequest req;
+    req.op = IoOp::Read;
+    req.linuxFd = linuxFd;
+    req.iovecs = iovecs;
+    req.iovecCount = iovecCount;
+    req.offset = offset;
+
+    submit(&req, 1);
+    return req.result;
+}
+
+ssize_t IoEngine::pwritev(int linuxFd,
+                          const ::iovec* iovecs,
+                          int iovecCount,
+                          off_t offset)
+{
+    IoRequest req;
+    req.op = IoOp::Write;
+    req.linuxFd = linuxFd;
+    req.iovecs = iovecs;
+    req.iovecCount = iovecCount;
+    req.offset = offset;
+
+    submit(&req, 1);
+    return req.result;
+}
+
+void IoEngine::submitBatch(std::vector<IoRequest>& requests)
+{
+    submit(requests.data(), requests.size());
+}
+
+// ---------------------------------
+// Syscalls
+// ---------------------------------
+
+static void doSyscallRequest(IoRequest& req)
+{
+    ssize_t res;
+    if (req.op == IoOp::Read) {
+        res = req.offset < 0
+                ? ::readv(req.linuxFd, req.iovecs, req.iovecCount)
+                : ::preadv(req.linuxFd, req.iovecs, req.iovecCount, req.offset);
+    } else {
+        res =
+          req.offset < 0
+            ? ::writev(req.linuxFd, req.iovecs, req.iovecCount)
+            : ::pwritev(req.linuxFd, req.iovecs, req.iovecCount, req.offset);
+    }
+
+    req.result = res < 0 ? -errno : res;
+}
+
+void SyscallIoEngine::submit(IoRequest* requests, size_t nRequests)
+{
+    for (size_t i = 0; i < nRequests; i++) {
+        doSyscallRequest(requests[i]);
+    }
+}
+
+std::string SyscallIoEngine::getName() const
+{
+    return IO_ENGINE_SYSCALL;
+}
+
+// ---------------------------------
+// io_uring
+// ---------------------------------
+
+#ifdef FAASM_IO_URING
+static int ioUringSetup(unsigned entries, io_uring_params* params)
+{
+    return (int)::syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int ioUringEnter(int ringFd,
+                        unsigned toSubmit,
+                        unsigned minComplete,
+                        unsigned flags)
+{
+    return (int)::syscall(
+      __NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, nullptr, 0);
+}
+
+IoUringIoEngine::IoUringIoEngine(unsigned queueDepth)
+{
+    io_uring_params params{};
+    ringFd = ioUringSetup(queueDepth, &params);
+    if (ringFd < 0) {
+        SPDLOG_WARN("io_uring setup failed: {}", std::strerror(errno));
+        return;
+    }
+
+    supportsCurrentOffset = (params.features & IORING_FEAT_RW_CUR_POS) != 0;
+
+    // Map the submission and completion rings, which share a mapping on
+    // newer kernels
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMmap) {
+        sqRingSize = std::max(sqRingSize, cqRingSize);
+        cqRingSize = sqRingSize;
+    }
+
+    sqRingPtr = ::mmap(nullptr,
+                       sqRingSize,
+                       PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE,
+                       ringFd,
+                       IORING_OFF_SQ_RING);
+
+    if (singleMmap) {
+        cqRingPtr = sqRingPtr;
+    } else if (sqRingPtr != MAP_FAILED) {
+        cqRingPtr = ::mmap(nullptr,
+                           cqRingSize,
+                           PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE,
+                           ringFd,
+                           IORING_OFF_CQ_RING);
+    }
+
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    if (sqRingPtr != MAP_FAILED && cqRingPtr != MAP_FAILED) {
+        sqesPtr = ::mmap(nullptr,
+                         sqesSize,
+                         PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE,
+                         ringFd,
+                         IORING_OFF_SQES);
+    }
+
+    if (sqRingPtr == MAP_FAILED || cqRingPtr == MAP_FAILED ||
+        sqesPtr == MAP_FAILED) {
+        SPDLOG_WARN("Mapping io_uring failed: {}", std::strerror(errno));
+        sqRingPtr = sqRingPtr == MAP_FAILED ? nullptr : sqRingPtr;
+        cqRingPtr = cqRingPtr == MAP_FAILED ? nullptr : cqRingPtr;
+        sqesPtr = sqesPtr == MAP_FAILED ? nullptr : sqesPtr;
+        tearDown();
+        return;
+    }
+
+    auto* sqBase = static_cast<uint8_t*>(sqRingPtr);
+    sqEntries = params.sq_entries;
+    sqTail = reinterpret_cast<unsigned*>(sqBase + params.sq_off.tail);
+    sqMask = reinterpret_cast<unsigned*>(sqBase + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<unsigned*>(sqBase + params.sq_off.array);
+
+    auto* cqBase = static_cast<uint8_t*>(cqRingPtr);
+    cqHead = reinterpret_cast<unsigned*>(cqBase + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned*>(cqBase + params.cq_off.tail);
+    cqMask = reinterpret_cast<unsigned*>(cqBase + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(cqBase + params.cq_off.cqes);
+}
+
+IoUringIoEngine::~IoUringIoEngine()
+{
+    tearDown();
+}
+
+void IoUringIoEngine::tearDown()
+{
+    if (sqesPtr != nullptr) {
+        ::munmap(sqesPtr, sqesSize);
+        sqesPtr = nullptr;
+    }
+
+    if (cqRingPtr != nullptr && cqRingPtr != sqRingPtr) {
+        ::munmap(cqRingPtr, cqRingSize);
+    }
+    cqRingPtr = nullptr;
+
+    if (sqRingPtr != nullptr) {
+        ::munmap(sqRingPtr, sqRingSize);
+        sqRingPtr = nullptr;
+    }
+
+    if (ringFd >= 0) {
+        ::close(ringFd);
+        ringFd = -1;
+    }
+}
+
+bool IoUringIoEngine::isReady() const
+{
+    return ringFd >= 0;
+}
+
+std::string IoUringIoEngine::getName() const
+{
+    return IO_ENGINE_IO_URING;
+}
+
+void IoUringIoEngine::submitChunk(IoRequest** requests, unsigned nRequests)
+{
+    // Fill in the submission queue entries. We are the only producer, so the
+    // tail can be read without synchronisation
+    unsigned tail = *sqTail;
+    auto* sqes = static_cast<io_uring_sqe*>(sqesPtr);
+    for (unsigned i = 0; i < nRequests; i++) {
+        IoRequest& req = *requests[i];
+        unsigned idx = tail & *sqMask;
+
+        io_uring_sqe* sqe = &sqes[idx];
+        std::memset(sqe, 0, sizeof(io_uring_sqe));
+        sqe->opcode = req.op == IoOp::Read ? IORING_OP_READV : IORING_OP_WRITEV;
+        sqe->addr = reinterpret_cast<uint64_t>(req.iovecs);
+        sqe->len = req.iovecCount;
+        sqe->off = req.offset < 0 ? (uint64_t)-1 : (uint64_t)req.offset;
+        sqe->fd = req.linuxFd;
+        sqe->user_data = i;
+
+        sqArray[idx] = idx;
+        tail++;
+    }
+
+    __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+
+    // Submit everything and wait for it all to complete in one go
+    unsigned toSubmit = nRequests;
+    unsigned completed = 0;
+    while (completed < nRequests) {
+        int res = ioUringEnter(
+          ringFd, toSubmit, nRequests - completed, IORING_ENTER_GETEVENTS);
+        if (res < 0 && errno != EINTR) {
+            SPDLOG_ERROR("io_uring_enter failed: {}", std::strerror(errno));
+            throw std::runtime_error("io_uring_enter failed");
+        }
+
+        if (res > 0) {
+            toSubmit -= std::min((unsigned)res, toSubmit);
+        }
+
+        // Reap whatever has completed, the user data is the request index
+        unsigned head = *cqHead;
+        unsigned cqTailVal = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        while (head != cqTailVal) {
+            io_uring_cqe* cqe = &cqes[head & *cqMask];
+            requests[cqe->user_data]->result = cqe->res;
+            completed++;
+            head++;
+        }
+
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+    }
+}
+
+void IoUringIoEngine::submit(IoRequest* requests, size_t nRequests)
+{
+    if (!isReady()) {
+        throw std::runtime_error("io_uring engine not ready");
+    }
+
+    // Older kernels can't use the current file offset with io_uring
+    ringRequests.clear();
+    for (size_t i = 0; i < nRequests; i++) {
+        IoRequest& req = requests[i];
+        if (supportsCurrentOffset || req.offset >= 0) {
+            ringRequests.push_back(&req);
+        } else {
+            doSyscallRequest(req);
+        }
+    }
+
+    size_t offset = 0;
+    while (offset < ringRequests.size()) {
+        unsigned chunkSize =
+          std::min<size_t>(ringRequests.size() - offset, sqEntries);
+        submitChunk(ringRequests.data() + offset, chunkSize);
+        offset += chunkSize;
+    }
+}
+#endif
+
+// ---------------------------------
+// Engine selection
+// ---------------------------------
+
+static std::unique_ptr<IoEngine> createIoEngine()
+{
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+    if (conf.ioEngine == IO_ENGINE_IO_URING) {
+#ifdef FAASM_IO_URING
+        auto engine = std::make_unique<IoUringIoEngine>();
+        if (engine->isReady()) {
+            return engine;
+        }
+
+        SPDLOG_WARN("io_uring unavailable, falling back to syscall engine");
+#else
+        SPDLOG_WARN("Faasm not built with io_uring, using syscall engine");
+#endif
+    } else if (conf.ioEngine != IO_ENGINE_SYSCALL) {
+        SPDLOG_ERROR("Unrecognised IO engine: {}", conf.ioEngine);
+        throw std::runtime_error("Unrecognised IO engine");
+    }
+
+    return std::make_unique<SyscallIoEngine>();
+}
+
+IoEngine& getIoEngine()
+{
+    static thread_local std::unique_ptr<IoEngine> engine = createIoEngine();
+    return *engine;
+}
+}
@@ -0,0 +1,551 @@
+#include <storage/FileDescriptor.h>
+#include <storage/PathCache.h>
+
+#include <conf/FaasmConfig.h>
+
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace storage {
+
+double PathCacheStats::hitRate() const
+{
+    uint64_t total = hits + misses + bypasses;
+    if (total == 0) {
+        return 0;
+    }
+
+    return (double)hits / (double)total;
+}
+
+/**
+ * Splits a path into its parent directory relative to the runtime root and its
+ * final component, dropping empty and . components. Returns false if the path
+ * can't be cached, i.e. it has .. components.
+ */
+static bool splitPath(const std::string& path,
+                      std::string& parent,
+                      std::string& name)
+{
+    parent.clear();
+    name.clear();
+
+    size_t start = 0;
+    while (start <= path.size()) {
+        size_t end = path.find('/', start);
+        if (end == std::string::npos) {
+            end = path.size();
+        }
+
+        size_t len = end - start;
+        if (len == 2 && path.compare(start, len, "..") == 0) {
+            return false;
+        }
+
+        if (len > 0 && !(len == 1 && path[start] == '.')) {
+            if (!name.empty()) {
+                if (!parent.empty()) {
+                    parent += '/';
+                }
+                parent += name;
+            }
+            name.assign(path, start, len);
+        }
+
+        start = end + 1;
+    }
+
+    // The root itself
+    if (name.empty()) {
+        name = ".";
+        return true;
+    }
+
+    // Keep a trailing slash, which requires the target to be a directory
+    if (path.back() == '/') {
+        name += '/';
+    }
+
+    return true;
+}
+
+static std::string cacheKey(const std::string& parent, const std::string& name)
+{
+    std::string key = parent;
+    if (name != ".") {
+        if (!key.empty()) {
+            key += '/';
+        }
+        key += name;
+    }
+
+    if (!key.empty() && key.back() == '/') {
+        key.pop_back();
+    }
+
+    return key;
+}
+
+// Bumped by every cache when it renames or removes something
+static std::atomic<uint64_t> treeGeneration = 0;
+
+static void bumpTreeGeneration()
+{
+    treeGeneration.fetch_add(1, std::memory_order_acq_rel);
+}
+
+PathCache::~PathCache()
+{
+    doClear();
+}
+
+/**
+ * Directories can be deleted directly on the host, in which case lookups
+ * through a cached fd fail with ENOENT or ESTALE. A deleted directory has no
+ * links left, which tells this apart from the target itself not existing.
+ */
+static bool isStaleDirFd(int dirFd, int err)
+{
+    if (err == ESTALE) {
+        return true;
+    }
+
+    if (err != ENOENT) {
+        return false;
+    }
+
+    struct ::stat dirStat
+    {};
+    return ::fstat(dirFd, &dirStat) != 0 || dirStat.st_nlink == 0;
+}
+
+template<typename T, typename Op>
+T PathCache::withParent(const std::string& path, Op op)
+{
+    std::string parent;
+    std::string name;
+    if (!splitPath(path, parent, name)) {
+        bypasses++;
+        std::string realPath = prependRuntimeRoot(path);
+        T res = op(AT_FDCWD, realPath.c_str());
+        return res < 0 ? -errno : res;
+    }
+
+    // Hits only need a shared lock, which is held until the syscall is done so
+    // the fd can't be closed underneath it
+    int staleFd = -1;
+    {
+        faabric::util::SharedLock lock(mx);
+        const conf::FaasmConfig& conf = conf::getFaasmConfig();
+        if (rootFd >= 0 && rootPath == conf.runtimeFilesDir) {
+            int dirFd = -1;
+            if (parent.empty()) {
+                dirFd = rootFd;
+            } else {
+                // Entries from an older generation are checked under the
+                // full lock
+                auto it = dirs.find(parent);
+                if (it != dirs.end() &&
+                    it->second.generation ==
+                      treeGeneration.load(std::memory_order_acquire)) {
+                    dirFd = it->second.fd;
+                }
+            }
+
+            if (dirFd >= 0) {
+                hits++;
+                T res = op(dirFd, name.c_str());
+                if (res >= 0) {
+                    return res;
+                }
+
+                int err = errno;
+                if (!isStaleDirFd(dirFd, err)) {
+                    return -err;
+                }
+
+                staleFd = dirFd;
+            }
+        }
+    }
+
+    faabric::util::FullLock lock(mx);
+    if (staleFd >= 0) {
+        dropStaleDir(parent, staleFd);
+    }
+
+    if (!checkRoot()) {
+        return -errno;
+    }
+
+    int dirFd = getParentFd(parent);
+    if (dirFd < 0) {
+        return dirFd;
+    }
+
+    T res = op(dirFd, name.c_str());
+    if (res >= 0) {
+        return res;
+    }
+
+    // The fd may have come from the cache, in which case try a fresh one
+    int err = errno;
+    if (!isStaleDirFd(dirFd, err)) {
+        return -err;
+    }
+
+    dropStaleDir(parent, dirFd);
+    if (!checkRoot()) {
+        return -errno;
+    }
+
+    dirFd = getParentFd(parent);
+    if (dirFd < 0) {
+        return dirFd;
+    }
+
+    res = op(dirFd, name.c_str());
+    return res < 0 ? -errno : res;
+}
+
+void PathCache::dropStaleDir(const std::string& parent, int dirFd)
+{
+    // If the root has gone, so has everything below it
+    if (parent.empty()) {
+        if (dirFd == rootFd) {
+            invalidations += dirs.size() + 1;
+            doClear();
+        }
+
+        return;
+    }
+
+    // Another thread may have replaced the entry already
+    auto it = dirs.find(parent);
+    if (it == dirs.end() || it->second.fd != dirFd) {
+        return;
+    }
+
+    SPDLOG_DEBUG("Dropping stale cached directory {}", parent);
+    dropDirs(parent);
+}
+
+bool PathCache::checkRoot()
+{
+    const conf::FaasmConfig& conf = conf::getFaasmConfig();
+    if (rootFd >= 0 && rootPath == conf.runtimeFilesDir) {
+        return true;
+    }
+
+    // The runtime root has changed, so everything cached is stale
+    doClear();
+
+    rootPath = conf.runtimeFilesDir;
+    rootFd = ::open(rootPath.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (rootFd < 0) {
+        SPDLOG_ERROR(
+          "Failed to open runtime root {} ({})", rootPath, ::strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+bool PathCache::isCurrent(const std::string& parent, CachedDir& dir)
+{
+    uint64_t generation = treeGeneration.load(std::memory_order_acquire);
+    if (dir.generation == generation) {
+        return true;
+    }
+
+    struct ::stat dirStat
+    {};
+    if (::fstatat(rootFd, parent.c_str(), &dirStat, 0) != 0 ||
+        dirStat.st_dev != dir.dev || dirStat.st_ino != dir.ino) {
+        return false;
+    }
+
+    dir.generation = generation;
+    return true;
+}
+
+int PathCache::getParentFd(const std::string& parent)
+{
+    if (parent.empty()) {
+        hits++;
+        return rootFd;
+    }
+
+    auto it = dirs.find(parent);
+    if (it != dirs.end()) {
+        if (isCurrent(parent, it->second)) {
+            hits++;
+            return it->second.fd;
+        }
+
+        SPDLOG_DEBUG("Cached directory {} has been moved or replaced", parent);
+        dropDirs(parent);
+    }
+
+    misses++;
+
+    if (dirs.size() >= PATH_CACHE_MAX_DIRS) {
+        SPDLOG_DEBUG("Path cache full ({} dirs), emptying", dirs.size());
+        closeDirFds();
+    }
+
+    // Read the generation first, so a change while opening is checked later
+    uint64_t generation = treeGeneration.load(std::memory_order_acquire);
+    int dirFd =
+      ::openat(rootFd, parent.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd < 0) {
+        return -errno;
+    }
+
+    struct ::stat dirStat
+    {};
+    if (::fstat(dirFd, &dirStat) != 0) {
+        int err = errno;
+        ::close(dirFd);
+        return -err;
+    }
+
+    dirs[parent] = { dirFd, dirStat.st_dev, dirStat.st_ino, generation };
+    return dirFd;
+}
+
+int PathCache::open(const std::string& path, int flags, mode_t mode)
+{
+    return withParent<int>(path, [flags, mode](int dirFd, const char* name) {
+        return ::openat(dirFd, name, flags, mode);
+    });
+}
+
+int PathCache::stat(const std::string& path, struct ::stat* statBuf)
+{
+    return withParent<int>(path, [statBuf](int dirFd, const char* name) {
+        return ::fstatat(dirFd, name, statBuf, 0);
+    });
+}
+
+int PathCache::mkdir(const std::string& path, mode_t mode)
+{
+    int res = withParent<int>(path, [mode](int dirFd, const char* name) {
+        return ::mkdirat(dirFd, name, mode);
+    });
+
+    invalidate(path);
+    return res;
+}
+
+int PathCache::unlink(const std::string& path)
+{
+    int res = withParent<int>(path, [](int dirFd, const char* name) {
+        return ::unlinkat(dirFd, name, 0);
+    });
+
+    // Unlinking a symlink can change where a path leads
+    if (res == 0) {
+        bumpTreeGeneration();
+    }
+
+    invalidate(path);
+    return res;
+}
+
+int PathCache::rmdir(const std::string& path)
+{
+    int res = withParent<int>(path, [](int dirFd, const char* name) {
+        return ::unlinkat(dirFd, name, AT_REMOVEDIR);
+    });
+
+    if (res == 0) {
+        bumpTreeGeneration();
+    }
+
+    invalidate(path);
+    return res;
+}
+
+int PathCache::rename(const std::string& oldPath, const std::string& newPath)
+{
+    std::string oldParent;
+    std::string oldName;
+    std::string newParent;
+    std::string newName;
+
+    int res;
+    if (!splitPath(oldPath, oldParent, oldName) ||
+        !splitPath(newPath, newParent, newName)) {
+        bypasses++;
+        std::string realOldPath = prependRuntimeRoot(oldPath);
+        std::string realNewPath = prependRuntimeRoot(newPath);
+        res = ::rename(realOldPath.c_str(), realNewPath.c_str());
+        res = res < 0 ? -errno : res;
+    } else {
+        // Renames are rare, so just do the whole thing under the full lock
+        faabric::util::FullLock lock(mx);
+        if (!checkRoot()) {
+            return -errno;
+        }
+
+        // Make sure looking up the second parent can't evict the first
+        if (dirs.size() + 2 > PATH_CACHE_MAX_DIRS) {
+            closeDirFds();
+        }
+
+        int oldDirFd = getParentFd(oldParent);
+        if (oldDirFd < 0) {
+            return oldDirFd;
+        }
+
+        int newDirFd = getParentFd(newParent);
+        if (newDirFd < 0) {
+            return newDirFd;
+        }
+
+        res = ::renameat(oldDirFd, oldName.c_str(), newDirFd, newName.c_str());
+        if (res < 0) {
+            int err = errno;
+            bool oldStale = isStaleDirFd(oldDirFd, err);
+            bool newStale = isStaleDirFd(newDirFd, err);
+            if (!oldStale && !newStale) {
+                return -err;
+            }
+
+            // Retry with fresh fds for both parents
+            if (oldStale) {
+                dropStaleDir(oldParent, oldDirFd);
+            }
+            if (newStale) {
+                dropStaleDir(newParent, newDirFd);
+            }
+
+            if (!checkRoot()) {
+                return -errno;
+            }
+
+            if (dirs.size() + 2 > PATH_CACHE_MAX_DIRS) {
+                closeDirFds();
+            }
+
+            oldDirFd = getParentFd(oldParent);
+            if (oldDirFd < 0) {
+                return oldDirFd;
+            }
+
+            newDirFd = getParentFd(newParent);
+            if (newDirFd < 0) {
+                return newDirFd;
+            }
+
+            res = ::renameat(
+              oldDirFd, oldName.c_str(), newDirFd, newName.c_str());
+            res = res < 0 ? -errno : res;
+        }
+    }
+
+    if (res == 0) {
+        bumpTreeGeneration();
+    }
+
+    invalidate(oldPath);
+    invalidate(newPath);
+    return res;
+}
+
+ssize_t PathCache::readLink(const std::string& path,
+                            char* buffer,
+                            size_t bufferLen)
+{
+    return withParent<ssize_t>(
+      path, [buffer, bufferLen](int dirFd, const char* name) {
+          return ::readlinkat(dirFd, name, buffer, bufferLen);
+      });
+}
+
+void PathCache::invalidate(const std::string& path)
+{
+    faabric::util::FullLock lock(mx);
+
+    if (dirs.empty()) {
+        return;
+    }
+
+    std::string parent;
+    std::string name;
+    std::string key;
+    if (splitPath(path, parent, name)) {
+        key = cacheKey(parent, name);
+    }
+
+    // Paths we can't map to a key, and the root itself, invalidate everything
+    if (key.empty()) {
+        invalidations += dirs.size();
+        closeDirFds();
+        return;
+    }
+
+    dropDirs(key);
+}
+
+void PathCache::dropDirs(const std::string& key)
+{
+    for (auto it = dirs.begin(); it != dirs.end();) {
+        const std::string& p = it->first;
+        bool isBelow = p.size() > key.size() && p[key.size()] == '/' &&
+                       p.compare(0, key.size(), key) == 0;
+        if (p == key || isBelow) {
+            invalidations++;
+            ::close(it->second.fd);
+            it = dirs.erase(it);
+        } else {
+            it++;
+        }
+    }
+}
+
+void PathCache::clear()
+{
+    faabric::util::FullLock lock(mx);
+    doClear();
+}
+
+void PathCache::closeDirFds()
+{
+    for (auto& [p, dir] : dirs) {
+        ::close(dir.fd);
+    }
+    dirs.clear();
+}
+
+void PathCache::doClear()
+{
+    closeDirFds();
+
+    if (rootFd >= 0) {
+        ::close(rootFd);
+        rootFd = -1;
+    }
+    rootPath.clear();
+}
+
+PathCacheStats PathCache::getStats()
+{
+    faabric::util::SharedLock lock(mx);
+
+    PathCacheStats stats;
+    stats.hits = hits;
+    stats.misses = misses;
+    stats.bypasses = bypasses;
+    stats.invalidations = invalidations;
+    stats.cachedDirs = dirs.size();
+
+    return stats;
+}
+}
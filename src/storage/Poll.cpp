@@ -0,0 +1,346 @@
+#include "Poll.h"
+
+#include <faabric/util/logging.h>
+#include <faabric/util/timing.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <vector>
+
+namespace storage {
+
+// Marks the timer in the epoll set, other events hold the index of their fd
+#define POLL_TIMER_EVENT UINT32_MAX
+
+/**
+ * Each thread keeps an epoll instance and a timer, reused across calls to
+ * poll_oneoff. The timer gives nanosecond timeouts, and lets us wait for the
+ * earliest clock subscription and any fds at the same time.
+ */
+struct Poller
+{
+    int epollFd = -1;
+    int timerFd = -1;
+
+    Poller()
+    {
+        epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+        timerFd =
+          ::timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+        if (epollFd < 0 || timerFd < 0) {
+            SPDLOG_ERROR("Failed to create poller ({})", strerror(errno));
+            throw std::runtime_error("Failed to create poller");
+        }
+
+        epoll_event timerEvent{ .events = EPOLLIN,
+                                .data = { .u32 = POLL_TIMER_EVENT } };
+        ::epoll_ctl(epollFd, EPOLL_CTL_ADD, timerFd, &timerEvent);
+    }
+
+    ~Poller()
+    {
+        ::close(timerFd);
+        ::close(epollFd);
+    }
+
+    Poller(const Poller& other) = delete;
+
+    Poller& operator=(const Poller& other) = delete;
+};
+
+static Poller& getPoller()
+{
+    static thread_local Poller poller;
+    return poller;
+}
+
+struct PolledFd
+{
+    int linuxFd;
+    uint32_t epollEvents = 0;
+    uint32_t readyEvents = 0;
+};
+
+static uint64_t getMonotonicNanos()
+{
+    timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return faabric::util::timespecToNanos(&ts);
+}
+
+/**
+ * Works out the monotonic deadline of a clock subscription, or returns a WASI
+ * error if the clock is not supported
+ */
+static __wasi_errno_t getClockDeadline(const __wasi_subscription_t& sub,
+                                       uint64_t nowNanos,
+                                       uint64_t& deadline)
+{
+    uint64_t timeout = sub.u.clock.timeout;
+    bool isAbsolute = sub.u.clock.flags & __WASI_SUBSCRIPTION_CLOCK_ABSTIME;
+
+    if (sub.u.clock.clock_id == __WASI_CLOCK_MONOTONIC) {
+        deadline = isAbsolute ? timeout : nowNanos + timeout;
+    } else if (sub.u.clock.clock_id == __WASI_CLOCK_REALTIME) {
+        if (isAbsolute) {
+            // Convert to a monotonic deadline
+            timespec ts{};
+            clock_gettime(CLOCK_REALTIME, &ts);
+            uint64_t realNanos = faabric::util::timespecToNanos(&ts);
+            deadline =
+              timeout > realNanos ? nowNanos + (timeout - realNanos) : 0;
+        } else {
+            deadline = nowNanos + timeout;
+        }
+    } else {
+        return __WASI_EINVAL;
+    }
+
+    return __WASI_ESUCCESS;
+}
+
+/**
+ * Regular files can't be added to an epoll set and are always ready. For reads
+ * we report the bytes left before the end of the file.
+ */
+static uint64_t getRegularFileReadBytes(int linuxFd)
+{
+    struct stat fileStat
+    {};
+    off_t offset = ::lseek(linuxFd, 0, SEEK_CUR);
+    if (::fstat(linuxFd, &fileStat) != 0 || offset < 0 ||
+        offset >= fileStat.st_size) {
+        return 0;
+    }
+
+    return fileStat.st_size - offset;
+}
+
+int pollOneoff(const __wasi_subscription_t* subscriptions,
+               __wasi_event_t* events,
+               int nSubs,
+               const std::function<int(int)>& getLinuxFd)
+{
+    if (nSubs <= 0) {
+        return 0;
+    }
+
+    uint64_t nowNanos = getMonotonicNanos();
+
+    // Events that fire without waiting (errors and regular files), the
+    // earliest clock deadline, and the fds to wait on
+    std::vector<__wasi_event_t> immediateEvents;
+    std::vector<uint64_t> deadlines(nSubs, UINT64_MAX);
+    uint64_t earliestDeadline = UINT64_MAX;
+    std::vector<PolledFd> polledFds;
+    std::vector<int> subPolledFdIdxs(nSubs, -1);
+
+    for (int i = 0; i < nSubs; i++) {
+        const __wasi_subscription_t& sub = subscriptions[i];
+
+        __wasi_event_t event{};
+        event.userdata = sub.userdata;
+        event.type = sub.type;
+
+        if (sub.type == __WASI_EVENTTYPE_CLOCK) {
+            event.error = getClockDeadline(sub, nowNanos, deadlines[i]);
+            if (event.error != __WASI_ESUCCESS) {
+                immediateEvents.push_back(event);
+            } else {
+                earliestDeadline = std::min(earliestDeadline, deadlines[i]);
+            }
+
+            continue;
+        }
+
+        if (sub.type != __WASI_EVENTTYPE_FD_READ &&
+            sub.type != __WASI_EVENTTYPE_FD_WRITE) {
+            event.error = __WASI_EINVAL;
+            immediateEvents.push_back(event);
+            continue;
+        }
+
+        int linuxFd = getLinuxFd(sub.u.fd_readwrite.fd);
+        if (linuxFd < 0) {
+            event.error = __WASI_EBADF;
+            immediateEvents.push_back(event);
+            continue;
+        }
+
+        uint32_t epollEvents = EPOLLOUT;
+        if (sub.type == __WASI_EVENTTYPE_FD_READ) {
+            epollEvents = EPOLLIN | EPOLLRDHUP;
+        }
+
+        // Subscriptions on the same fd share an epoll registration
+        auto it = std::find_if(
+          polledFds.begin(), polledFds.end(), [linuxFd](const PolledFd& p) {
+              return p.linuxFd == linuxFd;
+          });
+        if (it == polledFds.end()) {
+            polledFds.push_back({ .linuxFd = linuxFd });
+            it = std::prev(polledFds.end());
+        }
+
+        it->epollEvents |= epollEvents;
+        subPolledFdIdxs[i] = std::distance(polledFds.begin(), it);
+    }
+
+    // Register the fds, regular files are always ready
+    Poller& poller = getPoller();
+    std::vector<bool> isRegistered(polledFds.size(), false);
+    bool anyReady = !immediateEvents.empty();
+    for (size_t p = 0; p < polledFds.size(); p++) {
+        epoll_event ev{ .events = polledFds[p].epollEvents,
+                        .data = { .u32 = (uint32_t)p } };
+        if (::epoll_ctl(
+              poller.epollFd, EPOLL_CTL_ADD, polledFds[p].linuxFd, &ev) == 0) {
+            isRegistered[p] = true;
+        } else if (errno == EPERM) {
+            polledFds[p].readyEvents =
+              polledFds[p].epollEvents & (EPOLLIN | EPOLLOUT);
+            anyReady = true;
+        } else {
+            SPDLOG_ERROR("Failed to poll fd {} ({})",
+                         polledFds[p].linuxFd,
+                         strerror(errno));
+            polledFds[p].readyEvents = EPOLLERR;
+            anyReady = true;
+        }
+    }
+
+    bool hasRegisteredFds =
+      std::find(isRegistered.begin(), isRegistered.end(), true) !=
+      isRegistered.end();
+
+    if (anyReady) {
+        // Still pick up any other fds that are ready
+        if (hasRegisteredFds) {
+            std::vector<epoll_event> readyEvents(polledFds.size() + 1);
+            int nReady = ::epoll_wait(
+              poller.epollFd, readyEvents.data(), readyEvents.size(), 0);
+            for (int e = 0; e < nReady; e++) {
+                uint32_t idx = readyEvents[e].data.u32;
+                if (idx != POLL_TIMER_EVENT) {
+                    polledFds[idx].readyEvents = readyEvents[e].events;
+                }
+            }
+        }
+    } else if (!hasRegisteredFds) {
+        // Only clocks, so we can just sleep until the earliest one
+        timespec t{};
+        faabric::util::nanosToTimespec(earliestDeadline, &t);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, nullptr) ==
+               EINTR) {
+        }
+    } else {
+        // Arm the timer for the earliest clock, if any
+        itimerspec timerSpec{};
+        if (earliestDeadline != UINT64_MAX) {
+            // A zero value disarms the timer, so expired deadlines need a
+            // non-zero time in the past
+            uint64_t timerNanos = std::max<uint64_t>(earliestDeadline, 1);
+            faabric::util::nanosToTimespec(timerNanos, &timerSpec.it_value);
+        }
+        ::timerfd_settime(
+          poller.timerFd, TFD_TIMER_ABSTIME, &timerSpec, nullptr);
+
+        std::vector<epoll_event> readyEvents(polledFds.size() + 1);
+        int nReady = -1;
+        while (nReady < 0) {
+            nReady = ::epoll_wait(
+              poller.epollFd, readyEvents.data(), readyEvents.size(), -1);
+            if (nReady < 0 && errno != EINTR) {
+                SPDLOG_ERROR("epoll_wait failed ({})", strerror(errno));
+                throw std::runtime_error("epoll_wait failed");
+            }
+        }
+
+        for (int e = 0; e < nReady; e++) {
+            uint32_t idx = readyEvents[e].data.u32;
+            if (idx != POLL_TIMER_EVENT) {
+                polledFds[idx].readyEvents = readyEvents[e].events;
+            }
+        }
+
+        // Disarm and drain the timer
+        itimerspec disarm{};
+        ::timerfd_settime(poller.timerFd, 0, &disarm, nullptr);
+        uint64_t expirations;
+        while (::read(poller.timerFd, &expirations, sizeof(expirations)) > 0) {
+        }
+    }
+
+    for (size_t p = 0; p < polledFds.size(); p++) {
+        if (isRegistered[p]) {
+            ::epoll_ctl(
+              poller.epollFd, EPOLL_CTL_DEL, polledFds[p].linuxFd, nullptr);
+        }
+    }
+
+    // Write out the events that have fired
+    int nEvents = 0;
+    for (auto& event : immediateEvents) {
+        events[nEvents++] = event;
+    }
+
+    nowNanos = getMonotonicNanos();
+    for (int i = 0; i < nSubs; i++) {
+        const __wasi_subscription_t& sub = subscriptions[i];
+
+        __wasi_event_t event{};
+        event.userdata = sub.userdata;
+        event.type = sub.type;
+        event.error = __WASI_ESUCCESS;
+
+        if (sub.type == __WASI_EVENTTYPE_CLOCK) {
+            if (deadlines[i] == UINT64_MAX || deadlines[i] > nowNanos) {
+                continue;
+            }
+
+            events[nEvents++] = event;
+            continue;
+        }
+
+        if (subPolledFdIdxs[i] < 0) {
+            continue;
+        }
+
+        PolledFd& polledFd = polledFds[subPolledFdIdxs[i]];
+        bool isRead = sub.type == __WASI_EVENTTYPE_FD_READ;
+        uint32_t wanted = isRead ? EPOLLIN : EPOLLOUT;
+        uint32_t hangup = EPOLLHUP | EPOLLRDHUP | EPOLLERR;
+        if ((polledFd.readyEvents & (wanted | hangup)) == 0) {
+            continue;
+        }
+
+        if (polledFd.readyEvents & EPOLLERR) {
+            event.error = __WASI_EIO;
+        }
+
+        if (polledFd.readyEvents & hangup) {
+            event.u.fd_readwrite.flags = __WASI_EVENT_FD_READWRITE_HANGUP;
+        }
+
+        if (isRead && !isRegistered[subPolledFdIdxs[i]]) {
+            event.u.fd_readwrite.nbytes =
+              getRegularFileReadBytes(polledFd.linuxFd);
+        } else if (isRead) {
+            int nBytes = 0;
+            if (::ioctl(polledFd.linuxFd, FIONREAD, &nBytes) == 0) {
+                event.u.fd_readwrite.nbytes = nBytes;
+            }
+        }
+
+        events[nEvents++] = event;
+    }
+
+    return nEvents;
+}
+}
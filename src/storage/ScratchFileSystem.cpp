@@ -0,0 +1,597 @@
+#include "ScratchFileSystem.h"
+
+#include <conf/FaasmConfig.h>
+
+#include <faabric/util/logging.h>
+#include <faabric/util/string_tools.h>
+
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace storage {
+
+// ---------------------------------
+// Scratch file
+// ---------------------------------
+
+ScratchFile::ScratchFile(const std::string& name)
+{
+    memFd = memfd_create(name.c_str(), MFD_CLOEXEC);
+    if (memFd < 0) {
+        SPDLOG_ERROR("Failed to create scratch file {}: {}",
+                     name,
+                     std::strerror(errno));
+        throw std::runtime_error("Failed to create scratch file");
+    }
+}
+
+ScratchFile::~ScratchFile()
+{
+    if (memFd >= 0) {
+        ::close(memFd);
+    }
+}
+
+int ScratchFile::getFd() const
+{
+    return memFd;
+}
+
+size_t ScratchFile::getSize() const
+{
+    return size;
+}
+
+void ScratchFile::setSize(size_t newSize)
+{
+    size = newSize;
+}
+
+void ScratchFile::addLink()
+{
+    links++;
+}
+
+int ScratchFile::removeLink()
+{
+    return --links;
+}
+
+// ---------------------------------
+// Scratch filesystem
+// ---------------------------------
+
+ScratchFileSystem::ScratchFileSystem()
+{
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+    prefix = conf.scratchFsPrefix.empty() ? ""
+                                          : normalisePath(conf.scratchFsPrefix);
+    maxBytes = ((size_t)conf.scratchFsMaxMb) * ONE_MB_BYTES;
+}
+
+ScratchFileSystem::ScratchFileSystem(const std::string& prefixIn,
+                                     size_t maxBytesIn)
+  : maxBytes(maxBytesIn)
+{
+    prefix = prefixIn.empty() ? "" : normalisePath(prefixIn);
+}
+
+ScratchFileSystem::~ScratchFileSystem()
+{
+    reset();
+}
+
+ScratchFileSystem::ScratchFileSystem(const ScratchFileSystem& other)
+  : prefix(other.prefix)
+  , maxBytes(other.maxBytes)
+{}
+
+ScratchFileSystem& ScratchFileSystem::operator=(const ScratchFileSystem& other)
+{
+    if (this != &other) {
+        reset();
+        prefix = other.prefix;
+        maxBytes = other.maxBytes;
+    }
+
+    return *this;
+}
+
+bool ScratchFileSystem::isEnabled() const
+{
+    return !prefix.empty();
+}
+
+std::string ScratchFileSystem::normalisePath(const std::string& path) const
+{
+    // Resolve "." and ".." lexically, and make the result absolute, so that
+    // paths relative to the "." and "/" preopens map to the same key
+    std::vector<std::string> parts;
+    size_t start = 0;
+    while (start <= path.size()) {
+        size_t end = path.find('/', start);
+        if (end == std::string::npos) {
+            end = path.size();
+        }
+
+        std::string part = path.substr(start, end - start);
+        if (part == "..") {
+            if (!parts.empty()) {
+                parts.pop_back();
+            }
+        } else if (!part.empty() && part != ".") {
+            parts.push_back(part);
+        }
+
+        start = end + 1;
+    }
+
+    std::string result;
+    for (const auto& part : parts) {
+        result += "/" + part;
+    }
+
+    return result.empty() ? "/" : result;
+}
+
+bool ScratchFileSystem::isScratchPath(const std::string& path) const
+{
+    if (prefix.empty()) {
+        return false;
+    }
+
+    std::string normPath = normalisePath(path);
+    return normPath == prefix ||
+           faabric::util::startsWith(normPath, prefix + "/");
+}
+
+std::string ScratchFileSystem::parentPath(const std::string& path) const
+{
+    size_t lastSlash = path.find_last_of('/');
+    if (lastSlash == 0 || lastSlash == std::string::npos) {
+        return "/";
+    }
+
+    return path.substr(0, lastSlash);
+}
+
+bool ScratchFileSystem::hasChildren(const std::string& path) const
+{
+    std::string childPrefix = path + "/";
+    for (const auto& f : files) {
+        if (faabric::util::startsWith(f.first, childPrefix)) {
+            return true;
+        }
+    }
+
+    for (const auto& d : dirs) {
+        if (faabric::util::startsWith(d, childPrefix)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+std::string ScratchFileSystem::createTempName(const std::string& namePrefix)
+{
+    std::string base = namePrefix.empty() ? "tmp" : namePrefix;
+
+    std::string name;
+    do {
+        name = fmt::format("{}/{}{:06}", prefix, base, tempNameCounter++);
+    } while (files.count(name) > 0 || dirs.count(name) > 0);
+
+    return name;
+}
+
+int ScratchFileSystem::registerFd(const std::shared_ptr<ScratchFile>& file,
+                                  int linuxFlags)
+{
+    // Reopen through procfs to get a new open file description, so that each
+    // fd has its own offset, just as with a real file
+    int reopenFlags = (linuxFlags & (O_ACCMODE | O_APPEND | O_NONBLOCK));
+    std::string procPath = fmt::format("/proc/self/fd/{}", file->getFd());
+    int linuxFd = ::open(procPath.c_str(), reopenFlags);
+    if (linuxFd < 0) {
+        return -errno;
+    }
+
+    linkFile(file);
+    openFds[linuxFd] = file;
+    return linuxFd;
+}
+
+void ScratchFileSystem::linkFile(const std::shared_ptr<ScratchFile>& file)
+{
+    file->addLink();
+}
+
+// Once nothing refers to a file its contents are freed
+void ScratchFileSystem::unlinkFile(const std::shared_ptr<ScratchFile>& file)
+{
+    if (file->removeLink() == 0) {
+        usedBytes -= file->getSize();
+    }
+}
+
+void ScratchFileSystem::setFileSize(ScratchFile& file, size_t newSize)
+{
+    usedBytes = usedBytes - file.getSize() + newSize;
+    file.setSize(newSize);
+}
+
+int ScratchFileSystem::open(const std::string& path, int linuxFlags)
+{
+    std::string normPath = normalisePath(path);
+
+    if (normPath == prefix || dirs.count(normPath) > 0) {
+        return -EISDIR;
+    }
+
+    auto it = files.find(normPath);
+    if (it != files.end()) {
+        if ((linuxFlags & O_CREAT) && (linuxFlags & O_EXCL)) {
+            return -EEXIST;
+        }
+
+        if (linuxFlags & O_DIRECTORY) {
+            return -ENOTDIR;
+        }
+
+        bool truncate = linuxFlags & O_TRUNC;
+        if (truncate && ::ftruncate(it->second->getFd(), 0) == 0) {
+            setFileSize(*it->second, 0);
+        }
+
+        return registerFd(it->second, linuxFlags);
+    }
+
+    if (!(linuxFlags & O_CREAT)) {
+        return -ENOENT;
+    }
+
+    std::string parent = parentPath(normPath);
+    if (parent != prefix && dirs.count(parent) == 0) {
+        return -ENOENT;
+    }
+
+    SPDLOG_TRACE("Creating scratch file {}", normPath);
+    auto file = std::make_shared<ScratchFile>(normPath);
+    linkFile(file);
+    files[normPath] = file;
+
+    return registerFd(file, linuxFlags);
+}
+
+int ScratchFileSystem::openAnonymous(const std::string& name)
+{
+    auto file = std::make_shared<ScratchFile>(name);
+    return registerFd(file, O_RDWR);
+}
+
+int ScratchFileSystem::stat(const std::string& path, struct ::stat* nativeStat)
+{
+    std::string normPath = normalisePath(path);
+
+    if (normPath == prefix || dirs.count(normPath) > 0) {
+        *nativeStat = {};
+        nativeStat->st_mode = S_IFDIR | S_IRWXU | S_IRGRP | S_IXGRP;
+        nativeStat->st_nlink = 2;
+        nativeStat->st_ino = std::hash<std::string>{}(normPath);
+        return 0;
+    }
+
+    auto it = files.find(normPath);
+    if (it == files.end()) {
+        return -ENOENT;
+    }
+
+    if (::fstat(it->second->getFd(), nativeStat) < 0) {
+        return -errno;
+    }
+
+    return 0;
+}
+
+int ScratchFileSystem::unlink(const std::string& path)
+{
+    std::string normPath = normalisePath(path);
+    if (normPath == prefix || dirs.count(normPath) > 0) {
+        return -EISDIR;
+    }
+
+    // Open fds keep the contents alive until they are closed
+    auto it = files.find(normPath);
+    if (it == files.end()) {
+        return -ENOENT;
+    }
+
+    unlinkFile(it->second);
+    files.erase(it);
+    return 0;
+}
+
+int ScratchFileSystem::rename(const std::string& oldPath,
+                              const std::string& newPath)
+{
+    std::string normOld = normalisePath(oldPath);
+    std::string normNew = normalisePath(newPath);
+
+    if (!isScratchPath(normNew)) {
+        return -EXDEV;
+    }
+
+    std::string newParent = parentPath(normNew);
+    if (newParent != prefix && dirs.count(newParent) == 0) {
+        return -ENOENT;
+    }
+
+    auto it = files.find(normOld);
+    if (it != files.end()) {
+        if (dirs.count(normNew) > 0) {
+            return -EISDIR;
+        }
+
+        std::shared_ptr<ScratchFile> file = it->second;
+        files.erase(it);
+
+        // Any file already at the new path is replaced
+        auto existing = files.find(normNew);
+        if (existing != files.end()) {
+            unlinkFile(existing->second);
+        }
+
+        files[normNew] = file;
+        return 0;
+    }
+
+    if (dirs.count(normOld) == 0) {
+        return -ENOENT;
+    }
+
+    if (files.count(normNew) > 0) {
+        return -ENOTDIR;
+    }
+
+    if (dirs.count(normNew) > 0 && hasChildren(normNew)) {
+        return -ENOTEMPTY;
+    }
+
+    // Move the directory along with everything underneath it
+    std::string oldChildPrefix = normOld + "/";
+    std::unordered_map<std::string, std::shared_ptr<ScratchFile>> newFiles;
+    for (auto& f : files) {
+        if (faabric::util::startsWith(f.first, oldChildPrefix)) {
+            newFiles[normNew + f.first.substr(normOld.size())] = f.second;
+        } else {
+            newFiles[f.first] = f.second;
+        }
+    }
+    files = std::move(newFiles);
+
+    std::set<std::string> newDirs;
+    for (const auto& d : dirs) {
+        if (d == normOld || faabric::util::startsWith(d, oldChildPrefix)) {
+            newDirs.insert(normNew + d.substr(normOld.size()));
+        } else {
+            newDirs.insert(d);
+        }
+    }
+    dirs = std::move(newDirs);
+
+    return 0;
+}
+
+int ScratchFileSystem::mkdir(const std::string& path)
+{
+    std::string normPath = normalisePath(path);
+    if (normPath == prefix || dirs.count(normPath) > 0 ||
+        files.count(normPath) > 0) {
+        return -EEXIST;
+    }
+
+    std::string parent = parentPath(normPath);
+    if (parent != prefix && dirs.count(parent) == 0) {
+        return -ENOENT;
+    }
+
+    dirs.insert(normPath);
+    return 0;
+}
+
+int ScratchFileSystem::rmdir(const std::string& path)
+{
+    std::string normPath = normalisePath(path);
+    if (normPath == prefix) {
+        return -EBUSY;
+    }
+
+    if (files.count(normPath) > 0) {
+        return -ENOTDIR;
+    }
+
+    if (dirs.count(normPath) == 0) {
+        return -ENOENT;
+    }
+
+    if (hasChildren(normPath)) {
+        return -ENOTEMPTY;
+    }
+
+    dirs.erase(normPath);
+    return 0;
+}
+
+int ScratchFileSystem::dup(int linuxFd)
+{
+    auto it = openFds.find(linuxFd);
+    if (it == openFds.end()) {
+        return -EBADF;
+    }
+
+    int newFd = ::dup(linuxFd);
+    if (newFd < 0) {
+        return -errno;
+    }
+
+    linkFile(it->second);
+    openFds[newFd] = it->second;
+    return newFd;
+}
+
+void ScratchFileSystem::close(int linuxFd)
+{
+    auto it = openFds.find(linuxFd);
+    if (it == openFds.end()) {
+        return;
+    }
+
+    ::close(linuxFd);
+    unlinkFile(it->second);
+    openFds.erase(it);
+}
+
+int ScratchFileSystem::listDir(const std::string& path,
+                               std::vector<DirEnt>& entries)
+{
+    std::string normPath = normalisePath(path);
+    if (normPath != prefix && dirs.count(normPath) == 0) {
+        return files.count(normPath) > 0 ? -ENOTDIR : -ENOENT;
+    }
+
+    uint64_t nextIdx = 0;
+    auto addEntry = [&entries, &nextIdx](const std::string& name,
+                                         uint8_t type) {
+        nextIdx++;
+        DirEnt ent;
+        ent.next = nextIdx;
+        ent.type = type;
+        ent.ino = std::hash<std::string>{}(name);
+        ent.path = name;
+        entries.push_back(ent);
+    };
+
+    addEntry(".", DT_DIR);
+    addEntry("..", DT_DIR);
+
+    for (const auto& d : dirs) {
+        if (parentPath(d) == normPath) {
+            addEntry(d.substr(normPath.size() + 1), DT_DIR);
+        }
+    }
+
+    for (const auto& f : files) {
+        if (parentPath(f.first) == normPath) {
+            addEntry(f.first.substr(normPath.size() + 1), DT_REG);
+        }
+    }
+
+    return 0;
+}
+
+int ScratchFileSystem::checkWrite(int linuxFd, size_t nBytes, off_t offset)
+{
+    auto it = openFds.find(linuxFd);
+    if (it == openFds.end()) {
+        return -EBADF;
+    }
+
+    size_t fileSize = it->second->getSize();
+    int fdFlags = ::fcntl(linuxFd, F_GETFL);
+
+    // Note that Linux appends even on positional writes with O_APPEND
+    size_t writeOffset;
+    if (fdFlags >= 0 && (fdFlags & O_APPEND)) {
+        writeOffset = fileSize;
+    } else if (offset >= 0) {
+        writeOffset = offset;
+    } else {
+        off_t currentOffset = ::lseek(linuxFd, 0, SEEK_CUR);
+        writeOffset = currentOffset < 0 ? fileSize : (size_t)currentOffset;
+    }
+
+    return checkGrowth(fileSize, writeOffset + nBytes);
+}
+
+int ScratchFileSystem::checkResize(int linuxFd, size_t newSize)
+{
+    auto it = openFds.find(linuxFd);
+    if (it == openFds.end()) {
+        return -EBADF;
+    }
+
+    // Truncation ignores the fd's offset and O_APPEND
+    return checkGrowth(it->second->getSize(), newSize);
+}
+
+void ScratchFileSystem::updateSize(int linuxFd)
+{
+    auto it = openFds.find(linuxFd);
+    if (it == openFds.end()) {
+        return;
+    }
+
+    struct ::stat nativeStat
+    {};
+    if (::fstat(linuxFd, &nativeStat) < 0) {
+        SPDLOG_WARN("Failed to stat scratch fd {}: {}",
+                    linuxFd,
+                    std::strerror(errno));
+        return;
+    }
+
+    setFileSize(*it->second, nativeStat.st_size);
+}
+
+int ScratchFileSystem::checkGrowth(size_t fileSize, size_t newTop) const
+{
+    size_t growth = newTop > fileSize ? newTop - fileSize : 0;
+    if (growth > 0 && getUsedBytes() + growth > maxBytes) {
+        SPDLOG_WARN("Scratch filesystem full ({} + {} > {})",
+                    getUsedBytes(),
+                    growth,
+                    maxBytes);
+        return -ENOSPC;
+    }
+
+    return 0;
+}
+
+bool ScratchFileSystem::ownsFd(int linuxFd) const
+{
+    return openFds.count(linuxFd) > 0;
+}
+
+size_t ScratchFileSystem::getUsedBytes() const
+{
+    return usedBytes;
+}
+
+size_t ScratchFileSystem::getMaxBytes() const
+{
+    return maxBytes;
+}
+
+size_t ScratchFileSystem::getFileCount() const
+{
+    return files.size();
+}
+
+void ScratchFileSystem::reset()
+{
+    for (const auto& f : openFds) {
+        ::close(f.first);
+    }
+
+    openFds.clear();
+    files.clear();
+    dirs.clear();
+    tempNameCounter = 0;
+    usedBytes = 0;
+}
+}
@@ -0,0 +1,303 @@
+#include <threads/ArrayReduction.h>
+
+#include <faabric/util/logging.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+using namespace faabric::util;
+
+namespace threads {
+
+struct ArrayReductionsHeader
+{
+    uint32_t nReductions;
+    uint32_t blockSize;
+};
+
+static size_t alignUp(size_t nBytes)
+{
+    return (nBytes + 7) & ~((size_t)7);
+}
+
+static size_t getElementSize(int32_t dataType)
+{
+    switch (dataType) {
+        case (SnapshotDataType::Int):
+        case (SnapshotDataType::Float): {
+            return sizeof(int32_t);
+        }
+        case (SnapshotDataType::Long):
+        case (SnapshotDataType::Double): {
+            return sizeof(int64_t);
+        }
+        default: {
+            SPDLOG_ERROR("Unsupported array reduction type {}", dataType);
+            throw std::runtime_error("Unsupported array reduction type");
+        }
+    }
+}
+
+static size_t getSlotSize(const ArrayReduction& r)
+{
+    return sizeof(uint64_t) + alignUp(getArrayReductionBytes(r));
+}
+
+size_t getArrayReductionBytes(const ArrayReduction& r)
+{
+    return r.count * getElementSize(r.dataType);
+}
+
+bool canMergeArray(SnapshotDataType dataType, SnapshotMergeOperation mergeOp)
+{
+    bool typeOk =
+      dataType == SnapshotDataType::Int || dataType == SnapshotDataType::Long ||
+      dataType == SnapshotDataType::Float ||
+      dataType == SnapshotDataType::Double;
+
+    // Products can't be split into parts per host without losing precision
+    bool opOk = mergeOp == SnapshotMergeOperation::Sum ||
+                mergeOp == SnapshotMergeOperation::Subtract ||
+                mergeOp == SnapshotMergeOperation::Max ||
+                mergeOp == SnapshotMergeOperation::Min;
+
+    return typeOk && opOk;
+}
+
+size_t getArrayReductionsSize(const std::vector<ArrayReduction>& reductions,
+                              int nSlots)
+{
+    size_t size = alignUp(sizeof(ArrayReductionsHeader) +
+                          reductions.size() * sizeof(ArrayReduction));
+
+    for (const auto& r : reductions) {
+        size += alignUp(getArrayReductionBytes(r));
+        size += nSlots * getSlotSize(r);
+    }
+
+    return alignUp(size);
+}
+
+uint32_t writeArrayReductions(uint8_t* memoryBase,
+                              uint32_t blockPtr,
+                              const std::vector<ArrayReduction>& reductions,
+                              int firstIdx,
+                              int nSlots)
+{
+    std::vector<ArrayReduction> written = reductions;
+
+    // Bases all come before the slots, so the part of the block that's only
+    // read by other hosts is contiguous
+    uint32_t offset = alignUp(blockPtr + sizeof(ArrayReductionsHeader) +
+                              written.size() * sizeof(ArrayReduction));
+    for (auto& r : written) {
+        size_t valuesSize = getArrayReductionBytes(r);
+        r.basePtr = offset;
+        std::memcpy(
+          memoryBase + r.basePtr, memoryBase + r.arrayPtr, valuesSize);
+        offset += alignUp(valuesSize);
+    }
+
+    uint32_t slotsStart = offset;
+    for (auto& r : written) {
+        r.slotSize = getSlotSize(r);
+        r.slotsPtr = offset;
+        r.firstIdx = firstIdx;
+        r.nSlots = nSlots;
+        std::memset(memoryBase + r.slotsPtr, 0, (size_t)nSlots * r.slotSize);
+        offset += nSlots * r.slotSize;
+    }
+
+    ArrayReductionsHeader header{ (uint32_t)written.size(),
+                                  (uint32_t)alignUp(offset - blockPtr) };
+    std::memcpy(memoryBase + blockPtr, &header, sizeof(header));
+    std::memcpy(memoryBase + blockPtr + sizeof(header),
+                written.data(),
+                written.size() * sizeof(ArrayReduction));
+
+    return slotsStart;
+}
+
+static std::vector<ArrayReduction> readArrayReductions(uint8_t* memoryBase,
+                                                       uint32_t blockPtr,
+                                                       size_t& blockSize)
+{
+    ArrayReductionsHeader header;
+    std::memcpy(&header, memoryBase + blockPtr, sizeof(header));
+    blockSize = header.blockSize;
+
+    std::vector<ArrayReduction> reductions(header.nReductions);
+    std::memcpy(reductions.data(),
+                memoryBase + blockPtr + sizeof(header),
+                reductions.size() * sizeof(ArrayReduction));
+
+    return reductions;
+}
+
+template<typename T>
+static void recordValues(const T* values,
+                         T* base,
+                         T* slot,
+                         uint32_t count,
+                         int32_t mergeOp)
+{
+    // Extremes can be recorded again without changing the result
+    if (mergeOp == SnapshotMergeOperation::Max ||
+        mergeOp == SnapshotMergeOperation::Min) {
+        std::copy(values, values + count, slot);
+        return;
+    }
+
+    // Sums are recorded as the change since the last thread on this host
+    // recorded them, so each change is only merged once
+    for (uint32_t i = 0; i < count; i++) {
+        slot[i] = values[i] - base[i];
+    }
+    std::copy(values, values + count, base);
+}
+
+// Each loop works on whole arrays with no branches, so can be vectorised
+template<typename T>
+static void mergeValues(T* values,
+                        const T* slot,
+                        uint32_t count,
+                        int32_t mergeOp)
+{
+    switch (mergeOp) {
+        case (SnapshotMergeOperation::Sum):
+        case (SnapshotMergeOperation::Subtract): {
+            for (uint32_t i = 0; i < count; i++) {
+                values[i] += slot[i];
+            }
+            break;
+        }
+        case (SnapshotMergeOperation::Max): {
+            for (uint32_t i = 0; i < count; i++) {
+                values[i] = std::max(values[i], slot[i]);
+            }
+            break;
+        }
+        case (SnapshotMergeOperation::Min): {
+            for (uint32_t i = 0; i < count; i++) {
+                values[i] = std::min(values[i], slot[i]);
+            }
+            break;
+        }
+        default: {
+            SPDLOG_ERROR("Unsupported array reduction operation {}", mergeOp);
+            throw std::runtime_error("Unsupported array reduction operation");
+        }
+    }
+}
+
+template<typename T>
+static void recordReduction(uint8_t* memoryBase,
+                            const ArrayReduction& r,
+                            uint8_t* slot)
+{
+    recordValues(reinterpret_cast<T*>(memoryBase + r.arrayPtr),
+                 reinterpret_cast<T*>(memoryBase + r.basePtr),
+                 reinterpret_cast<T*>(slot + sizeof(uint64_t)),
+                 r.count,
+                 r.mergeOp);
+}
+
+template<typename T>
+static void mergeReduction(uint8_t* memoryBase,
+                           const ArrayReduction& r,
+                           const uint8_t* slot)
+{
+    mergeValues(reinterpret_cast<T*>(memoryBase + r.arrayPtr),
+                reinterpret_cast<const T*>(slot + sizeof(uint64_t)),
+                r.count,
+                r.mergeOp);
+}
+
+void recordArrayReductions(uint8_t* memoryBase,
+                           uint32_t blockPtr,
+                           int groupIdx)
+{
+    size_t blockSize = 0;
+    for (const auto& r :
+         readArrayReductions(memoryBase, blockPtr, blockSize)) {
+        int slotIdx = groupIdx - r.firstIdx;
+        if (slotIdx < 0 || slotIdx >= r.nSlots) {
+            SPDLOG_ERROR("No array reduction slot for thread {} ({} from {})",
+                         groupIdx,
+                         r.nSlots,
+                         r.firstIdx);
+            throw std::runtime_error("No array reduction slot for thread");
+        }
+
+        uint8_t* slot = memoryBase + r.slotsPtr + slotIdx * r.slotSize;
+        switch (r.dataType) {
+            case (SnapshotDataType::Int): {
+                recordReduction<int32_t>(memoryBase, r, slot);
+                break;
+            }
+            case (SnapshotDataType::Long): {
+                recordReduction<int64_t>(memoryBase, r, slot);
+                break;
+            }
+            case (SnapshotDataType::Float): {
+                recordReduction<float>(memoryBase, r, slot);
+                break;
+            }
+            case (SnapshotDataType::Double): {
+                recordReduction<double>(memoryBase, r, slot);
+                break;
+            }
+            default: {
+                SPDLOG_ERROR("Unsupported array reduction type {}", r.dataType);
+                throw std::runtime_error("Unsupported array reduction type");
+            }
+        }
+
+        *reinterpret_cast<uint32_t*>(slot) = 1;
+    }
+}
+
+size_t mergeArrayReductions(uint8_t* memoryBase, uint32_t blockPtr)
+{
+    size_t blockSize = 0;
+    for (const auto& r :
+         readArrayReductions(memoryBase, blockPtr, blockSize)) {
+        for (int i = 0; i < r.nSlots; i++) {
+            const uint8_t* slot = memoryBase + r.slotsPtr + i * r.slotSize;
+
+            // Only threads on other hosts record their slots
+            if (*reinterpret_cast<const uint32_t*>(slot) == 0) {
+                continue;
+            }
+
+            switch (r.dataType) {
+                case (SnapshotDataType::Int): {
+                    mergeReduction<int32_t>(memoryBase, r, slot);
+                    break;
+                }
+                case (SnapshotDataType::Long): {
+                    mergeReduction<int64_t>(memoryBase, r, slot);
+                    break;
+                }
+                case (SnapshotDataType::Float): {
+                    mergeReduction<float>(memoryBase, r, slot);
+                    break;
+                }
+                case (SnapshotDataType::Double): {
+                    mergeReduction<double>(memoryBase, r, slot);
+                    break;
+                }
+                default: {
+                    SPDLOG_ERROR("Unsupported array reduction type {}",
+                                 r.dataType);
+                    throw std::runtime_error(
+                      "Unsupported array reduction type");
+                }
+            }
+        }
+    }
+
+    return blockSize;
+}
+}
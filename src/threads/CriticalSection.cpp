@@ -0,0 +1,50 @@
+#include <threads/CriticalSection.h>
+
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+
+namespace threads {
+
+void CriticalSection::lock()
+{
+    mx.lock();
+}
+
+void CriticalSection::unlock()
+{
+    mx.unlock();
+}
+
+std::shared_ptr<CriticalSection> CriticalSections::get(int32_t crit)
+{
+    // Sections are created once per name, so lookups rarely need the full lock
+    {
+        faabric::util::SharedLock lock(sectionsMx);
+        auto it = sections.find(crit);
+        if (it != sections.end()) {
+            return it->second;
+        }
+    }
+
+    faabric::util::FullLock lock(sectionsMx);
+    std::shared_ptr<CriticalSection>& section = sections[crit];
+    if (section == nullptr) {
+        SPDLOG_TRACE("Creating critical section {}", crit);
+        section = std::make_shared<CriticalSection>();
+    }
+
+    return section;
+}
+
+void CriticalSections::clear()
+{
+    faabric::util::FullLock lock(sectionsMx);
+    sections.clear();
+}
+
+size_t CriticalSections::size()
+{
+    faabric::util::SharedLock lock(sectionsMx);
+    return sections.size();
+}
+}
@@ -0,0 +1,178 @@
+#include <threads/FutexSync.h>
+
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+
+namespace threads {
+
+static long futex(int32_t* addr,
+                  int op,
+                  int32_t val,
+                  const struct timespec* timeout = nullptr,
+                  uint32_t bitset = 0)
+{
+    return ::syscall(SYS_futex, addr, op, val, timeout, nullptr, bitset);
+}
+
+static void futexWait(int32_t* addr, int32_t expected)
+{
+    futex(addr, FUTEX_WAIT_PRIVATE, expected);
+}
+
+static void futexWake(int32_t* addr, int32_t nWaiters)
+{
+    futex(addr, FUTEX_WAKE_PRIVATE, nWaiters);
+}
+
+static inline void cpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#else
+    std::this_thread::yield();
+#endif
+}
+
+// Takes the mutex, marking it contended so that the unlock wakes a waiter
+static void lockContended(std::atomic_ref<int32_t>& state, int32_t* mx)
+{
+    int32_t c = state.exchange(2, std::memory_order_acquire);
+    while (c != 0) {
+        futexWait(mx, 2);
+        c = state.exchange(2, std::memory_order_acquire);
+    }
+}
+
+void futexMutexLock(int32_t* mx)
+{
+    std::atomic_ref<int32_t> state(*mx);
+
+    for (int i = 0; i < FUTEX_SPIN_COUNT; i++) {
+        int32_t c = 0;
+        if (state.compare_exchange_weak(
+              c, 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+            return;
+        }
+
+        // Already has waiters, so don't bother spinning
+        if (c == 2) {
+            break;
+        }
+
+        cpuRelax();
+    }
+
+    lockContended(state, mx);
+}
+
+bool futexMutexTryLock(int32_t* mx)
+{
+    std::atomic_ref<int32_t> state(*mx);
+
+    int32_t c = 0;
+    return state.compare_exchange_strong(
+      c, 1, std::memory_order_acquire, std::memory_order_relaxed);
+}
+
+void futexMutexUnlock(int32_t* mx)
+{
+    std::atomic_ref<int32_t> state(*mx);
+
+    if (state.fetch_sub(1, std::memory_order_release) != 1) {
+        state.store(0, std::memory_order_release);
+        futexWake(mx, 1);
+    }
+}
+
+int futexCondWait(int32_t* cond,
+                  int32_t* mx,
+                  const struct timespec* absTimeout)
+{
+    std::atomic_ref<int32_t> seq(*cond);
+    std::atomic_ref<int32_t> state(*mx);
+
+    // Read the sequence while holding the mutex, so any signal after the
+    // unlock changes it and the wait returns immediately
+    int32_t expected = seq.load(std::memory_order_relaxed);
+    futexMutexUnlock(mx);
+
+    int res = 0;
+    if (absTimeout == nullptr) {
+        futexWait(cond, expected);
+    } else {
+        long r = futex(cond,
+                       FUTEX_WAIT_BITSET_PRIVATE | FUTEX_CLOCK_REALTIME,
+                       expected,
+                       absTimeout,
+                       FUTEX_BITSET_MATCH_ANY);
+        if (r == -1 && errno == ETIMEDOUT) {
+            res = ETIMEDOUT;
+        }
+    }
+
+    // Other waiters may have been woken with us, so take the mutex as
+    // contended
+    lockContended(state, mx);
+
+    return res;
+}
+
+void futexCondSignal(int32_t* cond)
+{
+    std::atomic_ref<int32_t> seq(*cond);
+    seq.fetch_add(1, std::memory_order_release);
+    futexWake(cond, 1);
+}
+
+void futexCondBroadcast(int32_t* cond)
+{
+    std::atomic_ref<int32_t> seq(*cond);
+    seq.fetch_add(1, std::memory_order_release);
+    futexWake(cond, INT_MAX);
+}
+
+void futexBarrierInit(int32_t* barrier, int32_t count)
+{
+    barrier[0] = count;
+    barrier[1] = 0;
+    barrier[2] = 0;
+}
+
+bool futexBarrierWait(int32_t* barrier)
+{
+    int32_t count = barrier[0];
+    std::atomic_ref<int32_t> arrived(barrier[1]);
+    std::atomic_ref<int32_t> generation(barrier[2]);
+
+    int32_t gen = generation.load(std::memory_order_acquire);
+
+    // The last thread in resets the count before releasing the others, so
+    // they can't start arriving at the next round early
+    if (arrived.fetch_add(1, std::memory_order_acq_rel) + 1 >= count) {
+        arrived.store(0, std::memory_order_relaxed);
+        generation.fetch_add(1, std::memory_order_release);
+        futexWake(&barrier[2], INT_MAX);
+        return true;
+    }
+
+    for (int i = 0; i < FUTEX_SPIN_COUNT; i++) {
+        if (generation.load(std::memory_order_acquire) != gen) {
+            return false;
+        }
+        cpuRelax();
+    }
+
+    while (generation.load(std::memory_order_acquire) == gen) {
+        futexWait(&barrier[2], gen);
+    }
+
+    return false;
+}
+}
@@ -0,0 +1,39 @@
+#include <threads/FutexSync.h>
+#include <threads/LocalTeam.h>
+
+namespace threads {
+
+static thread_local std::shared_ptr<LocalTeam> currentTeam = nullptr;
+
+std::shared_ptr<LocalTeam> getCurrentLocalTeam()
+{
+    return currentTeam;
+}
+
+void setCurrentLocalTeam(std::shared_ptr<LocalTeam> team)
+{
+    currentTeam = std::move(team);
+}
+
+LocalTeam::LocalTeam(int groupIdIn, int sizeIn)
+  : groupId(groupIdIn)
+  , size(sizeIn)
+{
+    futexBarrierInit(barrierWords, size);
+}
+
+void LocalTeam::barrier()
+{
+    futexBarrierWait(barrierWords);
+}
+
+void LocalTeam::lock()
+{
+    teamMx.lock();
+}
+
+void LocalTeam::unlock()
+{
+    teamMx.unlock();
+}
+}
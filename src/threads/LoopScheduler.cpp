@@ -0,0 +1,118 @@
+#include <threads/LoopScheduler.h>
+
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+
+namespace threads {
+
+static std::mutex loopsMx;
+
+static std::map<std::pair<int, int>, std::shared_ptr<DynamicLoop>> loops;
+
+uint64_t getLoopChunkSize(LoopSchedule schedule,
+                          uint64_t remaining,
+                          uint64_t chunk,
+                          int nThreads)
+{
+    uint64_t size = chunk;
+    if (schedule == LoopSchedule::Guided) {
+        uint64_t divisor = 2 * (uint64_t)nThreads;
+        size = std::max(chunk, (remaining + divisor - 1) / divisor);
+    }
+
+    return std::min(size, remaining);
+}
+
+DynamicLoop::DynamicLoop(LoopSchedule scheduleIn,
+                         uint64_t tripCountIn,
+                         uint64_t chunkIn,
+                         int nThreadsIn)
+  : schedule(scheduleIn)
+  , tripCount(tripCountIn)
+  , chunk(std::max<uint64_t>(chunkIn, 1))
+  , nThreads(nThreadsIn)
+{}
+
+bool DynamicLoop::next(uint64_t& start, uint64_t& size)
+{
+    // Dynamic chunks are all the same size, so a single add claims one
+    if (schedule == LoopSchedule::Dynamic) {
+        start = nextIteration.fetch_add(chunk, std::memory_order_relaxed);
+        if (start >= tripCount) {
+            return false;
+        }
+
+        size = std::min(chunk, tripCount - start);
+        return true;
+    }
+
+    // Guided chunks depend on how many iterations are left
+    start = nextIteration.load(std::memory_order_relaxed);
+    while (start < tripCount) {
+        size = getLoopChunkSize(schedule, tripCount - start, chunk, nThreads);
+        if (nextIteration.compare_exchange_weak(
+              start, start + size, std::memory_order_relaxed)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool DynamicLoop::finish()
+{
+    return nFinished.fetch_add(1, std::memory_order_acq_rel) + 1 >= nThreads;
+}
+
+std::shared_ptr<DynamicLoop> getOrCreateDynamicLoop(int groupId,
+                                                    int loopIdx,
+                                                    LoopSchedule schedule,
+                                                    uint64_t tripCount,
+                                                    uint64_t chunk,
+                                                    int nThreads)
+{
+    faabric::util::UniqueLock lock(loopsMx);
+
+    auto key = std::make_pair(groupId, loopIdx);
+    auto it = loops.find(key);
+    if (it != loops.end()) {
+        return it->second;
+    }
+
+    SPDLOG_TRACE("Creating dynamic loop {}:{} with {} iterations",
+                 groupId,
+                 loopIdx,
+                 tripCount);
+
+    auto loop =
+      std::make_shared<DynamicLoop>(schedule, tripCount, chunk, nThreads);
+    loops.emplace(key, loop);
+
+    return loop;
+}
+
+void finishDynamicLoop(int groupId, int loopIdx)
+{
+    faabric::util::UniqueLock lock(loopsMx);
+
+    auto it = loops.find(std::make_pair(groupId, loopIdx));
+    if (it == loops.end()) {
+        SPDLOG_ERROR("Finishing unknown dynamic loop {}:{}", groupId, loopIdx);
+        throw std::runtime_error("Finishing unknown dynamic loop");
+    }
+
+    if (it->second->finish()) {
+        loops.erase(it);
+    }
+}
+
+void clearDynamicLoops()
+{
+    faabric::util::UniqueLock lock(loopsMx);
+    loops.clear();
+}
+}
@@ -0,0 +1,96 @@
+#include <threads/ParkedTeam.h>
+
+#include <faabric/util/logging.h>
+
+#include <algorithm>
+
+// Polls of the generation before a parked thread waits on the futex
+#define PARKED_TEAM_SPIN_COUNT 1000
+
+namespace threads {
+
+ParkedTeam::ParkedTeam(int nThreadsIn)
+  : nThreads(nThreadsIn)
+  , errors(nThreadsIn, nullptr)
+{
+    SPDLOG_DEBUG("Starting parked team of {} threads", nThreads);
+
+    for (int i = 0; i < nThreads; i++) {
+        threads.emplace_back([this, i] { workerLoop(i); });
+    }
+}
+
+ParkedTeam::~ParkedTeam()
+{
+    SPDLOG_DEBUG("Stopping parked team of {} threads", nThreads);
+
+    stopping = true;
+    generation.fetch_add(1, std::memory_order_release);
+    generation.notify_all();
+
+    for (auto& t : threads) {
+        if (t.joinable()) {
+            t.join();
+        }
+    }
+}
+
+void ParkedTeam::run(const std::function<void(int)>& job)
+{
+    currentJob = &job;
+    std::fill(errors.begin(), errors.end(), nullptr);
+    nRunning.store(nThreads, std::memory_order_relaxed);
+
+    // Publishes the job and everything above to the threads
+    generation.fetch_add(1, std::memory_order_release);
+    generation.notify_all();
+
+    int running = nRunning.load(std::memory_order_acquire);
+    while (running != 0) {
+        nRunning.wait(running, std::memory_order_acquire);
+        running = nRunning.load(std::memory_order_acquire);
+    }
+
+    currentJob = nullptr;
+
+    for (auto& e : errors) {
+        if (e != nullptr) {
+            std::rethrow_exception(e);
+        }
+    }
+}
+
+void ParkedTeam::workerLoop(int threadNum)
+{
+    uint32_t seen = 0;
+    while (true) {
+        // Short regions usually follow one another quickly, so spin before
+        // parking
+        uint32_t current = generation.load(std::memory_order_acquire);
+        for (int i = 0; i < PARKED_TEAM_SPIN_COUNT && current == seen; i++) {
+            std::this_thread::yield();
+            current = generation.load(std::memory_order_acquire);
+        }
+
+        while (current == seen) {
+            generation.wait(seen, std::memory_order_acquire);
+            current = generation.load(std::memory_order_acquire);
+        }
+
+        seen = current;
+        if (stopping) {
+            return;
+        }
+
+        try {
+            (*currentJob)(threadNum);
+        } catch (...) {
+            errors.at(threadNum) = std::current_exception();
+        }
+
+        if (nRunning.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            nRunning.notify_all();
+        }
+    }
+}
+}
@@ -0,0 +1,101 @@
+#include <threads/ReductionTree.h>
+
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+
+#include <thread>
+#include <unordered_map>
+
+// Polls before a waiting thread yields
+#define REDUCTION_SPIN_COUNT 100
+
+namespace threads {
+
+static std::mutex treesMx;
+
+static std::unordered_map<int, std::weak_ptr<ReductionTree>> trees;
+
+static void awaitRound(const std::atomic<uint64_t>& value, uint64_t round)
+{
+    int nPolls = 0;
+    while (value.load(std::memory_order_acquire) < round) {
+        if (++nPolls >= REDUCTION_SPIN_COUNT) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+ReductionTree::ReductionTree(int nThreadsIn)
+  : nThreads(nThreadsIn)
+  , threadData(nThreadsIn, 0)
+  , threadRounds(nThreadsIn, 0)
+  , ready(new std::atomic<uint64_t>[nThreadsIn])
+{
+    for (int i = 0; i < nThreads; i++) {
+        ready[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+bool ReductionTree::reduce(int threadNum,
+                           int32_t data,
+                           const std::function<void(int32_t, int32_t)>& combine)
+{
+    uint64_t round = ++threadRounds.at(threadNum);
+    threadData.at(threadNum) = data;
+
+    for (int stride = 1; stride < nThreads; stride *= 2) {
+        // Hand this subtree up to the parent
+        if (threadNum % (2 * stride) != 0) {
+            ready[threadNum].store(round, std::memory_order_release);
+            return false;
+        }
+
+        int child = threadNum + stride;
+        if (child < nThreads) {
+            awaitRound(ready[child], round);
+            combine(data, threadData.at(child));
+        }
+    }
+
+    return true;
+}
+
+void ReductionTree::release()
+{
+    released.store(threadRounds.at(0), std::memory_order_release);
+}
+
+void ReductionTree::awaitRelease(int threadNum)
+{
+    awaitRound(released, threadRounds.at(threadNum));
+}
+
+std::shared_ptr<ReductionTree> getOrCreateReductionTree(int groupId,
+                                                        int nThreads)
+{
+    faabric::util::UniqueLock lock(treesMx);
+
+    std::shared_ptr<ReductionTree> tree = trees[groupId].lock();
+    if (tree != nullptr) {
+        return tree;
+    }
+
+    // Forget any trees no longer in use
+    for (auto it = trees.begin(); it != trees.end();) {
+        if (it->second.expired()) {
+            it = trees.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    SPDLOG_TRACE("Creating reduction tree for group {} ({} threads)",
+                 groupId,
+                 nThreads);
+
+    tree = std::make_shared<ReductionTree>(nThreads);
+    trees[groupId] = tree;
+
+    return tree;
+}
+}
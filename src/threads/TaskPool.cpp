@@ -0,0 +1,175 @@
+#include <threads/TaskPool.h>
+
+#include <faabric/util/locks.h>
+#include <faabric/util/logging.h>
+
+#include <thread>
+#include <unordered_map>
+
+// Empty polls before a waiting thread yields
+#define TASK_SPIN_COUNT 100
+
+namespace threads {
+
+static std::mutex poolsMx;
+
+static std::unordered_map<int, std::weak_ptr<TaskPool>> pools;
+
+static thread_local ThreadTasks threadTasks;
+
+TaskGroup::TaskGroup(std::shared_ptr<TaskGroup> parentIn)
+  : parent(std::move(parentIn))
+{}
+
+Task::Task(int32_t taskPtrIn,
+           std::shared_ptr<Task> parentIn,
+           std::shared_ptr<TaskGroup> groupIn)
+  : taskPtr(taskPtrIn)
+  , parent(std::move(parentIn))
+  , group(std::move(groupIn))
+  , currentGroup(group)
+{}
+
+void TaskDeque::push(std::shared_ptr<Task> task)
+{
+    faabric::util::UniqueLock lock(mx);
+    tasks.push_back(std::move(task));
+}
+
+std::shared_ptr<Task> TaskDeque::pop()
+{
+    faabric::util::UniqueLock lock(mx);
+    if (tasks.empty()) {
+        return nullptr;
+    }
+
+    std::shared_ptr<Task> task = std::move(tasks.back());
+    tasks.pop_back();
+    return task;
+}
+
+std::shared_ptr<Task> TaskDeque::steal()
+{
+    faabric::util::UniqueLock lock(mx);
+    if (tasks.empty()) {
+        return nullptr;
+    }
+
+    std::shared_ptr<Task> task = std::move(tasks.front());
+    tasks.pop_front();
+    return task;
+}
+
+TaskPool::TaskPool(int nThreadsIn)
+  : nThreads(nThreadsIn)
+  , deques(nThreadsIn)
+{}
+
+void TaskPool::push(int threadNum, std::shared_ptr<Task> task)
+{
+    nPending.fetch_add(1, std::memory_order_acq_rel);
+
+    if (task->parent != nullptr) {
+        task->parent->nIncompleteChildren.fetch_add(1,
+                                                    std::memory_order_acq_rel);
+    }
+
+    if (task->group != nullptr) {
+        task->group->nIncomplete.fetch_add(1, std::memory_order_acq_rel);
+    }
+
+    deques.at(threadNum).push(std::move(task));
+}
+
+std::shared_ptr<Task> TaskPool::next(int threadNum)
+{
+    std::shared_ptr<Task> task = deques.at(threadNum).pop();
+    if (task != nullptr) {
+        return task;
+    }
+
+    // Try the other threads in turn, starting with the next one along so
+    // that thieves spread out
+    for (int i = 1; i < nThreads; i++) {
+        task = deques.at((threadNum + i) % nThreads).steal();
+        if (task != nullptr) {
+            return task;
+        }
+    }
+
+    return nullptr;
+}
+
+void TaskPool::complete(const std::shared_ptr<Task>& task)
+{
+    if (task->group != nullptr) {
+        task->group->nIncomplete.fetch_sub(1, std::memory_order_acq_rel);
+    }
+
+    if (task->parent != nullptr) {
+        task->parent->nIncompleteChildren.fetch_sub(1,
+                                                    std::memory_order_acq_rel);
+    }
+
+    nPending.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+int TaskPool::getPendingCount()
+{
+    return nPending.load(std::memory_order_acquire);
+}
+
+void TaskPool::executeUntil(
+  int threadNum,
+  const std::function<bool()>& done,
+  const std::function<void(std::shared_ptr<Task>)>& exec)
+{
+    int nEmpty = 0;
+    while (!done()) {
+        std::shared_ptr<Task> task = next(threadNum);
+        if (task != nullptr) {
+            nEmpty = 0;
+            exec(std::move(task));
+            continue;
+        }
+
+        // Whatever we're waiting for is executing on another thread
+        if (++nEmpty >= TASK_SPIN_COUNT) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+std::shared_ptr<TaskPool> getOrCreateTaskPool(int groupId, int nThreads)
+{
+    faabric::util::UniqueLock lock(poolsMx);
+
+    std::shared_ptr<TaskPool> pool = pools[groupId].lock();
+    if (pool != nullptr) {
+        return pool;
+    }
+
+    // Forget any pools no longer in use
+    for (auto it = pools.begin(); it != pools.end();) {
+        if (it->second.expired()) {
+            it = pools.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    SPDLOG_TRACE("Creating task pool for group {} ({} threads)",
+                 groupId,
+                 nThreads);
+
+    pool = std::make_shared<TaskPool>(nThreads);
+    pools[groupId] = pool;
+
+    return pool;
+}
+
+ThreadTasks& getThreadTasks()
+{
+    return threadTasks;
+}
+}
@@ -52,6 +52,8 @@ std::shared_ptr<Level> getCurrentOpenMPLevel()
           faabric::scheduler::getScheduler().getThisHostResources().slots();
         SPDLOG_DEBUG("Creating default OpenMP level with {} threads", nThreads);
         currentLevel = std::make_shared<Level>(nThreads);
+        currentLevel->maxActiveLevels =
+          conf::getFaasmConfig().ompMaxActiveLevels;
     }
 
     return currentLevel;
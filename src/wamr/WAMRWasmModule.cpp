@@ -1,9 +1,11 @@
+#include <conf/FaasmConfig.h>
 #include <storage/FileLoader.h>
 #include <wamr/WAMRWasmModule.h>
 #include <wamr/native.h>
 #include <wasm/WasmExecutionContext.h>
 #include <wasm/WasmModule.h>
 
+#include <faabric/util/func.h>
 #include <faabric/util/locks.h>
 #include <faabric/util/logging.h>
 #include <faabric/util/string_tools.h>
@@ -66,6 +68,10 @@ WAMRWasmModule::WAMRWasmModule(int threadPoolSizeIn)
 
 WAMRWasmModule::~WAMRWasmModule()
 {
+    // Any background pthread dispatches use the thread instances
+    awaitPthreadDispatchers();
+    destroyThreadExecEnvs();
+
     wasm_runtime_deinstantiate(moduleInstance);
     wasm_runtime_unload(wasmModule);
 }
@@ -108,8 +114,12 @@ void WAMRWasmModule::doBindToFunction(faabric::Message& msg, bool cache)
 
     currentBrk.store(getMemorySizeBytes(), std::memory_order_release);
 
-    // Set up thread stacks
-    createThreadStacks();
+    // Thread stacks, task memory and instances are created on first use, but
+    // the table recording the stacks must be at the same offset on all hosts
+    createThreadStackTable();
+    resetThreadStacks();
+    resetTaskMemory();
+    destroyThreadExecEnvs();
 }
 
 int32_t WAMRWasmModule::executeFunction(faabric::Message& msg)
@@ -139,6 +149,112 @@ int32_t WAMRWasmModule::executeFunction(faabric::Message& msg)
     return returnValue;
 }
 
+int32_t WAMRWasmModule::executePthread(int threadPoolIdx,
+                                       uint32_t stackTop,
+                                       faabric::Message& msg)
+{
+    std::string funcStr = faabric::util::funcToString(msg, false);
+    SPDLOG_DEBUG(
+      "WAMR module executing pthread {} for {}", threadPoolIdx, funcStr);
+
+    WASMExecEnv* execEnv = getThreadExecEnv(threadPoolIdx, stackTop);
+
+    // The single argument is passed as a string in the input data, and WAMR
+    // writes the return value over the first argument
+    std::vector<uint32_t> argv = { (uint32_t)std::stoi(msg.inputdata()) };
+    bool success =
+      wasm_runtime_call_indirect(execEnv, msg.funcptr(), 1, argv.data());
+
+    int32_t returnValue = argv[0];
+    if (!success) {
+        WASMModuleInstanceCommon* threadInstance =
+          wasm_runtime_get_module_inst(execEnv);
+        SPDLOG_ERROR("Failed to execute pthread from function pointer {}: {}",
+                     msg.funcptr(),
+                     wasm_runtime_get_exception(threadInstance));
+        wasm_runtime_clear_exception(threadInstance);
+
+        returnValue = 1;
+    }
+
+    msg.set_returnvalue(returnValue);
+
+    return returnValue;
+}
+
+WASMExecEnv* WAMRWasmModule::getThreadExecEnv(int threadPoolIdx,
+                                              uint32_t stackTop)
+{
+    WASMExecEnv* execEnv = nullptr;
+    {
+        std::unique_lock<std::mutex> lock(threadExecEnvsMx);
+        if (threadExecEnvs.empty()) {
+            threadExecEnvs.assign(threadPoolSize, nullptr);
+        }
+        execEnv = threadExecEnvs.at(threadPoolIdx);
+
+        if (execEnv == nullptr) {
+            WASMModuleInstanceCommon* threadInstance =
+              wasm_runtime_instantiate_internal(wasmModule,
+                                                true,
+                                                STACK_SIZE_KB,
+                                                0,
+                                                errorBuffer,
+                                                ERROR_BUFFER_SIZE);
+            if (threadInstance == nullptr) {
+                SPDLOG_ERROR("Failed to instantiate WAMR thread instance: {}",
+                             std::string(errorBuffer));
+                throw std::runtime_error("Failed to create WAMR thread");
+            }
+
+            // Sub-instances only share memory if it's declared as shared
+            if (wasm_runtime_addr_app_to_native(threadInstance, 0) !=
+                wasm_runtime_addr_app_to_native(moduleInstance, 0)) {
+                wasm_runtime_deinstantiate_internal(threadInstance, true);
+                SPDLOG_ERROR("WAMR threads need shared memory ({})",
+                             boundFunction);
+                throw std::runtime_error("WAMR threads need shared memory");
+            }
+
+            execEnv = wasm_exec_env_create(threadInstance, STACK_SIZE_KB);
+            if (execEnv == nullptr) {
+                wasm_runtime_deinstantiate_internal(threadInstance, true);
+                SPDLOG_ERROR("Failed to create exec env for WAMR thread {}",
+                             threadPoolIdx);
+                throw std::runtime_error("Failed to create WAMR exec env");
+            }
+
+            threadExecEnvs.at(threadPoolIdx) = execEnv;
+        }
+    }
+
+    // The executing thread and its stack may change between uses
+    wasm_exec_env_set_thread_info(execEnv);
+    if (!wasm_exec_env_set_aux_stack(
+          execEnv, stackTop, THREAD_STACK_SIZE - 16)) {
+        SPDLOG_ERROR("Failed to set WAMR thread stack to {}", stackTop);
+        throw std::runtime_error("Failed to set WAMR thread stack");
+    }
+
+    return execEnv;
+}
+
+void WAMRWasmModule::destroyThreadExecEnvs()
+{
+    std::unique_lock<std::mutex> lock(threadExecEnvsMx);
+    for (WASMExecEnv* execEnv : threadExecEnvs) {
+        if (execEnv == nullptr) {
+            continue;
+        }
+
+        WASMModuleInstanceCommon* threadInstance =
+          wasm_runtime_get_module_inst(execEnv);
+        wasm_exec_env_destroy(execEnv);
+        wasm_runtime_deinstantiate_internal(threadInstance, true);
+    }
+    threadExecEnvs.clear();
+}
+
 int WAMRWasmModule::executeWasmFunctionFromPointer(int wasmFuncPtr)
 {
     // NOTE: WAMR doesn't provide a nice interface for calling functions using
@@ -324,7 +440,19 @@ uint32_t WAMRWasmModule::shrinkMemory(size_t nBytes)
 
 uint32_t WAMRWasmModule::mmapMemory(size_t nBytes)
 {
-    return growMemory(nBytes);
+    // The mmap interface allows non page-aligned values, and rounds up
+    return growMemory(roundUpToWasmPageAligned(nBytes));
+}
+
+void WAMRWasmModule::unmapMemory(uint32_t offset, size_t nBytes)
+{
+    if (nBytes == 0) {
+        return;
+    }
+
+    // Memory is not reclaimed, but file-backed pages must be released
+    releaseFileMappings(offset, nBytes);
+    SPDLOG_WARN("WAMR ignoring unmap memory {} at {}", nBytes, offset);
 }
 
 size_t WAMRWasmModule::getMemorySizeBytes()
@@ -337,8 +465,10 @@ size_t WAMRWasmModule::getMemorySizeBytes()
 
 uint8_t* WAMRWasmModule::getMemoryBase()
 {
-    SPDLOG_WARN("WAMR getMemoryBase not implemented");
-    return nullptr;
+    auto aotModule = reinterpret_cast<AOTModuleInstance*>(moduleInstance);
+    AOTMemoryInstance* aotMem =
+      ((AOTMemoryInstance**)aotModule->memories.ptr)[0];
+    return static_cast<uint8_t*>(aotMem->memory_data.ptr);
 }
 
 size_t WAMRWasmModule::getMaxMemoryPages()
@@ -362,10 +492,4 @@ std::vector<std::string> WAMRWasmModule::getArgv()
 {
     return argv;
 }
-
-uint32_t WAMRWasmModule::mmapFile(uint32_t fp, size_t length)
-{
-    // TODO - implement
-    return 0;
-}
 }
@@ -1,6 +1,7 @@
 #include <conf/FaasmConfig.h>
 #include <faabric/util/logging.h>
 #include <storage/FileDescriptor.h>
+#include <storage/IoEngine.h>
 #include <wamr/WAMRWasmModule.h>
 #include <wamr/native.h>
 #include <wamr/types.h>
@@ -194,10 +195,11 @@ static int32_t wasi_fd_read(wasm_exec_env_t exec_env,
 
     SPDLOG_DEBUG("S - fd_read {} ({})", fd, path);
 
-    storage::FileDescriptor fileDesc = fileSystem.getFileDescriptor(fd);
+    storage::FileDescriptor& fileDesc = fileSystem.getFileDescriptor(fd);
 
     // Translate app iovecs to native ones
-    std::vector<::iovec> ioVecBuffNative(ioVecCountWasm, (::iovec){});
+    std::vector<::iovec>& ioVecBuffNative =
+      storage::getIovecBuffer(ioVecCountWasm);
     for (int i = 0; i < ioVecCountWasm; i++) {
         module->validateWasmOffset(ioVecBuffWasm[i].buffOffset,
                                    sizeof(char) * ioVecBuffWasm[i].buffLen);
@@ -211,21 +213,39 @@ static int32_t wasi_fd_read(wasm_exec_env_t exec_env,
 
     // Read from fd
     module->validateNativePointer(bytesRead, sizeof(int32_t));
-    *bytesRead =
-      ::readv(fileDesc.getLinuxFd(), ioVecBuffNative.data(), ioVecCountWasm);
+    ssize_t n = fileDesc.read(ioVecBuffNative, ioVecCountWasm);
+    if (n < 0) {
+        return fileDesc.getWasiErrno();
+    }
+
+    *bytesRead = n;
 
     return __WASI_ESUCCESS;
 }
 
 static int32_t wasi_fd_readdir(wasm_exec_env_t exec_env,
-                               int32_t a,
-                               int32_t* b,
-                               char* c,
-                               int64_t d,
-                               int32_t e)
+                               int32_t fd,
+                               uint8_t* buf,
+                               uint32_t bufLen,
+                               int64_t startCookie,
+                               uint32_t* resSize)
 {
-    SPDLOG_DEBUG("S - fd_readdir");
-    throw std::runtime_error("fd_readdir not implemented");
+    SPDLOG_DEBUG("S - fd_readdir {} {}", fd, startCookie);
+
+    WAMRWasmModule* module = getExecutingWAMRModule();
+    if (!module->getFileSystem().fileDescriptorExists(fd)) {
+        return __WASI_EBADF;
+    }
+
+    module->validateNativePointer(resSize, sizeof(uint32_t));
+
+    storage::FileDescriptor& fileDesc =
+      module->getFileSystem().getFileDescriptor(fd);
+
+    fileDesc.seekDir(startCookie);
+    *resSize = fileDesc.copyDirentsToWasiBuffer(buf, bufLen);
+
+    return __WASI_ESUCCESS;
 }
 
 static int32_t wasi_fd_seek(wasm_exec_env_t exec_env,
@@ -264,7 +284,8 @@ static int32_t wasi_fd_write(wasm_exec_env_t exec_env,
     module->validateNativePointer(bytesWritten, sizeof(int32_t));
 
     // Translate the app iovecs into native iovecs
-    std::vector<::iovec> ioVecBuffNative(ioVecCountWasm, (::iovec){});
+    std::vector<::iovec>& ioVecBuffNative =
+      storage::getIovecBuffer(ioVecCountWasm);
     for (int i = 0; i < ioVecCountWasm; i++) {
         module->validateWasmOffset(ioVecBuffWasm[i].buffOffset,
                                    sizeof(char) * ioVecBuffWasm[i].buffLen);
@@ -7,6 +7,9 @@
 #include <wasm/WasmModule.h>
 #include <wasm_export.h>
 
+#include <cstring>
+#include <sys/mman.h>
+
 namespace wasm {
 static int32_t __sbrk_wrapper(wasm_exec_env_t exec_env, int32_t increment)
 {
@@ -25,8 +28,96 @@ static int32_t __sbrk_wrapper(wasm_exec_env_t exec_env, int32_t increment)
     }
 }
 
+static int32_t doMmap(int32_t addr,
+                      int32_t length,
+                      int32_t prot,
+                      int32_t flags,
+                      int32_t fd,
+                      int64_t offset)
+{
+    // Only fixed mappings are placed at the requested address
+    uint32_t fixedPtr = 0;
+    if (flags & MAP_FIXED) {
+        if (addr == 0) {
+            return -EINVAL;
+        }
+        fixedPtr = addr;
+    }
+
+    WAMRWasmModule* module = getExecutingWAMRModule();
+    if (fd != -1) {
+        storage::FileDescriptor& fileDesc =
+          module->getFileSystem().getFileDescriptor(fd);
+
+        // Writes through a shared mapping would bypass the scratch
+        // filesystem's size limit
+        if (fileDesc.isScratch() && (flags & MAP_SHARED) &&
+            (prot & PROT_WRITE)) {
+            SPDLOG_WARN("Rejecting writable shared mapping of scratch fd {}",
+                        fd);
+            return -EACCES;
+        }
+
+        return module->mmapFile(
+          fileDesc.getLinuxFd(), length, prot, flags, offset, fixedPtr);
+    }
+
+    if (fixedPtr != 0) {
+        return module->mmapFixedMemory(fixedPtr, length);
+    }
+
+    return module->mmapMemory(length);
+}
+
+static int32_t mmap_wrapper(wasm_exec_env_t exec_env,
+                            int32_t addr,
+                            int32_t length,
+                            int32_t prot,
+                            int32_t flags,
+                            int32_t fd,
+                            int64_t offset)
+{
+    SPDLOG_DEBUG(
+      "S - mmap - {} {} {} {} {} {}", addr, length, prot, flags, fd, offset);
+
+    int32_t result = doMmap(addr, length, prot, flags, fd, offset);
+
+    // Callers expect MAP_FAILED and errno rather than -errno, and the guest's
+    // errno can't be set from here, so failures are fatal
+    if (result < 0 && result > -4096) {
+        SPDLOG_ERROR("mmap failed ({} - {})", -result, ::strerror(-result));
+        throw std::runtime_error("mmap failed");
+    }
+
+    return result;
+}
+
+static int32_t munmap_wrapper(wasm_exec_env_t exec_env,
+                              int32_t addr,
+                              int32_t length)
+{
+    SPDLOG_DEBUG("S - munmap - {} {}", addr, length);
+
+    getExecutingWAMRModule()->unmapMemory(addr, length);
+
+    return 0;
+}
+
+static int32_t msync_wrapper(wasm_exec_env_t exec_env,
+                             int32_t addr,
+                             int32_t length,
+                             int32_t flags)
+{
+    SPDLOG_DEBUG("S - msync - {} {} {}", addr, length, flags);
+
+    return getExecutingWAMRModule()->syncMappedFile(addr, length, flags);
+}
+
 static NativeSymbol ns[] = {
     REG_NATIVE_FUNC(__sbrk, "(i)i"),
+    REG_NATIVE_FUNC(mmap, "(iiiiiI)i"),
+    REG_NATIVE_FUNC(msync, "(iii)i"),
+    REG_NATIVE_FUNC(munmap, "(ii)i"),
 };
 
 uint32_t getFaasmMemoryApi(NativeSymbol** nativeSymbols)
@@ -1,33 +1,72 @@
+#include <threads/FutexSync.h>
+#include <threads/ThreadState.h>
+#include <wamr/WAMRWasmModule.h>
 #include <wamr/native.h>
+#include <wamr/types.h>
 #include <wasm_export.h>
 
+#include <faabric/scheduler/ExecutorContext.h>
 #include <faabric/util/logging.h>
 
+#include <cerrno>
+#include <pthread.h>
+
 namespace wasm {
 
 // -------------------------------------------
-// 14/04/21 - WAMR threading not implemented
-// All of these functions are stubbed as threading with WAMR isn't yet
-// implemented. Once it is, we will need to implement the function here,
-// exepctially the locking which is used to manage thread-safe memory
-// provisioning.
+// Pthreads are queued and awaited through the same WasmModule machinery as
+// WAVM, and each thread runs in its own instance sharing the module's memory.
+// Locks, condition variables and barriers are local only, with their state
+// held in the guest's own structs.
 // -------------------------------------------
 
+static int32_t* getSyncWordsPtr(int32_t wasmPtr, size_t nWords = 1)
+{
+    WAMRWasmModule* module = getExecutingWAMRModule();
+    module->validateWasmOffset(wasmPtr, nWords * sizeof(int32_t));
+    return reinterpret_cast<int32_t*>(module->wasmPointerToNative(wasmPtr));
+}
+
 static int32_t pthread_create_wrapper(wasm_exec_env_t exec_env,
-                                      int32_t a,
-                                      int32_t b,
-                                      int32_t c,
-                                      int32_t d)
+                                      int32_t pthreadPtr,
+                                      int32_t attrPtr,
+                                      int32_t entryFunc,
+                                      int32_t argsPtr)
 {
-    SPDLOG_DEBUG("S - pthread_create {} {} {} {}", a, b, c, d);
+    SPDLOG_DEBUG("S - pthread_create {} {} {} {}",
+                 pthreadPtr,
+                 attrPtr,
+                 entryFunc,
+                 argsPtr);
+
+    // The first field of the pthread struct points to itself
+    *getSyncWordsPtr(pthreadPtr) = pthreadPtr;
+
+    threads::PthreadCall pthreadCall;
+    pthreadCall.pthreadPtr = pthreadPtr;
+    pthreadCall.entryFunc = entryFunc;
+    pthreadCall.argsPtr = argsPtr;
+
+    getExecutingWAMRModule()->queuePthreadCall(pthreadCall);
+
     return 0;
 }
 
 static int32_t pthread_join_wrapper(wasm_exec_env_t exec_env,
-                                    int32_t a,
-                                    int32_t b)
+                                    int32_t pthreadPtr,
+                                    int32_t resPtrPtr)
 {
-    SPDLOG_DEBUG("S - pthread_join {} {}", a, b);
+    SPDLOG_DEBUG("S - pthread_join {} {}", pthreadPtr, resPtrPtr);
+
+    faabric::Message* call =
+      &faabric::scheduler::ExecutorContext::get()->getMsg();
+    int returnValue =
+      getExecutingWAMRModule()->awaitPthreadCall(call, pthreadPtr);
+
+    if (resPtrPtr != 0) {
+        *getSyncWordsPtr(resPtrPtr) = returnValue;
+    }
+
     return 0;
 }
 
@@ -43,26 +82,44 @@ static int32_t pthread_mutex_init_wrapper(wasm_exec_env_t exec_env,
                                           int32_t a,
                                           int32_t b)
 {
-    SPDLOG_DEBUG("S - pthread_mutex_init {} {}", a, b);
+    SPDLOG_TRACE("S - pthread_mutex_init {} {}", a, b);
+    *getSyncWordsPtr(a) = 0;
+
     return 0;
 }
 
 static int32_t pthread_mutex_lock_wrapper(wasm_exec_env_t exec_env, int32_t a)
 {
     SPDLOG_TRACE("S - pthread_mutex_lock {}", a);
+    threads::futexMutexLock(getSyncWordsPtr(a));
+
+    return 0;
+}
+
+static int32_t pthread_mutex_trylock_wrapper(wasm_exec_env_t exec_env,
+                                             int32_t a)
+{
+    SPDLOG_TRACE("S - pthread_mutex_trylock {}", a);
+
+    if (!threads::futexMutexTryLock(getSyncWordsPtr(a))) {
+        return EBUSY;
+    }
+
     return 0;
 }
 
 static int32_t pthread_mutex_unlock_wrapper(wasm_exec_env_t exec_env, int32_t a)
 {
     SPDLOG_TRACE("S - pthread_mutex_unlock {}", a);
+    threads::futexMutexUnlock(getSyncWordsPtr(a));
+
     return 0;
 }
 
 static int32_t pthread_mutex_destroy_wrapper(wasm_exec_env_t exec_env,
                                              int32_t a)
 {
-    SPDLOG_DEBUG("S - pthread_mutex_destroy {}", a);
+    SPDLOG_TRACE("S - pthread_mutex_destroy {}", a);
     return 0;
 }
 
@@ -70,13 +127,17 @@ static int32_t pthread_cond_init_wrapper(wasm_exec_env_t exec_env,
                                          int32_t a,
                                          int32_t b)
 {
-    SPDLOG_DEBUG("S - pthread_cond_init {}", a, b);
+    SPDLOG_TRACE("S - pthread_cond_init {} {}", a, b);
+    *getSyncWordsPtr(a) = 0;
+
     return 0;
 }
 
 static int32_t pthread_cond_signal_wrapper(wasm_exec_env_t exec_env, int32_t a)
 {
-    SPDLOG_DEBUG("S - pthread_cond_signal {}", a);
+    SPDLOG_TRACE("S - pthread_cond_signal {}", a);
+    threads::futexCondSignal(getSyncWordsPtr(a));
+
     return 0;
 }
 
@@ -84,20 +145,77 @@ static int32_t pthread_cond_wait_wrapper(wasm_exec_env_t exec_env,
                                          int32_t a,
                                          int32_t b)
 {
-    SPDLOG_DEBUG("S - pthread_cond_wait {}", a, b);
-    return 0;
+    SPDLOG_TRACE("S - pthread_cond_wait {} {}", a, b);
+    return threads::futexCondWait(getSyncWordsPtr(a), getSyncWordsPtr(b));
+}
+
+static int32_t pthread_cond_timedwait_wrapper(wasm_exec_env_t exec_env,
+                                              int32_t a,
+                                              int32_t b,
+                                              int32_t c)
+{
+    SPDLOG_TRACE("S - pthread_cond_timedwait {} {} {}", a, b, c);
+
+    WAMRWasmModule* module = getExecutingWAMRModule();
+    module->validateWasmOffset(c, sizeof(timespec_app_t));
+    auto wasmTimeout =
+      reinterpret_cast<timespec_app_t*>(module->wasmPointerToNative(c));
+
+    timespec timeout{};
+    timeout.tv_sec = wasmTimeout->tv_sec;
+    timeout.tv_nsec = wasmTimeout->tv_nsec;
+
+    return threads::futexCondWait(
+      getSyncWordsPtr(a), getSyncWordsPtr(b), &timeout);
 }
 
 static int32_t pthread_cond_broadcast_wrapper(wasm_exec_env_t exec_env,
                                               int32_t a)
 {
-    SPDLOG_DEBUG("S - pthread_cond_broadcast {}", a);
+    SPDLOG_TRACE("S - pthread_cond_broadcast {}", a);
+    threads::futexCondBroadcast(getSyncWordsPtr(a));
+
     return 0;
 }
 
 static int32_t pthread_cond_destroy_wrapper(wasm_exec_env_t exec_env, int32_t a)
 {
-    SPDLOG_DEBUG("S - pthread_cond_destroy {}", a);
+    SPDLOG_TRACE("S - pthread_cond_destroy {}", a);
+    return 0;
+}
+
+static int32_t pthread_barrier_init_wrapper(wasm_exec_env_t exec_env,
+                                            int32_t a,
+                                            int32_t b,
+                                            int32_t count)
+{
+    SPDLOG_TRACE("S - pthread_barrier_init {} {} {}", a, b, count);
+
+    if (count <= 0) {
+        return EINVAL;
+    }
+
+    threads::futexBarrierInit(getSyncWordsPtr(a, 3), count);
+
+    return 0;
+}
+
+static int32_t pthread_barrier_wait_wrapper(wasm_exec_env_t exec_env,
+                                            int32_t a)
+{
+    SPDLOG_TRACE("S - pthread_barrier_wait {}", a);
+
+    if (threads::futexBarrierWait(getSyncWordsPtr(a, 3))) {
+        return PTHREAD_BARRIER_SERIAL_THREAD;
+    }
+
+    return 0;
+}
+
+static int32_t pthread_barrier_destroy_wrapper(wasm_exec_env_t exec_env,
+                                               int32_t a)
+{
+    SPDLOG_TRACE("S - pthread_barrier_destroy {}", a);
     return 0;
 }
 
@@ -120,7 +238,7 @@ static int32_t pthread_equal_wrapper(wasm_exec_env_t exec_env,
                                      int32_t b)
 {
     SPDLOG_DEBUG("S - pthread_equal {} {}", a, b);
-    return 0;
+    return a == b;
 }
 
 static NativeSymbol ns[] = {
@@ -129,13 +247,18 @@ static NativeSymbol ns[] = {
     REG_NATIVE_FUNC(pthread_once, "(ii)i"),
     REG_NATIVE_FUNC(pthread_mutex_init, "(ii)i"),
     REG_NATIVE_FUNC(pthread_mutex_lock, "(i)i"),
+    REG_NATIVE_FUNC(pthread_mutex_trylock, "(i)i"),
     REG_NATIVE_FUNC(pthread_mutex_unlock, "(i)i"),
     REG_NATIVE_FUNC(pthread_mutex_destroy, "(i)i"),
     REG_NATIVE_FUNC(pthread_cond_init, "(ii)i"),
     REG_NATIVE_FUNC(pthread_cond_signal, "(i)i"),
     REG_NATIVE_FUNC(pthread_cond_wait, "(ii)i"),
+    REG_NATIVE_FUNC(pthread_cond_timedwait, "(iii)i"),
     REG_NATIVE_FUNC(pthread_cond_broadcast, "(i)i"),
     REG_NATIVE_FUNC(pthread_cond_destroy, "(i)i"),
+    REG_NATIVE_FUNC(pthread_barrier_init, "(iii)i"),
+    REG_NATIVE_FUNC(pthread_barrier_wait, "(i)i"),
+    REG_NATIVE_FUNC(pthread_barrier_destroy, "(i)i"),
     REG_NATIVE_FUNC(pthread_mutexattr_init, "(i)i"),
     REG_NATIVE_FUNC(pthread_mutexattr_destroy, "(i)i"),
     REG_NATIVE_FUNC(pthread_equal, "(ii)i"),
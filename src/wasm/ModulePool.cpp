@@ -0,0 +1,102 @@
+#include <wasm/ModulePool.h>
+
+#include <conf/FaasmConfig.h>
+
+#include <faabric/util/func.h>
+#include <faabric/util/logging.h>
+
+namespace wasm {
+
+ModulePool& getModulePool()
+{
+    static ModulePool pool;
+    return pool;
+}
+
+// Modules have one thread stack and execution context per pool thread, so can
+// only be reused by Faaslets with the same size pool
+static std::string getPoolKey(const faabric::Message& msg, int threadPoolSize)
+{
+    return fmt::format(
+      "{}_{}", faabric::util::funcToString(msg, false), threadPoolSize);
+}
+
+std::unique_ptr<WasmModule> ModulePool::claim(const faabric::Message& msg,
+                                              int threadPoolSize)
+{
+    std::string key = getPoolKey(msg, threadPoolSize);
+
+    std::unique_lock<std::mutex> lock(mx);
+    auto it = modules.find(key);
+    if (it == modules.end() || it->second.empty()) {
+        return nullptr;
+    }
+
+    std::unique_ptr<WasmModule> module = std::move(it->second.back());
+    it->second.pop_back();
+    pooledCount--;
+
+    SPDLOG_TRACE("Claimed pooled module for {} ({} left)", key, pooledCount);
+    return module;
+}
+
+bool ModulePool::release(const faabric::Message& msg,
+                         int threadPoolSize,
+                         std::unique_ptr<WasmModule> module)
+{
+    if (module == nullptr || !module->isBound()) {
+        return false;
+    }
+
+    const conf::FaasmConfig& conf = conf::getFaasmConfig();
+    std::string key = getPoolKey(msg, threadPoolSize);
+
+    // Done outside the lock, so Faaslets shutting down together don't queue
+    // behind each other
+    module->releaseIdleMemory();
+
+    std::unique_lock<std::mutex> lock(mx);
+    if (pooledCount >= (size_t)conf.modulePoolSize) {
+        return false;
+    }
+
+    modules[key].emplace_back(std::move(module));
+    pooledCount++;
+
+    SPDLOG_TRACE(
+      "Released module for {} to pool ({} pooled)", key, pooledCount);
+    return true;
+}
+
+size_t ModulePool::getPooledModuleCount()
+{
+    std::unique_lock<std::mutex> lock(mx);
+    return pooledCount;
+}
+
+size_t ModulePool::getPooledModuleCount(const faabric::Message& msg,
+                                        int threadPoolSize)
+{
+    std::string key = getPoolKey(msg, threadPoolSize);
+
+    std::unique_lock<std::mutex> lock(mx);
+    auto it = modules.find(key);
+    if (it == modules.end()) {
+        return 0;
+    }
+
+    return it->second.size();
+}
+
+void ModulePool::clear()
+{
+    // Destroy the modules outside the lock, as this unmaps their memory
+    std::unordered_map<std::string, std::vector<std::unique_ptr<WasmModule>>>
+      toDestroy;
+    {
+        std::unique_lock<std::mutex> lock(mx);
+        toDestroy.swap(modules);
+        pooledCount = 0;
+    }
+}
+}
@@ -0,0 +1,165 @@
+#include <wasm/PageAllocator.h>
+
+#include <algorithm>
+#include <iterator>
+
+namespace wasm {
+
+uint32_t PageAllocator::allocate(size_t nBytes)
+{
+    if (nBytes == 0) {
+        return 0;
+    }
+
+    auto best = freeRegions.end();
+    for (auto it = freeRegions.begin(); it != freeRegions.end(); it++) {
+        if (it->second < nBytes) {
+            continue;
+        }
+
+        if (best == freeRegions.end() || it->second < best->second) {
+            best = it;
+
+            // Can't do better than an exact fit
+            if (best->second == nBytes) {
+                break;
+            }
+        }
+    }
+
+    if (best == freeRegions.end()) {
+        return 0;
+    }
+
+    // Take from the bottom of the region
+    uint32_t offset = best->first;
+    size_t remainder = best->second - nBytes;
+    freeRegions.erase(best);
+    if (remainder > 0) {
+        freeRegions[offset + nBytes] = remainder;
+    }
+
+    freeBytes -= nBytes;
+    return offset;
+}
+
+void PageAllocator::free(uint32_t offset, size_t nBytes)
+{
+    if (nBytes == 0) {
+        return;
+    }
+
+    size_t start = offset;
+    size_t end = start + nBytes;
+
+    // Merge with a region touching or overlapping the start
+    auto it = freeRegions.upper_bound(offset);
+    if (it != freeRegions.begin()) {
+        auto prev = std::prev(it);
+        size_t prevEnd = prev->first + prev->second;
+        if (prevEnd >= start) {
+            start = prev->first;
+            end = std::max(end, prevEnd);
+            freeBytes -= prev->second;
+            freeRegions.erase(prev);
+        }
+    }
+
+    // Merge with any regions touching or overlapping the rest
+    while (it != freeRegions.end() && it->first <= end) {
+        end = std::max(end, (size_t)it->first + it->second);
+        freeBytes -= it->second;
+        it = freeRegions.erase(it);
+    }
+
+    freeRegions[start] = end - start;
+    freeBytes += end - start;
+}
+
+void PageAllocator::reserve(uint32_t offset, size_t nBytes)
+{
+    size_t start = offset;
+    size_t end = start + nBytes;
+
+    // Start from the last region beginning before the range, it may overlap
+    auto it = freeRegions.upper_bound(offset);
+    if (it != freeRegions.begin()) {
+        it--;
+    }
+
+    while (it != freeRegions.end() && it->first < end) {
+        size_t regionStart = it->first;
+        size_t regionEnd = regionStart + it->second;
+        if (regionEnd <= start) {
+            it++;
+            continue;
+        }
+
+        // Keep any parts of the region outside the range
+        freeBytes -= it->second;
+        it = freeRegions.erase(it);
+        if (regionStart < start) {
+            freeRegions[regionStart] = start - regionStart;
+            freeBytes += start - regionStart;
+        }
+
+        if (end < regionEnd) {
+            it = freeRegions.emplace(end, regionEnd - end).first;
+            freeBytes += regionEnd - end;
+            it++;
+        }
+    }
+}
+
+uint32_t PageAllocator::trimTop(uint32_t brk)
+{
+    if (freeRegions.empty()) {
+        return brk;
+    }
+
+    auto last = std::prev(freeRegions.end());
+    if ((size_t)last->first + last->second != brk) {
+        return brk;
+    }
+
+    uint32_t newBrk = last->first;
+    freeBytes -= last->second;
+    freeRegions.erase(last);
+
+    return newBrk;
+}
+
+void PageAllocator::truncate(uint32_t top)
+{
+    auto it = freeRegions.lower_bound(top);
+    if (it != freeRegions.begin()) {
+        auto prev = std::prev(it);
+        size_t prevEnd = prev->first + prev->second;
+        if (prevEnd > top) {
+            freeBytes -= prevEnd - top;
+            prev->second = top - prev->first;
+        }
+    }
+
+    while (it != freeRegions.end()) {
+        freeBytes -= it->second;
+        it = freeRegions.erase(it);
+    }
+}
+
+void PageAllocator::clear()
+{
+    freeRegions.clear();
+    freeBytes = 0;
+}
+
+size_t PageAllocator::getFreeBytes() const
+{
+    return freeBytes;
+}
+
+size_t PageAllocator::getFreeRegionCount() const
+{
+    return freeRegions.size();
+}
+}
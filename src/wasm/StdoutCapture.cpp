@@ -0,0 +1,252 @@
+#include <wasm/StdoutCapture.h>
+
+#include <faabric/util/logging.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace wasm {
+
+StdoutCapture::StdoutCapture(size_t capacityIn,
+                             const std::string& policyIn,
+                             const std::string& sinkIn)
+  : capacity(capacityIn)
+  , sink(sinkIn)
+{
+    if (policyIn == STDOUT_POLICY_TAIL) {
+        tail = true;
+    } else if (policyIn == STDOUT_POLICY_HEAD) {
+        tail = false;
+    } else {
+        SPDLOG_ERROR("Unrecognised stdout capture policy: {}", policyIn);
+        throw std::runtime_error("Unrecognised stdout capture policy");
+    }
+
+    if (sink.starts_with(STDOUT_SINK_UNIX_PREFIX)) {
+        openSocketSink();
+    }
+}
+
+StdoutCapture::~StdoutCapture()
+{
+    closeSink();
+}
+
+void StdoutCapture::beginCall(const std::string& callName)
+{
+    std::unique_lock<std::mutex> lock(mx);
+
+    if (sink.empty()) {
+        return;
+    }
+
+    // Sockets are kept open across calls, but reconnected if they have failed
+    if (sink.starts_with(STDOUT_SINK_UNIX_PREFIX)) {
+        if (sinkFd < 0) {
+            openSocketSink();
+        }
+        return;
+    }
+
+    closeSink();
+
+    std::string filePath = sink + "/" + callName + ".stdout";
+    sinkFd =
+      ::open(filePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (sinkFd < 0) {
+        SPDLOG_WARN("Failed to open stdout sink {} ({})",
+                    filePath,
+                    ::strerror(errno));
+    }
+}
+
+size_t StdoutCapture::write(const ::iovec* iovecs, int iovecCount)
+{
+    std::unique_lock<std::mutex> lock(mx);
+
+    size_t written = 0;
+    for (int i = 0; i < iovecCount; i++) {
+        doWrite(static_cast<const uint8_t*>(iovecs[i].iov_base),
+                iovecs[i].iov_len);
+        written += iovecs[i].iov_len;
+    }
+
+    writeToSink(iovecs, iovecCount);
+
+    return written;
+}
+
+size_t StdoutCapture::write(const char* data, size_t length)
+{
+    ::iovec iov = { .iov_base = const_cast<char*>(data), .iov_len = length };
+    return write(&iov, 1);
+}
+
+void StdoutCapture::doWrite(const uint8_t* data, size_t length)
+{
+    if (length == 0 || capacity == 0) {
+        droppedBytes += length;
+        return;
+    }
+
+    if (buffer.empty()) {
+        buffer.resize(capacity);
+    }
+
+    if (!tail) {
+        // Keep what fits, drop the rest
+        size_t nCopied = std::min(length, capacity - size);
+        std::copy(data, data + nCopied, buffer.begin() + size);
+        size += nCopied;
+        droppedBytes += length - nCopied;
+        return;
+    }
+
+    // Only the last capacity bytes of a large write can survive
+    if (length >= capacity) {
+        droppedBytes += size + length - capacity;
+        std::copy(data + length - capacity, data + length, buffer.begin());
+        start = 0;
+        size = capacity;
+        return;
+    }
+
+    // Copy into the ring, wrapping around the end
+    size_t writePos = (start + size) % capacity;
+    size_t firstPart = std::min(length, capacity - writePos);
+    std::copy(data, data + firstPart, buffer.begin() + writePos);
+    std::copy(data + firstPart, data + length, buffer.begin());
+
+    // Overwrite the oldest bytes if full
+    size_t newSize = size + length;
+    if (newSize > capacity) {
+        size_t overflow = newSize - capacity;
+        start = (start + overflow) % capacity;
+        droppedBytes += overflow;
+        newSize = capacity;
+    }
+
+    size = newSize;
+}
+
+void StdoutCapture::writeToSink(const ::iovec* iovecs, int iovecCount)
+{
+    if (sinkFd < 0) {
+        return;
+    }
+
+    // Use sendmsg on sockets to avoid SIGPIPE if the reader goes away
+    ssize_t res;
+    if (sink.starts_with(STDOUT_SINK_UNIX_PREFIX)) {
+        ::msghdr msg{};
+        msg.msg_iov = const_cast<::iovec*>(iovecs);
+        msg.msg_iovlen = iovecCount;
+        res = ::sendmsg(sinkFd, &msg, MSG_NOSIGNAL);
+    } else {
+        res = ::writev(sinkFd, iovecs, iovecCount);
+    }
+
+    if (res < 0) {
+        int err = errno;
+        SPDLOG_WARN("Failed writing to stdout sink {} ({}), closing",
+                    sink,
+                    ::strerror(err));
+        closeSink();
+    }
+}
+
+void StdoutCapture::openSocketSink()
+{
+    std::string socketPath =
+      sink.substr(std::string(STDOUT_SINK_UNIX_PREFIX).size());
+
+    ::sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(addr.sun_path)) {
+        SPDLOG_ERROR("Stdout sink socket path too long: {}", socketPath);
+        throw std::runtime_error("Stdout sink socket path too long");
+    }
+    std::copy(socketPath.begin(), socketPath.end(), addr.sun_path);
+
+    sinkFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (::connect(sinkFd, (::sockaddr*)&addr, sizeof(addr)) != 0) {
+        SPDLOG_WARN("Failed to connect to stdout sink {} ({})",
+                    socketPath,
+                    ::strerror(errno));
+        closeSink();
+    }
+}
+
+void StdoutCapture::closeSink()
+{
+    if (sinkFd >= 0) {
+        ::close(sinkFd);
+        sinkFd = -1;
+    }
+}
+
+std::string StdoutCapture::read()
+{
+    std::unique_lock<std::mutex> lock(mx);
+
+    std::string marker;
+    if (droppedBytes > 0) {
+        marker = fmt::format("[{} bytes of output dropped]", droppedBytes);
+    }
+
+    std::string result;
+    result.reserve(size + marker.size() + 1);
+
+    if (tail && !marker.empty()) {
+        result += marker + "\n";
+    }
+
+    size_t firstPart = std::min(size, capacity - start);
+    result.append(reinterpret_cast<const char*>(buffer.data()) + start,
+                  firstPart);
+    result.append(reinterpret_cast<const char*>(buffer.data()),
+                  size - firstPart);
+
+    if (!tail && !marker.empty()) {
+        result += "\n" + marker;
+    }
+
+    return result;
+}
+
+void StdoutCapture::clear()
+{
+    std::unique_lock<std::mutex> lock(mx);
+
+    start = 0;
+    size = 0;
+    droppedBytes = 0;
+}
+
+size_t StdoutCapture::getSize()
+{
+    std::unique_lock<std::mutex> lock(mx);
+    return size;
+}
+
+size_t StdoutCapture::getDroppedBytes()
+{
+    std::unique_lock<std::mutex> lock(mx);
+    return droppedBytes;
+}
+
+size_t StdoutCapture::getCapacity() const
+{
+    return capacity;
+}
+
+bool StdoutCapture::isTail() const
+{
+    return tail;
+}
+}
@@ -18,9 +18,13 @@
 #include <faabric/util/snapshot.h>
 #include <faabric/util/timing.h>
 
+#include <algorithm>
 #include <boost/filesystem.hpp>
+#include <chrono>
+#include <cstring>
 #include <sstream>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/uio.h>
 
 namespace wasm {
@@ -65,7 +69,11 @@ WasmModule::WasmModule(int threadPoolSizeIn)
   , reg(faabric::snapshot::getSnapshotRegistry())
 {}
 
-WasmModule::~WasmModule() {}
+WasmModule::~WasmModule()
+{
+    awaitPthreadDispatchers();
+    stopParkedTeam();
+}
 
 void WasmModule::flush() {}
 
@@ -91,6 +99,8 @@ std::shared_ptr<faabric::util::SnapshotData> WasmModule::getSnapshotData()
     auto snap = std::make_shared<faabric::util::SnapshotData>(
       std::span<const uint8_t>(memBase, currentSize), maxSize);
 
+    addSnapshotHintsToSnapshot(snap);
+
     return snap;
 }
 
@@ -153,9 +163,25 @@ void WasmModule::restore(const std::string& snapshotKey)
     auto data = reg.getSnapshot(snapshotKey);
     setMemorySize(data->getSize());
 
-    // Map the snapshot into memory
+    // Map the snapshot into memory, this replaces any file mappings
     uint8_t* memoryBase = getMemoryBase();
     data->mapToMemory({ memoryBase, data->getSize() });
+    adviseHugePages(0, data->getSize());
+
+    {
+        faabric::util::FullLock lock(fileMappingsMutex);
+        fileMappings.clear();
+    }
+
+    // Stacks and tasks in the old memory may now be overwritten by the
+    // snapshot, only the stacks in its stack table are still valid
+    resetThreadStacks();
+    resetTaskMemory();
+
+    // Unmapped regions in the old memory mean nothing in the snapshot
+    faabric::util::FullLock lock(moduleMutex);
+    pageAllocator.clear();
+    memoryFileBacked = true;
 }
 
 void WasmModule::ignoreThreadStacksInSnapshot(const std::string& snapKey)
@@ -163,25 +189,47 @@ void WasmModule::ignoreThreadStacksInSnapshot(const std::string& snapKey)
     std::shared_ptr<faabric::util::SnapshotData> snap =
       faabric::snapshot::getSnapshotRegistry().getSnapshot(snapKey);
 
-    // Stacks grow downwards and snapshot diffs are inclusive, so we need to
-    // start the diff on the byte at the bottom of the stacks region
-    uint32_t threadStackRegionStart =
-      threadStacks.at(0) - (THREAD_STACK_SIZE - 1) - GUARD_REGION_SIZE;
+    // Stacks are allocated lazily, so each one has its own region covering the
+    // stack and the guard pages either side of it
     uint32_t threadStackRegionSize =
-      threadPoolSize * (THREAD_STACK_SIZE + (2 * GUARD_REGION_SIZE));
-
-    SPDLOG_TRACE("Ignoring snapshot diffs for {} for thread stacks: {}-{}",
-                 snapKey,
-                 threadStackRegionStart,
-                 threadStackRegionStart + threadStackRegionSize);
-
-    // Note - the merge regions for a snapshot are keyed on the offset, so
-    // we will just overwrite the same region if another module has already
-    // set it
-    snap->addMergeRegion(threadStackRegionStart,
-                         threadStackRegionSize,
-                         faabric::util::SnapshotDataType::Raw,
-                         faabric::util::SnapshotMergeOperation::Ignore);
+      THREAD_STACK_SIZE + (2 * GUARD_REGION_SIZE);
+
+    std::unique_lock<std::mutex> lock(threadStacksMx);
+
+    // Each host records its own stacks in the table
+    if (threadStackTablePtr != 0) {
+        snap->addMergeRegion(threadStackTablePtr,
+                             threadPoolSize * sizeof(uint32_t),
+                             faabric::util::SnapshotDataType::Raw,
+                             faabric::util::SnapshotMergeOperation::Ignore);
+    }
+
+    std::vector<uint32_t> allStacks = threadStacks;
+    allStacks.insert(allStacks.end(),
+                     nestedThreadStacks.begin(),
+                     nestedThreadStacks.end());
+
+    for (uint32_t stackTop : allStacks) {
+        if (stackTop == 0) {
+            continue;
+        }
+
+        uint32_t threadStackRegionStart =
+          stackTop + 16 - THREAD_STACK_SIZE - GUARD_REGION_SIZE;
+
+        SPDLOG_TRACE("Ignoring snapshot diffs for {} for thread stack: {}-{}",
+                     snapKey,
+                     threadStackRegionStart,
+                     threadStackRegionStart + threadStackRegionSize);
+
+        // Note - the merge regions for a snapshot are keyed on the offset, so
+        // we will just overwrite the same region if another module has already
+        // set it
+        snap->addMergeRegion(threadStackRegionStart,
+                             threadStackRegionSize,
+                             faabric::util::SnapshotDataType::Raw,
+                             faabric::util::SnapshotMergeOperation::Ignore);
+    }
 }
 
 std::string WasmModule::getBoundUser()
@@ -194,72 +242,61 @@ std::string WasmModule::getBoundFunction()
     return boundFunction;
 }
 
-int WasmModule::getStdoutFd()
+StdoutCapture& WasmModule::getStdoutCapture()
 {
-    if (stdoutMemFd == 0) {
-        stdoutMemFd = memfd_create("stdoutfd", 0);
-        SPDLOG_DEBUG("Capturing stdout: fd={}", stdoutMemFd);
+    std::unique_lock<std::mutex> lock(stdoutCaptureMx);
+    if (stdoutCapture == nullptr) {
+        conf::FaasmConfig& conf = conf::getFaasmConfig();
+        stdoutCapture = std::make_unique<StdoutCapture>(
+          (size_t)conf.stdoutCaptureMaxKb * 1024,
+          conf.stdoutCapturePolicy,
+          conf.stdoutSink);
+        SPDLOG_DEBUG("Capturing stdout: {} KiB ({})",
+                     conf.stdoutCaptureMaxKb,
+                     conf.stdoutCapturePolicy);
     }
 
-    return stdoutMemFd;
+    return *stdoutCapture;
 }
 
 ssize_t WasmModule::captureStdout(const struct ::iovec* iovecs, int iovecCount)
 {
-    int memFd = getStdoutFd();
-    ssize_t writtenSize = ::writev(memFd, iovecs, iovecCount);
-
-    if (writtenSize < 0) {
-        SPDLOG_ERROR("Failed capturing stdout: {}", strerror(errno));
-        throw std::runtime_error(std::string("Failed capturing stdout: ") +
-                                 strerror(errno));
-    }
+    size_t writtenSize = getStdoutCapture().write(iovecs, iovecCount);
 
     SPDLOG_DEBUG("Captured {} bytes of formatted stdout", writtenSize);
-    stdoutSize += writtenSize;
     return writtenSize;
 }
 
 ssize_t WasmModule::captureStdout(const void* buffer)
 {
-    int memFd = getStdoutFd();
-
-    ssize_t writtenSize =
-      dprintf(memFd, "%s\n", reinterpret_cast<const char*>(buffer));
-
-    if (writtenSize < 0) {
-        SPDLOG_ERROR("Failed capturing stdout: {}", strerror(errno));
-        throw std::runtime_error("Failed capturing stdout");
-    }
+    const char* str = reinterpret_cast<const char*>(buffer);
+    ::iovec iovecs[2] = {
+        { .iov_base = const_cast<char*>(str), .iov_len = ::strlen(str) },
+        { .iov_base = const_cast<char*>("\n"), .iov_len = 1 },
+    };
+    size_t writtenSize = getStdoutCapture().write(iovecs, 2);
 
     SPDLOG_DEBUG("Captured {} bytes of unformatted stdout", writtenSize);
-    stdoutSize += writtenSize;
     return writtenSize;
 }
 
 std::string WasmModule::getCapturedStdout()
 {
-    if (stdoutSize == 0) {
+    if (stdoutCapture == nullptr) {
         return "";
     }
 
-    // Go back to start
-    int memFd = getStdoutFd();
-    lseek(memFd, 0, SEEK_SET);
-
-    // Read in and return
-    std::string stdoutString(stdoutSize, '\0');
-    read(memFd, stdoutString.data(), stdoutSize);
-    SPDLOG_DEBUG("Read stdout length {}:\n{}", stdoutSize, stdoutString);
+    std::string stdoutString = stdoutCapture->read();
+    SPDLOG_DEBUG("Read stdout length {}", stdoutString.size());
 
     return stdoutString;
 }
 
 void WasmModule::clearCapturedStdout()
 {
-    close(stdoutMemFd);
-    stdoutMemFd = 0;
-    stdoutSize = 0;
+    if (stdoutCapture != nullptr) {
+        stdoutCapture->clear();
+    }
 }
 
 uint32_t WasmModule::getArgc()
@@ -272,6 +309,26 @@ uint32_t WasmModule::getArgvBufferSize()
     return argvBufferSize;
 }
 
+static bool isHugePagesEnabled(const faabric::Message& msg)
+{
+    const std::string& hugePages = conf::getFaasmConfig().hugePages;
+    if (hugePages == "on" || hugePages == "off") {
+        return hugePages == "on";
+    }
+
+    // Otherwise it's a list of functions
+    std::string funcStr = faabric::util::funcToString(msg, false);
+    std::stringstream ss(hugePages);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (item == funcStr) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 void WasmModule::bindToFunction(faabric::Message& msg, bool cache)
 {
     if (_isBound) {
@@ -281,6 +338,7 @@ void WasmModule::bindToFunction(faabric::Message& msg, bool cache)
     _isBound = true;
     boundUser = msg.user();
     boundFunction = msg.function();
+    hugePages = isHugePagesEnabled(msg);
 
     // Call into subclass hook, setting the context beforehand
     WasmExecutionContext ctx(this);
@@ -304,6 +362,327 @@ void WasmModule::prepareArgcArgv(const faabric::Message& msg)
     }
 }
 
+static void mapZeroedMemory(uint8_t* hostPtr, size_t length)
+{
+    void* res = ::mmap(hostPtr,
+                       length,
+                       PROT_READ | PROT_WRITE,
+                       MAP_FIXED | MAP_PRIVATE | MAP_ANONYMOUS,
+                       -1,
+                       0);
+    if (res == MAP_FAILED) {
+        SPDLOG_ERROR("Failed to remap zeroed memory ({} - {})",
+                     errno,
+                     ::strerror(errno));
+        throw std::runtime_error("Failed to remap zeroed memory");
+    }
+}
+
+/**
+ * Files are mapped directly over wasm memory, so no data is copied and large
+ * files can be processed by mapping windows of them in turn.
+ *
+ * Only the part of the region backed by the file is mapped from it, the rest
+ * is zeroed anonymous memory. This avoids a SIGBUS when the guest touches
+ * pages past the end of the file.
+ */
+uint32_t WasmModule::mmapFile(uint32_t fd,
+                              size_t length,
+                              int prot,
+                              int flags,
+                              off_t offset,
+                              uint32_t wasmPtr)
+{
+    size_t pageSize = faabric::util::HOST_PAGE_SIZE;
+    int shareType = flags & (MAP_SHARED | MAP_PRIVATE);
+    if (length == 0 || offset < 0 || offset % pageSize != 0 ||
+        (shareType != MAP_SHARED && shareType != MAP_PRIVATE)) {
+        SPDLOG_ERROR("Invalid file mapping (length {}, offset {}, flags {})",
+                     length,
+                     offset,
+                     flags);
+        return -EINVAL;
+    }
+
+    struct ::stat fileStat
+    {};
+    if (::fstat(fd, &fileStat) != 0) {
+        return -errno;
+    }
+
+    size_t regionLength = ((length + pageSize - 1) / pageSize) * pageSize;
+    size_t fileLength = 0;
+    if (offset < fileStat.st_size) {
+        fileLength = std::min<size_t>(regionLength, fileStat.st_size - offset);
+        fileLength = ((fileLength + pageSize - 1) / pageSize) * pageSize;
+    }
+
+    // Start from zeroed memory, as allocated memory may have been reclaimed
+    bool isNewRegion = wasmPtr == 0;
+    if (isNewRegion) {
+        wasmPtr = mmapMemory(length);
+        releaseFileMappings(wasmPtr, regionLength);
+        mapZeroedMemory(wasmPointerToNative(wasmPtr), regionLength);
+    } else {
+        uint32_t res = mmapFixedMemory(wasmPtr, regionLength);
+        if (res != wasmPtr) {
+            return res;
+        }
+    }
+
+    uint8_t* hostPtr = wasmPointerToNative(wasmPtr);
+
+    if (fileLength == 0) {
+        return wasmPtr;
+    }
+
+    int hostProt = prot & (PROT_READ | PROT_WRITE);
+    void* res =
+      ::mmap(hostPtr, fileLength, hostProt, shareType | MAP_FIXED, fd, offset);
+    if (res == MAP_FAILED) {
+        int err = errno;
+        SPDLOG_ERROR("Failed mmapping file descriptor {} ({} - {})",
+                     fd,
+                     err,
+                     ::strerror(err));
+
+        mapZeroedMemory(hostPtr, fileLength);
+        if (isNewRegion) {
+            unmapMemory(wasmPtr, length);
+        }
+
+        return -err;
+    }
+
+    faabric::util::FullLock lock(fileMappingsMutex);
+    fileMappings[wasmPtr] = fileLength;
+
+    return wasmPtr;
+}
+
+/**
+ * Like an anonymous MAP_FIXED mapping, this replaces whatever is at the given
+ * address with zeroed memory. The region must be below the break, as memory
+ * above it is handed out when the break grows.
+ */
+uint32_t WasmModule::mmapFixedMemory(uint32_t wasmPtr, size_t length)
+{
+    size_t pageSize = faabric::util::HOST_PAGE_SIZE;
+    size_t regionLength = ((length + pageSize - 1) / pageSize) * pageSize;
+    if (length == 0 || wasmPtr % pageSize != 0 ||
+        wasmPtr + regionLength > getCurrentBrk()) {
+        SPDLOG_ERROR(
+          "Invalid fixed mapping at {} ({} bytes)", wasmPtr, regionLength);
+        return -EINVAL;
+    }
+
+    {
+        // The region may have been unmapped, so it must not be handed out
+        // again. Free memory is tracked in whole wasm pages.
+        faabric::util::FullLock lock(moduleMutex);
+        size_t start = (wasmPtr / WASM_BYTES_PER_PAGE) * WASM_BYTES_PER_PAGE;
+        size_t end = wasmPtr + regionLength;
+        end = ((end + WASM_BYTES_PER_PAGE - 1) / WASM_BYTES_PER_PAGE) *
+              WASM_BYTES_PER_PAGE;
+        pageAllocator.reserve(start, end - start);
+    }
+
+    releaseFileMappings(wasmPtr, regionLength);
+    mapZeroedMemory(wasmPointerToNative(wasmPtr), regionLength);
+
+    return wasmPtr;
+}
+
+MemoryStats WasmModule::getMemoryStats()
+{
+    faabric::util::SharedLock lock(moduleMutex);
+
+    MemoryStats stats = memoryStats;
+    stats.growCount = growCount.load(std::memory_order_relaxed);
+    stats.grownBytes = grownBytes.load(std::memory_order_relaxed);
+    stats.peakBrk = peakBrk.load(std::memory_order_relaxed);
+    stats.freeBytes = pageAllocator.getFreeBytes();
+    stats.freeRegionCount = pageAllocator.getFreeRegionCount();
+
+    return stats;
+}
+
+void WasmModule::recordMemoryGrowth(size_t nBytes, size_t newBrk)
+{
+    growCount.fetch_add(1, std::memory_order_relaxed);
+    grownBytes.fetch_add(nBytes, std::memory_order_relaxed);
+
+    size_t peak = peakBrk.load(std::memory_order_relaxed);
+    while (newBrk > peak && !peakBrk.compare_exchange_weak(
+                              peak, newBrk, std::memory_order_relaxed)) {
+    }
+}
+
+void WasmModule::resetMemoryStats()
+{
+    memoryStats = MemoryStats();
+    growCount = 0;
+    grownBytes = 0;
+    peakBrk = 0;
+}
+
+/**
+ * Anonymous pages are dropped with MADV_DONTNEED, which keeps the mapping
+ * intact. After restoring a snapshot memory is a private mapping of the
+ * snapshot, where MADV_DONTNEED would bring back the snapshot's contents, so
+ * instead fresh anonymous pages are mapped over the range.
+ */
+void WasmModule::releaseMemoryPages(uint32_t wasmPtr, size_t length)
+{
+    size_t pageSize = faabric::util::HOST_PAGE_SIZE;
+    size_t start = ((wasmPtr + pageSize - 1) / pageSize) * pageSize;
+    size_t end = ((wasmPtr + length) / pageSize) * pageSize;
+    if (end <= start) {
+        return;
+    }
+
+    uint8_t* hostPtr = wasmPointerToNative(start);
+    if (memoryFileBacked) {
+        mapZeroedMemory(hostPtr, end - start);
+        adviseHugePages(start, end - start);
+    } else if (::madvise(hostPtr, end - start, MADV_DONTNEED) != 0) {
+        SPDLOG_ERROR("Failed to release memory {}-{} ({} - {})",
+                     start,
+                     end,
+                     errno,
+                     ::strerror(errno));
+        throw std::runtime_error("Failed to release memory");
+    }
+
+    memoryStats.releasedBytes += end - start;
+}
+
+/**
+ * Nothing above the break is in use. Below it, a reset module's memory is a
+ * private mapping of the snapshot with no changes of its own, so dropping its
+ * pages only means they're read from the snapshot again when touched. Other
+ * memory below the break can't be dropped, as it would read as zero.
+ */
+void WasmModule::releaseIdleMemory()
+{
+    uint32_t brk = getCurrentBrk();
+    size_t memSize = getMemorySizeBytes();
+    if (memSize > brk) {
+        releaseMemoryPages(brk, memSize - brk);
+    }
+
+    if (!memoryFileBacked || brk == 0) {
+        return;
+    }
+
+    if (::madvise(getMemoryBase(), brk, MADV_DONTNEED) != 0) {
+        SPDLOG_ERROR("Failed to release idle memory below {} ({} - {})",
+                     brk,
+                     errno,
+                     ::strerror(errno));
+        throw std::runtime_error("Failed to release idle memory");
+    }
+
+    memoryStats.releasedBytes += brk;
+}
+
+/**
+ * Huge pages can only back 2MB-aligned ranges of host memory, so the advice
+ * is widened to the 2MB boundaries around the range, otherwise the kernel
+ * would split the mapping part way through a huge page. Snapshot diffs and
+ * releasing memory still work on host pages, and the kernel splits any huge
+ * pages this touches. Memory that is a private mapping of a snapshot only gets
+ * huge pages for reads, and only if shmem huge pages are set to advise.
+ */
+void WasmModule::adviseHugePages(uint32_t wasmPtr, size_t length)
+{
+    if (!hugePages || length == 0) {
+        return;
+    }
+
+    uintptr_t memBase = (uintptr_t)getMemoryBase();
+    uintptr_t start = (memBase + wasmPtr) & ~(HUGE_PAGE_SIZE - 1);
+    uintptr_t end =
+      (memBase + wasmPtr + length + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+
+    // Don't stray outside the memory, any partial huge page at the top gets
+    // advised when memory grows into it
+    start = std::max(start, memBase);
+    end = std::min(end, memBase + getMemorySizeBytes());
+    if (end <= start) {
+        return;
+    }
+
+    if (::madvise((void*)start, end - start, MADV_HUGEPAGE) != 0) {
+        SPDLOG_WARN("Failed to advise huge pages for {}/{} ({}), disabling",
+                    boundUser,
+                    boundFunction,
+                    ::strerror(errno));
+        hugePages = false;
+        return;
+    }
+
+    memoryStats.hugePageBytes += end - start;
+}
+
+int WasmModule::syncMappedFile(uint32_t wasmPtr, size_t length, int flags)
+{
+    if (wasmPtr % faabric::util::HOST_PAGE_SIZE != 0) {
+        return -EINVAL;
+    }
+
+    if (wasmPtr + length > getMemorySizeBytes()) {
+        return -ENOMEM;
+    }
+
+    if (::msync(wasmPointerToNative(wasmPtr), length, flags) != 0) {
+        return -errno;
+    }
+
+    return 0;
+}
+
+void WasmModule::releaseFileMappings(uint32_t wasmPtr, size_t length)
+{
+    size_t pageSize = faabric::util::HOST_PAGE_SIZE;
+    size_t start = (wasmPtr / pageSize) * pageSize;
+    size_t end = ((wasmPtr + length + pageSize - 1) / pageSize) * pageSize;
+
+    faabric::util::FullLock lock(fileMappingsMutex);
+
+    // Start from the last mapping beginning before the range, it may overlap
+    auto it = fileMappings.upper_bound(start);
+    if (it != fileMappings.begin()) {
+        it--;
+    }
+
+    while (it != fileMappings.end() && it->first < end) {
+        size_t mapStart = it->first;
+        size_t mapEnd = mapStart + it->second;
+        if (mapEnd <= start) {
+            it++;
+            continue;
+        }
+
+        size_t overlapStart = std::max(mapStart, start);
+        size_t overlapEnd = std::min(mapEnd, end);
+        SPDLOG_TRACE(
+          "MEM - releasing file mapping {}-{}", overlapStart, overlapEnd);
+        mapZeroedMemory(wasmPointerToNative(overlapStart),
+                        overlapEnd - overlapStart);
+
+        // Keep track of any parts of the mapping outside the range
+        it = fileMappings.erase(it);
+        if (mapStart < overlapStart) {
+            fileMappings[mapStart] = overlapStart - mapStart;
+        }
+
+        if (overlapEnd < mapEnd) {
+            fileMappings[overlapEnd] = mapEnd - overlapEnd;
+        }
+    }
+}
+
 /**
  * Maps the given state into the module's memory.
  *
@@ -384,13 +763,18 @@ int32_t WasmModule::executeTask(
     // Set up context for this task
     WasmExecutionContext ctx(this);
 
-    // Modules must have provisioned their own thread stacks
-    assert(!threadStacks.empty());
-    uint32_t stackTop = threadStacks.at(threadPoolIdx);
+    // Only threads need their own stack, which may be allocated here
+    uint32_t stackTop = 0;
+    if (req->type() == faabric::BatchExecuteRequest::THREADS) {
+        stackTop = getThreadStack(threadPoolIdx);
+    }
 
-    // Ignore stacks and guard pages in snapshot if present
+    // Ignore stacks, guard pages and hinted regions in snapshot if present
     if (!msg.snapshotkey().empty()) {
         ignoreThreadStacksInSnapshot(msg.snapshotkey());
+        addSnapshotHintsToSnapshot(
+          faabric::snapshot::getSnapshotRegistry().getSnapshot(
+            msg.snapshotkey()));
     }
 
     // Perform the appropriate type of execution
@@ -423,9 +807,28 @@ int32_t WasmModule::executeTask(
     } else {
         // Vanilla function
         SPDLOG_TRACE("Executing {} as standard function", funcStr);
+        if (conf::getFaasmConfig().captureStdout == "on") {
+            getStdoutCapture().beginCall(fmt::format(
+              "{}_{}_{}", msg.user(), msg.function(), msg.id()));
+        }
+
         returnValue = executeFunction(msg);
     }
 
+    // Threads that don't share memory with the one that forked them record
+    // their part of any array reductions, which goes back in their diffs
+    if (req->type() == faabric::BatchExecuteRequest::THREADS) {
+        recordArrayReductions(msg.groupidx());
+    }
+
+    // Don't leave eagerly dispatched pthreads or parked OpenMP threads
+    // running past the function, nor keep its critical sections
+    if (req->type() != faabric::BatchExecuteRequest::THREADS) {
+        awaitPthreadDispatchers();
+        stopParkedTeam();
+        criticalSections.clear();
+    }
+
     if (returnValue != 0) {
         msg.set_outputdata(
           fmt::format("Call failed (return value={})", returnValue));
@@ -436,8 +839,12 @@ int32_t WasmModule::executeTask(
     if (conf.captureStdout == "on") {
         std::string moduleStdout = getCapturedStdout();
         if (!moduleStdout.empty()) {
-            std::string newOutput = moduleStdout + "\n" + msg.outputdata();
-            msg.set_outputdata(newOutput);
+            // Append in place to avoid copying the output again
+            moduleStdout.reserve(moduleStdout.size() + 1 +
+                                 msg.outputdata().size());
+            moduleStdout += "\n";
+            moduleStdout += msg.outputdata();
+            msg.set_outputdata(std::move(moduleStdout));
 
             clearCapturedStdout();
         }
@@ -478,52 +885,315 @@ void WasmModule::addMergeRegionForNextThreads(
 
 std::vector<faabric::util::SnapshotMergeRegion> WasmModule::getMergeRegions()
 {
-    return mergeRegions;
+    std::vector<faabric::util::SnapshotMergeRegion> regions = mergeRegions;
+
+    faabric::util::SharedLock lock(snapshotHintsMx);
+    for (const auto& [wasmPtr, h] : snapshotHints) {
+        regions.emplace_back(wasmPtr,
+                             h.first,
+                             faabric::util::SnapshotDataType::Raw,
+                             faabric::util::SnapshotMergeOperation::Ignore);
+    }
+
+    return regions;
 }
 
 void WasmModule::clearMergeRegions()
 {
     mergeRegions.clear();
+    arrayReductions.clear();
+}
+
+void WasmModule::addArrayReductionForNextThreads(
+  uint32_t wasmPtr,
+  uint32_t count,
+  faabric::util::SnapshotDataType dataType,
+  faabric::util::SnapshotMergeOperation mergeOp)
+{
+    threads::ArrayReduction r;
+    r.arrayPtr = wasmPtr;
+    r.count = count;
+    r.dataType = dataType;
+    r.mergeOp = mergeOp;
+
+    arrayReductions.push_back(r);
+}
+
+std::vector<faabric::util::SnapshotMergeRegion>
+WasmModule::prepareArrayReductions(int firstIdx, int nThreads)
+{
+    std::vector<faabric::util::SnapshotMergeRegion> regions;
+    if (arrayReductions.empty()) {
+        return regions;
+    }
+
+    if (arrayReductionsRefPtr == 0) {
+        SPDLOG_ERROR("No thread pool for array reductions");
+        throw std::runtime_error("No thread pool for array reductions");
+    }
+
+    std::unique_lock<std::mutex> lock(arrayReductionsMx);
+    if (forkedArrayReductionsPtr != 0) {
+        SPDLOG_ERROR("Array reductions already in flight at {}",
+                     forkedArrayReductionsPtr);
+        throw std::runtime_error("Array reductions already in flight");
+    }
+
+    forkedArrayReductionsSize =
+      threads::getArrayReductionsSize(arrayReductions, nThreads);
+    forkedArrayReductionsPtr = mmapMemory(forkedArrayReductionsSize);
+
+    uint32_t slotsPtr = threads::writeArrayReductions(getMemoryBase(),
+                                                      forkedArrayReductionsPtr,
+                                                      arrayReductions,
+                                                      firstIdx,
+                                                      nThreads);
+
+    *reinterpret_cast<uint32_t*>(wasmPointerToNative(arrayReductionsRefPtr)) =
+      forkedArrayReductionsPtr;
+
+    // Changes to the arrays on other hosts come back in their slots, and the
+    // rest of the block is only read by them
+    for (const auto& r : arrayReductions) {
+        regions.emplace_back(r.arrayPtr,
+                             threads::getArrayReductionBytes(r),
+                             faabric::util::SnapshotDataType::Raw,
+                             faabric::util::SnapshotMergeOperation::Ignore);
+    }
+
+    regions.emplace_back(forkedArrayReductionsPtr,
+                         slotsPtr - forkedArrayReductionsPtr,
+                         faabric::util::SnapshotDataType::Raw,
+                         faabric::util::SnapshotMergeOperation::Ignore);
+
+    SPDLOG_DEBUG("Prepared {} array reductions for {} threads at {}",
+                 arrayReductions.size(),
+                 nThreads,
+                 forkedArrayReductionsPtr);
+
+    return regions;
+}
+
+void WasmModule::finishArrayReductions(bool merge)
+{
+    std::unique_lock<std::mutex> lock(arrayReductionsMx);
+    if (forkedArrayReductionsPtr == 0) {
+        return;
+    }
+
+    if (merge) {
+        threads::mergeArrayReductions(getMemoryBase(),
+                                      forkedArrayReductionsPtr);
+    }
+
+    *reinterpret_cast<uint32_t*>(wasmPointerToNative(arrayReductionsRefPtr)) =
+      0;
+    unmapMemory(forkedArrayReductionsPtr, forkedArrayReductionsSize);
+
+    forkedArrayReductionsPtr = 0;
+    forkedArrayReductionsSize = 0;
+}
+
+void WasmModule::recordArrayReductions(int groupIdx)
+{
+    if (arrayReductionsRefPtr == 0) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(arrayReductionsMx);
+    if (forkedArrayReductionsPtr != 0) {
+        return;
+    }
+
+    uint32_t blockPtr =
+      *reinterpret_cast<uint32_t*>(wasmPointerToNative(arrayReductionsRefPtr));
+    if (blockPtr == 0) {
+        return;
+    }
+
+    threads::recordArrayReductions(getMemoryBase(), blockPtr, groupIdx);
+}
+
+void WasmModule::setSnapshotHint(uint32_t wasmPtr,
+                                 uint32_t length,
+                                 SnapshotHint hint)
+{
+    faabric::util::FullLock lock(snapshotHintsMx);
+
+    if (hint == SnapshotHint::NONE) {
+        SPDLOG_TRACE("Removing snapshot hint at {}", wasmPtr);
+        snapshotHints.erase(wasmPtr);
+        return;
+    }
+
+    if (hint != SnapshotHint::SCRATCH && hint != SnapshotHint::READ_ONLY) {
+        SPDLOG_ERROR("Unrecognised snapshot hint: {}", hint);
+        throw std::runtime_error("Unrecognised snapshot hint");
+    }
+
+    if (length == 0 || (size_t)wasmPtr + length > getMemorySizeBytes()) {
+        SPDLOG_ERROR("Invalid snapshot hint region {}-{} (memory size {})",
+                     wasmPtr,
+                     (size_t)wasmPtr + length,
+                     getMemorySizeBytes());
+        throw std::runtime_error("Invalid snapshot hint region");
+    }
+
+    SPDLOG_TRACE("Adding {} snapshot hint {}-{}",
+                 hint == SnapshotHint::SCRATCH ? "scratch" : "read-only",
+                 wasmPtr,
+                 wasmPtr + length);
+    snapshotHints[wasmPtr] = { length, hint };
+}
+
+std::map<uint32_t, std::pair<uint32_t, SnapshotHint>>
+WasmModule::getSnapshotHints()
+{
+    faabric::util::SharedLock lock(snapshotHintsMx);
+    return snapshotHints;
+}
+
+/**
+ * Scratch and read-only regions are both ignored when merging diffs. Changes
+ * to scratch regions are thrown away, and read-only regions don't change, so
+ * either way there's nothing to ship back from threads.
+ */
+void WasmModule::addSnapshotHintsToSnapshot(
+  std::shared_ptr<faabric::util::SnapshotData> snap)
+{
+    faabric::util::SharedLock lock(snapshotHintsMx);
+    for (const auto& [wasmPtr, h] : snapshotHints) {
+        snap->addMergeRegion(wasmPtr,
+                             h.first,
+                             faabric::util::SnapshotDataType::Raw,
+                             faabric::util::SnapshotMergeOperation::Ignore);
+    }
 }
 
 void WasmModule::queuePthreadCall(threads::PthreadCall call)
 {
-    // We assume that all pthread calls are queued from the main thread before
-    // await is called from the same thread, so this doesn't need to be
-    // thread-safe.
-    queuedPthreadCalls.emplace_back(call);
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+    bool eager = conf.pthreadDispatch == "eager";
+
+    std::unique_lock<std::mutex> lock(pthreadCallsMx);
+
+    std::promise<int32_t> result;
+    pthreadResults.insert_or_assign(call.pthreadPtr,
+                                    result.get_future().share());
+
+    bool isFirst = queuedPthreadCalls.empty();
+    queuedPthreadCalls.emplace_back(call, std::move(result));
+
+    joinFinishedPthreadDispatchers();
+
+    // Without eager dispatch, the queue is executed on the first join. With
+    // it, the first call in an empty queue starts a dispatcher which picks up
+    // any others created within the batch window.
+    if (!eager || !isFirst) {
+        return;
+    }
+
+    auto* executorCtx = faabric::scheduler::ExecutorContext::get();
+    faabric::scheduler::Executor* executor = executorCtx->getExecutor();
+    std::shared_ptr<faabric::BatchExecuteRequest> req =
+      executorCtx->getBatchRequest();
+
+    int msgIdx = 0;
+    int parentMsgId = executorCtx->getMsg().id();
+    for (int i = 0; i < req->messages_size(); i++) {
+        if (req->messages().at(i).id() == parentMsgId) {
+            msgIdx = i;
+            break;
+        }
+    }
+
+    int windowUs = conf.pthreadBatchWindowUs;
+    pthreadDispatchers.emplace_back([this, executor, req, msgIdx, windowUs] {
+        faabric::scheduler::ExecutorContext::set(executor, req, msgIdx);
+        WasmExecutionContext ctx(this);
+
+        if (windowUs > 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(windowUs));
+        }
+
+        std::vector<QueuedPthreadCall> calls;
+        {
+            std::unique_lock<std::mutex> lock(pthreadCallsMx);
+            calls.swap(queuedPthreadCalls);
+        }
+
+        // The batch runs alongside the calling thread, which may carry on
+        // writing to memory, so it can't be sent to other hosts
+        if (!calls.empty()) {
+            dispatchPthreadCalls(
+              std::move(calls), req->messages().at(msgIdx), true);
+        }
+
+        std::unique_lock<std::mutex> lock(pthreadCallsMx);
+        finishedPthreadDispatchers.push_back(std::this_thread::get_id());
+    });
 }
 
-int WasmModule::awaitPthreadCall(faabric::Message* msg, int pthreadPtr)
+void WasmModule::joinFinishedPthreadDispatchers()
 {
-    // We assume that await is called in a loop from the main thread, after
-    // all pthread calls have been queued, so this function doesn't need to be
-    // thread safe.
-    assert(msg != nullptr);
+    for (std::thread::id id : finishedPthreadDispatchers) {
+        auto it = std::find_if(
+          pthreadDispatchers.begin(),
+          pthreadDispatchers.end(),
+          [id](const std::thread& t) { return t.get_id() == id; });
+
+        // Finished dispatchers only have to exit, as they hold no locks
+        if (it != pthreadDispatchers.end()) {
+            it->join();
+            pthreadDispatchers.erase(it);
+        }
+    }
 
-    // Execute the queued pthread calls
-    faabric::scheduler::Executor* executor =
-      faabric::scheduler::ExecutorContext::get()->getExecutor();
-    if (!queuedPthreadCalls.empty()) {
-        int nPthreadCalls = queuedPthreadCalls.size();
+    finishedPthreadDispatchers.clear();
+}
+
+void WasmModule::dispatchPthreadCalls(std::vector<QueuedPthreadCall> calls,
+                                      const faabric::Message& parentMsg,
+                                      bool forceLocal)
+{
+    int nPthreadCalls = calls.size();
 
-        std::string funcStr = faabric::util::funcToString(*msg, true);
-        SPDLOG_DEBUG(
-          "Executing {} pthread calls for {}", nPthreadCalls, funcStr);
+    std::string funcStr = faabric::util::funcToString(parentMsg, true);
+    SPDLOG_DEBUG("Executing {} pthread calls for {}", nPthreadCalls, funcStr);
 
-        std::shared_ptr<faabric::BatchExecuteRequest> req =
-          faabric::util::batchExecFactory(
-            msg->user(), msg->function(), nPthreadCalls);
+    std::shared_ptr<faabric::BatchExecuteRequest> req =
+      faabric::util::batchExecFactory(
+        parentMsg.user(), parentMsg.function(), nPthreadCalls);
 
-        req->set_type(faabric::BatchExecuteRequest::THREADS);
-        req->set_subtype(wasm::ThreadRequestType::PTHREAD);
+    req->set_type(faabric::BatchExecuteRequest::THREADS);
+    req->set_subtype(wasm::ThreadRequestType::PTHREAD);
+    req->set_singlehost(forceLocal);
 
+    // Thread IDs start at one and keep counting up while any threads are
+    // outstanding, so that batches in flight at the same time don't share
+    // IDs. IDs that would land on the main thread's pool slot are skipped.
+    int firstIdx = 0;
+    int maxIdx = 0;
+    {
+        std::unique_lock<std::mutex> lock(pthreadCallsMx);
         for (int i = 0; i < nPthreadCalls; i++) {
-            threads::PthreadCall p = queuedPthreadCalls.at(i);
+            if (threadPoolSize > 1 && nextPthreadIdx % threadPoolSize == 0) {
+                nextPthreadIdx++;
+            }
+
+            if (i == 0) {
+                firstIdx = nextPthreadIdx;
+            }
+
+            threads::PthreadCall& p = calls.at(i).first;
             faabric::Message& m = req->mutable_messages()->at(i);
 
             // Propagate app ID
-            m.set_appid(msg->appid());
+            m.set_appid(parentMsg.appid());
+
+            if (forceLocal) {
+                m.set_topologyhint("FORCE_LOCAL");
+            }
 
             // Function pointer and args
             // NOTE - with a pthread interface we only ever pass the
@@ -532,114 +1202,329 @@ int WasmModule::awaitPthreadCall(faabric::Message* msg, int pthreadPtr)
             m.set_funcptr(p.entryFunc);
             m.set_inputdata(std::to_string(p.argsPtr));
 
-            // Assign a thread ID and increment. Our pthread IDs start
-            // at 1. Set this as part of the group with the other threads.
-            m.set_appidx(i + 1);
-            m.set_groupidx(i + 1);
+            // Set this as part of the group with the other threads
+            m.set_appidx(nextPthreadIdx);
+            m.set_groupidx(nextPthreadIdx);
+            maxIdx = nextPthreadIdx++;
 
-            // Record this thread -> call ID
             SPDLOG_TRACE("pthread {} mapped to call {}", p.pthreadPtr, m.id());
-            pthreadPtrsToChainedCalls.insert({ p.pthreadPtr, m.id() });
+        }
+    }
+
+    bool hasArrayReductions = false;
+    try {
+        provisionThreadStacks(maxIdx + 1);
+
+        // Batches kept on this host share memory, so don't need the array
+        // reductions to be merged
+        std::vector<faabric::util::SnapshotMergeRegion> regions =
+          getMergeRegions();
+        if (!req->singlehost()) {
+            std::vector<faabric::util::SnapshotMergeRegion> arrayRegions =
+              prepareArrayReductions(firstIdx, maxIdx - firstIdx + 1);
+            hasArrayReductions = !arrayRegions.empty();
+            regions.insert(
+              regions.end(), arrayRegions.begin(), arrayRegions.end());
         }
 
         // Execute the threads and await results
-        lastPthreadResults = executor->executeThreads(req, mergeRegions);
+        faabric::scheduler::Executor* executor =
+          faabric::scheduler::ExecutorContext::get()->getExecutor();
+        std::vector<std::pair<uint32_t, int32_t>> results =
+          executor->executeThreads(req, regions);
+
+        if (hasArrayReductions) {
+            finishArrayReductions(true);
+        }
+
+        for (int i = 0; i < nPthreadCalls; i++) {
+            uint32_t msgId = req->messages().at(i).id();
+            auto it = std::find_if(
+              results.begin(), results.end(), [msgId](const auto& r) {
+                  return r.first == msgId;
+              });
+
+            if (it == results.end()) {
+                SPDLOG_ERROR(
+                  "Did not find a result for pthread: ptr {}, mid {}",
+                  calls.at(i).first.pthreadPtr,
+                  msgId);
+                calls.at(i).second.set_exception(std::make_exception_ptr(
+                  std::runtime_error("Result not found for pthread")));
+            } else {
+                calls.at(i).second.set_value(it->second);
+            }
+        }
+    } catch (...) {
+        if (hasArrayReductions) {
+            finishArrayReductions(false);
+        }
 
-        // Empty the queue
-        queuedPthreadCalls.clear();
+        // Anything left waiting gets the error when joined
+        for (auto& [p, result] : calls) {
+            try {
+                result.set_exception(std::current_exception());
+            } catch (const std::future_error&) {
+                // Already set
+            }
+        }
     }
+}
 
-    // Get the result of this call
-    unsigned int pthreadMsgId = pthreadPtrsToChainedCalls[pthreadPtr];
-    bool found = false;
-    int thisResult = 0;
-    for (auto [mid, res] : lastPthreadResults) {
-        if (pthreadMsgId == mid) {
-            thisResult = res;
-            found = true;
-            break;
+int WasmModule::awaitPthreadCall(faabric::Message* msg, int pthreadPtr)
+{
+    assert(msg != nullptr);
+
+    bool eager = conf::getFaasmConfig().pthreadDispatch == "eager";
+
+    std::vector<QueuedPthreadCall> calls;
+    std::shared_future<int32_t> result;
+    {
+        std::unique_lock<std::mutex> lock(pthreadCallsMx);
+        auto it = pthreadResults.find(pthreadPtr);
+        if (it == pthreadResults.end()) {
+            SPDLOG_ERROR("Did not find a result for pthread: ptr {}",
+                         pthreadPtr);
+            throw std::runtime_error("Result not found for pthread");
+        }
+        result = it->second;
+
+        // Queued calls are left to the dispatcher in eager mode
+        if (!eager) {
+            calls.swap(queuedPthreadCalls);
         }
     }
 
-    if (!found) {
-        SPDLOG_ERROR("Did not find a result for pthread: ptr {}, mid {}",
-                     pthreadPtr,
-                     pthreadMsgId);
-        throw std::runtime_error("Result not found for pthread");
+    // Execute the queued pthread calls
+    if (!calls.empty()) {
+        dispatchPthreadCalls(std::move(calls), *msg, false);
     }
 
-    // Remove the mapping for this pointer
-    pthreadPtrsToChainedCalls.erase(pthreadPtr);
+    // Rethrows if the thread failed
+    int thisResult = result.get();
+
+    std::unique_lock<std::mutex> lock(pthreadCallsMx);
+    pthreadResults.erase(pthreadPtr);
 
-    // If we're done, clear the results
-    if (pthreadPtrsToChainedCalls.empty()) {
-        lastPthreadResults.clear();
+    // If we're done, thread IDs can start again
+    if (pthreadResults.empty() && queuedPthreadCalls.empty()) {
+        nextPthreadIdx = 1;
     }
 
     return thisResult;
 }
 
-void WasmModule::createThreadStacks()
+void WasmModule::awaitPthreadDispatchers()
+{
+    std::vector<std::thread> dispatchers;
+    {
+        std::unique_lock<std::mutex> lock(pthreadCallsMx);
+        dispatchers.swap(pthreadDispatchers);
+        finishedPthreadDispatchers.clear();
+    }
+
+    for (auto& t : dispatchers) {
+        if (t.joinable()) {
+            t.join();
+        }
+    }
+}
+
+void WasmModule::createThreadStackTable()
 {
-    SPDLOG_DEBUG("Creating {} thread stacks", threadPoolSize);
+    if (threadPoolSize == 0) {
+        threadStackTablePtr = 0;
+        arrayReductionsRefPtr = 0;
+        return;
+    }
+
+    // New memory is zeroed, i.e. no stacks or array reductions yet
+    threadStackTablePtr = growMemory((threadPoolSize + 1) * sizeof(uint32_t));
+    arrayReductionsRefPtr =
+      threadStackTablePtr + threadPoolSize * sizeof(uint32_t);
+}
 
-    for (int i = 0; i < threadPoolSize; i++) {
-        // Allocate thread stack and guard pages
-        uint32_t memSize = THREAD_STACK_SIZE + (2 * GUARD_REGION_SIZE);
-        uint32_t memBase = growMemory(memSize);
+uint32_t WasmModule::createThreadStack()
+{
+    // Allocate thread stack and guard pages
+    uint32_t memSize = THREAD_STACK_SIZE + (2 * GUARD_REGION_SIZE);
+    uint32_t memBase = growMemory(memSize);
+
+    // Note that wasm stacks grow downwards, so we have to store the stack top,
+    // which is the offset one below the guard region above the stack. Subtract
+    // 16 to make sure the stack is 16-aligned as required by the C ABI
+    uint32_t stackTop = memBase + GUARD_REGION_SIZE + THREAD_STACK_SIZE - 16;
 
-        // Note that wasm stacks grow downwards, so we have to store the
-        // stack top, which is the offset one below the guard region above
-        // the stack Subtract 16 to make sure the stack is 16-aligned as
-        // required by the C ABI
-        uint32_t stackTop =
-          memBase + GUARD_REGION_SIZE + THREAD_STACK_SIZE - 16;
-        threadStacks.push_back(stackTop);
+    // Add guard regions
+    createMemoryGuardRegion(memBase);
+    createMemoryGuardRegion(stackTop + 16);
 
-        // Add guard regions
-        createMemoryGuardRegion(memBase);
-        createMemoryGuardRegion(stackTop + 16);
+    return stackTop;
+}
+
+uint32_t WasmModule::getThreadStack(int threadPoolIdx)
+{
+    if (threadPoolIdx < 0 || threadPoolIdx >= threadPoolSize) {
+        SPDLOG_ERROR("Thread pool index {} out of range (pool size {})",
+                     threadPoolIdx,
+                     threadPoolSize);
+        throw std::runtime_error("Thread pool index out of range");
     }
+
+    std::unique_lock<std::mutex> lock(threadStacksMx);
+    if ((int)threadStacks.size() < threadPoolSize) {
+        threadStacks.resize(threadPoolSize, 0);
+    }
+
+    if (threadStacks.at(threadPoolIdx) == 0) {
+        SPDLOG_DEBUG("Creating thread stack {}", threadPoolIdx);
+        uint32_t stackTop = createThreadStack();
+        threadStacks.at(threadPoolIdx) = stackTop;
+
+        if (threadStackTablePtr != 0) {
+            auto* table = reinterpret_cast<uint32_t*>(
+              wasmPointerToNative(threadStackTablePtr));
+            table[threadPoolIdx] = stackTop;
+        }
+    }
+
+    return threadStacks.at(threadPoolIdx);
 }
 
-std::vector<uint32_t> WasmModule::getThreadStacks()
+void WasmModule::provisionThreadStacks(int nThreads)
 {
-    return threadStacks;
+    int nStacks = std::min(nThreads, threadPoolSize);
+    for (int i = 0; i < nStacks; i++) {
+        getThreadStack(i);
+    }
 }
 
-std::shared_ptr<std::mutex> WasmModule::getPthreadMutex(uint32_t id)
+uint32_t WasmModule::claimNestedThreadStack()
 {
-    faabric::util::SharedLock lock(pthreadLocksMx);
-    auto it = pthreadLocks.find(id);
-    if (it != pthreadLocks.end()) {
-        return it->second;
+    std::unique_lock<std::mutex> lock(threadStacksMx);
+    if (!freeNestedThreadStacks.empty()) {
+        uint32_t stackTop = freeNestedThreadStacks.back();
+        freeNestedThreadStacks.pop_back();
+        return stackTop;
     }
 
-    SPDLOG_ERROR("Trying to get non-existent pthread lock {}", id);
-    throw std::runtime_error("Non-existent pthread lock");
+    SPDLOG_DEBUG("Creating nested thread stack {}", nestedThreadStacks.size());
+    uint32_t stackTop = createThreadStack();
+    nestedThreadStacks.push_back(stackTop);
+
+    return stackTop;
 }
 
-std::shared_ptr<std::mutex> WasmModule::getOrCreatePthreadMutex(uint32_t id)
+void WasmModule::releaseNestedThreadStack(uint32_t stackTop)
 {
-    std::shared_ptr<std::mutex> mx = nullptr;
-    {
-        faabric::util::SharedLock lock(pthreadLocksMx);
-        auto it = pthreadLocks.find(id);
-        if (it != pthreadLocks.end()) {
-            return it->second;
+    std::unique_lock<std::mutex> lock(threadStacksMx);
+    freeNestedThreadStacks.push_back(stackTop);
+}
+
+uint32_t WasmModule::allocateTaskMemory(uint32_t nBytes)
+{
+    uint32_t blockSize = (nBytes + TASK_MEMORY_ALIGNMENT - 1) &
+                         ~(TASK_MEMORY_ALIGNMENT - 1);
+
+    std::unique_lock<std::mutex> lock(taskMemoryMx);
+
+    std::vector<uint32_t>& freeBlocks = freeTaskBlocks[blockSize];
+    if (!freeBlocks.empty()) {
+        uint32_t wasmPtr = freeBlocks.back();
+        freeBlocks.pop_back();
+        return wasmPtr;
+    }
+
+    uint32_t wasmPtr;
+    if (blockSize > TASK_MEMORY_CHUNK_SIZE) {
+        wasmPtr = mmapMemory(blockSize);
+    } else {
+        // The rest of the current chunk is abandoned when a block won't fit
+        if (taskChunkEnd - taskChunkNext < blockSize) {
+            taskChunkNext = mmapMemory(TASK_MEMORY_CHUNK_SIZE);
+            taskChunkEnd = taskChunkNext + TASK_MEMORY_CHUNK_SIZE;
         }
+
+        wasmPtr = taskChunkNext;
+        taskChunkNext += blockSize;
+    }
+
+    taskBlockSizes[wasmPtr] = blockSize;
+
+    return wasmPtr;
+}
+
+void WasmModule::freeTaskMemory(uint32_t wasmPtr)
+{
+    std::unique_lock<std::mutex> lock(taskMemoryMx);
+
+    auto it = taskBlockSizes.find(wasmPtr);
+    if (it == taskBlockSizes.end()) {
+        SPDLOG_ERROR("Freeing unknown task memory at {}", wasmPtr);
+        throw std::runtime_error("Freeing unknown task memory");
+    }
+
+    freeTaskBlocks[it->second].push_back(wasmPtr);
+}
+
+bool WasmModule::runOnParkedTeam(int nThreads,
+                                 const std::function<void(int)>& job)
+{
+    std::unique_lock<std::mutex> lock(parkedTeamMx, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        return false;
     }
 
-    faabric::util::FullLock lock(pthreadLocksMx);
-    auto it = pthreadLocks.find(id);
-    if (it != pthreadLocks.end()) {
-        return it->second;
+    if (parkedTeam == nullptr || parkedTeam->nThreads != nThreads) {
+        // Stop the old team before starting the new one
+        parkedTeam = nullptr;
+        parkedTeam = std::make_unique<threads::ParkedTeam>(nThreads);
     }
 
-    mx = std::make_shared<std::mutex>();
-    pthreadLocks[id] = mx;
+    parkedTeam->run(job);
 
-    return mx;
+    return true;
+}
+
+void WasmModule::stopParkedTeam()
+{
+    std::unique_lock<std::mutex> lock(parkedTeamMx);
+    parkedTeam = nullptr;
+}
+
+std::shared_ptr<threads::CriticalSection> WasmModule::getCriticalSection(
+  int32_t crit)
+{
+    return criticalSections.get(crit);
+}
+
+void WasmModule::resetTaskMemory()
+{
+    std::unique_lock<std::mutex> lock(taskMemoryMx);
+    taskBlockSizes.clear();
+    freeTaskBlocks.clear();
+    taskChunkNext = 0;
+    taskChunkEnd = 0;
+}
+
+void WasmModule::resetThreadStacks()
+{
+    std::unique_lock<std::mutex> lock(threadStacksMx);
+    threadStacks.assign(threadPoolSize, 0);
+    nestedThreadStacks.clear();
+    freeNestedThreadStacks.clear();
+
+    if (threadStackTablePtr != 0) {
+        auto* table =
+          reinterpret_cast<uint32_t*>(wasmPointerToNative(threadStackTablePtr));
+        std::copy(table, table + threadPoolSize, threadStacks.begin());
+    }
+}
+
+std::vector<uint32_t> WasmModule::getThreadStacks()
+{
+    std::unique_lock<std::mutex> lock(threadStacksMx);
+    return threadStacks;
 }
 
 bool WasmModule::isBound()
@@ -687,11 +1572,6 @@ uint32_t WasmModule::mmapMemory(size_t nBytes)
     throw std::runtime_error("mmapMemory not implemented");
 }
 
-uint32_t WasmModule::mmapFile(uint32_t fp, size_t length)
-{
-    throw std::runtime_error("mmapFile not implemented");
-}
-
 void WasmModule::unmapMemory(uint32_t offset, size_t nBytes)
 {
     throw std::runtime_error("unmapMemory not implemented");
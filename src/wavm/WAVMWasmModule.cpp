@@ -1,5 +1,6 @@
 #include "syscalls.h"
 
+#include <algorithm>
 #include <boost/filesystem.hpp>
 #include <stdexcept>
 #include <sys/mman.h>
@@ -17,6 +18,7 @@
 
 #include <conf/FaasmConfig.h>
 #include <storage/SharedFiles.h>
+#include <threads/TaskPool.h>
 #include <threads/ThreadState.h>
 #include <wasm/WasmExecutionContext.h>
 #include <wasm/WasmModule.h>
@@ -153,6 +155,7 @@ void WAVMWasmModule::clone(const WAVMWasmModule& other,
     _isBound = other._isBound;
     boundUser = other.boundUser;
     boundFunction = other.boundFunction;
+    hugePages = other.hugePages;
 
     currentBrk.store(other.currentBrk.load(std::memory_order_acquire),
                      std::memory_order_release);
@@ -162,14 +165,32 @@ void WAVMWasmModule::clone(const WAVMWasmModule& other,
     wasmEnvironment = other.wasmEnvironment;
 
     // Note - we keep the thread stack offsets but not the threads themselves as
-    // each module will have its own thread pool
+    // each module will have its own thread pool. Stacks are allocated lazily,
+    // so the offsets are only valid if memory is copied from the other module,
+    // otherwise they come from the snapshot's stack table
     threadPoolSize = other.threadPoolSize;
-    threadStacks = other.threadStacks;
-    openMPContexts = std::vector<Runtime::Context*>(threadPoolSize, nullptr);
+    threadStackTablePtr = other.threadStackTablePtr;
+    arrayReductionsRefPtr = other.arrayReductionsRefPtr;
+    if (snapshotKey.empty()) {
+        threadStacks = other.threadStacks;
+        nestedThreadStacks = other.nestedThreadStacks;
+        freeNestedThreadStacks = other.nestedThreadStacks;
+
+        // No tasks are running in the copy, so all its task memory is free
+        taskBlockSizes = other.taskBlockSizes;
+        freeTaskBlocks.clear();
+        for (const auto& [wasmPtr, blockSize] : taskBlockSizes) {
+            freeTaskBlocks[blockSize].push_back(wasmPtr);
+        }
+        taskChunkNext = other.taskChunkNext;
+        taskChunkEnd = other.taskChunkEnd;
+    } else {
+        resetTaskMemory();
+    }
+    threadContexts = std::vector<Runtime::Context*>(threadPoolSize, nullptr);
 
     // Do not copy over any captured stdout
-    stdoutMemFd = 0;
-    stdoutSize = 0;
+    stdoutCapture = nullptr;
 
     if (other._isBound) {
         assert(other.compartment != nullptr);
@@ -209,11 +230,31 @@ void WAVMWasmModule::clone(const WAVMWasmModule& other,
             // Map the snapshot into memory
             uint8_t* memoryBase = getMemoryBase();
             data->mapToMemory({ memoryBase, data->getSize() });
+
+            // Pick up the stacks from the snapshot's stack table
+            resetThreadStacks();
         }
 
+        // Free regions are only valid if memory was copied from the other
+        // module, and file mappings are never carried over
+        {
+            faabric::util::FullLock lock(fileMappingsMutex);
+            fileMappings.clear();
+        }
+        pageAllocator = snapshotKey.empty() ? other.pageAllocator
+                                            : PageAllocator();
+        resetMemoryStats();
+        memoryFileBacked = !snapshotKey.empty();
+
+        // Cloned memory is a new mapping, so doesn't keep any advice
+        adviseHugePages(0, getMemorySizeBytes());
+
         // Reset shared memory variables
         sharedMemWasmPtrs = other.sharedMemWasmPtrs;
 
+        // Hints refer to the memory, which is the same as the other module's
+        snapshotHints = other.snapshotHints;
+
         // Remap dynamic modules
         lastLoadedDynamicModuleHandle = other.lastLoadedDynamicModuleHandle;
         dynamicPathToHandleMap = other.dynamicPathToHandleMap;
@@ -263,6 +304,13 @@ void WAVMWasmModule::doWAVMGarbageCollection()
 
     executionContext = nullptr;
 
+    // Thread contexts belong to the compartment
+    threadContexts.assign(threadContexts.size(), nullptr);
+    {
+        faabric::util::UniqueLock lock(nestedThreadContextsMx);
+        nestedThreadContexts.clear();
+    }
+
     if (compartment != nullptr) {
         bool compartmentCleared =
           Runtime::tryCollectCompartment(std::move(compartment));
@@ -290,6 +338,12 @@ Runtime::Function* WAVMWasmModule::getFunction(Runtime::Instance* module,
     return func;
 }
 
+Runtime::Function* WAVMWasmModule::getExportedFunction(
+  const std::string& funcName)
+{
+    return getFunction(moduleInstance, funcName, false);
+}
+
 void WAVMWasmModule::addModuleToGOT(IR::Module& mod, bool isMainModule)
 {
     // This function is **critical** for dynamic linking to work properly,
@@ -461,11 +515,14 @@ void WAVMWasmModule::doBindToFunctionInternal(faabric::Message& msg,
     // We have to set the current brk before executing any code
     currentBrk.store(getMemorySizeBytes(), std::memory_order_release);
 
-    // Set up thread stacks
-    createThreadStacks();
+    // Thread stacks and task memory are allocated on first use, but the table
+    // recording the stacks must be at the same offset on all hosts
+    createThreadStackTable();
+    resetThreadStacks();
+    resetTaskMemory();
 
-    // Allocate a pool of OpenMP contexts
-    openMPContexts = std::vector<Runtime::Context*>(threadPoolSize, nullptr);
+    // Thread contexts are created on first use
+    threadContexts = std::vector<Runtime::Context*>(threadPoolSize, nullptr);
 
     // Execute the wasm ctors function. This is a hook generated by the linker
     // that lets things set up the environment (e.g. handling preopened
@@ -929,12 +986,7 @@ int32_t WAVMWasmModule::executePthread(int threadPoolIdx,
     int argsPtr = std::stoi(msg.inputdata());
     std::vector<IR::UntaggedValue> invokeArgs = { argsPtr };
 
-    Runtime::ContextRuntimeData* contextRuntimeData =
-      getContextRuntimeData(executionContext);
-
-    // Set up the context
-    Runtime::Context* threadContext =
-      createThreadContext(stackTop, contextRuntimeData);
+    Runtime::Context* threadContext = getThreadContext(threadPoolIdx, stackTop);
 
     // Execute the function
     IR::UntaggedValue returnValue;
@@ -949,11 +1001,59 @@ int32_t WAVMWasmModule::executeOMPThread(int threadPoolIdx,
                                          faabric::Message& msg)
 {
     faabric::util::SharedLock lock(resetMx);
-    Runtime::Function* funcInstance = getFunctionFromPtr(msg.funcptr());
 
     std::string funcStr = faabric::util::funcToString(msg, false);
     SPDLOG_DEBUG("Executing OpenMP thread {} for {}", threadPoolIdx, funcStr);
 
+    Runtime::Context* ctx = getThreadContext(threadPoolIdx, stackTop);
+
+    int32_t returnValue =
+      executeOMPMicrotask(ctx, msg.funcptr(), msg.appidx());
+    finishOMPTasks(ctx, msg.appidx());
+    msg.set_returnvalue(returnValue);
+
+    return returnValue;
+}
+
+int32_t WAVMWasmModule::executeNestedOMPThread(uint32_t stackTop,
+                                               faabric::Message& msg)
+{
+    // The thread that forked the nested team holds the reset lock until the
+    // team has finished, so we don't take it again here
+    SPDLOG_DEBUG("Executing nested OpenMP thread {} (group {})",
+                 msg.appidx(),
+                 msg.groupid());
+
+    Runtime::ContextRuntimeData* parentData =
+      getContextRuntimeData(executionContext);
+
+    Runtime::Context* ctx = nullptr;
+    {
+        faabric::util::UniqueLock lock(nestedThreadContextsMx);
+        Runtime::Context*& nestedCtx = nestedThreadContexts[stackTop];
+        if (nestedCtx == nullptr) {
+            nestedCtx = createThreadContext(stackTop, parentData);
+        }
+
+        ctx = nestedCtx;
+    }
+
+    resetThreadContext(ctx, stackTop, parentData);
+
+    int32_t returnValue =
+      executeOMPMicrotask(ctx, msg.funcptr(), msg.appidx());
+    finishOMPTasks(ctx, msg.appidx());
+    msg.set_returnvalue(returnValue);
+
+    return returnValue;
+}
+
+int32_t WAVMWasmModule::executeOMPMicrotask(Runtime::Context* ctx,
+                                            int32_t microtaskPtr,
+                                            int32_t threadNum)
+{
+    Runtime::Function* funcInstance = getFunctionFromPtr(microtaskPtr);
+
     // Set up function args
     // NOTE: an OpenMP microtask takes the following arguments:
     // - The thread ID within its current team
@@ -961,51 +1061,114 @@ int32_t WAVMWasmModule::executeOMPThread(int threadPoolIdx,
     // - A pointer to each of the non-global shared variables
     std::shared_ptr<threads::Level> ompLevel = threads::getCurrentOpenMPLevel();
     int argc = ompLevel->nSharedVarOffsets;
-    std::vector<IR::UntaggedValue> invokeArgs = { msg.appidx(), argc };
+    std::vector<IR::UntaggedValue> invokeArgs = { threadNum, argc };
     for (int argIdx = 0; argIdx < argc; argIdx++) {
         invokeArgs.emplace_back(ompLevel->sharedVarOffsets[argIdx]);
     }
 
-    Runtime::ContextRuntimeData* contextRuntimeData =
-      getContextRuntimeData(executionContext);
-
-    if (openMPContexts.at(threadPoolIdx) == nullptr) {
-        openMPContexts.at(threadPoolIdx) =
-          createThreadContext(stackTop, contextRuntimeData);
-    }
-    Runtime::Context* ctx = openMPContexts.at(threadPoolIdx);
-
     // Execute the wasm function
     IR::UntaggedValue returnValue;
     executeWasmFunction(ctx, funcInstance, invokeArgs, returnValue);
-    msg.set_returnvalue(returnValue.i32);
 
     return returnValue.i32;
 }
 
-U32 WAVMWasmModule::mmapFile(U32 fd, size_t length)
+void WAVMWasmModule::executeOMPTask(Runtime::Context* ctx,
+                                    int32_t gtid,
+                                    std::shared_ptr<threads::Task> task,
+                                    threads::TaskPool* pool)
 {
-    // Create a new memory region
-    U32 wasmPtr = mmapMemory(length);
-    U32* targetPtr = &Runtime::memoryRef<U32>(defaultMemory, wasmPtr);
+    threads::ThreadTasks& threadTasks = threads::getThreadTasks();
+    std::shared_ptr<threads::Task> parentTask = threadTasks.currentTask;
+    threadTasks.currentTask = task;
+
+    // The task entry is the second field of the kmp_task_t
+    I32 entryFunc =
+      Runtime::memoryRef<I32>(defaultMemory, task->taskPtr + sizeof(I32));
+    Runtime::Function* funcInstance = getFunctionFromPtr(entryFunc);
 
-    // Unmap and remap the memory
-    munmap(targetPtr, length);
-    U32* mmappedPtr =
-      (U32*)mmap(targetPtr, length, PROT_READ, MAP_SHARED, fd, 0);
-    if (mmappedPtr == MAP_FAILED) {
-        SPDLOG_ERROR("Failed mmapping file descriptor {} ({} - {})",
-                     fd,
-                     errno,
-                     strerror(errno));
-        throw std::runtime_error("Unable to map file");
+    std::vector<IR::UntaggedValue> invokeArgs = { gtid, task->taskPtr };
+    IR::UntaggedValue returnValue;
+    executeWasmFunction(ctx, funcInstance, invokeArgs, returnValue);
+
+    threadTasks.currentTask = parentTask;
+    freeTaskMemory(task->taskPtr);
+
+    if (pool != nullptr) {
+        pool->complete(task);
     }
+}
+
+void WAVMWasmModule::executeOMPTasksUntil(Runtime::Context* ctx,
+                                          int32_t gtid,
+                                          const std::function<bool()>& done)
+{
+    threads::ThreadTasks& threadTasks = threads::getThreadTasks();
+    threads::TaskPool* pool = threadTasks.pool.get();
+    pool->executeUntil(
+      threadTasks.threadNum,
+      done,
+      [this, ctx, gtid, pool](std::shared_ptr<threads::Task> task) {
+          executeOMPTask(ctx, gtid, std::move(task), pool);
+      });
+}
 
-    if (mmappedPtr != targetPtr) {
-        throw std::runtime_error("Unable to map file into required location");
+void WAVMWasmModule::finishOMPTasks(Runtime::Context* ctx, int32_t gtid)
+{
+    threads::ThreadTasks& threadTasks = threads::getThreadTasks();
+    if (threadTasks.pool == nullptr) {
+        return;
     }
 
-    return wasmPtr;
+    // There's an implicit barrier at the end of a parallel region, so all the
+    // team's tasks must finish before any thread leaves it
+    std::shared_ptr<threads::TaskPool> pool = threadTasks.pool;
+    executeOMPTasksUntil(
+      ctx, gtid, [&pool] { return pool->getPendingCount() == 0; });
+
+    threadTasks = threads::ThreadTasks();
+}
+
+/**
+ * Growth within already provisioned memory just bumps the break with a CAS,
+ * so threads allocating concurrently don't serialise on the module mutex.
+ * Returns false if there isn't enough provisioned memory.
+ */
+bool WAVMWasmModule::growProvisionedMemory(size_t nBytes, uint32_t& oldBrk)
+{
+    // Memory only grows under the module mutex, so a stale size is safe
+    size_t memSize = getMemorySizeBytes();
+
+    // Note that sizes must be large enough to capture allocations larger
+    // than a 32-bit integer can hold
+    oldBrk = currentBrk.load(std::memory_order_acquire);
+    size_t newBrk;
+    do {
+        newBrk = (size_t)oldBrk + nBytes;
+        if (newBrk > memSize) {
+            return false;
+        }
+    } while (!currentBrk.compare_exchange_weak(
+      oldBrk, newBrk, std::memory_order_acq_rel, std::memory_order_acquire));
+
+    SPDLOG_TRACE("MEM - Growing memory using already provisioned {} + {} <= {}",
+                 oldBrk,
+                 nBytes,
+                 memSize);
+
+    recordMemoryGrowth(nBytes, newBrk);
+
+    // Make sure permissions on memory are open
+    size_t newTop = faabric::util::getRequiredHostPages(newBrk);
+    size_t newStart = faabric::util::getRequiredHostPagesRoundDown(oldBrk);
+    newTop *= faabric::util::HOST_PAGE_SIZE;
+    newStart *= faabric::util::HOST_PAGE_SIZE;
+    SPDLOG_TRACE("Reclaiming memory {}-{}", newStart, newTop);
+
+    uint8_t* memBase = getMemoryBase();
+    faabric::util::claimVirtualMemory({ memBase + newStart, memBase + newTop });
+
+    return true;
 }
 
 U32 WAVMWasmModule::growMemory(size_t nBytes)
@@ -1015,18 +1178,25 @@ U32 WAVMWasmModule::growMemory(size_t nBytes)
         return currentBrk.load(std::memory_order_acquire);
     }
 
-    faabric::util::FullLock lock(moduleMutex);
-
-    // Check if we can reclaim. Note that sizes must be large enough to capture
-    // allocations larger than a 32-bit integer can hold.
-    uint32_t oldBrk = currentBrk.load(std::memory_order_acquire);
-    size_t newBrk = oldBrk + nBytes;
-
-    if (!isWasmPageAligned(newBrk)) {
+    // The break is always page aligned, so growth must be too
+    if (!isWasmPageAligned(nBytes)) {
         SPDLOG_ERROR("Growing memory by {} is not wasm page aligned", nBytes);
         throw std::runtime_error("Non-wasm-page-aligned memory growth");
     }
 
+    // Check if we can reclaim without taking the lock
+    uint32_t oldBrk;
+    if (growProvisionedMemory(nBytes, oldBrk)) {
+        return oldBrk;
+    }
+
+    faabric::util::FullLock lock(moduleMutex);
+
+    // Another thread may have added pages while we were waiting
+    if (growProvisionedMemory(nBytes, oldBrk)) {
+        return oldBrk;
+    }
+
     size_t oldBytes = getMemorySizeBytes();
     size_t newBytes = oldBytes + nBytes;
     size_t oldPages = Runtime::getMemoryNumPages(defaultMemory);
@@ -1042,29 +1212,10 @@ U32 WAVMWasmModule::growMemory(size_t nBytes)
         throw std::runtime_error("Memory growth exceeding max");
     }
 
-    // If we can reclaim old memory, just bump the break
-    if (newBrk <= oldBytes) {
-        SPDLOG_TRACE(
-          "MEM - Growing memory using already provisioned {} + {} <= {}",
-          oldBrk,
-          nBytes,
-          oldBytes);
-
-        currentBrk.store(newBrk, std::memory_order_release);
-
-        // Make sure permissions on memory are open
-        size_t newTop = faabric::util::getRequiredHostPages(currentBrk);
-        size_t newStart = faabric::util::getRequiredHostPagesRoundDown(oldBrk);
-        newTop *= faabric::util::HOST_PAGE_SIZE;
-        newStart *= faabric::util::HOST_PAGE_SIZE;
-        SPDLOG_TRACE("Reclaiming memory {}-{}", newStart, newTop);
-
-        uint8_t* memBase = getMemoryBase();
-        faabric::util::claimVirtualMemory(
-          { memBase + newStart, memBase + newTop });
-
-        return oldBrk;
-    }
+    // Claim the new region by moving the break to its top before adding the
+    // pages. Growth on the fast path can't succeed again until the pages
+    // exist, at which point it will be above the new region.
+    oldBrk = currentBrk.exchange(newBytes, std::memory_order_acq_rel);
 
     Uptr newMemPageBase;
     Uptr pageChange = newPages - oldPages;
@@ -1072,6 +1223,9 @@ U32 WAVMWasmModule::growMemory(size_t nBytes)
       Runtime::growMemory(defaultMemory, pageChange, &newMemPageBase);
 
     if (result != Runtime::GrowResult::success) {
+        // Nothing else can have moved the break while it was past the top
+        currentBrk.store(oldBrk, std::memory_order_release);
+
         if (result == Runtime::GrowResult::outOfMemory) {
             SPDLOG_ERROR("Committing new pages failed (errno={} ({})) "
                          "(growing by {} from current {})",
@@ -1110,9 +1264,9 @@ U32 WAVMWasmModule::growMemory(size_t nBytes)
     // Get offset of bottom of new range
     auto newMemBase = (U32)(newMemPageBase * WASM_BYTES_PER_PAGE);
 
-    // Set current break to top of the new memory
+    // The break is already at the top of the new memory
     size_t newMemSize = getMemorySizeBytes();
-    currentBrk.store(newMemSize, std::memory_order_release);
+    recordMemoryGrowth(nBytes, newMemSize);
 
     if (newMemBase != oldBytes) {
         SPDLOG_ERROR("Expected base of new region ({}) to be end of memory "
@@ -1131,6 +1285,8 @@ U32 WAVMWasmModule::growMemory(size_t nBytes)
         throw std::runtime_error("Memory growth discrepancy");
     }
 
+    adviseHugePages(newMemBase, nBytes);
+
     return newMemBase;
 }
 
@@ -1152,11 +1308,22 @@ uint32_t WAVMWasmModule::shrinkMemory(size_t nBytes)
         throw std::runtime_error("Shrinking by more than current brk");
     }
 
-    // Note - we don't actually free the memory, we just change the brk
+    // Memory stays provisioned for later growth, but its host pages are
+    // released
     U32 newBrk = oldBrk - nBytes;
 
     SPDLOG_TRACE("MEM - shrinking memory {} -> {}", oldBrk, newBrk);
-    currentBrk.store(newBrk, std::memory_order_release);
+    releaseMemoryPages(newBrk, nBytes);
+
+    // Memory may have grown on top of the region without the lock, in which
+    // case it can only be kept for reuse
+    U32 expectedBrk = oldBrk;
+    if (currentBrk.compare_exchange_strong(
+          expectedBrk, newBrk, std::memory_order_acq_rel)) {
+        pageAllocator.truncate(newBrk);
+    } else {
+        pageAllocator.free(newBrk, nBytes);
+    }
 
     return oldBrk;
 }
@@ -1185,13 +1352,36 @@ void WAVMWasmModule::unmapMemory(uint32_t offset, size_t nBytes)
         throw std::runtime_error("munmapping outside memory max");
     }
 
-    if (unmapTop == currentBrk.load(std::memory_order_acquire)) {
-        SPDLOG_TRACE("MEM - munmapping top of memory by {}", pageAligned);
-        shrinkMemory(pageAligned);
-    } else {
-        SPDLOG_WARN("MEM - unable to reclaim unmapped memory {} at {}",
-                    pageAligned,
-                    offset);
+    releaseFileMappings(offset, pageAligned);
+
+    faabric::util::FullLock lock(moduleMutex);
+
+    U32 oldBrk = currentBrk.load(std::memory_order_acquire);
+    if (offset >= oldBrk) {
+        SPDLOG_WARN(
+          "MEM - ignoring munmap above brk ({} >= {})", offset, oldBrk);
+        return;
+    }
+
+    size_t freed = std::min<size_t>(unmapTop, oldBrk) - offset;
+    releaseMemoryPages(offset, freed);
+    memoryStats.unmapCount++;
+    memoryStats.unmappedBytes += freed;
+
+    // Keep the region for reuse, unless it is at the top of memory, in which
+    // case it (and any free regions below it) go back to the brk
+    pageAllocator.free(offset, freed);
+    if (unmapTop == oldBrk) {
+        U32 newBrk = pageAllocator.trimTop(oldBrk);
+        U32 expectedBrk = oldBrk;
+        if (currentBrk.compare_exchange_strong(
+              expectedBrk, newBrk, std::memory_order_acq_rel)) {
+            SPDLOG_TRACE(
+              "MEM - munmapping top of memory {} -> {}", oldBrk, newBrk);
+        } else {
+            // Memory has grown on top of the region since
+            pageAllocator.free(newBrk, oldBrk - newBrk);
+        }
     }
 }
 
@@ -1199,6 +1389,21 @@ U32 WAVMWasmModule::mmapMemory(size_t nBytes)
 {
     // Note - the mmap interface allows non page-aligned values, and rounds up.
     uint32_t pageAligned = roundUpToWasmPageAligned(nBytes);
+
+    {
+        // Reuse previously unmapped memory where possible
+        faabric::util::FullLock lock(moduleMutex);
+        U32 reused = pageAllocator.allocate(pageAligned);
+        if (reused != 0) {
+            SPDLOG_TRACE("MEM - reusing unmapped memory {} at {}",
+                         pageAligned,
+                         reused);
+            memoryStats.reuseCount++;
+            memoryStats.reusedBytes += pageAligned;
+            return reused;
+        }
+    }
+
     return growMemory(pageAligned);
 }
 
@@ -1523,7 +1728,39 @@ Runtime::Context* WAVMWasmModule::createThreadContext(
         throw std::runtime_error("Thread stack top not 16 byte aligned");
     }
 
+    resetThreadContext(ctx, stackTop, contextRuntimeData);
+
+    return ctx;
+}
+
+void WAVMWasmModule::resetThreadContext(
+  Runtime::Context* ctx,
+  uint32_t stackTop,
+  Runtime::ContextRuntimeData* contextRuntimeData)
+{
+    std::copy(std::begin(contextRuntimeData->mutableGlobals),
+              std::end(contextRuntimeData->mutableGlobals),
+              std::begin(ctx->runtimeData->mutableGlobals));
+
     ctx->runtimeData->mutableGlobals[0] = stackTop;
+}
+
+Runtime::Context* WAVMWasmModule::getThreadContext(int threadPoolIdx,
+                                                   uint32_t stackTop)
+{
+    Runtime::ContextRuntimeData* parentData =
+      getContextRuntimeData(executionContext);
+
+    Runtime::Context*& ctx = threadContexts.at(threadPoolIdx);
+    if (ctx == nullptr) {
+        ctx = createThreadContext(stackTop, parentData);
+        return ctx;
+    }
+
+    // The parent's globals (e.g. the TLS base) and the stack may have
+    // changed since the context was last used, e.g. if the module has been
+    // restored, and a trapped thread may not have unwound its stack
+    resetThreadContext(ctx, stackTop, parentData);
 
     return ctx;
 }
@@ -1652,6 +1889,14 @@ void WAVMWasmModule::printDebugInfo()
                stackPointer,
                stackPointer + dataSizeBytes);
         printf("Heap range:         %i - %lu\n", heapBase, memSizeBytes);
+        MemoryStats stats = getMemoryStats();
+        printf("Unmapped memory:    %lu bytes in %lu regions\n",
+               stats.freeBytes,
+               stats.freeRegionCount);
+        printf("Memory growth:      %lu bytes in %lu calls (peak brk %lu)\n",
+               stats.grownBytes,
+               stats.growCount,
+               stats.peakBrk);
         printf("Table size:         %lu\n", tableSize);
         printf("Dynamic modules:    %lu\n", dynamicModuleMap.size());
 
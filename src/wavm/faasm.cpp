@@ -23,6 +23,7 @@
 #include <faabric/util/state.h>
 
 #include <conf/FaasmConfig.h>
+#include <threads/ArrayReduction.h>
 
 using namespace WAVM;
 using namespace faabric::transport;
@@ -621,14 +622,19 @@ static faabric::util::SnapshotMergeOperation extractSnapshotMergeOp(I32 mergeOp)
     throw std::runtime_error("Unrecognised merge operation");
 }
 
-WAVM_DEFINE_INTRINSIC_FUNCTION(env,
-                               "__faasm_sm_reduce",
-                               void,
-                               __faasm_sm_reduce,
-                               I32 varPtr,
-                               I32 varType,
-                               I32 reduceOp,
-                               int currentBatch)
+/**
+ * Registers a reduction over an array of count elements. Snapshot merge regions
+ * only hold a single value of their data type, so arrays in the next batch are
+ * merged by Faasm instead, with a single ignored region over the array (see
+ * threads/ArrayReduction.h). Reductions faabric has to merge, i.e. those for
+ * the current batch, whose snapshot already exists, and products, have one
+ * region per element.
+ */
+static void registerReduction(I32 varPtr,
+                              I32 varType,
+                              I32 count,
+                              I32 reduceOp,
+                              int currentBatch)
 {
     // Here we have two scenarios, the second of which differs in behaviour when
     // we're in single host mode:
@@ -648,38 +654,116 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
     // Here we can ignore if we're in the current batch, and it's in single host
     // mode.
     if (isCurrentBatch && isSingleHost) {
-        SPDLOG_DEBUG("S - sm_reduce - {} {} {} {} (ignored, single host)",
+        SPDLOG_DEBUG("S - sm_reduce - {} {} {} {} {} (ignored, single host)",
                      varPtr,
                      varType,
+                     count,
                      reduceOp,
                      currentBatch);
         return;
     }
 
-    SPDLOG_DEBUG(
-      "S - sm_reduce - {} {} {} {}", varPtr, varType, reduceOp, currentBatch);
+    SPDLOG_DEBUG("S - sm_reduce - {} {} {} {} {}",
+                 varPtr,
+                 varType,
+                 count,
+                 reduceOp,
+                 currentBatch);
 
     auto dataType = extractSnapshotDataType(varType);
     faabric::util::SnapshotMergeOperation mergeOp =
       extractSnapshotMergeOp(reduceOp);
 
+    wasm::WasmModule* module = getExecutingModule();
+    size_t regionSize = (size_t)count * dataType.first;
+    if (count <= 0 || varPtr < 0 ||
+        varPtr + regionSize > module->getMemorySizeBytes()) {
+        SPDLOG_ERROR("Invalid reduction array {} of {} elements", varPtr, count);
+        throw std::runtime_error("Invalid reduction array");
+    }
+
     faabric::Message* msg = &ExecutorContext::get()->getMsg();
     SPDLOG_DEBUG("Registering reduction variable {}-{} for {} {}",
                  varPtr,
-                 varPtr + dataType.first,
+                 varPtr + regionSize,
                  faabric::util::funcToString(*msg, false),
                  isCurrentBatch ? "this batch" : "next batch");
 
+    std::shared_ptr<faabric::util::SnapshotData> snap = nullptr;
     if (isCurrentBatch) {
         faabric::scheduler::Executor* executor =
           ExecutorContext::get()->getExecutor();
-        auto snap = executor->getMainThreadSnapshot(*msg, false);
-        snap->addMergeRegion(varPtr, dataType.first, dataType.second, mergeOp);
-    } else {
-        wasm::WasmModule* module = getExecutingModule();
-        module->addMergeRegionForNextThreads(
-          varPtr, dataType.first, dataType.second, mergeOp);
+        snap = executor->getMainThreadSnapshot(*msg, false);
     }
+
+    auto addRegion = [&](uint32_t regionPtr,
+                         size_t length,
+                         faabric::util::SnapshotDataType regionType) {
+        if (isCurrentBatch) {
+            snap->addMergeRegion(regionPtr, length, regionType, mergeOp);
+        } else {
+            module->addMergeRegionForNextThreads(
+              regionPtr, length, regionType, mergeOp);
+        }
+    };
+
+    // Untyped operations work on any length of memory
+    if (mergeOp == faabric::util::SnapshotMergeOperation::Bytewise ||
+        mergeOp == faabric::util::SnapshotMergeOperation::Ignore) {
+        addRegion(varPtr, regionSize, faabric::util::SnapshotDataType::Raw);
+        return;
+    }
+
+    bool isAligned = varPtr % dataType.first == 0;
+    if (count > 1 && !isCurrentBatch && isAligned &&
+        threads::canMergeArray(dataType.second, mergeOp)) {
+        module->addArrayReductionForNextThreads(
+          varPtr, count, dataType.second, mergeOp);
+        return;
+    }
+
+    for (I32 i = 0; i < count; i++) {
+        addRegion(varPtr + i * dataType.first, dataType.first, dataType.second);
+    }
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_sm_reduce",
+                               void,
+                               __faasm_sm_reduce,
+                               I32 varPtr,
+                               I32 varType,
+                               I32 reduceOp,
+                               int currentBatch)
+{
+    registerReduction(varPtr, varType, 1, reduceOp, currentBatch);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_sm_reduce_array",
+                               void,
+                               __faasm_sm_reduce_array,
+                               I32 varPtr,
+                               I32 varType,
+                               I32 count,
+                               I32 reduceOp,
+                               int currentBatch)
+{
+    registerReduction(varPtr, varType, count, reduceOp, currentBatch);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__faasm_sm_hint",
+                               void,
+                               __faasm_sm_hint,
+                               I32 varPtr,
+                               I32 length,
+                               I32 hint)
+{
+    SPDLOG_DEBUG("S - sm_hint - {} {} {}", varPtr, length, hint);
+
+    getExecutingModule()->setSnapshotHint(
+      varPtr, length, static_cast<wasm::SnapshotHint>(hint));
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
@@ -178,7 +178,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
  *
  * The function should fill the read buffer until it's reached the final "page"
  * of results, at which point the returned size will be smaller than the read
- * buffer.
+ * buffer. Each call passes the cookie of the entry to start from.
  */
 WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                "fd_readdir",
@@ -200,15 +200,9 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
     storage::FileDescriptor& fileDesc =
       getExecutingWAVMModule()->getFileSystem().getFileDescriptor(fd);
 
-    bool isStartCookie = startCookie == __WASI_DIRCOOKIE_START;
-    if (fileDesc.iterStarted() && isStartCookie) {
-        // Return invalid if we've already started the iterator but also get the
-        // start cookie
-        return __WASI_EINVAL;
-    } else if (!fileDesc.iterStarted() && !isStartCookie) {
-        throw std::runtime_error(
-          "No directory iterator exists, and this is not the start cookie");
-    }
+    // Resume from the cookie, this is a no-op when reading sequentially, and
+    // the start cookie rewinds the iterator
+    fileDesc.seekDir(startCookie);
 
     U8* buffer = Runtime::memoryArrayPtr<U8>(
       getExecutingWAVMModule()->defaultMemory, buf, bufLen);
@@ -320,6 +314,12 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi, "fd_close", I32, wasi_fd_close, I32 fd)
     // TODO - actually closing here can close the preopened fds which messes
     // things up Ignore for now.
 
+    // Scratch files are the exception, closing them frees their memory
+    storage::FileSystem& fs = getExecutingWAVMModule()->getFileSystem();
+    if (fs.fileDescriptorExists(fd) && fs.getFileDescriptor(fd).isScratch()) {
+        fs.closeFileDescriptor(fd);
+    }
+
     return 0;
 }
 
@@ -344,7 +344,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
 
     storage::FileDescriptor& fileDesc = fileSystem.getFileDescriptor(fd);
 
-    auto nativeIovecs = wasiIovecsToNativeIovecs(iovecsPtr, iovecCount);
+    auto& nativeIovecs = wasiIovecsToNativeIovecs(iovecsPtr, iovecCount);
     ssize_t bytesWritten = fileDesc.write(nativeIovecs, iovecCount);
     if (bytesWritten < 0) {
         return fileDesc.getWasiErrno();
@@ -381,10 +381,14 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
       "S - fd_read - {} {} {} ({})", fd, iovecsPtr, iovecCount, path);
 
     storage::FileDescriptor& fileDesc = fileSystem.getFileDescriptor(fd);
-    auto nativeIovecs = wasiIovecsToNativeIovecs(iovecsPtr, iovecCount);
+    auto& nativeIovecs = wasiIovecsToNativeIovecs(iovecsPtr, iovecCount);
+
+    ssize_t bytesRead = fileDesc.read(nativeIovecs, iovecCount);
+    if (bytesRead < 0) {
+        PROF_END(FdRead)
+        return fileDesc.getWasiErrno();
+    }
 
-    int bytesRead =
-      readv(fileDesc.getLinuxFd(), nativeIovecs.data(), iovecCount);
     Runtime::memoryRef<int>(getExecutingWAVMModule()->defaultMemory,
                             resBytesRead) = (int)bytesRead;
 
@@ -878,9 +882,85 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
+/**
+ * Copies a string onto the guest heap using the guest's own malloc, so that
+ * the guest can free it as normal. Returns zero if malloc is not exported.
+ */
+static I32 copyStringToGuestHeap(
+  Runtime::ContextRuntimeData* contextRuntimeData,
+  const std::string& str)
+{
+    WAVMWasmModule* module = getExecutingWAVMModule();
+    Runtime::Function* mallocFunc = module->getExportedFunction("malloc");
+    if (mallocFunc == nullptr) {
+        SPDLOG_WARN("Guest does not export malloc, cannot return string");
+        return 0;
+    }
+
+    Runtime::Context* context =
+      Runtime::getContextFromRuntimeData(contextRuntimeData);
+
+    std::vector<IR::UntaggedValue> args = { (I32)(str.size() + 1) };
+    IR::UntaggedValue result;
+    module->executeWasmFunction(context, mallocFunc, args, result);
+
+    I32 strPtr = result.i32;
+    if (strPtr == 0) {
+        return 0;
+    }
+
+    char* hostPtr = Runtime::memoryArrayPtr<char>(
+      module->defaultMemory, strPtr, str.size() + 1);
+    std::copy(str.begin(), str.end(), hostPtr);
+    hostPtr[str.size()] = '\0';
+
+    return strPtr;
+}
+
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "tmpfile", I32, tmpfile)
 {
-    throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
+    SPDLOG_DEBUG("S - tmpfile");
+
+    WAVMWasmModule* module = getExecutingWAVMModule();
+    storage::FileSystem& fs = module->getFileSystem();
+
+    // Wrapping the fd in a FILE* needs the guest's own fdopen
+    Runtime::Function* fdopenFunc = module->getExportedFunction("fdopen");
+    if (fdopenFunc == nullptr) {
+        SPDLOG_WARN("Guest does not export fdopen, cannot create tmpfile");
+        return 0;
+    }
+
+    int fd = fs.openScratchAnonymous("tmpfile");
+    if (fd < 0) {
+        SPDLOG_WARN("Failed to create scratch tmpfile ({})", fd);
+        return 0;
+    }
+
+    I32 modePtr = copyStringToGuestHeap(contextRuntimeData, "w+");
+    if (modePtr == 0) {
+        fs.closeFileDescriptor(fd);
+        return 0;
+    }
+
+    Runtime::Context* context =
+      Runtime::getContextFromRuntimeData(contextRuntimeData);
+
+    std::vector<IR::UntaggedValue> args = { fd, modePtr };
+    IR::UntaggedValue result;
+    module->executeWasmFunction(context, fdopenFunc, args, result);
+
+    Runtime::Function* freeFunc = module->getExportedFunction("free");
+    if (freeFunc != nullptr) {
+        IR::UntaggedValue freeResult;
+        module->executeWasmFunction(context, freeFunc, { modePtr }, freeResult);
+    }
+
+    if (result.i32 == 0) {
+        fs.closeFileDescriptor(fd);
+    }
+
+    return result.i32;
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "umask", I32, umask, I32 a)
@@ -888,25 +968,59 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env, "umask", I32, umask, I32 a)
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
-WAVM_DEFINE_INTRINSIC_FUNCTION(env, "msync", I32, msync, I32 a, I32 b, I32 c)
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "msync",
+                               I32,
+                               msync,
+                               I32 addr,
+                               I32 length,
+                               I32 flags)
 {
-    throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
+    SPDLOG_DEBUG("S - msync - {} {} {}", addr, length, flags);
+
+    return getExecutingWAVMModule()->syncMappedFile(addr, length, flags);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "tempnam", I32, tempnam, I32 a, I32 b)
 {
     SPDLOG_TRACE("S - tempnam - {} {}", a, b);
-    throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
+
+    // The directory argument is ignored, temporary files always live in the
+    // scratch filesystem
+    storage::ScratchFileSystem& scratch =
+      getExecutingWAVMModule()->getFileSystem().getScratchFileSystem();
+    if (!scratch.isEnabled()) {
+        SPDLOG_WARN("Scratch filesystem disabled, cannot create tempnam");
+        return 0;
+    }
+
+    std::string namePrefix;
+    if (b != 0) {
+        namePrefix = getStringFromWasm(b);
+    }
+
+    std::string name = scratch.createTempName(namePrefix);
+    return copyStringToGuestHeap(contextRuntimeData, name);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                "memfd_create",
                                I32,
                                memfd_create,
-                               I32 a,
-                               I32 b)
+                               I32 namePtr,
+                               I32 flags)
 {
-    throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
+    std::string name = getStringFromWasm(namePtr);
+    SPDLOG_DEBUG("S - memfd_create - {} {}", name, flags);
+
+    int fd =
+      getExecutingWAVMModule()->getFileSystem().openScratchAnonymous(name);
+    if (fd < 0) {
+        SPDLOG_ERROR("Failed to create scratch memfd {} ({})", name, fd);
+        return -1;
+    }
+
+    return fd;
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env, "setgroups", I32, setgroups, I32 a, I32 b)
@@ -928,61 +1042,132 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                "fd_datasync",
                                I32,
                                wasi_fd_datasync,
-                               I32 a)
+                               I32 fd)
 {
-    throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
+    SPDLOG_DEBUG("S - fd_datasync - {}", fd);
+
+    storage::FileDescriptor& fileDesc =
+      getExecutingWAVMModule()->getFileSystem().getFileDescriptor(fd);
+    if (!fileDesc.sync(true)) {
+        return fileDesc.getWasiErrno();
+    }
+
+    return __WASI_ESUCCESS;
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                "fd_pwrite",
                                I32,
                                wasi_fd_pwrite,
-                               I32 a,
-                               I32 b,
-                               I32 c,
-                               I64 d,
-                               I32 e)
+                               I32 fd,
+                               I32 iovecsPtr,
+                               I32 iovecCount,
+                               I64 offset,
+                               I32 resBytesWrittenPtr)
 {
-    throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
+    SPDLOG_TRACE("S - fd_pwrite - {} {} {} {} {}",
+                 fd,
+                 iovecsPtr,
+                 iovecCount,
+                 offset,
+                 resBytesWrittenPtr);
+
+    storage::FileDescriptor& fileDesc =
+      getExecutingWAVMModule()->getFileSystem().getFileDescriptor(fd);
+
+    auto& nativeIovecs = wasiIovecsToNativeIovecs(iovecsPtr, iovecCount);
+    ssize_t bytesWritten = fileDesc.pwrite(nativeIovecs, iovecCount, offset);
+    if (bytesWritten < 0) {
+        return fileDesc.getWasiErrno();
+    }
+
+    Runtime::memoryRef<int32_t>(getExecutingWAVMModule()->defaultMemory,
+                                resBytesWrittenPtr) = bytesWritten;
+
+    return __WASI_ESUCCESS;
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                "fd_pread",
                                I32,
                                wasi_fd_pread,
-                               I32 a,
-                               I32 b,
-                               I32 c,
-                               I64 d,
-                               I32 e)
+                               I32 fd,
+                               I32 iovecsPtr,
+                               I32 iovecCount,
+                               I64 offset,
+                               I32 resBytesReadPtr)
 {
-    throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
+    SPDLOG_TRACE("S - fd_pread - {} {} {} {} {}",
+                 fd,
+                 iovecsPtr,
+                 iovecCount,
+                 offset,
+                 resBytesReadPtr);
+
+    storage::FileDescriptor& fileDesc =
+      getExecutingWAVMModule()->getFileSystem().getFileDescriptor(fd);
+
+    // Reads go straight into wasm memory without touching the fd's offset
+    auto& nativeIovecs = wasiIovecsToNativeIovecs(iovecsPtr, iovecCount);
+    ssize_t bytesRead = fileDesc.pread(nativeIovecs, iovecCount, offset);
+    if (bytesRead < 0) {
+        return fileDesc.getWasiErrno();
+    }
+
+    Runtime::memoryRef<int32_t>(getExecutingWAVMModule()->defaultMemory,
+                                resBytesReadPtr) = bytesRead;
+
+    return __WASI_ESUCCESS;
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                "fd_filestat_set_size",
                                I32,
                                wasi_fd_filestat_set_size,
-                               I32 a,
-                               I64 b)
+                               I32 fd,
+                               I64 size)
 {
-    throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
+    SPDLOG_DEBUG("S - fd_filestat_set_size - {} {}", fd, size);
+
+    storage::FileDescriptor& fileDesc =
+      getExecutingWAVMModule()->getFileSystem().getFileDescriptor(fd);
+    if (!fileDesc.setSize(size)) {
+        return fileDesc.getWasiErrno();
+    }
+
+    return __WASI_ESUCCESS;
 }
 
-WAVM_DEFINE_INTRINSIC_FUNCTION(wasi, "fd_sync", I32, wasi_fd_sync, I32 a)
+WAVM_DEFINE_INTRINSIC_FUNCTION(wasi, "fd_sync", I32, wasi_fd_sync, I32 fd)
 {
-    throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
+    SPDLOG_DEBUG("S - fd_sync - {}", fd);
+
+    storage::FileDescriptor& fileDesc =
+      getExecutingWAVMModule()->getFileSystem().getFileDescriptor(fd);
+    if (!fileDesc.sync(false)) {
+        return fileDesc.getWasiErrno();
+    }
+
+    return __WASI_ESUCCESS;
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                                "fd_allocate",
                                I32,
                                wasi_fd_allocate,
-                               I32 a,
-                               I64 b,
-                               I64 c)
+                               I32 fd,
+                               I64 offset,
+                               I64 len)
 {
-    throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
+    SPDLOG_DEBUG("S - fd_allocate - {} {} {}", fd, offset, len);
+
+    storage::FileDescriptor& fileDesc =
+      getExecutingWAVMModule()->getFileSystem().getFileDescriptor(fd);
+    if (!fileDesc.allocate(offset, len)) {
+        return fileDesc.getWasiErrno();
+    }
+
+    return __WASI_ESUCCESS;
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
@@ -1,7 +1,9 @@
 #include "WAVMWasmModule.h"
 #include "syscalls.h"
 
+#include <cstring>
 #include <linux/membarrier.h>
+#include <sys/mman.h>
 
 #include <WAVM/Runtime/Intrinsics.h>
 #include <WAVM/Runtime/Runtime.h>
@@ -62,21 +64,21 @@ std::shared_ptr<faabric::state::StateKeyValue> getStateKV(I32 keyPtr)
     return kv;
 }
 
-I32 doMmap(I32 addr, I32 length, I32 prot, I32 flags, I32 fd, I32 offset)
+I32 doMmap(I32 addr, I32 length, I32 prot, I32 flags, I32 fd, I64 offset)
 {
-
     SPDLOG_DEBUG(
       "S - mmap - {} {} {} {} {} {}", addr, length, prot, flags, fd, offset);
 
-    // Although we are ignoring the offset we should probably
-    // double check when something explicitly requests one
-    if (offset != 0) {
-        SPDLOG_WARN("WARNING: ignoring non-zero mmap offset ({})", offset);
-    }
-
-    // Likewise with the address hint
-    if (addr != 0) {
-        SPDLOG_WARN("WARNING: ignoring mmap hint at {}", addr);
+    // Only fixed mappings are placed at the requested address, other hints
+    // are ignored
+    uint32_t fixedPtr = 0;
+    if (flags & MAP_FIXED) {
+        if (addr == 0) {
+            return -EINVAL;
+        }
+        fixedPtr = addr;
+    } else if (addr != 0) {
+        SPDLOG_DEBUG("Ignoring mmap hint at {}", addr);
     }
 
     WAVMWasmModule* module = getExecutingWAVMModule();
@@ -85,24 +87,50 @@ I32 doMmap(I32 addr, I32 length, I32 prot, I32 flags, I32 fd, I32 offset)
         // If fd is provided, we're mapping a file into memory
         storage::FileDescriptor& fileDesc =
           module->getFileSystem().getFileDescriptor(fd);
-        return module->mmapFile(fileDesc.getLinuxFd(), length);
-    } else {
-        // Map memory
-        return module->mmapMemory(length);
+
+        // Writes through a shared mapping would bypass the scratch
+        // filesystem's size limit
+        if (fileDesc.isScratch() && (flags & MAP_SHARED) &&
+            (prot & PROT_WRITE)) {
+            SPDLOG_WARN("Rejecting writable shared mapping of scratch fd {}",
+                        fd);
+            return -EACCES;
+        }
+
+        return module->mmapFile(
+          fileDesc.getLinuxFd(), length, prot, flags, offset, fixedPtr);
     }
+
+    if (fixedPtr != 0) {
+        return module->mmapFixedMemory(fixedPtr, length);
+    }
+
+    // Map memory
+    return module->mmapMemory(length);
+}
+
+// Syscall 90, the legacy mmap, takes the offset into the file in bytes
+I32 s__mmap(I32 addr, I32 length, I32 prot, I32 flags, I32 fd, I32 offset)
+{
+    return doMmap(addr, length, prot, flags, fd, (I64)(U32)offset);
 }
 
 /**
  * Note that syscall 192 is mmap2, which has the same interface as mmap except
  * that the final argument specifies the offset into the file in 4096-byte units
- * (instead of bytes, as is done by mmap). Given that we ignore the offset we
- * can just treat it like mmap
+ * (instead of bytes, as is done by mmap).
  */
-I32 s__mmap(I32 addr, I32 length, I32 prot, I32 flags, I32 fd, I32 offset)
+I32 s__mmap2(I32 addr, I32 length, I32 prot, I32 flags, I32 fd, I32 offset)
 {
-    return doMmap(addr, length, prot, flags, fd, offset);
+    return doMmap(addr, length, prot, flags, fd, (I64)(U32)offset * 4096);
 }
 
+/**
+ * Unlike the syscalls, whose -errno results are converted by libc, direct
+ * callers of mmap expect MAP_FAILED and errno to be set. The guest's errno
+ * can't be set from here, so failures are fatal, as they were before file
+ * offsets were supported.
+ */
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                "mmap",
                                I32,
@@ -114,7 +142,15 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 fd,
                                I64 offset)
 {
-    return doMmap(addr, length, prot, flags, fd, (I32)offset);
+    I32 result = doMmap(addr, length, prot, flags, fd, offset);
+
+    // Mappings are page-aligned, so only the last page holds errno values
+    if (result < 0 && result > -4096) {
+        SPDLOG_ERROR("mmap failed ({} - {})", -result, ::strerror(-result));
+        throw std::runtime_error("mmap failed");
+    }
+
+    return result;
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
@@ -6,8 +6,11 @@
 #include <faabric/scheduler/ExecutorContext.h>
 #include <faabric/scheduler/Scheduler.h>
 #include <faabric/snapshot/SnapshotRegistry.h>
+#include <faabric/state/State.h>
 #include <faabric/state/StateKeyValue.h>
 #include <faabric/transport/PointToPointBroker.h>
+#include <faabric/util/bytes.h>
+#include <faabric/util/environment.h>
 #include <faabric/util/func.h>
 #include <faabric/util/gids.h>
 #include <faabric/util/locks.h>
@@ -19,11 +22,19 @@
 #include <faabric/util/string_tools.h>
 #include <faabric/util/timing.h>
 
+#include <conf/FaasmConfig.h>
+#include <threads/CriticalSection.h>
+#include <threads/LocalTeam.h>
+#include <threads/LoopScheduler.h>
+#include <threads/ReductionTree.h>
+#include <threads/TaskPool.h>
 #include <threads/ThreadState.h>
 #include <wasm/WasmExecutionContext.h>
 #include <wasm/WasmModule.h>
 #include <wavm/WAVMWasmModule.h>
 
+#include <thread>
+
 using namespace WAVM;
 using namespace faabric::scheduler;
 
@@ -66,6 +77,90 @@ getExecutingPointToPointGroup()
       msg.groupid());
 }
 
+// Nested teams synchronise locally, and all others through their point-to-point
+// group
+
+static void teamBarrier(faabric::Message* msg)
+{
+    std::shared_ptr<threads::LocalTeam> team = threads::getCurrentLocalTeam();
+    if (team != nullptr) {
+        team->barrier();
+    } else {
+        getExecutingPointToPointGroup()->barrier(msg->groupidx());
+    }
+}
+
+// Teams spanning several hosts, i.e. top-level teams not in single host mode,
+// also need the distributed lock of their point-to-point group
+
+static bool isDistributedTeam(std::shared_ptr<threads::Level> level)
+{
+    return level->numThreads > 1 && threads::getCurrentLocalTeam() == nullptr &&
+           !ExecutorContext::get()->getBatchRequest()->singlehost();
+}
+
+/**
+ * Tasks are queued on per-thread deques shared by the threads of a team on
+ * this host, and are executed by the thread that created them or stolen by
+ * other threads when they are idle. Waiting threads (at a taskwait, taskgroup
+ * or barrier) execute queued tasks rather than blocking.
+ *
+ * The task data is allocated in wasm memory, laid out as the kmp_task_t
+ * struct defined in kmp.h:
+ *
+ * struct kmp_task_t {
+ *     void* shareds;
+ *     kmp_routine_entry_t routine;
+ *     kmp_int32 part_id;
+ *     ...
+ * }
+ *
+ * followed by the task's privates and then its shareds.
+ *
+ * Teams with one thread have nobody to share tasks with, so their tasks are
+ * executed as soon as they're created.
+ */
+static bool initThreadTasks(faabric::Message* msg,
+                            std::shared_ptr<threads::Level> level)
+{
+    if (level->numThreads == 1) {
+        return false;
+    }
+
+    threads::ThreadTasks& threadTasks = threads::getThreadTasks();
+    if (threadTasks.pool == nullptr || threadTasks.groupId != msg->groupid()) {
+        threadTasks.pool =
+          threads::getOrCreateTaskPool(msg->groupid(), level->numThreads);
+        threadTasks.groupId = msg->groupid();
+        threadTasks.threadNum = level->getLocalThreadNum(msg);
+        threadTasks.currentTask =
+          std::make_shared<threads::Task>(0, nullptr, nullptr);
+    }
+
+    return true;
+}
+
+static void executeTasksUntil(Runtime::ContextRuntimeData* contextRuntimeData,
+                              faabric::Message* msg,
+                              const std::function<bool()>& done)
+{
+    getExecutingWAVMModule()->executeOMPTasksUntil(
+      Runtime::getContextFromRuntimeData(contextRuntimeData),
+      msg->appidx(),
+      done);
+}
+
+static void executeTaskNow(Runtime::ContextRuntimeData* contextRuntimeData,
+                           faabric::Message* msg,
+                           I32 taskPtr)
+{
+    getExecutingWAVMModule()->executeOMPTask(
+      Runtime::getContextFromRuntimeData(contextRuntimeData),
+      msg->appidx(),
+      std::make_shared<threads::Task>(taskPtr, nullptr, nullptr),
+      nullptr);
+}
+
 // ------------------------------------------------
 // THREAD NUMS AND LEVELS
 // ------------------------------------------------
@@ -213,7 +308,21 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 globalTid)
 {
     OMP_FUNC_ARGS("__kmpc_barrier {} {}", loc, globalTid);
-    getExecutingPointToPointGroup()->barrier(msg->groupidx());
+
+    if (level->numThreads == 1) {
+        return;
+    }
+
+    // All the team's queued tasks must complete before it passes the barrier
+    if (initThreadTasks(msg, level)) {
+        std::shared_ptr<threads::TaskPool> pool =
+          threads::getThreadTasks().pool;
+        executeTasksUntil(contextRuntimeData, msg, [&pool] {
+            return pool->getPendingCount() == 0;
+        });
+    }
+
+    teamBarrier(msg);
 }
 
 // ----------------------------------------------------
@@ -222,13 +331,19 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
 
 /**
  * Enter code protected by a `critical` construct. This function blocks until
- the thread can enter the critical section.
+ * the thread can enter the critical section.
+ *
+ * Each critical name has its own lock in the module, so threads of local
+ * teams only contend with those entering a section of the same name. Threads
+ * of teams spanning several hosts only take the group's distributed lock, as
+ * also taking a lock local to the host could deadlock with a thread holding
+ * the remote lock. The group only has a single distributed lock, so sections
+ * with different names still exclude each other in distributed teams.
+ *
  * @param loc  source location information.
  * @param global_tid  global thread number.
- * @param crit identity of the critical section. This could be a pointer to a
- lock associated with the critical section, or some other suitably unique value.
-    The lock is not used because Faasm needs to control the locking mechanism
- for the team.
+ * @param crit identity of the critical section, a pointer to the
+ * kmp_critical_name for the section's name.
  */
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                "__kmpc_critical",
@@ -240,19 +355,16 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
 {
     OMP_FUNC_ARGS("__kmpc_critical {} {} {}", loc, globalTid, crit);
 
-    if (level->numThreads > 1) {
+    if (isDistributedTeam(level)) {
         getExecutingPointToPointGroup()->lock(msg->groupidx(), true);
-
-        // NOTE: here we need to pull the latest snapshot diffs from master.
-        // This is a really inefficient way to implement a critical, and needs
-        // more thought as to whether we can avoid doing a request/ response
-        // every time.
+    } else {
+        getExecutingWAVMModule()->getCriticalSection(crit)->lock();
     }
 }
 
 /**
- * Exits code protected by a `critical` construct, releasing the held lock. This
- * function blocks until the thread can enter the critical section.
+ * Exits code protected by a `critical` construct, releasing the lock taken in
+ * __kmpc_critical.
  * @param loc  source location information.
  * @param global_tid  global thread number.
  * @param crit compiler lock. See __kmpc_critical for more information
@@ -267,8 +379,10 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
 {
     OMP_FUNC_ARGS("__kmpc_end_critical {} {} {}", loc, globalTid, crit);
 
-    if (level->numThreads > 1) {
+    if (isDistributedTeam(level)) {
         getExecutingPointToPointGroup()->unlock(msg->groupidx(), true);
+    } else {
+        getExecutingWAVMModule()->getCriticalSection(crit)->unlock();
     }
 }
 
@@ -369,6 +483,201 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
 // FORKING
 // ----------------------------------------------------
 
+/**
+ * Builds the request for a team executed by threads on this host, rather than
+ * through the scheduler. Each team gets a new group ID, as group state (e.g.
+ * dynamic loops and task pools) is keyed by group.
+ */
+static std::shared_ptr<faabric::BatchExecuteRequest> makeLocalTeamRequest(
+  faabric::Message* parentCall,
+  std::shared_ptr<threads::Level> nextLevel,
+  I32 microtaskPtr)
+{
+    int nThreads = nextLevel->numThreads;
+
+    std::shared_ptr<faabric::BatchExecuteRequest> req =
+      faabric::util::batchExecFactory(
+        parentCall->user(), parentCall->function(), nThreads);
+    req->set_type(faabric::BatchExecuteRequest::THREADS);
+    req->set_subtype(ThreadRequestType::OPENMP);
+    req->set_singlehost(true);
+
+    std::vector<uint8_t> serialisedLevel = nextLevel->serialise();
+    req->set_contextdata(serialisedLevel.data(), serialisedLevel.size());
+
+    int groupId = faabric::util::generateGid();
+    for (int i = 0; i < nThreads; i++) {
+        faabric::Message& m = req->mutable_messages()->at(i);
+        m.set_appid(parentCall->appid());
+        m.set_funcptr(microtaskPtr);
+        m.set_appidx(nextLevel->getGlobalThreadNum(i));
+        m.set_groupid(groupId);
+        m.set_groupidx(i);
+        m.set_groupsize(nThreads);
+    }
+
+    return req;
+}
+
+/**
+ * Executes a team on threads local to this host, either on new threads or on
+ * the module's parked team. Each thread takes its own stack from the module,
+ * and the team synchronises through a LocalTeam rather than a point-to-point
+ * group.
+ *
+ * Returns false without executing anything if the parked team is already in
+ * use.
+ */
+static bool executeLocalTeam(WAVMWasmModule* module,
+                             std::shared_ptr<faabric::BatchExecuteRequest> req,
+                             bool parked)
+{
+    int nThreads = req->messages_size();
+    int groupId = req->messages(0).groupid();
+    auto team = std::make_shared<threads::LocalTeam>(groupId, nThreads);
+    faabric::scheduler::Executor* executor =
+      ExecutorContext::get()->getExecutor();
+
+    std::vector<int32_t> results(nThreads, 0);
+    auto job = [module, executor, req, team, &results](int i) {
+        ExecutorContext::set(executor, req, i);
+        WasmExecutionContext wasmCtx(module);
+        threads::setCurrentOpenMPLevel(req);
+        threads::setCurrentLocalTeam(team);
+
+        std::exception_ptr error = nullptr;
+        uint32_t stackTop = module->claimNestedThreadStack();
+        try {
+            results.at(i) = module->executeNestedOMPThread(
+              stackTop, req->mutable_messages()->at(i));
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        module->releaseNestedThreadStack(stackTop);
+        threads::setCurrentLocalTeam(nullptr);
+
+        if (error != nullptr) {
+            std::rethrow_exception(error);
+        }
+    };
+
+    if (parked) {
+        if (!module->runOnParkedTeam(nThreads, job)) {
+            return false;
+        }
+    } else {
+        std::vector<std::exception_ptr> errors(nThreads, nullptr);
+        std::vector<std::thread> threads;
+        for (int i = 0; i < nThreads; i++) {
+            threads.emplace_back([&job, &errors, i] {
+                try {
+                    job(i);
+                } catch (...) {
+                    errors.at(i) = std::current_exception();
+                }
+            });
+        }
+
+        for (auto& t : threads) {
+            t.join();
+        }
+
+        for (auto& e : errors) {
+            if (e != nullptr) {
+                std::rethrow_exception(e);
+            }
+        }
+    }
+
+    for (int i = 0; i < nThreads; i++) {
+        if (results.at(i) != 0) {
+            SPDLOG_ERROR(
+              "Local OpenMP thread {} failed, result {}", i, results.at(i));
+            throw std::runtime_error("OpenMP threads failed");
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Nested parallel regions are executed by new threads on this host, outside
+ * the executor's thread pool, as the pool threads may all be busy executing
+ * the enclosing team.
+ *
+ * When the nested level only has one thread, e.g. because the maximum number
+ * of active levels has been reached, the region is serialised and executed
+ * by the calling thread in its own context.
+ */
+static void forkNestedLevel(WAVMWasmModule* module,
+                            Runtime::Context* callerContext,
+                            std::shared_ptr<threads::Level> parentLevel,
+                            std::shared_ptr<threads::Level> nextLevel,
+                            I32 microtaskPtr)
+{
+    faabric::Message* parentCall = &ExecutorContext::get()->getMsg();
+
+    if (nextLevel->numThreads == 1) {
+        SPDLOG_TRACE("Serialising nested OpenMP level {}", nextLevel->depth);
+
+        // The calling thread is thread zero of the new level
+        nextLevel->globalTidOffset = parentCall->appidx();
+
+        threads::setCurrentOpenMPLevel(nextLevel);
+        int32_t res = module->executeOMPMicrotask(
+          callerContext, microtaskPtr, parentCall->appidx());
+        threads::setCurrentOpenMPLevel(parentLevel);
+
+        if (res != 0) {
+            SPDLOG_ERROR("Serialised OpenMP region failed, result {}", res);
+            throw std::runtime_error("OpenMP threads failed");
+        }
+
+        return;
+    }
+
+    std::shared_ptr<faabric::BatchExecuteRequest> req =
+      makeLocalTeamRequest(parentCall, nextLevel, microtaskPtr);
+
+    SPDLOG_DEBUG("Forking nested OpenMP level {} with {} threads (group {})",
+                 nextLevel->depth,
+                 nextLevel->numThreads,
+                 req->messages(0).groupid());
+
+    executeLocalTeam(module, req, false);
+}
+
+/**
+ * In persistent mode, top-level teams that fit on this host are executed by
+ * the module's parked team, which stays alive between parallel regions until
+ * the function finishes. Each region is handed to the parked threads through
+ * host memory, which avoids going through the scheduler for every region.
+ *
+ * Returns false if the region must be dispatched as a batch instead, i.e. if
+ * the team doesn't fit on this host, or the parked team is already busy with
+ * a region forked by another thread.
+ */
+static bool forkPersistentLevel(WAVMWasmModule* module,
+                                std::shared_ptr<threads::Level> nextLevel,
+                                I32 microtaskPtr)
+{
+    if (conf::getFaasmConfig().ompTeams != "persistent" ||
+        nextLevel->numThreads > faabric::util::getUsableCores()) {
+        return false;
+    }
+
+    faabric::Message* parentCall = &ExecutorContext::get()->getMsg();
+    std::shared_ptr<faabric::BatchExecuteRequest> req =
+      makeLocalTeamRequest(parentCall, nextLevel, microtaskPtr);
+
+    SPDLOG_DEBUG("Running OpenMP region with persistent team of {} (group {})",
+                 nextLevel->numThreads,
+                 req->messages(0).groupid());
+
+    return executeLocalTeam(module, req, true);
+}
+
 /**
  * The LLVM version of this function is implemented in the openmp source at:
  * https://github.com/llvm/llvm-project/blob/main/openmp/runtime/src/kmp_csupport.cpp
@@ -427,8 +736,20 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
     }
 
     if (nextLevel->depth > 1) {
-        SPDLOG_ERROR("Nested OpenMP support removed");
-        throw std::runtime_error("Nested OpenMP support removed");
+        forkNestedLevel(parentModule,
+                        Runtime::getContextFromRuntimeData(contextRuntimeData),
+                        parentLevel,
+                        nextLevel,
+                        microtaskPtr);
+
+        parentLevel->pushedThreads = -1;
+        return;
+    }
+
+    if (forkPersistentLevel(parentModule, nextLevel, microtaskPtr)) {
+        parentModule->clearMergeRegions();
+        parentLevel->pushedThreads = -1;
+        return;
     }
 
     // Set up the chained calls
@@ -462,11 +783,29 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
         m.set_groupidx(i);
     }
 
+    // Make sure the stacks and array reductions exist before the threads'
+    // snapshot is taken
+    parentModule->provisionThreadStacks(nextLevel->numThreads);
+
+    std::vector<faabric::util::SnapshotMergeRegion> mergeRegions =
+      parentModule->getMergeRegions();
+    std::vector<faabric::util::SnapshotMergeRegion> arrayRegions =
+      parentModule->prepareArrayReductions(0, nextLevel->numThreads);
+    mergeRegions.insert(
+      mergeRegions.end(), arrayRegions.begin(), arrayRegions.end());
+
     // Execute the threads
     faabric::scheduler::Executor* executor =
       faabric::scheduler::ExecutorContext::get()->getExecutor();
-    std::vector<std::pair<uint32_t, int>> results =
-      executor->executeThreads(req, parentModule->getMergeRegions());
+    std::vector<std::pair<uint32_t, int>> results;
+    try {
+        results = executor->executeThreads(req, mergeRegions);
+    } catch (...) {
+        parentModule->finishArrayReductions(false);
+        throw;
+    }
+
+    parentModule->finishArrayReductions(true);
 
     for (auto [mid, res] : results) {
         if (res != 0) {
@@ -492,6 +831,20 @@ enum sched_type : int
     sch_lower = 32, /**< lower bound for unordered values */
     sch_static_chunked = 33,
     sch_static = 34, /**< static unspecialized */
+    sch_dynamic_chunked = 35,
+    sch_guided_chunked = 36,
+    sch_runtime = 37,
+    sch_auto = 38,
+    sch_trapezoidal = 39,
+    sch_static_greedy = 40,
+    sch_static_balanced = 41,
+    sch_guided_iterative_chunked = 42,
+    sch_guided_analytical_chunked = 43,
+    sch_static_steal = 44,
+
+    // Modifiers set on the schedule by the compiler, which we ignore
+    sch_modifier_monotonic = (1 << 29),
+    sch_modifier_nonmonotonic = (1 << 30),
 };
 
 template<typename T>
@@ -713,108 +1066,1003 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
     OMP_FUNC_ARGS("__kmpc_for_static_fini {} {}", loc, gtid);
 }
 
-// ---------------------------------------------------
-// REDUCTION
-// ---------------------------------------------------
+// -------------------------------------------------------
+// FOR LOOP DISPATCH
+// -------------------------------------------------------
 
 /**
- * Called to start a reduction.
+ * Loops with a dynamic or guided schedule are handed out in chunks, with each
+ * thread calling __kmpc_dispatch_next until there are no iterations left.
+ * Static schedules may also come through here (e.g. schedule(runtime)), in
+ * which case each thread works out its own chunks without coordinating.
+ *
+ * Dynamic and guided chunks are claimed from a counter of the iterations
+ * handed out so far. When the whole team is on this host, the counter is an
+ * atomic shared between the threads. Otherwise it is held in global state,
+ * and threads claim chunks while holding the team's distributed lock. The
+ * state is removed by the last thread to run out of chunks.
+ *
+ * Each thread keeps track of the loops it has started in the current team.
+ * All threads of a team encounter the same loops in the same order, so the
+ * group ID and this index identify the loop across the team.
  */
-void startReduceCritical(faabric::Message* msg,
-                         std::shared_ptr<threads::Level> level,
-                         int32_t numReduceVars,
-                         int32_t reduceVarPtrs,
-                         int32_t reduceVarsSize)
+struct LoopDispatch
+{
+    int groupId = -1;
+    int loopIdx = -1;
+
+    threads::LoopBounds bounds;
+
+    // A static chunk of zero means each thread gets one balanced chunk
+    bool isStatic = true;
+    uint64_t chunk = 0;
+    uint64_t staticChunkIdx = 0;
+
+    bool isDistributed = false;
+    threads::LoopSchedule schedule = threads::LoopSchedule::Dynamic;
+    std::shared_ptr<threads::DynamicLoop> loop = nullptr;
+};
 
+// Loops in serialised nested regions run on the same thread as any loop
+// enclosing them, so each thread keeps its dispatch state by level depth
+static thread_local std::vector<LoopDispatch> loopDispatches;
+
+static LoopDispatch& getLoopDispatch(int depth)
 {
-    // This function synchronises updates to shared reduce variables.
-    // Each host will have its own copy of these variables, which will be merged
-    // at the end of the parallel section via Faasm shared memory.
-    // This means we only need to synchronise local accesses here, so we only
-    // need a local lock.
-    SPDLOG_TRACE("Entering reduce critical section for group {}",
-                 msg->groupid());
+    if ((int)loopDispatches.size() <= depth) {
+        loopDispatches.resize(depth + 1);
+    }
 
-    std::shared_ptr<faabric::transport::PointToPointGroup> group =
-      faabric::transport::PointToPointGroup::getOrAwaitGroup(msg->groupid());
-    group->localLock();
+    return loopDispatches.at(depth);
 }
 
-/**
- * Called to finish off a reduction.
- */
-void endReduceCritical(faabric::Message* msg, bool barrier)
+template<typename T>
+void dispatch_init(I32 schedule,
+                   T lower,
+                   T upper,
+                   typename std::make_signed<T>::type incr,
+                   typename std::make_signed<T>::type chunk)
 {
+    faabric::Message* msg = &ExecutorContext::get()->getMsg();
     std::shared_ptr<threads::Level> level = threads::getCurrentOpenMPLevel();
-    int localThreadNum = level->getLocalThreadNum(msg);
 
-    // Unlock the critical section
-    std::shared_ptr<faabric::transport::PointToPointGroup> group =
-      faabric::transport::PointToPointGroup::getGroup(msg->groupid());
-    group->localUnlock();
+    LoopDispatch& dispatch = getLoopDispatch(level->depth);
 
-    // Master must make sure all other threads are done
-    group->notify(localThreadNum);
+    if (incr == 0) {
+        SPDLOG_ERROR("OpenMP loop with zero increment");
+        throw std::runtime_error("OpenMP loop with zero increment");
+    }
 
-    // Everyone waits if there's a barrier
-    if (barrier) {
-        PROF_START(FinaliseReduceBarrier)
-        group->barrier(localThreadNum);
-        PROF_END(FinaliseReduceBarrier)
+    // Loops in a serialised region are only seen by this thread, so don't
+    // count towards the team's loops
+    if (level->numThreads > 1) {
+        if (dispatch.groupId != msg->groupid()) {
+            dispatch.groupId = msg->groupid();
+            dispatch.loopIdx = -1;
+        }
+
+        dispatch.loopIdx++;
+    }
+
+    dispatch.bounds = threads::LoopBounds::fromLoop<T>(lower, upper, incr);
+    dispatch.chunk = chunk < 1 ? 1 : chunk;
+    dispatch.staticChunkIdx = 0;
+    dispatch.isDistributed = false;
+    dispatch.loop = nullptr;
+
+    int sched =
+      schedule & ~(sch_modifier_monotonic | sch_modifier_nonmonotonic);
+    switch (sched) {
+        // Like the LLVM runtime, runtime and auto default to static balanced
+        case sch_static:
+        case sch_static_greedy:
+        case sch_static_balanced:
+        case sch_runtime:
+        case sch_auto: {
+            dispatch.isStatic = true;
+            dispatch.chunk = 0;
+            break;
+        }
+        case sch_static_chunked: {
+            dispatch.isStatic = true;
+            break;
+        }
+        case sch_dynamic_chunked:
+        case sch_static_steal: {
+            dispatch.isStatic = false;
+            dispatch.schedule = threads::LoopSchedule::Dynamic;
+            break;
+        }
+        case sch_guided_chunked:
+        case sch_guided_iterative_chunked:
+        case sch_guided_analytical_chunked:
+        case sch_trapezoidal: {
+            dispatch.isStatic = false;
+            dispatch.schedule = threads::LoopSchedule::Guided;
+            break;
+        }
+        default: {
+            SPDLOG_ERROR("Unimplemented OpenMP scheduler {}", schedule);
+            throw std::runtime_error("Unimplemented OpenMP scheduler");
+        }
+    }
+
+    // A single thread takes the whole loop in one go
+    if (level->numThreads == 1) {
+        dispatch.isStatic = true;
+        dispatch.chunk = 0;
+    }
+
+    if (dispatch.isStatic) {
+        return;
+    }
+
+    dispatch.isDistributed =
+      !ExecutorContext::get()->getBatchRequest()->singlehost();
+
+    if (!dispatch.isDistributed) {
+        dispatch.loop =
+          threads::getOrCreateDynamicLoop(dispatch.groupId,
+                                          dispatch.loopIdx,
+                                          dispatch.schedule,
+                                          dispatch.bounds.tripCount,
+                                          dispatch.chunk,
+                                          level->numThreads);
     }
 }
 
-/**
- * This function is called to start the critical section required to perform the
- * reduction operation by each thread. It will then call __kmpc_end_reduce (and
- * its nowait equivalent), when it's finished.
- *
- * It seems that in our case, always returning 1 for both kmpc_reduce and
- * kmpc_reduce_nowait gets the right result.
- *
- * In the OpenMP source we can see a more varied set of return values, but these
- * are for cases we don't yet support (notably teams):
- * https://github.com/llvm/llvm-project/blob/main/openmp/runtime/src/kmp_csupport.cpp
- *
- * Note that the reduce vars passed into this function are the *LOCAL* copies
- * on the thread's own stack used to hold intermediate results. There is
- * apparently no way to get a reference to the final destination of the
- * reduction result in this function, that is only known in kmpc_fork_call.
- */
-WAVM_DEFINE_INTRINSIC_FUNCTION(env,
-                               "__kmpc_reduce",
-                               I32,
-                               __kmpc_reduce,
-                               I32 loc,
-                               I32 gtid,
-                               I32 numReduceVars,
-                               I32 reduceVarsSize,
-                               I32 reduceVarPtrs,
-                               I32 reduceFunc,
-                               I32 lockPtr)
+static bool nextStaticChunk(LoopDispatch& dispatch,
+                            int localThreadNum,
+                            int nThreads,
+                            uint64_t& start,
+                            uint64_t& size)
 {
-    OMP_FUNC_ARGS("__kmpc_reduce {} {} {} {} {} {} {}",
-                  loc,
-                  gtid,
-                  numReduceVars,
-                  reduceVarsSize,
-                  reduceVarPtrs,
-                  reduceFunc,
-                  lockPtr);
+    uint64_t chunkIdx = dispatch.staticChunkIdx++;
 
-    startReduceCritical(
-      msg, level, numReduceVars, reduceVarPtrs, reduceVarsSize);
-    return 1;
+    // Balanced chunks, as in for_static_init
+    if (dispatch.chunk == 0) {
+        if (chunkIdx > 0) {
+            return false;
+        }
+
+        uint64_t smallChunk = dispatch.bounds.tripCount / nThreads;
+        uint64_t extras = dispatch.bounds.tripCount % nThreads;
+        uint64_t t = localThreadNum;
+
+        start = t * smallChunk + std::min(t, extras);
+        size = smallChunk + (t < extras ? 1 : 0);
+
+        return size > 0;
+    }
+
+    // Round-robin chunks
+    start = (localThreadNum + chunkIdx * nThreads) * dispatch.chunk;
+    if (start >= dispatch.bounds.tripCount) {
+        return false;
+    }
+
+    size = std::min(dispatch.chunk, dispatch.bounds.tripCount - start);
+    return true;
 }
 
-/**
- * See __kmpc_reduce
- */
-WAVM_DEFINE_INTRINSIC_FUNCTION(env,
-                               "__kmpc_reduce_nowait",
-                               I32,
-                               __kmpc_reduce_nowait,
-                               I32 loc,
+// A distributed loop's state in global state, only read and written under the
+// team's lock. Starts zeroed.
+struct DistributedLoopState
+{
+    uint64_t nextIteration;
+    uint64_t nFinished;
+};
+
+static bool nextDistributedChunk(LoopDispatch& dispatch,
+                                 faabric::Message* msg,
+                                 int nThreads,
+                                 uint64_t& start,
+                                 uint64_t& size)
+{
+    std::string key =
+      fmt::format("omp_loop_{}_{}", dispatch.groupId, dispatch.loopIdx);
+    faabric::state::State& state = faabric::state::getGlobalState();
+    auto kv = state.getKV(msg->user(), key, sizeof(DistributedLoopState));
+
+    auto group = getExecutingPointToPointGroup();
+    group->lock(msg->groupidx(), true);
+
+    DistributedLoopState loopState;
+    kv->pull();
+    kv->get(BYTES(&loopState));
+
+    start = loopState.nextIteration;
+    bool hasChunk = start < dispatch.bounds.tripCount;
+    if (hasChunk) {
+        size = threads::getLoopChunkSize(dispatch.schedule,
+                                         dispatch.bounds.tripCount - start,
+                                         dispatch.chunk,
+                                         nThreads);
+        loopState.nextIteration += size;
+    } else {
+        loopState.nFinished++;
+    }
+
+    // Each thread runs out of chunks once, so the last to do so can remove the
+    // key, as no other thread will read it again
+    if (loopState.nFinished == (uint64_t)nThreads) {
+        state.deleteKV(msg->user(), key);
+    } else {
+        kv->set(BYTES(&loopState));
+        kv->pushFull();
+    }
+
+    group->unlock(msg->groupidx(), true);
+
+    return hasChunk;
+}
+
+template<typename T>
+I32 dispatch_next(I32* lastIter,
+                  T* lower,
+                  T* upper,
+                  typename std::make_signed<T>::type* stride)
+{
+    faabric::Message* msg = &ExecutorContext::get()->getMsg();
+    std::shared_ptr<threads::Level> level = threads::getCurrentOpenMPLevel();
+    int localThreadNum = level->getLocalThreadNum(msg);
+    LoopDispatch& dispatch = getLoopDispatch(level->depth);
+
+    uint64_t start = 0;
+    uint64_t size = 0;
+    bool hasChunk;
+    if (dispatch.isStatic) {
+        hasChunk = nextStaticChunk(
+          dispatch, localThreadNum, level->numThreads, start, size);
+    } else if (dispatch.isDistributed) {
+        hasChunk =
+          nextDistributedChunk(dispatch, msg, level->numThreads, start, size);
+    } else {
+        hasChunk = dispatch.loop->next(start, size);
+    }
+
+    if (!hasChunk) {
+        if (dispatch.loop != nullptr) {
+            dispatch.loop = nullptr;
+            threads::finishDynamicLoop(dispatch.groupId, dispatch.loopIdx);
+        }
+
+        return 0;
+    }
+
+    dispatch.bounds.getChunk<T>(start, size, *lower, *upper);
+    *stride = (typename std::make_signed<T>::type)dispatch.bounds.incr;
+
+    if (lastIter != nullptr) {
+        *lastIter = (start + size == dispatch.bounds.tripCount);
+    }
+
+    return 1;
+}
+
+/**
+ * @param    loc       Source code location
+ * @param    gtid      Global thread id of this thread
+ * @param    schedule  Scheduling type for the parallel loop
+ * @param    lower     First iteration of the loop
+ * @param    upper     Last iteration of the loop (inclusive)
+ * @param    incr      Loop increment
+ * @param    chunk     The chunk size for the parallel loop
+ *
+ * Called by every thread in the team before it starts taking chunks with
+ * __kmpc_dispatch_next_4. The LLVM implementation is __kmp_dispatch_init in
+ * runtime/src/kmp_dispatch.cpp.
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_dispatch_init_4",
+                               void,
+                               __kmpc_dispatch_init_4,
+                               I32 loc,
+                               I32 gtid,
+                               I32 schedule,
+                               I32 lower,
+                               I32 upper,
+                               I32 incr,
+                               I32 chunk)
+{
+    OMP_FUNC_ARGS("__kmpc_dispatch_init_4 {} {} {} {} {} {} {}",
+                  loc,
+                  gtid,
+                  schedule,
+                  lower,
+                  upper,
+                  incr,
+                  chunk);
+
+    dispatch_init<I32>(schedule, lower, upper, incr, chunk);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_dispatch_init_4u",
+                               void,
+                               __kmpc_dispatch_init_4u,
+                               I32 loc,
+                               I32 gtid,
+                               I32 schedule,
+                               I32 lower,
+                               I32 upper,
+                               I32 incr,
+                               I32 chunk)
+{
+    OMP_FUNC_ARGS("__kmpc_dispatch_init_4u {} {} {} {} {} {} {}",
+                  loc,
+                  gtid,
+                  schedule,
+                  lower,
+                  upper,
+                  incr,
+                  chunk);
+
+    dispatch_init<U32>(schedule, (U32)lower, (U32)upper, incr, chunk);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_dispatch_init_8",
+                               void,
+                               __kmpc_dispatch_init_8,
+                               I32 loc,
+                               I32 gtid,
+                               I32 schedule,
+                               I64 lower,
+                               I64 upper,
+                               I64 incr,
+                               I64 chunk)
+{
+    OMP_FUNC_ARGS("__kmpc_dispatch_init_8 {} {} {} {} {} {} {}",
+                  loc,
+                  gtid,
+                  schedule,
+                  lower,
+                  upper,
+                  incr,
+                  chunk);
+
+    dispatch_init<I64>(schedule, lower, upper, incr, chunk);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_dispatch_init_8u",
+                               void,
+                               __kmpc_dispatch_init_8u,
+                               I32 loc,
+                               I32 gtid,
+                               I32 schedule,
+                               I64 lower,
+                               I64 upper,
+                               I64 incr,
+                               I64 chunk)
+{
+    OMP_FUNC_ARGS("__kmpc_dispatch_init_8u {} {} {} {} {} {} {}",
+                  loc,
+                  gtid,
+                  schedule,
+                  lower,
+                  upper,
+                  incr,
+                  chunk);
+
+    dispatch_init<U64>(schedule, (U64)lower, (U64)upper, incr, chunk);
+}
+
+/**
+ * @param    loc         Source code location
+ * @param    gtid        Global thread id of this thread
+ * @param    lastIterPtr Pointer to the "last iteration" flag (boolean)
+ * @param    lowerPtr    Pointer to the lower bound of the chunk
+ * @param    upperPtr    Pointer to the upper bound of the chunk (inclusive)
+ * @param    stridePtr   Pointer to the stride within the chunk
+ *
+ * Claims the next chunk of the loop set up by __kmpc_dispatch_init_4.
+ *
+ * @return   one if a chunk was claimed, zero when the loop is finished
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_dispatch_next_4",
+                               I32,
+                               __kmpc_dispatch_next_4,
+                               I32 loc,
+                               I32 gtid,
+                               I32 lastIterPtr,
+                               I32 lowerPtr,
+                               I32 upperPtr,
+                               I32 stridePtr)
+{
+    OMP_FUNC_ARGS("__kmpc_dispatch_next_4 {} {} {} {} {} {}",
+                  loc,
+                  gtid,
+                  lastIterPtr,
+                  lowerPtr,
+                  upperPtr,
+                  stridePtr);
+
+    Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
+    I32* lastIter = lastIterPtr == 0
+                      ? nullptr
+                      : &Runtime::memoryRef<I32>(memoryPtr, lastIterPtr);
+    I32* lower = &Runtime::memoryRef<I32>(memoryPtr, lowerPtr);
+    I32* upper = &Runtime::memoryRef<I32>(memoryPtr, upperPtr);
+    I32* stride = &Runtime::memoryRef<I32>(memoryPtr, stridePtr);
+
+    return dispatch_next<I32>(lastIter, lower, upper, stride);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_dispatch_next_4u",
+                               I32,
+                               __kmpc_dispatch_next_4u,
+                               I32 loc,
+                               I32 gtid,
+                               I32 lastIterPtr,
+                               I32 lowerPtr,
+                               I32 upperPtr,
+                               I32 stridePtr)
+{
+    OMP_FUNC_ARGS("__kmpc_dispatch_next_4u {} {} {} {} {} {}",
+                  loc,
+                  gtid,
+                  lastIterPtr,
+                  lowerPtr,
+                  upperPtr,
+                  stridePtr);
+
+    Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
+    I32* lastIter = lastIterPtr == 0
+                      ? nullptr
+                      : &Runtime::memoryRef<I32>(memoryPtr, lastIterPtr);
+    U32* lower = &Runtime::memoryRef<U32>(memoryPtr, lowerPtr);
+    U32* upper = &Runtime::memoryRef<U32>(memoryPtr, upperPtr);
+    I32* stride = &Runtime::memoryRef<I32>(memoryPtr, stridePtr);
+
+    return dispatch_next<U32>(lastIter, lower, upper, stride);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_dispatch_next_8",
+                               I32,
+                               __kmpc_dispatch_next_8,
+                               I32 loc,
+                               I32 gtid,
+                               I32 lastIterPtr,
+                               I32 lowerPtr,
+                               I32 upperPtr,
+                               I32 stridePtr)
+{
+    OMP_FUNC_ARGS("__kmpc_dispatch_next_8 {} {} {} {} {} {}",
+                  loc,
+                  gtid,
+                  lastIterPtr,
+                  lowerPtr,
+                  upperPtr,
+                  stridePtr);
+
+    Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
+    I32* lastIter = lastIterPtr == 0
+                      ? nullptr
+                      : &Runtime::memoryRef<I32>(memoryPtr, lastIterPtr);
+    I64* lower = &Runtime::memoryRef<I64>(memoryPtr, lowerPtr);
+    I64* upper = &Runtime::memoryRef<I64>(memoryPtr, upperPtr);
+    I64* stride = &Runtime::memoryRef<I64>(memoryPtr, stridePtr);
+
+    return dispatch_next<I64>(lastIter, lower, upper, stride);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_dispatch_next_8u",
+                               I32,
+                               __kmpc_dispatch_next_8u,
+                               I32 loc,
+                               I32 gtid,
+                               I32 lastIterPtr,
+                               I32 lowerPtr,
+                               I32 upperPtr,
+                               I32 stridePtr)
+{
+    OMP_FUNC_ARGS("__kmpc_dispatch_next_8u {} {} {} {} {} {}",
+                  loc,
+                  gtid,
+                  lastIterPtr,
+                  lowerPtr,
+                  upperPtr,
+                  stridePtr);
+
+    Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
+    I32* lastIter = lastIterPtr == 0
+                      ? nullptr
+                      : &Runtime::memoryRef<I32>(memoryPtr, lastIterPtr);
+    U64* lower = &Runtime::memoryRef<U64>(memoryPtr, lowerPtr);
+    U64* upper = &Runtime::memoryRef<U64>(memoryPtr, upperPtr);
+    I64* stride = &Runtime::memoryRef<I64>(memoryPtr, stridePtr);
+
+    return dispatch_next<U64>(lastIter, lower, upper, stride);
+}
+
+/**
+ * Only called for ordered loops, which need no extra bookkeeping here as the
+ * loop is cleaned up when __kmpc_dispatch_next runs out of chunks.
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_dispatch_fini_4",
+                               void,
+                               __kmpc_dispatch_fini_4,
+                               I32 loc,
+                               I32 gtid)
+{
+    OMP_FUNC_ARGS("__kmpc_dispatch_fini_4 {} {}", loc, gtid);
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_dispatch_fini_8",
+                               void,
+                               __kmpc_dispatch_fini_8,
+                               I32 loc,
+                               I32 gtid)
+{
+    OMP_FUNC_ARGS("__kmpc_dispatch_fini_8 {} {}", loc, gtid);
+}
+
+// ---------------------------------------------------
+// TASKS
+// ---------------------------------------------------
+
+/**
+ * Allocates a task, returning a pointer to its kmp_task_t.
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_omp_task_alloc",
+                               I32,
+                               __kmpc_omp_task_alloc,
+                               I32 loc,
+                               I32 gtid,
+                               I32 flags,
+                               I32 sizeofTask,
+                               I32 sizeofShareds,
+                               I32 taskEntry)
+{
+    OMP_FUNC_ARGS("__kmpc_omp_task_alloc {} {} {} {} {} {}",
+                  loc,
+                  gtid,
+                  flags,
+                  sizeofTask,
+                  sizeofShareds,
+                  taskEntry);
+
+    WAVMWasmModule* module = getExecutingWAVMModule();
+
+    // Shareds follow the task struct and its privates, pointer-aligned
+    uint32_t sharedsOffset = (sizeofTask + 7) & ~7;
+    uint32_t taskSize = sharedsOffset + sizeofShareds;
+    uint32_t taskPtr = module->allocateTaskMemory(taskSize);
+
+    U8* taskBytes =
+      Runtime::memoryArrayPtr<U8>(module->defaultMemory, taskPtr, taskSize);
+    std::memset(taskBytes, 0, taskSize);
+
+    I32* task = reinterpret_cast<I32*>(taskBytes);
+    task[0] = sizeofShareds > 0 ? taskPtr + sharedsOffset : 0;
+    task[1] = taskEntry;
+
+    return taskPtr;
+}
+
+/**
+ * Queues a task for deferred execution.
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_omp_task",
+                               I32,
+                               __kmpc_omp_task,
+                               I32 loc,
+                               I32 gtid,
+                               I32 taskPtr)
+{
+    OMP_FUNC_ARGS("__kmpc_omp_task {} {} {}", loc, gtid, taskPtr);
+
+    if (!initThreadTasks(msg, level)) {
+        executeTaskNow(contextRuntimeData, msg, taskPtr);
+        return 0;
+    }
+
+    threads::ThreadTasks& threadTasks = threads::getThreadTasks();
+    std::shared_ptr<threads::Task> parent = threadTasks.currentTask;
+    threadTasks.pool->push(
+      threadTasks.threadNum,
+      std::make_shared<threads::Task>(taskPtr, parent, parent->currentGroup));
+
+    return 0;
+}
+
+/**
+ * Queues a task with dependencies on its siblings. Rather than tracking the
+ * dependencies, we wait for all the current task's children to complete,
+ * then execute the task straight away.
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_omp_task_with_deps",
+                               I32,
+                               __kmpc_omp_task_with_deps,
+                               I32 loc,
+                               I32 gtid,
+                               I32 taskPtr,
+                               I32 nDeps,
+                               I32 depList,
+                               I32 nNoAliasDeps,
+                               I32 noAliasDepList)
+{
+    OMP_FUNC_ARGS("__kmpc_omp_task_with_deps {} {} {} {} {} {} {}",
+                  loc,
+                  gtid,
+                  taskPtr,
+                  nDeps,
+                  depList,
+                  nNoAliasDeps,
+                  noAliasDepList);
+
+    if (initThreadTasks(msg, level)) {
+        std::shared_ptr<threads::Task> current =
+          threads::getThreadTasks().currentTask;
+        executeTasksUntil(contextRuntimeData, msg, [&current] {
+            return current->nIncompleteChildren.load() == 0;
+        });
+    }
+
+    executeTaskNow(contextRuntimeData, msg, taskPtr);
+
+    return 0;
+}
+
+/**
+ * Waits for an undeferred task's dependencies, which as above means waiting
+ * for all the current task's children.
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_omp_wait_deps",
+                               void,
+                               __kmpc_omp_wait_deps,
+                               I32 loc,
+                               I32 gtid,
+                               I32 nDeps,
+                               I32 depList,
+                               I32 nNoAliasDeps,
+                               I32 noAliasDepList)
+{
+    OMP_FUNC_ARGS("__kmpc_omp_wait_deps {} {} {} {} {} {}",
+                  loc,
+                  gtid,
+                  nDeps,
+                  depList,
+                  nNoAliasDeps,
+                  noAliasDepList);
+
+    if (initThreadTasks(msg, level)) {
+        std::shared_ptr<threads::Task> current =
+          threads::getThreadTasks().currentTask;
+        executeTasksUntil(contextRuntimeData, msg, [&current] {
+            return current->nIncompleteChildren.load() == 0;
+        });
+    }
+}
+
+/**
+ * Undeferred tasks (e.g. with an if(0) clause) are executed by the compiled
+ * code between these calls, so we only need to make them the current task.
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_omp_task_begin_if0",
+                               void,
+                               __kmpc_omp_task_begin_if0,
+                               I32 loc,
+                               I32 gtid,
+                               I32 taskPtr)
+{
+    OMP_FUNC_ARGS("__kmpc_omp_task_begin_if0 {} {} {}", loc, gtid, taskPtr);
+
+    if (initThreadTasks(msg, level)) {
+        threads::ThreadTasks& threadTasks = threads::getThreadTasks();
+        std::shared_ptr<threads::Task> parent = threadTasks.currentTask;
+        threadTasks.currentTask = std::make_shared<threads::Task>(
+          taskPtr, parent, parent->currentGroup);
+    }
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_omp_task_complete_if0",
+                               void,
+                               __kmpc_omp_task_complete_if0,
+                               I32 loc,
+                               I32 gtid,
+                               I32 taskPtr)
+{
+    OMP_FUNC_ARGS("__kmpc_omp_task_complete_if0 {} {} {}", loc, gtid, taskPtr);
+
+    if (initThreadTasks(msg, level)) {
+        threads::ThreadTasks& threadTasks = threads::getThreadTasks();
+        threadTasks.currentTask = threadTasks.currentTask->parent;
+    }
+
+    getExecutingWAVMModule()->freeTaskMemory(taskPtr);
+}
+
+/**
+ * Waits for the current task's children, though not their descendants.
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_omp_taskwait",
+                               I32,
+                               __kmpc_omp_taskwait,
+                               I32 loc,
+                               I32 gtid)
+{
+    OMP_FUNC_ARGS("__kmpc_omp_taskwait {} {}", loc, gtid);
+
+    if (initThreadTasks(msg, level)) {
+        std::shared_ptr<threads::Task> current =
+          threads::getThreadTasks().currentTask;
+        executeTasksUntil(contextRuntimeData, msg, [&current] {
+            return current->nIncompleteChildren.load() == 0;
+        });
+    }
+
+    return 0;
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_omp_taskyield",
+                               I32,
+                               __kmpc_omp_taskyield,
+                               I32 loc,
+                               I32 gtid,
+                               I32 endPart)
+{
+    OMP_FUNC_ARGS("__kmpc_omp_taskyield {} {} {}", loc, gtid, endPart);
+    return 0;
+}
+
+/**
+ * Opens a taskgroup, which the tasks created by the current task, and all
+ * their descendants, count towards until it's closed.
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_taskgroup",
+                               void,
+                               __kmpc_taskgroup,
+                               I32 loc,
+                               I32 gtid)
+{
+    OMP_FUNC_ARGS("__kmpc_taskgroup {} {}", loc, gtid);
+
+    if (initThreadTasks(msg, level)) {
+        std::shared_ptr<threads::Task> current =
+          threads::getThreadTasks().currentTask;
+        current->currentGroup =
+          std::make_shared<threads::TaskGroup>(current->currentGroup);
+    }
+}
+
+/**
+ * Waits for all the tasks in the current taskgroup, then closes it.
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_end_taskgroup",
+                               void,
+                               __kmpc_end_taskgroup,
+                               I32 loc,
+                               I32 gtid)
+{
+    OMP_FUNC_ARGS("__kmpc_end_taskgroup {} {}", loc, gtid);
+
+    if (initThreadTasks(msg, level)) {
+        std::shared_ptr<threads::Task> current =
+          threads::getThreadTasks().currentTask;
+        std::shared_ptr<threads::TaskGroup> group = current->currentGroup;
+        if (group == nullptr) {
+            SPDLOG_ERROR("Ending taskgroup in thread {} with none open",
+                         localThreadNum);
+            throw std::runtime_error("Ending taskgroup with none open");
+        }
+
+        executeTasksUntil(contextRuntimeData, msg, [&group] {
+            return group->nIncomplete.load() == 0;
+        });
+
+        current->currentGroup = group->parent;
+    }
+}
+
+// ---------------------------------------------------
+// REDUCTION
+// ---------------------------------------------------
+
+/**
+ * Reductions in teams on a single host (including nested teams) combine the
+ * threads' private reduction data in a tree, calling the compiler-generated
+ * reduce function at each step. Thread zero then folds the combined data into
+ * the shared variables, while the other threads skip the final step.
+ *
+ * Teams spanning several hosts instead have every thread update its host's
+ * copy of the shared variables under a local lock, and the hosts' copies are
+ * combined through the merge regions when the threads finish.
+ */
+static bool useReductionTree(std::shared_ptr<threads::Level> level)
+{
+    return level->numThreads > 1 && !isDistributedTeam(level);
+}
+
+static std::shared_ptr<threads::ReductionTree> getReductionTree(
+  faabric::Message* msg,
+  std::shared_ptr<threads::Level> level)
+{
+    // Cache the tree so each reduction doesn't go through the registry
+    static thread_local std::shared_ptr<threads::ReductionTree> tree = nullptr;
+    static thread_local int treeGroupId = -1;
+
+    if (tree == nullptr || treeGroupId != msg->groupid()) {
+        tree =
+          threads::getOrCreateReductionTree(msg->groupid(), level->numThreads);
+        treeGroupId = msg->groupid();
+    }
+
+    return tree;
+}
+
+/**
+ * Returns 1 for thread zero, which must go on to fold the combined data into
+ * the shared variables, and 0 for all others. Other threads wait for thread
+ * zero to be done with their data before returning, which for blocking
+ * reductions is when it ends the reduction, so this also acts as the
+ * reduction's barrier.
+ */
+static I32 startReduceTree(Runtime::ContextRuntimeData* contextRuntimeData,
+                           faabric::Message* msg,
+                           std::shared_ptr<threads::Level> level,
+                           I32 reduceVarPtrs,
+                           I32 reduceFunc,
+                           bool nowait)
+{
+    int localThreadNum = level->getLocalThreadNum(msg);
+    std::shared_ptr<threads::ReductionTree> tree = getReductionTree(msg, level);
+
+    WAVMWasmModule* module = getExecutingWAVMModule();
+    Runtime::Context* ctx =
+      Runtime::getContextFromRuntimeData(contextRuntimeData);
+    Runtime::Function* func = module->getFunctionFromPtr(reduceFunc);
+
+    bool isRoot = tree->reduce(
+      localThreadNum, reduceVarPtrs, [module, ctx, func](I32 lhs, I32 rhs) {
+          std::vector<IR::UntaggedValue> args = { lhs, rhs };
+          IR::UntaggedValue result;
+          module->executeWasmFunction(ctx, func, args, result);
+      });
+
+    if (!isRoot) {
+        tree->awaitRelease(localThreadNum);
+        return 0;
+    }
+
+    // Without a barrier, the others can carry on once their data is combined
+    if (nowait) {
+        tree->release();
+    }
+
+    return 1;
+}
+
+/**
+ * Called to start a reduction in a team spanning several hosts.
+ */
+void startReduceCritical(faabric::Message* msg,
+                         std::shared_ptr<threads::Level> level,
+                         int32_t numReduceVars,
+                         int32_t reduceVarPtrs,
+                         int32_t reduceVarsSize)
+
+{
+    // This function synchronises updates to shared reduce variables.
+    // Each host will have its own copy of these variables, which will be merged
+    // at the end of the parallel section via Faasm shared memory.
+    // This means we only need to synchronise local accesses here, so we only
+    // need a local lock.
+    SPDLOG_TRACE("Entering reduce critical section for group {}",
+                 msg->groupid());
+
+    if (level->numThreads == 1) {
+        return;
+    }
+
+    std::shared_ptr<faabric::transport::PointToPointGroup> group =
+      faabric::transport::PointToPointGroup::getOrAwaitGroup(msg->groupid());
+    group->localLock();
+}
+
+/**
+ * Called to finish off a reduction in a team spanning several hosts.
+ */
+void endReduceCritical(faabric::Message* msg, bool barrier)
+{
+    std::shared_ptr<threads::Level> level = threads::getCurrentOpenMPLevel();
+    int localThreadNum = level->getLocalThreadNum(msg);
+
+    if (level->numThreads == 1) {
+        return;
+    }
+
+    // Unlock the critical section
+    std::shared_ptr<faabric::transport::PointToPointGroup> group =
+      faabric::transport::PointToPointGroup::getGroup(msg->groupid());
+    group->localUnlock();
+
+    // Master must make sure all other threads are done
+    group->notify(localThreadNum);
+
+    // Everyone waits if there's a barrier
+    if (barrier) {
+        PROF_START(FinaliseReduceBarrier)
+        group->barrier(localThreadNum);
+        PROF_END(FinaliseReduceBarrier)
+    }
+}
+
+/**
+ * This function is called by each thread to start a reduction. The return
+ * value tells the thread what to do next, as in the OpenMP source:
+ * https://github.com/llvm/llvm-project/blob/main/openmp/runtime/src/kmp_csupport.cpp
+ *
+ * - 1 means the thread must combine its reduce vars into the shared variables,
+ *   then call __kmpc_end_reduce (or its nowait equivalent).
+ * - 0 means there's nothing left to do, as the thread's reduce vars have been
+ *   combined into another thread's by a tree reduction.
+ *
+ * We don't return 2 (atomic reduction), as the guest's atomics are only
+ * atomic if it's built with the wasm threads feature.
+ *
+ * Note that the reduce vars passed into this function are the *LOCAL* copies
+ * on the thread's own stack used to hold intermediate results. There is
+ * apparently no way to get a reference to the final destination of the
+ * reduction result in this function, that is only known in kmpc_fork_call.
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_reduce",
+                               I32,
+                               __kmpc_reduce,
+                               I32 loc,
+                               I32 gtid,
+                               I32 numReduceVars,
+                               I32 reduceVarsSize,
+                               I32 reduceVarPtrs,
+                               I32 reduceFunc,
+                               I32 lockPtr)
+{
+    OMP_FUNC_ARGS("__kmpc_reduce {} {} {} {} {} {} {}",
+                  loc,
+                  gtid,
+                  numReduceVars,
+                  reduceVarsSize,
+                  reduceVarPtrs,
+                  reduceFunc,
+                  lockPtr);
+
+    if (useReductionTree(level)) {
+        return startReduceTree(
+          contextRuntimeData, msg, level, reduceVarPtrs, reduceFunc, false);
+    }
+
+    startReduceCritical(
+      msg, level, numReduceVars, reduceVarPtrs, reduceVarsSize);
+    return 1;
+}
+
+/**
+ * See __kmpc_reduce
+ */
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "__kmpc_reduce_nowait",
+                               I32,
+                               __kmpc_reduce_nowait,
+                               I32 loc,
                                I32 gtid,
                                I32 numReduceVars,
                                I32 reduceVarsSize,
@@ -831,6 +2079,11 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                   reduceFunc,
                   lockPtr);
 
+    if (useReductionTree(level)) {
+        return startReduceTree(
+          contextRuntimeData, msg, level, reduceVarPtrs, reduceFunc, true);
+    }
+
     startReduceCritical(
       msg, level, numReduceVars, reduceVarPtrs, reduceVarsSize);
     return 1;
@@ -848,6 +2101,13 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 lck)
 {
     OMP_FUNC_ARGS("__kmpc_end_reduce {} {} {}", loc, gtid, lck);
+
+    // Only thread zero ends a tree reduction, and the others are waiting
+    if (useReductionTree(level)) {
+        getReductionTree(msg, level)->release();
+        return;
+    }
+
     endReduceCritical(msg, true);
 }
 
@@ -863,6 +2123,12 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 lck)
 {
     OMP_FUNC_ARGS("__kmpc_end_reduce_nowait {} {} {}", loc, gtid, lck);
+
+    // Tree reductions have already released the other threads
+    if (useReductionTree(level)) {
+        return;
+    }
+
     endReduceCritical(msg, false);
 }
 
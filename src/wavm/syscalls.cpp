@@ -212,9 +212,7 @@ I32 executeSyscall(int syscallNumber,
         case 175:
             return s__rt_sigprocmask(a, b, c, d);
         case 192:
-            // mmap2 is basically the same as mmap (difference is in the final
-            // argument which we ignore)
-            return s__mmap(a, b, c, d, e, f);
+            return s__mmap2(a, b, c, d, e, f);
         case 196:
             return s__lstat64(a, b);
         case 197:
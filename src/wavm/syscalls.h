@@ -235,11 +235,12 @@ sockaddr getSockAddr(int32_t addrPtr);
 void writeNativeStatToWasmStat(struct ::stat64* nativeStatPtr,
                                int32_t wasmStatPtr);
 
-std::vector<iovec> wasmIovecsToNativeIovecs(int32_t wasmIovecPtr,
-                                            int32_t wasmIovecCount);
+// Both return a thread-local buffer, valid until the next call on this thread
+std::vector<iovec>& wasmIovecsToNativeIovecs(int32_t wasmIovecPtr,
+                                             int32_t wasmIovecCount);
 
-std::vector<iovec> wasiIovecsToNativeIovecs(int32_t wasiIovecPtr,
-                                            int32_t wasiIovecCount);
+std::vector<iovec>& wasiIovecsToNativeIovecs(int32_t wasiIovecPtr,
+                                             int32_t wasiIovecCount);
 
 // Faasm
 
@@ -322,6 +323,13 @@ int32_t s__mmap(int32_t addr,
                 int32_t fd,
                 int32_t offset);
 
+int32_t s__mmap2(int32_t addr,
+                 int32_t length,
+                 int32_t prot,
+                 int32_t flags,
+                 int32_t fd,
+                 int32_t offset);
+
 int32_t s__mprotect(int32_t addrPtr, int32_t len, int32_t prot);
 
 int32_t s__nanosleep(int32_t reqPtr, int32_t remPtr);
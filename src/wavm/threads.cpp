@@ -9,6 +9,7 @@
 #include <faabric/util/func.h>
 #include <faabric/util/logging.h>
 
+#include <threads/FutexSync.h>
 #include <threads/ThreadState.h>
 #include <wasm/WasmExecutionContext.h>
 #include <wasm/WasmModule.h>
@@ -16,6 +17,7 @@
 #include <wavm/WAVMWasmModule.h>
 
 #include <linux/futex.h>
+#include <pthread.h>
 
 #include <WAVM/Platform/Thread.h>
 #include <WAVM/Runtime/Intrinsics.h>
@@ -173,10 +175,17 @@ I32 s__futex(I32 uaddrPtr,
 
 // --------------------------
 // PTHREAD MUTEXES - We support pthread mutexes locally as they're important to
-// support thread-safe libc operations.
+// support thread-safe libc operations. The lock state is held in the guest's
+// own struct, and contended threads park on a futex on that address.
 // Note we use trace logging here as these are invoked a lot
 // --------------------------
 
+static int32_t* getSyncWordsPtr(I32 wasmPtr, Uptr nWords = 1)
+{
+    return Runtime::memoryArrayPtr<I32>(
+      getExecutingWAVMModule()->defaultMemory, (Uptr)wasmPtr, nWords);
+}
+
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                "pthread_mutex_init",
                                I32,
@@ -185,6 +194,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 attr)
 {
     SPDLOG_TRACE("S - pthread_mutex_init {} {}", mx, attr);
+    *getSyncWordsPtr(mx) = 0;
 
     return 0;
 }
@@ -196,7 +206,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 mx)
 {
     SPDLOG_TRACE("S - pthread_mutex_lock {}", mx);
-    getExecutingModule()->getOrCreatePthreadMutex(mx)->lock();
+    threads::futexMutexLock(getSyncWordsPtr(mx));
 
     return 0;
 }
@@ -209,10 +219,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
 {
     SPDLOG_TRACE("S - pthread_mutex_trylock {}", mx);
 
-    bool success =
-      getExecutingModule()->getOrCreatePthreadMutex(mx)->try_lock();
-
-    if (!success) {
+    if (!threads::futexMutexTryLock(getSyncWordsPtr(mx))) {
         return EBUSY;
     }
 
@@ -226,7 +233,7 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
                                I32 mx)
 {
     SPDLOG_TRACE("S - pthread_mutex_unlock {}", mx);
-    getExecutingModule()->getPthreadMutex(mx)->unlock();
+    threads::futexMutexUnlock(getSyncWordsPtr(mx));
 
     return 0;
 }
@@ -242,162 +249,226 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(env,
 }
 
 // --------------------------
-// STUBBED PTHREADS - We can safely ignore the following functions
+// PTHREAD CONDITION VARIABLES AND BARRIERS - Also local only, and built on
+// futexes in the same way as the mutexes
 // --------------------------
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
-                               "pthread_mutexattr_init",
+                               "pthread_cond_init",
                                I32,
-                               pthread_mutexattr_init,
+                               pthread_cond_init,
+                               I32 a,
+                               I32 b)
+{
+    SPDLOG_TRACE("S - pthread_cond_init {} {}", a, b);
+    *getSyncWordsPtr(a) = 0;
+
+    return 0;
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "pthread_cond_signal",
+                               I32,
+                               pthread_cond_signal,
                                I32 a)
 {
-    SPDLOG_TRACE("S - pthread_mutexattr_init {}", a);
+    SPDLOG_TRACE("S - pthread_cond_signal {}", a);
+    threads::futexCondSignal(getSyncWordsPtr(a));
 
     return 0;
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
-                               "pthread_mutexattr_destroy",
+                               "pthread_cond_broadcast",
                                I32,
-                               pthread_mutexattr_destroy,
+                               pthread_cond_broadcast,
                                I32 a)
 {
-    SPDLOG_TRACE("S - pthread_mutexattr_destroy {}", a);
+    SPDLOG_TRACE("S - pthread_cond_broadcast {}", a);
+    threads::futexCondBroadcast(getSyncWordsPtr(a));
 
     return 0;
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
-                               "pthread_cond_init",
+                               "pthread_cond_wait",
                                I32,
-                               pthread_cond_init,
+                               pthread_cond_wait,
                                I32 a,
                                I32 b)
 {
-    SPDLOG_TRACE("S - pthread_cond_init {} {}", a, b);
+    SPDLOG_TRACE("S - pthread_cond_wait {} {}", a, b);
+    return threads::futexCondWait(getSyncWordsPtr(a), getSyncWordsPtr(b));
+}
 
-    return 0;
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "pthread_cond_timedwait",
+                               I32,
+                               pthread_cond_timedwait,
+                               I32 a,
+                               I32 b,
+                               I32 c)
+{
+    SPDLOG_TRACE("S - pthread_cond_timedwait {} {} {}", a, b, c);
+
+    auto wasmTimeout = &Runtime::memoryRef<wasm_timespec>(
+      getExecutingWAVMModule()->defaultMemory, (Uptr)c);
+
+    timespec timeout{};
+    timeout.tv_sec = wasmTimeout->tv_sec;
+    timeout.tv_nsec = wasmTimeout->tv_nsec;
+
+    return threads::futexCondWait(
+      getSyncWordsPtr(a), getSyncWordsPtr(b), &timeout);
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
-                               "pthread_cond_signal",
+                               "pthread_cond_destroy",
                                I32,
-                               pthread_cond_signal,
+                               pthread_cond_destroy,
                                I32 a)
 {
-    SPDLOG_TRACE("S - pthread_cond_signal {}", a);
+    SPDLOG_TRACE("S - pthread_cond_destroy {}", a);
 
     return 0;
 }
 
-WAVM_DEFINE_INTRINSIC_FUNCTION(env, "pthread_self", I32, pthread_self)
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "pthread_barrier_init",
+                               I32,
+                               pthread_barrier_init,
+                               I32 a,
+                               I32 b,
+                               I32 count)
 {
-    SPDLOG_TRACE("S - pthread_self");
+    SPDLOG_TRACE("S - pthread_barrier_init {} {} {}", a, b, count);
+
+    if (count <= 0) {
+        return EINVAL;
+    }
+
+    threads::futexBarrierInit(getSyncWordsPtr(a, 3), count);
 
     return 0;
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
-                               "pthread_key_create",
+                               "pthread_barrier_wait",
                                I32,
-                               s__pthread_key_create,
-                               I32 a,
-                               I32 b)
+                               pthread_barrier_wait,
+                               I32 a)
 {
-    SPDLOG_TRACE("S - pthread_key_create {} {}", a, b);
+    SPDLOG_TRACE("S - pthread_barrier_wait {}", a);
+
+    if (threads::futexBarrierWait(getSyncWordsPtr(a, 3))) {
+        return PTHREAD_BARRIER_SERIAL_THREAD;
+    }
 
     return 0;
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
-                               "pthread_key_delete",
+                               "pthread_barrier_destroy",
                                I32,
-                               s__pthread_key_delete,
+                               pthread_barrier_destroy,
                                I32 a)
 {
-    SPDLOG_TRACE("S - pthread_key_delete {}", a);
+    SPDLOG_TRACE("S - pthread_barrier_destroy {}", a);
+
+    return 0;
+}
+
+// --------------------------
+// STUBBED PTHREADS - We can safely ignore the following functions
+// --------------------------
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env,
+                               "pthread_mutexattr_init",
+                               I32,
+                               pthread_mutexattr_init,
+                               I32 a)
+{
+    SPDLOG_TRACE("S - pthread_mutexattr_init {}", a);
 
     return 0;
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
-                               "pthread_getspecific",
+                               "pthread_mutexattr_destroy",
                                I32,
-                               s__pthread_getspecific,
+                               pthread_mutexattr_destroy,
                                I32 a)
 {
-    SPDLOG_TRACE("S - pthread_getspecific {}", a);
+    SPDLOG_TRACE("S - pthread_mutexattr_destroy {}", a);
+
+    return 0;
+}
+
+WAVM_DEFINE_INTRINSIC_FUNCTION(env, "pthread_self", I32, pthread_self)
+{
+    SPDLOG_TRACE("S - pthread_self");
 
     return 0;
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
-                               "pthread_setspecific",
+                               "pthread_key_create",
                                I32,
-                               s__pthread_setspecific,
+                               s__pthread_key_create,
                                I32 a,
                                I32 b)
 {
-    SPDLOG_TRACE("S - pthread_setspecific {} {}", a, b);
+    SPDLOG_TRACE("S - pthread_key_create {} {}", a, b);
 
     return 0;
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
-                               "pthread_cond_destroy",
+                               "pthread_key_delete",
                                I32,
-                               pthread_cond_destroy,
+                               s__pthread_key_delete,
                                I32 a)
 {
-    SPDLOG_TRACE("S - pthread_cond_destroy {}", a);
+    SPDLOG_TRACE("S - pthread_key_delete {}", a);
 
     return 0;
 }
 
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
-                               "pthread_cond_broadcast",
+                               "pthread_getspecific",
                                I32,
-                               pthread_cond_broadcast,
+                               s__pthread_getspecific,
                                I32 a)
 {
-    SPDLOG_TRACE("S - pthread_cond_broadcast {}", a);
+    SPDLOG_TRACE("S - pthread_getspecific {}", a);
 
     return 0;
 }
 
-// --------------------------
-// Unsupported
-// --------------------------
-
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
-                               "pthread_equal",
+                               "pthread_setspecific",
                                I32,
-                               pthread_equal,
+                               s__pthread_setspecific,
                                I32 a,
                                I32 b)
 {
-    SPDLOG_TRACE("S - pthread_equal {} {}", a, b);
-    throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
-}
+    SPDLOG_TRACE("S - pthread_setspecific {} {}", a, b);
 
-WAVM_DEFINE_INTRINSIC_FUNCTION(env,
-                               "pthread_cond_timedwait",
-                               I32,
-                               pthread_cond_timedwait,
-                               I32 a,
-                               I32 b,
-                               I32 c)
-{
-    throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
+    return 0;
 }
 
+// --------------------------
+// Unsupported
+// --------------------------
+
 WAVM_DEFINE_INTRINSIC_FUNCTION(env,
-                               "pthread_cond_wait",
+                               "pthread_equal",
                                I32,
-                               pthread_cond_wait,
+                               pthread_equal,
                                I32 a,
                                I32 b)
 {
+    SPDLOG_TRACE("S - pthread_equal {} {}", a, b);
     throwException(Runtime::ExceptionTypes::calledUnimplementedIntrinsic);
 }
 
@@ -9,6 +9,8 @@
 #include <faabric/util/logging.h>
 #include <faabric/util/timing.h>
 
+#include <storage/Poll.h>
+
 using namespace WAVM;
 
 namespace wasm {
@@ -87,42 +89,26 @@ WAVM_DEFINE_INTRINSIC_FUNCTION(wasi,
                  resNEvents);
     WAVMWasmModule* module = getExecutingWAVMModule();
 
+    if (nSubs <= 0) {
+        return __WASI_EINVAL;
+    }
+
     auto inEvents = Runtime::memoryArrayPtr<__wasi_subscription_t>(
       module->defaultMemory, subscriptionsPtr, nSubs);
     auto outEvents = Runtime::memoryArrayPtr<__wasi_event_t>(
       module->defaultMemory, eventsPtr, nSubs);
 
-    for (int i = 0; i < nSubs; i++) {
-        __wasi_subscription_t* thisSub = &inEvents[i];
-
-        if (thisSub->type == __WASI_EVENTTYPE_CLOCK) {
-            // This is a timing event like a sleep
-            uint64_t timeoutNanos = thisSub->u.clock.timeout;
-            int clockType = 0;
-            if (thisSub->u.clock.clock_id == __WASI_CLOCK_MONOTONIC) {
-                clockType = CLOCK_MONOTONIC;
-            } else if (thisSub->u.clock.clock_id == __WASI_CLOCK_REALTIME) {
-                clockType = CLOCK_REALTIME;
-            } else {
-                throw std::runtime_error("Unimplemented clock type");
-            }
-
-            // Do the sleep
-            timespec t{};
-            faabric::util::nanosToTimespec(timeoutNanos, &t);
-            clock_nanosleep(clockType, 0, &t, nullptr);
-        } else {
-            throw std::runtime_error("Unimplemented event type");
-        }
+    storage::FileSystem& fs = module->getFileSystem();
+    int nEvents =
+      storage::pollOneoff(inEvents, outEvents, nSubs, [&fs](int wasmFd) {
+          if (!fs.fileDescriptorExists(wasmFd)) {
+              return -1;
+          }
 
-        // Say that the event has occurred
-        __wasi_event_t* thisEvent = &outEvents[i];
-        thisEvent->type = thisSub->type;
-        thisEvent->error = __WASI_ESUCCESS;
-    }
+          return fs.getFileDescriptor(wasmFd).getLinuxFd();
+      });
 
-    // Write the result
-    Runtime::memoryRef<U32>(module->defaultMemory, resNEvents) = (U32)nSubs;
+    Runtime::memoryRef<U32>(module->defaultMemory, resNEvents) = (U32)nEvents;
 
     return __WASI_ESUCCESS;
 }
@@ -1,5 +1,6 @@
 #include "syscalls.h"
 
+#include <storage/IoEngine.h>
 #include <wavm/WAVMWasmModule.h>
 
 #include <faabric/scheduler/ExecutorContext.h>
@@ -100,16 +101,17 @@ void writeNativeStatToWasmStat(struct ::stat64* nativeStatPtr, I32 wasmStatPtr)
     wasmHostPtr->st_ino = nativeStatPtr->st_ino;
 }
 
-std::vector<::iovec> wasmIovecsToNativeIovecs(I32 wasmIovecPtr,
-                                              I32 wasmIovecCount)
+std::vector<::iovec>& wasmIovecsToNativeIovecs(I32 wasmIovecPtr,
+                                               I32 wasmIovecCount)
 {
     // Get array of wasm iovecs from memory
     Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
     auto wasmIovecs = Runtime::memoryArrayPtr<wasm_iovec>(
       memoryPtr, wasmIovecPtr, wasmIovecCount);
 
-    // Convert to native iovecs
-    std::vector<::iovec> nativeIovecs(wasmIovecCount, (::iovec){});
+    // Convert to native iovecs, reusing this thread's buffer
+    std::vector<::iovec>& nativeIovecs =
+      storage::getIovecBuffer(wasmIovecCount);
     for (int i = 0; i < wasmIovecCount; i++) {
 
         wasm_iovec wasmIovec = wasmIovecs[i];
@@ -124,8 +126,8 @@ std::vector<::iovec> wasmIovecsToNativeIovecs(I32 wasmIovecPtr,
     return nativeIovecs;
 }
 
-std::vector<::iovec> wasiIovecsToNativeIovecs(I32 wasiIovecPtr,
-                                              I32 wasiIovecCount)
+std::vector<::iovec>& wasiIovecsToNativeIovecs(I32 wasiIovecPtr,
+                                               I32 wasiIovecCount)
 {
     // Get array of wasi iovecs from memory
     Runtime::Memory* memoryPtr = getExecutingWAVMModule()->defaultMemory;
@@ -133,8 +135,9 @@ std::vector<::iovec> wasiIovecsToNativeIovecs(I32 wasiIovecPtr,
     auto wasmIovecs = Runtime::memoryArrayPtr<__wasi_ciovec_t>(
       memoryPtr, wasiIovecPtr, wasiIovecCount);
 
-    // Convert to native iovecs
-    std::vector<::iovec> nativeIovecs(wasiIovecCount, (::iovec){});
+    // Convert to native iovecs, reusing this thread's buffer
+    std::vector<::iovec>& nativeIovecs =
+      storage::getIovecBuffer(wasiIovecCount);
     for (int i = 0; i < wasiIovecCount; i++) {
         __wasi_ciovec_t wasiIovec = wasmIovecs[i];
         U8* outputPtr = &Runtime::memoryRef<U8>(memoryPtr, wasiIovec.buf);
@@ -24,10 +24,24 @@ TEST_CASE("Test default faasm config initialisation", "[conf]")
 
     REQUIRE(conf.pythonPreload == "off");
     REQUIRE(conf.captureStdout == "off");
+    REQUIRE(conf.stdoutCaptureMaxKb == 1024);
+    REQUIRE(conf.stdoutCapturePolicy == "tail");
+    REQUIRE(conf.stdoutSink.empty());
 
     REQUIRE(conf.chainedCallTimeout == 300000);
 
     REQUIRE(conf.wasmVm == "wavm");
+    REQUIRE(conf.modulePoolSize == 0);
+    REQUIRE(conf.hugePages == "off");
+    REQUIRE(conf.pthreadDispatch == "join");
+    REQUIRE(conf.pthreadBatchWindowUs == 500);
+    REQUIRE(conf.ompTeams == "batch");
+    REQUIRE(conf.ompMaxActiveLevels == 1);
+
+    REQUIRE(conf.scratchFsPrefix.empty());
+    REQUIRE(conf.scratchFsMaxMb == 64);
+
+    REQUIRE(conf.ioEngine == "syscall");
 
     REQUIRE(conf.s3Bucket == "faasm");
     REQUIRE(conf.s3Host == "minio");
@@ -47,12 +61,26 @@ TEST_CASE("Test overriding faasm config initialisation", "[conf]")
 
     std::string pythonPre = setEnvVar("PYTHON_PRELOAD", "on");
     std::string captureStdout = setEnvVar("CAPTURE_STDOUT", "on");
+    std::string stdoutMaxKb = setEnvVar("STDOUT_CAPTURE_MAX_KB", "16");
+    std::string stdoutPolicy = setEnvVar("STDOUT_CAPTURE_POLICY", "head");
+    std::string stdoutSink = setEnvVar("STDOUT_SINK", "/tmp/stdout");
     std::string wasmVm = setEnvVar("WASM_VM", "blah");
+    std::string modulePoolSize = setEnvVar("MODULE_POOL_SIZE", "20");
+    std::string hugePages = setEnvVar("HUGE_PAGES", "demo/omp,mpi/stencil");
+    std::string pthreadDispatch = setEnvVar("PTHREAD_DISPATCH", "eager");
+    std::string pthreadWindow = setEnvVar("PTHREAD_BATCH_WINDOW_US", "250");
+    std::string ompTeams = setEnvVar("OMP_TEAMS", "persistent");
+    std::string ompLevels = setEnvVar("OMP_MAX_ACTIVE_LEVELS", "3");
 
     std::string chainedTimeout = setEnvVar("CHAINED_CALL_TIMEOUT", "9999");
 
     std::string faasmLocalDir = setEnvVar("FAASM_LOCAL_DIR", "/tmp/blah");
 
+    std::string scratchPrefix = setEnvVar("SCRATCH_FS_PREFIX", "/tmp");
+    std::string scratchMaxMb = setEnvVar("SCRATCH_FS_MAX_MB", "16");
+
+    std::string ioEngine = setEnvVar("IO_ENGINE", "io_uring");
+
     std::string s3Bucket = setEnvVar("S3_BUCKET", "dummy-bucket");
     std::string s3Host = setEnvVar("S3_HOST", "dummy-host");
     std::string s3Port = setEnvVar("S3_PORT", "123456");
@@ -69,7 +97,16 @@ TEST_CASE("Test overriding faasm config initialisation", "[conf]")
 
     REQUIRE(conf.pythonPreload == "on");
     REQUIRE(conf.captureStdout == "on");
+    REQUIRE(conf.stdoutCaptureMaxKb == 16);
+    REQUIRE(conf.stdoutCapturePolicy == "head");
+    REQUIRE(conf.stdoutSink == "/tmp/stdout");
     REQUIRE(conf.wasmVm == "blah");
+    REQUIRE(conf.modulePoolSize == 20);
+    REQUIRE(conf.hugePages == "demo/omp,mpi/stencil");
+    REQUIRE(conf.pthreadDispatch == "eager");
+    REQUIRE(conf.pthreadBatchWindowUs == 250);
+    REQUIRE(conf.ompTeams == "persistent");
+    REQUIRE(conf.ompMaxActiveLevels == 3);
 
     REQUIRE(conf.chainedCallTimeout == 9999);
 
@@ -78,6 +115,11 @@ TEST_CASE("Test overriding faasm config initialisation", "[conf]")
     REQUIRE(conf.runtimeFilesDir == "/tmp/blah/runtime_root");
     REQUIRE(conf.sharedFilesDir == "/tmp/blah/shared");
 
+    REQUIRE(conf.scratchFsPrefix == "/tmp");
+    REQUIRE(conf.scratchFsMaxMb == 16);
+
+    REQUIRE(conf.ioEngine == "io_uring");
+
     REQUIRE(conf.s3Bucket == "dummy-bucket");
     REQUIRE(conf.s3Host == "dummy-host");
     REQUIRE(conf.s3Port == "123456");
@@ -93,12 +135,26 @@ TEST_CASE("Test overriding faasm config initialisation", "[conf]")
 
     setEnvVar("PYTHON_PRELOAD", pythonPre);
     setEnvVar("CAPTURE_STDOUT", captureStdout);
+    setEnvVar("STDOUT_CAPTURE_MAX_KB", stdoutMaxKb);
+    setEnvVar("STDOUT_CAPTURE_POLICY", stdoutPolicy);
+    setEnvVar("STDOUT_SINK", stdoutSink);
     setEnvVar("WASM_VM", wasmVm);
+    setEnvVar("MODULE_POOL_SIZE", modulePoolSize);
+    setEnvVar("HUGE_PAGES", hugePages);
+    setEnvVar("PTHREAD_DISPATCH", pthreadDispatch);
+    setEnvVar("PTHREAD_BATCH_WINDOW_US", pthreadWindow);
+    setEnvVar("OMP_TEAMS", ompTeams);
+    setEnvVar("OMP_MAX_ACTIVE_LEVELS", ompLevels);
 
     setEnvVar("CHAINED_CALL_TIMEOUT", chainedTimeout);
 
     setEnvVar("FAASM_LOCAL_DIR", faasmLocalDir);
 
+    setEnvVar("SCRATCH_FS_PREFIX", scratchPrefix);
+    setEnvVar("SCRATCH_FS_MAX_MB", scratchMaxMb);
+
+    setEnvVar("IO_ENGINE", ioEngine);
+
     setEnvVar("S3_BUCKET", s3Bucket);
     setEnvVar("S3_HOST", s3Host);
     setEnvVar("S3_PORT", s3Port);
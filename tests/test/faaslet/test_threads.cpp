@@ -10,6 +10,7 @@
 #include <faabric/util/func.h>
 #include <faabric/util/testing.h>
 
+#include <conf/FaasmConfig.h>
 #include <wavm/WAVMWasmModule.h>
 
 namespace tests {
@@ -44,4 +45,32 @@ TEST_CASE_METHOD(PthreadTestFixture, "Run thread checks locally", "[threads]")
 {
     runTestLocally("threads_check");
 }
+
+class EagerPthreadTestFixture
+  : public PthreadTestFixture
+  , public FaasmConfTestFixture
+{
+  public:
+    EagerPthreadTestFixture()
+      : faasmConf(FaasmConfTestFixture::conf)
+    {
+        faasmConf.pthreadDispatch = "eager";
+    }
+
+    ~EagerPthreadTestFixture() {}
+
+  protected:
+    conf::FaasmConfig& faasmConf;
+};
+
+TEST_CASE_METHOD(EagerPthreadTestFixture,
+                 "Run thread checks with eager dispatch",
+                 "[threads]")
+{
+    SECTION("No batch window") { faasmConf.pthreadBatchWindowUs = 0; }
+
+    SECTION("Default batch window") {}
+
+    runTestLocally("threads_check");
+}
 }
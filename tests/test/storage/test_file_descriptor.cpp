@@ -250,6 +250,63 @@ TEST_CASE("Test seek", "[storage]")
     boost::filesystem::remove(realPath);
 }
 
+TEST_CASE("Test positional read and write", "[storage]")
+{
+    FileSystem fs;
+    fs.prepareFilesystem();
+
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+    std::string dummyPath = "dummy_positional_file.txt";
+    std::string realPath = conf.runtimeFilesDir + "/" + dummyPath;
+    boost::filesystem::remove(realPath);
+
+    uint64_t rights = __WASI_RIGHT_FD_READ | __WASI_RIGHT_FD_WRITE;
+    int newFd = fs.openFileDescriptor(
+      DEFAULT_ROOT_FD, dummyPath, rights, 0, 0, __WASI_O_CREAT, 0);
+    REQUIRE(newFd > 0);
+    FileDescriptor& fileDesc = fs.getFileDescriptor(newFd);
+
+    // Write at an offset, leaving the fd's offset where it was
+    std::vector<uint8_t> dataA = { 1, 2, 3, 4 };
+    std::vector<::iovec> writeIovecs = { { dataA.data(), dataA.size() } };
+    REQUIRE(fileDesc.pwrite(writeIovecs, 1, 4) == 4);
+    REQUIRE(fileDesc.tell() == 0);
+
+    // Read it back across two iovecs
+    std::vector<uint8_t> readA(2);
+    std::vector<uint8_t> readB(2);
+    std::vector<::iovec> readIovecs = { { readA.data(), readA.size() },
+                                        { readB.data(), readB.size() } };
+    REQUIRE(fileDesc.pread(readIovecs, 2, 4) == 4);
+    REQUIRE(readA == std::vector<uint8_t>({ 1, 2 }));
+    REQUIRE(readB == std::vector<uint8_t>({ 3, 4 }));
+    REQUIRE(fileDesc.tell() == 0);
+
+    // Gap at the start is zeroed
+    REQUIRE(fileDesc.pread(readIovecs, 2, 0) == 4);
+    REQUIRE(readA == std::vector<uint8_t>({ 0, 0 }));
+
+    // Reading past the end returns nothing
+    REQUIRE(fileDesc.pread(readIovecs, 2, 100) == 0);
+
+    // Resize and allocate
+    REQUIRE(fileDesc.setSize(6));
+    REQUIRE(boost::filesystem::file_size(realPath) == 6);
+
+    REQUIRE(fileDesc.allocate(0, 20));
+    REQUIRE(boost::filesystem::file_size(realPath) == 20);
+
+    REQUIRE(fileDesc.sync(true));
+    REQUIRE(fileDesc.sync(false));
+
+    // Positional I/O on a closed fd fails cleanly
+    fileDesc.close();
+    REQUIRE(fileDesc.pread(readIovecs, 2, 0) == -1);
+    REQUIRE(fileDesc.getWasiErrno() == __WASI_EBADF);
+
+    boost::filesystem::remove(realPath);
+}
+
 TEST_CASE("Test stat and read shared file", "[storage]")
 {
     SharedFiles::clear();
@@ -413,5 +470,40 @@ TEST_CASE("Test readdir iterator and buffer", "[storage]")
 
         checkWasiDirentInBuffer(buffer2.data(), entC);
     }
+
+    SECTION("Resuming from cookies")
+    {
+        // Jump forwards, backwards and back to the start
+        std::vector<uint64_t> cookies = { 10, 11, 30, 5, 0, 20 };
+        for (auto cookie : cookies) {
+            fileDesc.seekDir(cookie);
+            storage::DirEnt ent = fileDesc.iterNext();
+            REQUIRE(ent.next == cookie + 1);
+            REQUIRE(ent.path == expectedList.at(cookie));
+        }
+
+        // Seeking past the end finishes the iterator
+        fileDesc.seekDir(expectedList.size() + 10);
+        REQUIRE(fileDesc.iterFinished());
+
+        // Fill a buffer from an arbitrary cookie, then resume from the cookie
+        // of the last complete entry
+        fileDesc.seekDir(7);
+        storage::DirEnt entA = fileDesc.iterNext();
+        storage::DirEnt entB = fileDesc.iterNext();
+        size_t sizeA = sizeof(__wasi_dirent_t) + entA.path.size();
+
+        std::vector<uint8_t> buffer(sizeA + 5);
+        fileDesc.seekDir(7);
+        size_t bytesCopied =
+          fileDesc.copyDirentsToWasiBuffer(buffer.data(), buffer.size());
+        REQUIRE(bytesCopied == buffer.size());
+        checkWasiDirentInBuffer(buffer.data(), entA);
+
+        std::vector<uint8_t> buffer2(1024);
+        fileDesc.seekDir(entA.next);
+        fileDesc.copyDirentsToWasiBuffer(buffer2.data(), buffer2.size());
+        checkWasiDirentInBuffer(buffer2.data(), entB);
+    }
 }
 }
@@ -0,0 +1,114 @@
+#include <catch2/catch.hpp>
+
+#include <storage/IoEngine.h>
+
+#include <fcntl.h>
+#include <memory>
+#include <unistd.h>
+
+using namespace storage;
+
+namespace tests {
+
+static void checkEngine(IoEngine& engine)
+{
+    std::string filePath = "/tmp/faasm_io_engine_test";
+    int fd = ::open(filePath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    REQUIRE(fd > 0);
+
+    // Vectored write at the current offset
+    std::string partA = "hello ";
+    std::string partB = "world";
+    std::vector<::iovec> writeIovecs = {
+        { partA.data(), partA.size() },
+        { partB.data(), partB.size() },
+    };
+    REQUIRE(engine.writev(fd, writeIovecs.data(), 2) == 11);
+
+    // Read back at the current offset
+    ::lseek(fd, 0, SEEK_SET);
+    std::string actual(11, '\0');
+    ::iovec readIovec = { actual.data(), actual.size() };
+    REQUIRE(engine.readv(fd, &readIovec, 1) == 11);
+    REQUIRE(actual == "hello world");
+
+    // Batch of positional reads on the same fd
+    int nReqs = 20;
+    std::vector<std::string> buffers(nReqs, std::string(5, '\0'));
+    std::vector<::iovec> iovecs(nReqs);
+    std::vector<IoRequest> batch(nReqs);
+    for (int i = 0; i < nReqs; i++) {
+        ::pwrite(fd, "abcde", 5, 20 + i * 5);
+
+        iovecs[i] = { buffers[i].data(), 5 };
+        batch[i].op = IoOp::Read;
+        batch[i].linuxFd = fd;
+        batch[i].iovecs = &iovecs[i];
+        batch[i].iovecCount = 1;
+        batch[i].offset = 20 + i * 5;
+    }
+
+    engine.submitBatch(batch);
+
+    for (int i = 0; i < nReqs; i++) {
+        REQUIRE(batch[i].result == 5);
+        REQUIRE(buffers[i] == "abcde");
+    }
+
+    // Reusing the fd number for another file must not read the old one
+    ::close(fd);
+    std::string otherPath = "/tmp/faasm_io_engine_test_other";
+    int otherFd = ::open(otherPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    REQUIRE(otherFd == fd);
+    ::pwrite(otherFd, "vwxyz", 5, 20);
+
+    engine.submitBatch(batch);
+    REQUIRE(batch[0].result == 5);
+    REQUIRE(buffers[0] == "vwxyz");
+    REQUIRE(batch[1].result == 0);
+
+    // Errors come back as negative errnos
+    ::close(otherFd);
+    REQUIRE(engine.readv(fd, &readIovec, 1) == -EBADF);
+
+    ::unlink(filePath.c_str());
+    ::unlink(otherPath.c_str());
+}
+
+TEST_CASE("Test iovec buffer is reused", "[storage]")
+{
+    std::vector<::iovec>& bufferA = getIovecBuffer(10);
+    REQUIRE(bufferA.size() >= 10);
+
+    std::vector<::iovec>& bufferB = getIovecBuffer(5);
+    REQUIRE(&bufferA == &bufferB);
+    REQUIRE(bufferB.size() >= 10);
+
+    ::iovec* dataBefore = bufferB.data();
+    std::vector<::iovec>& bufferC = getIovecBuffer(8);
+    REQUIRE(bufferC.data() == dataBefore);
+}
+
+TEST_CASE("Test syscall IO engine", "[storage]")
+{
+    SyscallIoEngine engine;
+    REQUIRE(engine.getName() == IO_ENGINE_SYSCALL);
+
+    checkEngine(engine);
+}
+
+#ifdef FAASM_IO_URING
+TEST_CASE("Test io_uring IO engine", "[storage]")
+{
+    IoUringIoEngine engine;
+    if (!engine.isReady()) {
+        WARN("io_uring not supported by kernel, skipping");
+        return;
+    }
+
+    REQUIRE(engine.getName() == IO_ENGINE_IO_URING);
+
+    checkEngine(engine);
+}
+#endif
+}
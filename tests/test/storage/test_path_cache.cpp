@@ -0,0 +1,178 @@
+#include <catch2/catch.hpp>
+
+#include <WAVM/WASI/WASIABI.h>
+
+#include <conf/FaasmConfig.h>
+#include <storage/FileSystem.h>
+#include <storage/PathCache.h>
+
+#include <faabric/util/files.h>
+
+#include <boost/filesystem.hpp>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace storage;
+
+namespace tests {
+
+TEST_CASE("Test path cache hits and invalidation", "[storage]")
+{
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+    std::string dummyDir = "path_cache_test_dir";
+    std::string realDir = conf.runtimeFilesDir + "/" + dummyDir;
+    boost::filesystem::remove_all(realDir);
+    boost::filesystem::create_directories(realDir + "/a");
+
+    PathCache cache;
+    struct ::stat statBuf;
+
+    // Create a file, which caches its parent
+    int fd = cache.open(dummyDir + "/a/file.txt", O_CREAT | O_WRONLY, 0644);
+    REQUIRE(fd > 0);
+    ::close(fd);
+
+    PathCacheStats stats = cache.getStats();
+    REQUIRE(stats.misses == 1);
+    REQUIRE(stats.cachedDirs == 1);
+
+    // Different spellings of the same path hit the cache
+    REQUIRE(cache.stat(dummyDir + "/a/file.txt", &statBuf) == 0);
+    REQUIRE(cache.stat("/" + dummyDir + "//a/./file.txt", &statBuf) == 0);
+    REQUIRE(cache.stat(dummyDir + "/a/missing.txt", &statBuf) == -ENOENT);
+
+    stats = cache.getStats();
+    REQUIRE(stats.hits == 3);
+    REQUIRE(stats.misses == 1);
+
+    // Paths with .. bypass the cache
+    REQUIRE(cache.stat(dummyDir + "/a/../a/file.txt", &statBuf) == 0);
+    REQUIRE(cache.getStats().bypasses == 1);
+
+    // Renaming the directory drops it from the cache
+    REQUIRE(cache.rename(dummyDir + "/a", dummyDir + "/b") == 0);
+    REQUIRE(cache.getStats().invalidations == 1);
+    REQUIRE(cache.stat(dummyDir + "/a/file.txt", &statBuf) == -ENOENT);
+    REQUIRE(cache.stat(dummyDir + "/b/file.txt", &statBuf) == 0);
+
+    // Removing and recreating the directory must not reuse the old fd
+    REQUIRE(cache.unlink(dummyDir + "/b/file.txt") == 0);
+    REQUIRE(cache.rmdir(dummyDir + "/b") == 0);
+    REQUIRE(cache.mkdir(dummyDir + "/b", 0755) == 0);
+
+    fd = cache.open(dummyDir + "/b/other.txt", O_CREAT | O_WRONLY, 0644);
+    REQUIRE(fd > 0);
+    ::close(fd);
+    REQUIRE(boost::filesystem::exists(realDir + "/b/other.txt"));
+
+    boost::filesystem::remove_all(realDir);
+}
+
+TEST_CASE("Test path cache with directories changed outside it", "[storage]")
+{
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+    std::string dummyDir = "path_cache_stale_dir";
+    std::string realDir = conf.runtimeFilesDir + "/" + dummyDir;
+    boost::filesystem::remove_all(realDir);
+    boost::filesystem::create_directories(realDir + "/a");
+
+    PathCache cache;
+    struct ::stat statBuf;
+
+    int fd = cache.open(dummyDir + "/a/file.txt", O_CREAT | O_WRONLY, 0644);
+    REQUIRE(fd > 0);
+    ::close(fd);
+    REQUIRE(cache.getStats().cachedDirs == 1);
+
+    // Missing files in a live directory don't drop it
+    REQUIRE(cache.stat(dummyDir + "/a/missing.txt", &statBuf) == -ENOENT);
+    REQUIRE(cache.getStats().invalidations == 0);
+
+    // Replace the directory behind the cache's back
+    boost::filesystem::remove_all(realDir + "/a");
+    boost::filesystem::create_directories(realDir + "/a");
+    faabric::util::writeBytesToFile(realDir + "/a/new.txt", { 1, 2, 3 });
+
+    REQUIRE(cache.stat(dummyDir + "/a/new.txt", &statBuf) == 0);
+    REQUIRE(statBuf.st_size == 3);
+    REQUIRE(cache.getStats().invalidations == 1);
+
+    // Do the same again, this time creating a file through the cache
+    boost::filesystem::remove_all(realDir + "/a");
+    boost::filesystem::create_directories(realDir + "/a");
+
+    fd = cache.open(dummyDir + "/a/other.txt", O_CREAT | O_WRONLY, 0644);
+    REQUIRE(fd > 0);
+    ::close(fd);
+    REQUIRE(boost::filesystem::exists(realDir + "/a/other.txt"));
+
+    // Directories that are really gone are still missing
+    boost::filesystem::remove_all(realDir + "/a");
+    REQUIRE(cache.stat(dummyDir + "/a/other.txt", &statBuf) == -ENOENT);
+    REQUIRE(cache.getStats().cachedDirs == 0);
+
+    boost::filesystem::remove_all(realDir);
+}
+
+TEST_CASE("Test path cache with directories replaced by another cache",
+          "[storage]")
+{
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+    std::string dummyDir = "path_cache_replaced_dir";
+    std::string realDir = conf.runtimeFilesDir + "/" + dummyDir;
+    boost::filesystem::remove_all(realDir);
+    boost::filesystem::create_directories(realDir + "/a");
+
+    // Each Faaslet has its own cache
+    PathCache cacheA;
+    PathCache cacheB;
+    struct ::stat statBuf;
+
+    int fd = cacheA.open(dummyDir + "/a/file.txt", O_CREAT | O_WRONLY, 0644);
+    REQUIRE(fd > 0);
+    ::close(fd);
+    REQUIRE(cacheA.getStats().cachedDirs == 1);
+
+    // Move the directory aside and put a new one in its place, while the old
+    // one still holds the file
+    REQUIRE(cacheB.rename(dummyDir + "/a", dummyDir + "/old") == 0);
+    REQUIRE(cacheB.mkdir(dummyDir + "/a", 0755) == 0);
+    faabric::util::writeBytesToFile(realDir + "/a/new.txt", { 1, 2, 3 });
+
+    // The first cache must resolve paths into the new directory
+    REQUIRE(cacheA.stat(dummyDir + "/a/file.txt", &statBuf) == -ENOENT);
+    REQUIRE(cacheA.getStats().invalidations == 1);
+    REQUIRE(cacheA.stat(dummyDir + "/a/new.txt", &statBuf) == 0);
+    REQUIRE(statBuf.st_size == 3);
+
+    // Once checked, the directory is a hit again
+    uint64_t hitsBefore = cacheA.getStats().hits;
+    REQUIRE(cacheA.stat(dummyDir + "/a/new.txt", &statBuf) == 0);
+    REQUIRE(cacheA.getStats().hits == hitsBefore + 1);
+    REQUIRE(cacheA.getStats().invalidations == 1);
+
+    boost::filesystem::remove_all(realDir);
+}
+
+TEST_CASE("Test path cache counters on filesystem", "[storage]")
+{
+    FileSystem fs;
+    fs.prepareFilesystem();
+
+    // Stat the same directory repeatedly, as an import would
+    FileDescriptor& rootFileDesc = fs.getFileDescriptor(DEFAULT_ROOT_FD);
+    for (int i = 0; i < 10; i++) {
+        rootFileDesc.stat("lib/python3.8/missing_module.py");
+    }
+
+    PathCacheStats stats = fs.getPathCacheStats();
+    REQUIRE(stats.misses == 1);
+    REQUIRE(stats.hits >= 9);
+    REQUIRE(stats.hitRate() > 0.5);
+
+    // Copies start with an empty cache
+    FileSystem fsCopy(fs);
+    REQUIRE(fsCopy.getPathCacheStats().hits == 0);
+    REQUIRE(fsCopy.getPathCacheStats().cachedDirs == 0);
+}
+}
@@ -0,0 +1,232 @@
+#include <catch2/catch.hpp>
+
+#include <WAVM/WASI/WASIABI.h>
+
+#include <storage/Poll.h>
+
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace storage;
+
+namespace tests {
+
+static __wasi_subscription_t clockSub(uint64_t userdata,
+                                      uint64_t timeoutNanos,
+                                      uint32_t clockId = __WASI_CLOCK_MONOTONIC)
+{
+    __wasi_subscription_t sub{};
+    sub.userdata = userdata;
+    sub.type = __WASI_EVENTTYPE_CLOCK;
+    sub.u.clock.clock_id = clockId;
+    sub.u.clock.timeout = timeoutNanos;
+
+    return sub;
+}
+
+static __wasi_subscription_t fdSub(uint64_t userdata,
+                                   __wasi_eventtype_t type,
+                                   int fd)
+{
+    __wasi_subscription_t sub{};
+    sub.userdata = userdata;
+    sub.type = type;
+    sub.u.fd_readwrite.fd = fd;
+
+    return sub;
+}
+
+// Wasm fds are the host fds in these tests, negative ones don't exist
+static int identityFd(int wasmFd)
+{
+    return wasmFd;
+}
+
+static std::vector<__wasi_event_t> doPoll(
+  const std::vector<__wasi_subscription_t>& subs)
+{
+    std::vector<__wasi_event_t> events(subs.size());
+    int nEvents =
+      pollOneoff(subs.data(), events.data(), subs.size(), identityFd);
+    events.resize(nEvents);
+
+    return events;
+}
+
+static long elapsedMillis(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+TEST_CASE("Test poll with only clocks", "[storage]")
+{
+    uint64_t millis = 1000 * 1000;
+
+    // The earliest timeout wins, not the sum of them
+    auto start = std::chrono::steady_clock::now();
+    std::vector<__wasi_event_t> events = doPoll({
+      clockSub(1, 500 * millis),
+      clockSub(2, 50 * millis),
+      clockSub(3, 800 * millis),
+    });
+    long elapsed = elapsedMillis(start);
+
+    REQUIRE(elapsed >= 50);
+    REQUIRE(elapsed < 500);
+    REQUIRE(events.size() == 1);
+    REQUIRE(events.at(0).userdata == 2);
+    REQUIRE(events.at(0).type == __WASI_EVENTTYPE_CLOCK);
+    REQUIRE(events.at(0).error == __WASI_ESUCCESS);
+
+    // Realtime clocks work too, unknown clocks fail without waiting
+    start = std::chrono::steady_clock::now();
+    events = doPoll({
+      clockSub(4, 500 * millis, __WASI_CLOCK_REALTIME),
+      clockSub(5, 500 * millis, __WASI_CLOCK_PROCESS_CPUTIME_ID),
+    });
+    REQUIRE(elapsedMillis(start) < 500);
+    REQUIRE(events.size() == 1);
+    REQUIRE(events.at(0).userdata == 5);
+    REQUIRE(events.at(0).error == __WASI_EINVAL);
+
+    events = doPoll({ clockSub(6, 10 * millis, __WASI_CLOCK_REALTIME) });
+    REQUIRE(events.size() == 1);
+    REQUIRE(events.at(0).userdata == 6);
+    REQUIRE(events.at(0).error == __WASI_ESUCCESS);
+}
+
+TEST_CASE("Test poll with pipes", "[storage]")
+{
+    int pipeFds[2];
+    REQUIRE(::pipe(pipeFds) == 0);
+    int readFd = pipeFds[0];
+    int writeFd = pipeFds[1];
+    uint64_t timeout = 5000L * 1000 * 1000;
+
+    // An empty pipe can be written but not read
+    auto start = std::chrono::steady_clock::now();
+    std::vector<__wasi_event_t> events = doPoll({
+      fdSub(1, __WASI_EVENTTYPE_FD_READ, readFd),
+      fdSub(2, __WASI_EVENTTYPE_FD_WRITE, writeFd),
+      clockSub(3, timeout),
+    });
+    REQUIRE(elapsedMillis(start) < 1000);
+    REQUIRE(events.size() == 1);
+    REQUIRE(events.at(0).userdata == 2);
+    REQUIRE(events.at(0).type == __WASI_EVENTTYPE_FD_WRITE);
+    REQUIRE(events.at(0).error == __WASI_ESUCCESS);
+
+    // Reads are ready once there's data, with the number of bytes available
+    std::string data = "hello";
+    ssize_t written = ::write(writeFd, data.data(), data.size());
+    REQUIRE(written == (ssize_t)data.size());
+    events = doPoll({
+      fdSub(4, __WASI_EVENTTYPE_FD_READ, readFd),
+      clockSub(5, timeout),
+    });
+    REQUIRE(elapsedMillis(start) < 1000);
+    REQUIRE(events.size() == 1);
+    REQUIRE(events.at(0).userdata == 4);
+    REQUIRE(events.at(0).u.fd_readwrite.nbytes == data.size());
+    REQUIRE(events.at(0).u.fd_readwrite.flags == 0);
+
+    // Closing the other end is a hangup
+    ::close(writeFd);
+    events = doPoll({ fdSub(6, __WASI_EVENTTYPE_FD_READ, readFd) });
+    REQUIRE(events.size() == 1);
+    REQUIRE(events.at(0).userdata == 6);
+    REQUIRE(events.at(0).u.fd_readwrite.flags ==
+            __WASI_EVENT_FD_READWRITE_HANGUP);
+
+    ::close(readFd);
+}
+
+TEST_CASE("Test poll waits for fds", "[storage]")
+{
+    int pipeFds[2];
+    REQUIRE(::pipe(pipeFds) == 0);
+
+    // Nothing happens on the pipe, so the clock fires
+    auto start = std::chrono::steady_clock::now();
+    std::vector<__wasi_event_t> events = doPoll({
+      fdSub(1, __WASI_EVENTTYPE_FD_READ, pipeFds[0]),
+      clockSub(2, 50L * 1000 * 1000),
+    });
+    REQUIRE(elapsedMillis(start) >= 50);
+    REQUIRE(events.size() == 1);
+    REQUIRE(events.at(0).userdata == 2);
+
+    ::close(pipeFds[0]);
+    ::close(pipeFds[1]);
+}
+
+TEST_CASE("Test poll with regular files", "[storage]")
+{
+    std::string filePath = "/tmp/faasm_poll_test";
+    int fd = ::open(filePath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    REQUIRE(fd > 0);
+
+    std::string data = "0123456789";
+    REQUIRE(::write(fd, data.data(), data.size()) == (ssize_t)data.size());
+    ::lseek(fd, 4, SEEK_SET);
+
+    // Regular files are always ready, reads report the bytes left
+    std::vector<__wasi_event_t> events = doPoll({
+      fdSub(1, __WASI_EVENTTYPE_FD_READ, fd),
+      fdSub(2, __WASI_EVENTTYPE_FD_WRITE, fd),
+      clockSub(3, 5000L * 1000 * 1000),
+    });
+    REQUIRE(events.size() == 2);
+    REQUIRE(events.at(0).userdata == 1);
+    REQUIRE(events.at(0).error == __WASI_ESUCCESS);
+    REQUIRE(events.at(0).u.fd_readwrite.nbytes == 6);
+    REQUIRE(events.at(1).userdata == 2);
+    REQUIRE(events.at(1).error == __WASI_ESUCCESS);
+
+    ::close(fd);
+    ::unlink(filePath.c_str());
+}
+
+TEST_CASE("Test poll errors", "[storage]")
+{
+    int pipeFds[2];
+    REQUIRE(::pipe(pipeFds) == 0);
+    int closedFd = pipeFds[1];
+    ::close(closedFd);
+
+    __wasi_subscription_t badType = fdSub(4, __WASI_EVENTTYPE_FD_READ, 0);
+    badType.type = 10;
+
+    // Errors are reported straight away, other ready fds are still included
+    auto start = std::chrono::steady_clock::now();
+    std::vector<__wasi_event_t> events = doPoll({
+      fdSub(1, __WASI_EVENTTYPE_FD_READ, -1),
+      fdSub(2, __WASI_EVENTTYPE_FD_READ, pipeFds[0]),
+      fdSub(3, __WASI_EVENTTYPE_FD_WRITE, closedFd),
+      badType,
+      clockSub(5, 5000L * 1000 * 1000),
+    });
+    REQUIRE(elapsedMillis(start) < 1000);
+    REQUIRE(events.size() == 4);
+
+    REQUIRE(events.at(0).userdata == 1);
+    REQUIRE(events.at(0).error == __WASI_EBADF);
+    REQUIRE(events.at(1).userdata == 4);
+    REQUIRE(events.at(1).error == __WASI_EINVAL);
+
+    // The pipe's write end is closed, so the read end has hung up
+    REQUIRE(events.at(2).userdata == 2);
+    REQUIRE(events.at(2).u.fd_readwrite.flags ==
+            __WASI_EVENT_FD_READWRITE_HANGUP);
+
+    // Host fds that can't be polled are errors
+    REQUIRE(events.at(3).userdata == 3);
+    REQUIRE(events.at(3).error == __WASI_EIO);
+
+    ::close(pipeFds[0]);
+}
+}
@@ -0,0 +1,242 @@
+#include <catch2/catch.hpp>
+
+#include "utils.h"
+
+#include <WAVM/WASI/WASIABI.h>
+
+#include <conf/FaasmConfig.h>
+#include <storage/FileDescriptor.h>
+#include <storage/FileSystem.h>
+#include <storage/ScratchFileSystem.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace storage;
+
+namespace tests {
+
+TEST_CASE("Test scratch filesystem paths", "[storage]")
+{
+    ScratchFileSystem disabled("", 1024);
+    REQUIRE(!disabled.isEnabled());
+    REQUIRE(!disabled.isScratchPath("/tmp/foo"));
+
+    ScratchFileSystem scratch("/tmp/", 1024);
+    REQUIRE(scratch.isEnabled());
+
+    REQUIRE(scratch.isScratchPath("/tmp"));
+    REQUIRE(scratch.isScratchPath("/tmp/foo"));
+    REQUIRE(scratch.isScratchPath("/tmp//foo/./bar"));
+    REQUIRE(!scratch.isScratchPath("/tmpfoo"));
+    REQUIRE(!scratch.isScratchPath("/etc/hosts"));
+
+    REQUIRE(scratch.normalisePath("/tmp//foo/./bar/") == "/tmp/foo/bar");
+
+    std::string nameA = scratch.createTempName("abc");
+    std::string nameB = scratch.createTempName("abc");
+    REQUIRE(nameA != nameB);
+    REQUIRE(scratch.isScratchPath(nameA));
+}
+
+TEST_CASE("Test scratch filesystem files and directories", "[storage]")
+{
+    ScratchFileSystem scratch("/tmp", 1024);
+
+    // Missing files and parents
+    REQUIRE(scratch.open("/tmp/foo", O_RDWR) == -ENOENT);
+    REQUIRE(scratch.open("/tmp/bar/foo", O_RDWR | O_CREAT) == -ENOENT);
+
+    // Create, write and read back through a second fd
+    int fdA = scratch.open("/tmp/foo", O_RDWR | O_CREAT);
+    REQUIRE(fdA >= 0);
+    REQUIRE(scratch.ownsFd(fdA));
+    REQUIRE(scratch.open("/tmp/foo", O_RDWR | O_CREAT | O_EXCL) == -EEXIST);
+
+    std::string data = "hello scratch";
+    REQUIRE(scratch.checkWrite(fdA, data.size()) == 0);
+    REQUIRE(::write(fdA, data.data(), data.size()) == (ssize_t)data.size());
+    scratch.updateSize(fdA);
+    REQUIRE(scratch.getUsedBytes() == data.size());
+
+    int fdB = scratch.open("/tmp/foo", O_RDONLY);
+    std::string actual(data.size(), '\0');
+    REQUIRE(::read(fdB, actual.data(), actual.size()) == (ssize_t)data.size());
+    REQUIRE(actual == data);
+
+    struct ::stat nativeStat
+    {};
+    REQUIRE(scratch.stat("/tmp/foo", &nativeStat) == 0);
+    REQUIRE(S_ISREG(nativeStat.st_mode));
+    REQUIRE(nativeStat.st_size == (off_t)data.size());
+
+    // Directories
+    REQUIRE(scratch.mkdir("/tmp/dir") == 0);
+    REQUIRE(scratch.mkdir("/tmp/dir") == -EEXIST);
+    REQUIRE(scratch.stat("/tmp/dir", &nativeStat) == 0);
+    REQUIRE(S_ISDIR(nativeStat.st_mode));
+
+    // Rename into the directory, then the directory is not empty
+    REQUIRE(scratch.rename("/tmp/foo", "/tmp/dir/foo") == 0);
+    REQUIRE(scratch.stat("/tmp/foo", &nativeStat) == -ENOENT);
+    REQUIRE(scratch.rmdir("/tmp/dir") == -ENOTEMPTY);
+
+    std::vector<DirEnt> entries;
+    REQUIRE(scratch.listDir("/tmp/dir", entries) == 0);
+    REQUIRE(entries.size() == 3);
+    REQUIRE(entries.at(2).path == "foo");
+    REQUIRE(entries.at(2).type == DT_REG);
+
+    // Remove everything
+    REQUIRE(scratch.unlink("/tmp/dir/foo") == 0);
+    REQUIRE(scratch.rmdir("/tmp/dir") == 0);
+    REQUIRE(scratch.getFileCount() == 0);
+
+    scratch.close(fdA);
+    scratch.close(fdB);
+    REQUIRE(!scratch.ownsFd(fdA));
+    REQUIRE(scratch.getUsedBytes() == 0);
+}
+
+TEST_CASE("Test scratch filesystem size limit", "[storage]")
+{
+    ScratchFileSystem scratch("/tmp", 100);
+
+    int fd = scratch.open("/tmp/big", O_RDWR | O_CREAT);
+    REQUIRE(fd >= 0);
+
+    std::vector<uint8_t> data(80, 1);
+    REQUIRE(scratch.checkWrite(fd, data.size()) == 0);
+    REQUIRE(::write(fd, data.data(), data.size()) == (ssize_t)data.size());
+    scratch.updateSize(fd);
+
+    // Going over the limit fails, overwriting existing bytes does not
+    REQUIRE(scratch.checkWrite(fd, 30) == -ENOSPC);
+    ::lseek(fd, 0, SEEK_SET);
+    REQUIRE(scratch.checkWrite(fd, 90) == 0);
+
+    // Resizing is checked on the new size, even with O_APPEND
+    REQUIRE(scratch.checkResize(fd, 50) == 0);
+    REQUIRE(scratch.checkResize(fd, 100) == 0);
+    REQUIRE(scratch.checkResize(fd, 120) == -ENOSPC);
+
+    int appendFd = scratch.open("/tmp/big", O_RDWR | O_APPEND);
+    REQUIRE(appendFd >= 0);
+    REQUIRE(scratch.checkWrite(appendFd, 0, 120) == 0);
+    REQUIRE(scratch.checkResize(appendFd, 120) == -ENOSPC);
+
+    // Reset frees everything
+    scratch.reset();
+    REQUIRE(scratch.getUsedBytes() == 0);
+    REQUIRE(scratch.getFileCount() == 0);
+    REQUIRE(!scratch.ownsFd(fd));
+}
+
+TEST_CASE("Test scratch filesystem space accounting", "[storage]")
+{
+    ScratchFileSystem scratch("/tmp", 1024);
+
+    int fdA = scratch.open("/tmp/a", O_RDWR | O_CREAT);
+    int fdB = scratch.open("/tmp/b", O_RDWR | O_CREAT);
+    REQUIRE(::ftruncate(fdA, 100) == 0);
+    scratch.updateSize(fdA);
+    REQUIRE(::ftruncate(fdB, 200) == 0);
+    scratch.updateSize(fdB);
+    REQUIRE(scratch.getUsedBytes() == 300);
+
+    // Shrinking frees space
+    REQUIRE(::ftruncate(fdB, 50) == 0);
+    scratch.updateSize(fdB);
+    REQUIRE(scratch.getUsedBytes() == 150);
+
+    // Unlinked files keep their space until the last fd is closed
+    int fdDup = scratch.dup(fdA);
+    REQUIRE(scratch.unlink("/tmp/a") == 0);
+    REQUIRE(scratch.getUsedBytes() == 150);
+    scratch.close(fdA);
+    REQUIRE(scratch.getUsedBytes() == 150);
+    scratch.close(fdDup);
+    REQUIRE(scratch.getUsedBytes() == 50);
+
+    // Renaming over a file frees the replaced file once it's closed
+    int fdC = scratch.open("/tmp/c", O_RDWR | O_CREAT);
+    REQUIRE(::ftruncate(fdC, 10) == 0);
+    scratch.updateSize(fdC);
+    scratch.close(fdC);
+    REQUIRE(scratch.getUsedBytes() == 60);
+    REQUIRE(scratch.rename("/tmp/c", "/tmp/b") == 0);
+    REQUIRE(scratch.getUsedBytes() == 60);
+    scratch.close(fdB);
+    REQUIRE(scratch.getUsedBytes() == 10);
+
+    // Opening with O_TRUNC empties the file
+    int fdTrunc = scratch.open("/tmp/b", O_RDWR | O_TRUNC);
+    REQUIRE(fdTrunc >= 0);
+    REQUIRE(scratch.getUsedBytes() == 0);
+    scratch.close(fdTrunc);
+}
+
+TEST_CASE("Test scratch files through the filesystem", "[storage]")
+{
+    conf::FaasmConfig& conf = conf::getFaasmConfig();
+    std::string originalPrefix = conf.scratchFsPrefix;
+    int originalMaxMb = conf.scratchFsMaxMb;
+
+    conf.scratchFsPrefix = "/tmp";
+    conf.scratchFsMaxMb = 1;
+
+    FileSystem fs;
+    fs.prepareFilesystem();
+
+    uint64_t rights = __WASI_RIGHT_FD_READ | __WASI_RIGHT_FD_WRITE;
+    int fd = fs.openFileDescriptor(
+      DEFAULT_ROOT_FD, "tmp/scratch.txt", rights, 0, 0, __WASI_O_CREAT, 0);
+    REQUIRE(fd > 0);
+
+    FileDescriptor& fileDesc = fs.getFileDescriptor(fd);
+    REQUIRE(fileDesc.isScratch());
+
+    std::string data = "in memory";
+    std::vector<::iovec> iovecs = { { data.data(), data.size() } };
+    REQUIRE(fileDesc.write(iovecs, 1) == (ssize_t)data.size());
+
+    FileDescriptor& rootFileDesc = fs.getFileDescriptor(DEFAULT_ROOT_FD);
+    Stat fileStat = rootFileDesc.stat("tmp/scratch.txt");
+    REQUIRE(!fileStat.failed);
+    REQUIRE(fileStat.wasiFiletype == __WASI_FILETYPE_REGULAR_FILE);
+    REQUIRE(fileStat.st_size == data.size());
+    REQUIRE(fs.getScratchFileSystem().getUsedBytes() == data.size());
+
+    // Writes past the limit fail with ENOSPC
+    std::vector<uint8_t> bigData(2 * 1024 * 1024, 1);
+    std::vector<::iovec> bigIovecs = { { bigData.data(), bigData.size() } };
+    REQUIRE(fileDesc.write(bigIovecs, 1) == -1);
+    REQUIRE(fileDesc.getWasiErrno() == __WASI_ENOSPC);
+
+    // Truncation and allocation are counted too
+    REQUIRE(fileDesc.setSize(100));
+    REQUIRE(fs.getScratchFileSystem().getUsedBytes() == 100);
+    REQUIRE(fileDesc.allocate(0, 200));
+    REQUIRE(fs.getScratchFileSystem().getUsedBytes() == 200);
+
+    // Anonymous files are not linked into the namespace
+    int anonFd = fs.openScratchAnonymous("anon");
+    REQUIRE(anonFd > 0);
+    REQUIRE(fs.getFileDescriptor(anonFd).isScratch());
+    REQUIRE(fs.getScratchFileSystem().getFileCount() == 1);
+
+    // Copies (e.g. on reset from a snapshot) start with an empty scratch
+    FileSystem fsCopy = fs;
+    REQUIRE(!fsCopy.fileDescriptorExists(fd));
+    REQUIRE(!fsCopy.fileDescriptorExists(anonFd));
+    REQUIRE(fsCopy.fileDescriptorExists(DEFAULT_ROOT_FD));
+    REQUIRE(fsCopy.getScratchFileSystem().getFileCount() == 0);
+    REQUIRE(fs.getScratchFileSystem().getFileCount() == 1);
+
+    fs.closeFileDescriptor(anonFd);
+    REQUIRE(!fs.fileDescriptorExists(anonFd));
+
+    conf.scratchFsPrefix = originalPrefix;
+    conf.scratchFsMaxMb = originalMaxMb;
+}
+}
@@ -0,0 +1,156 @@
+#include <catch2/catch.hpp>
+
+#include <threads/ArrayReduction.h>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+using namespace threads;
+using namespace faabric::util;
+
+namespace tests {
+
+template<typename T>
+static T* getArray(std::vector<uint8_t>& memory, uint32_t offset)
+{
+    return reinterpret_cast<T*>(memory.data() + offset);
+}
+
+template<typename T>
+static void checkArrayReduction(SnapshotDataType dataType,
+                                SnapshotMergeOperation mergeOp)
+{
+    int nThreads = 5;
+    int count = 37;
+    uint32_t arrayPtr = 1024;
+    uint32_t blockPtr = 8192;
+
+    std::vector<uint8_t> mainMemory(64 * 1024, 0);
+    for (int i = 0; i < count; i++) {
+        getArray<T>(mainMemory, arrayPtr)[i] = (T)(i * 3);
+    }
+
+    ArrayReduction r;
+    r.arrayPtr = arrayPtr;
+    r.count = count;
+    r.dataType = dataType;
+    r.mergeOp = mergeOp;
+    std::vector<ArrayReduction> reductions = { r };
+
+    size_t blockSize = getArrayReductionsSize(reductions, nThreads);
+    uint32_t slotsPtr = writeArrayReductions(
+      mainMemory.data(), blockPtr, reductions, 0, nThreads);
+    REQUIRE(slotsPtr > blockPtr);
+    REQUIRE(slotsPtr < blockPtr + blockSize);
+
+    // Each thread updates every element with a value of its own
+    auto updateArray = [&](std::vector<uint8_t>& memory, int t) {
+        T* values = getArray<T>(memory, arrayPtr);
+        for (int i = 0; i < count; i++) {
+            T update = (T)((t + 1) * (i % 7) - 10);
+            switch (mergeOp) {
+                case (SnapshotMergeOperation::Sum): {
+                    values[i] += update;
+                    break;
+                }
+                case (SnapshotMergeOperation::Subtract): {
+                    values[i] -= update;
+                    break;
+                }
+                case (SnapshotMergeOperation::Max): {
+                    values[i] = std::max(values[i], update);
+                    break;
+                }
+                default: {
+                    values[i] = std::min(values[i], update);
+                }
+            }
+        }
+    };
+
+    std::vector<uint8_t> snapshot = mainMemory;
+
+    // Threads 0 and 1 share memory with the thread that forked the batch,
+    // threads 2 and 3 run on one other host and thread 4 on another
+    updateArray(mainMemory, 0);
+    updateArray(mainMemory, 1);
+
+    std::vector<uint8_t> hostA = snapshot;
+    updateArray(hostA, 2);
+    recordArrayReductions(hostA.data(), blockPtr, 2);
+    updateArray(hostA, 3);
+    recordArrayReductions(hostA.data(), blockPtr, 3);
+
+    std::vector<uint8_t> hostB = snapshot;
+    updateArray(hostB, 4);
+    recordArrayReductions(hostB.data(), blockPtr, 4);
+
+    // Only the slots come back from the other hosts, each from one host
+    size_t slotsSize = r.count * sizeof(T) + sizeof(uint64_t);
+    for (auto [host, t] : std::vector<std::pair<std::vector<uint8_t>*, int>>{
+           { &hostA, 2 }, { &hostA, 3 }, { &hostB, 4 } }) {
+        uint32_t slotPtr = slotsPtr + t * ((slotsSize + 7) & ~7);
+        std::memcpy(
+          mainMemory.data() + slotPtr, host->data() + slotPtr, slotsSize);
+    }
+
+    REQUIRE(mergeArrayReductions(mainMemory.data(), blockPtr) == blockSize);
+
+    std::vector<uint8_t> expectedMemory = snapshot;
+    for (int t = 0; t < nThreads; t++) {
+        updateArray(expectedMemory, t);
+    }
+
+    T* actual = getArray<T>(mainMemory, arrayPtr);
+    T* expectedValues = getArray<T>(expectedMemory, arrayPtr);
+    std::vector<T> actualVec(actual, actual + count);
+    std::vector<T> expectedVec(expectedValues, expectedValues + count);
+    REQUIRE(actualVec == expectedVec);
+}
+
+TEST_CASE("Test merging array reductions from other hosts", "[threads]")
+{
+    SECTION("Int sum")
+    {
+        checkArrayReduction<int32_t>(SnapshotDataType::Int,
+                                     SnapshotMergeOperation::Sum);
+    }
+
+    SECTION("Int subtract")
+    {
+        checkArrayReduction<int32_t>(SnapshotDataType::Int,
+                                     SnapshotMergeOperation::Subtract);
+    }
+
+    SECTION("Long max")
+    {
+        checkArrayReduction<int64_t>(SnapshotDataType::Long,
+                                     SnapshotMergeOperation::Max);
+    }
+
+    SECTION("Float min")
+    {
+        checkArrayReduction<float>(SnapshotDataType::Float,
+                                   SnapshotMergeOperation::Min);
+    }
+
+    SECTION("Double sum")
+    {
+        checkArrayReduction<double>(SnapshotDataType::Double,
+                                    SnapshotMergeOperation::Sum);
+    }
+}
+
+TEST_CASE("Test which array reductions can be merged", "[threads]")
+{
+    REQUIRE(canMergeArray(SnapshotDataType::Int, SnapshotMergeOperation::Sum));
+    REQUIRE(
+      canMergeArray(SnapshotDataType::Double, SnapshotMergeOperation::Max));
+    REQUIRE(
+      !canMergeArray(SnapshotDataType::Int, SnapshotMergeOperation::Product));
+    REQUIRE(
+      !canMergeArray(SnapshotDataType::Bool, SnapshotMergeOperation::Sum));
+    REQUIRE(!canMergeArray(SnapshotDataType::Raw, SnapshotMergeOperation::Sum));
+}
+}
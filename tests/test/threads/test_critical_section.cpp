@@ -0,0 +1,68 @@
+#include <catch2/catch.hpp>
+
+#include <threads/CriticalSection.h>
+
+#include <thread>
+#include <vector>
+
+using namespace threads;
+
+namespace tests {
+
+TEST_CASE("Test critical sections are identified by name", "[threads]")
+{
+    CriticalSections sections;
+
+    int32_t critA = 1000;
+    int32_t critB = 2000;
+
+    std::shared_ptr<CriticalSection> sectionA = sections.get(critA);
+    REQUIRE(sections.get(critA) == sectionA);
+    REQUIRE(sections.get(critB) != sectionA);
+    REQUIRE(sections.size() == 2);
+
+    // Other modules don't share sections, even with the same address
+    CriticalSections otherSections;
+    REQUIRE(otherSections.get(critA) != sectionA);
+
+    sections.clear();
+    REQUIRE(sections.size() == 0);
+    REQUIRE(sections.get(critA) != sectionA);
+}
+
+TEST_CASE("Test critical sections exclude threads", "[threads]")
+{
+    CriticalSections sections;
+
+    int nThreads = 8;
+    int nLoops = 1000;
+
+    // Threads alternate between two sections, each guarding its own counter
+    int counterA = 0;
+    int counterB = 0;
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < nThreads; t++) {
+        threads.emplace_back([nLoops, &sections, &counterA, &counterB] {
+            for (int i = 0; i < nLoops; i++) {
+                std::shared_ptr<CriticalSection> a = sections.get(1);
+                a->lock();
+                counterA++;
+                a->unlock();
+
+                std::shared_ptr<CriticalSection> b = sections.get(2);
+                b->lock();
+                counterB++;
+                b->unlock();
+            }
+        });
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    REQUIRE(counterA == nThreads * nLoops);
+    REQUIRE(counterB == nThreads * nLoops);
+}
+}
@@ -0,0 +1,152 @@
+#include <catch2/catch.hpp>
+
+#include <threads/FutexSync.h>
+
+#include <atomic>
+#include <cerrno>
+#include <thread>
+#include <vector>
+
+using namespace threads;
+
+namespace tests {
+
+TEST_CASE("Test futex mutex", "[threads]")
+{
+    int32_t mx = 0;
+
+    REQUIRE(futexMutexTryLock(&mx));
+    REQUIRE(!futexMutexTryLock(&mx));
+    futexMutexUnlock(&mx);
+    REQUIRE(mx == 0);
+
+    int nThreads = 8;
+    int nLoops = 10000;
+    int counter = 0;
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < nThreads; i++) {
+        threads.emplace_back([&mx, &counter, nLoops] {
+            for (int j = 0; j < nLoops; j++) {
+                futexMutexLock(&mx);
+                counter++;
+                futexMutexUnlock(&mx);
+            }
+        });
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    REQUIRE(counter == nThreads * nLoops);
+    REQUIRE(mx == 0);
+}
+
+TEST_CASE("Test futex condition variable", "[threads]")
+{
+    int32_t mx = 0;
+    int32_t cond = 0;
+
+    SECTION("Signal")
+    {
+        bool ready = false;
+        std::thread waiter([&mx, &cond, &ready] {
+            futexMutexLock(&mx);
+            while (!ready) {
+                futexCondWait(&cond, &mx);
+            }
+            futexMutexUnlock(&mx);
+        });
+
+        futexMutexLock(&mx);
+        ready = true;
+        futexCondSignal(&cond);
+        futexMutexUnlock(&mx);
+
+        waiter.join();
+    }
+
+    SECTION("Broadcast")
+    {
+        int nReady = 0;
+        bool go = false;
+        std::vector<std::thread> waiters;
+        for (int i = 0; i < 4; i++) {
+            waiters.emplace_back([&mx, &cond, &nReady, &go] {
+                futexMutexLock(&mx);
+                nReady++;
+                while (!go) {
+                    futexCondWait(&cond, &mx);
+                }
+                futexMutexUnlock(&mx);
+            });
+        }
+
+        futexMutexLock(&mx);
+        go = true;
+        futexCondBroadcast(&cond);
+        futexMutexUnlock(&mx);
+
+        for (auto& t : waiters) {
+            t.join();
+        }
+    }
+
+    SECTION("Timeout")
+    {
+        timespec timeout{};
+        clock_gettime(CLOCK_REALTIME, &timeout);
+        timeout.tv_nsec += 1000000;
+        if (timeout.tv_nsec >= 1000000000) {
+            timeout.tv_sec++;
+            timeout.tv_nsec -= 1000000000;
+        }
+
+        futexMutexLock(&mx);
+        REQUIRE(futexCondWait(&cond, &mx, &timeout) == ETIMEDOUT);
+        futexMutexUnlock(&mx);
+    }
+
+    REQUIRE(mx == 0);
+}
+
+TEST_CASE("Test futex barrier", "[threads]")
+{
+    int nThreads = 4;
+    int nRounds = 100;
+
+    int32_t barrier[3];
+    futexBarrierInit(barrier, nThreads);
+
+    std::atomic<int> nSerial = 0;
+    std::atomic<int> arrived = 0;
+    std::atomic<bool> failed = false;
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < nThreads; i++) {
+        threads.emplace_back([&, nThreads, nRounds] {
+            for (int r = 0; r < nRounds; r++) {
+                arrived++;
+                if (futexBarrierWait(barrier)) {
+                    nSerial++;
+                }
+
+                // Nobody gets past the barrier until everyone has arrived
+                if (arrived.load() < (r + 1) * nThreads) {
+                    failed = true;
+                }
+
+                futexBarrierWait(barrier);
+            }
+        });
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    REQUIRE(!failed);
+    REQUIRE(nSerial == nRounds);
+}
+}
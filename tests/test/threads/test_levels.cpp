@@ -77,4 +77,41 @@ TEST_CASE("Check level serialisation sizes", "[threads]")
     size_t sizeDiff = serialisedA.size() - serialisedB.size();
     REQUIRE(sizeDiff == sharedVarOffsets.size() * sizeof(uint32_t));
 }
+
+TEST_CASE("Test nested levels respect max active levels", "[threads]")
+{
+    auto top = std::make_shared<Level>(1);
+    top->wantedThreads = 4;
+
+    // Only one active level by default, so nested levels are serialised
+    auto outer = std::make_shared<Level>(top->getMaxThreadsAtNextLevel());
+    outer->fromParentLevel(top);
+    REQUIRE(outer->depth == 1);
+    REQUIRE(outer->numThreads == 4);
+    REQUIRE(outer->activeLevels == 1);
+    REQUIRE(outer->getMaxThreadsAtNextLevel() == 1);
+
+    // Raising the limit allows a nested team
+    int maxActiveLevels = 2;
+    int expectedInner = 3;
+    SECTION("Nesting limit reached")
+    {
+        maxActiveLevels = 1;
+        expectedInner = 1;
+    }
+
+    SECTION("Nesting allowed") {}
+
+    outer->maxActiveLevels = maxActiveLevels;
+    outer->pushedThreads = 3;
+    auto inner = std::make_shared<Level>(outer->getMaxThreadsAtNextLevel());
+    inner->fromParentLevel(outer);
+
+    REQUIRE(inner->depth == 2);
+    REQUIRE(inner->numThreads == expectedInner);
+    REQUIRE(inner->activeLevels == maxActiveLevels);
+
+    // Nothing can be nested beneath the limit
+    REQUIRE(inner->getMaxThreadsAtNextLevel() == 1);
+}
 }
@@ -0,0 +1,56 @@
+#include <catch2/catch.hpp>
+
+#include <threads/LocalTeam.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace threads;
+
+namespace tests {
+
+TEST_CASE("Test local team barrier and lock", "[threads]")
+{
+    int nThreads = 8;
+    int nRounds = 50;
+    auto team = std::make_shared<LocalTeam>(123, nThreads);
+
+    std::atomic<int> arrived = 0;
+    std::atomic<bool> failed = false;
+    int counter = 0;
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < nThreads; i++) {
+        threads.emplace_back([&, team] {
+            setCurrentLocalTeam(team);
+
+            for (int r = 0; r < nRounds; r++) {
+                // The lock is recursive
+                getCurrentLocalTeam()->lock();
+                getCurrentLocalTeam()->lock();
+                counter++;
+                getCurrentLocalTeam()->unlock();
+                getCurrentLocalTeam()->unlock();
+
+                arrived++;
+                getCurrentLocalTeam()->barrier();
+                if (arrived.load() < (r + 1) * nThreads) {
+                    failed = true;
+                }
+                getCurrentLocalTeam()->barrier();
+            }
+        });
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    REQUIRE(!failed);
+    REQUIRE(counter == nThreads * nRounds);
+
+    // Threads outside a team don't see one
+    REQUIRE(getCurrentLocalTeam() == nullptr);
+}
+}
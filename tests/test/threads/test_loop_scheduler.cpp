@@ -0,0 +1,250 @@
+#include <catch2/catch.hpp>
+
+#include <threads/LoopScheduler.h>
+
+#include <algorithm>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace threads;
+
+namespace tests {
+
+TEST_CASE("Test loop chunk sizes", "[threads]")
+{
+    // Dynamic chunks are fixed, other than the last
+    REQUIRE(getLoopChunkSize(LoopSchedule::Dynamic, 100, 7, 4) == 7);
+    REQUIRE(getLoopChunkSize(LoopSchedule::Dynamic, 3, 7, 4) == 3);
+
+    // Guided chunks shrink down to the chunk size
+    REQUIRE(getLoopChunkSize(LoopSchedule::Guided, 800, 1, 4) == 100);
+    REQUIRE(getLoopChunkSize(LoopSchedule::Guided, 81, 1, 4) == 11);
+    REQUIRE(getLoopChunkSize(LoopSchedule::Guided, 20, 5, 4) == 5);
+    REQUIRE(getLoopChunkSize(LoopSchedule::Guided, 2, 5, 4) == 2);
+}
+
+TEST_CASE("Test claiming dynamic loop chunks", "[threads]")
+{
+    LoopSchedule schedule = LoopSchedule::Dynamic;
+    uint64_t chunk = 1;
+
+    SECTION("Dynamic")
+    {
+        schedule = LoopSchedule::Dynamic;
+        chunk = 3;
+    }
+
+    SECTION("Guided")
+    {
+        schedule = LoopSchedule::Guided;
+        chunk = 2;
+    }
+
+    int nThreads = 4;
+    uint64_t tripCount = 1001;
+    DynamicLoop loop(schedule, tripCount, chunk, nThreads);
+
+    std::mutex mx;
+    std::vector<int> claimed(tripCount, 0);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < nThreads; i++) {
+        threads.emplace_back([&loop, &mx, &claimed] {
+            uint64_t start;
+            uint64_t size;
+            while (loop.next(start, size)) {
+                std::unique_lock<std::mutex> lock(mx);
+                for (uint64_t j = start; j < start + size; j++) {
+                    claimed.at(j)++;
+                }
+            }
+        });
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    // Every iteration is handed out exactly once
+    std::vector<int> expected(tripCount, 1);
+    REQUIRE(claimed == expected);
+
+    uint64_t start;
+    uint64_t size;
+    REQUIRE(!loop.next(start, size));
+}
+
+TEST_CASE("Test dynamic loop registry", "[threads]")
+{
+    clearDynamicLoops();
+
+    int groupId = 123;
+    int nThreads = 3;
+
+    auto loopA = getOrCreateDynamicLoop(
+      groupId, 0, LoopSchedule::Dynamic, 10, 1, nThreads);
+    auto loopB = getOrCreateDynamicLoop(
+      groupId, 1, LoopSchedule::Guided, 10, 1, nThreads);
+    REQUIRE(loopA != loopB);
+
+    // Later threads get the same loop
+    REQUIRE(getOrCreateDynamicLoop(
+              groupId, 0, LoopSchedule::Dynamic, 10, 1, nThreads) == loopA);
+
+    // Loop is only removed once all threads have finished
+    for (int i = 0; i < nThreads; i++) {
+        finishDynamicLoop(groupId, 0);
+    }
+
+    auto loopC = getOrCreateDynamicLoop(
+      groupId, 0, LoopSchedule::Dynamic, 10, 1, nThreads);
+    REQUIRE(loopC != loopA);
+    REQUIRE(getOrCreateDynamicLoop(
+              groupId, 1, LoopSchedule::Guided, 10, 1, nThreads) == loopB);
+
+    REQUIRE_THROWS(finishDynamicLoop(groupId, 5));
+
+    clearDynamicLoops();
+}
+
+/**
+ * Runs a loop as the dispatch intrinsics do, with threads claiming chunks and
+ * converting them back to values of the loop variable. Returns all the values
+ * handed out, sorted.
+ */
+template<typename T>
+static std::vector<T> dispatchLoop(LoopSchedule schedule,
+                                   T lower,
+                                   T upper,
+                                   typename std::make_signed<T>::type incr,
+                                   uint64_t chunk)
+{
+    int nThreads = 4;
+    LoopBounds bounds = LoopBounds::fromLoop<T>(lower, upper, incr);
+    DynamicLoop loop(schedule, bounds.tripCount, chunk, nThreads);
+
+    std::mutex mx;
+    std::vector<T> values;
+    bool lastsMatch = true;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < nThreads; i++) {
+        threads.emplace_back([&] {
+            uint64_t start;
+            uint64_t size;
+            while (loop.next(start, size)) {
+                T first;
+                T last;
+                bounds.getChunk<T>(start, size, first, last);
+
+                std::unique_lock<std::mutex> lock(mx);
+                T value = first;
+                for (uint64_t j = 0; j < size; j++) {
+                    values.push_back(value);
+                    if (j < size - 1) {
+                        value = (T)(value + incr);
+                    }
+                }
+                lastsMatch &= value == last;
+            }
+        });
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    REQUIRE(lastsMatch);
+
+    std::sort(values.begin(), values.end());
+    return values;
+}
+
+// Runs the same loop serially, with wider arithmetic than the loop type
+template<typename T>
+static std::vector<T> serialLoop(T lower,
+                                 T upper,
+                                 typename std::make_signed<T>::type incr)
+{
+    std::vector<T> values;
+    if (incr > 0) {
+        for (__int128 v = lower; v <= (__int128)upper; v += incr) {
+            values.push_back((T)v);
+        }
+    } else {
+        for (__int128 v = lower; v >= (__int128)upper; v += incr) {
+            values.push_back((T)v);
+        }
+    }
+
+    std::sort(values.begin(), values.end());
+    return values;
+}
+
+template<typename T>
+static void checkDispatchedLoop(T lower,
+                                T upper,
+                                typename std::make_signed<T>::type incr)
+{
+    std::vector<T> expected = serialLoop<T>(lower, upper, incr);
+    REQUIRE(LoopBounds::fromLoop<T>(lower, upper, incr).tripCount ==
+            expected.size());
+
+    REQUIRE(dispatchLoop<T>(LoopSchedule::Dynamic, lower, upper, incr, 3) ==
+            expected);
+    REQUIRE(dispatchLoop<T>(LoopSchedule::Guided, lower, upper, incr, 2) ==
+            expected);
+}
+
+TEST_CASE("Test dispatching loops of each type", "[threads]")
+{
+    SECTION("Signed 4 byte")
+    {
+        checkDispatchedLoop<int32_t>(-100, 250, 3);
+    }
+
+    SECTION("Signed 4 byte, negative increment")
+    {
+        checkDispatchedLoop<int32_t>(10, -500, -7);
+    }
+
+    SECTION("Signed 4 byte, range wider than the type")
+    {
+        checkDispatchedLoop<int32_t>(std::numeric_limits<int32_t>::min(),
+                                     std::numeric_limits<int32_t>::max(),
+                                     1 << 24);
+    }
+
+    SECTION("Unsigned 4 byte, above signed limit")
+    {
+        checkDispatchedLoop<uint32_t>(0x7FFFFF00u, 0x80000400u, 5);
+    }
+
+    SECTION("Unsigned 4 byte, negative increment")
+    {
+        checkDispatchedLoop<uint32_t>(0xFFFFFFF0u, 0xFFFFF000u, -9);
+    }
+
+    SECTION("Signed 8 byte, negative increment")
+    {
+        checkDispatchedLoop<int64_t>(5000000000, 4999999000, -4);
+    }
+
+    SECTION("Unsigned 8 byte")
+    {
+        checkDispatchedLoop<uint64_t>(
+          0xFFFFFFFFFFFFF000ull, 0xFFFFFFFFFFFFFFFFull, 11);
+    }
+
+    SECTION("Unsigned 8 byte, negative increment")
+    {
+        checkDispatchedLoop<uint64_t>(
+          0x8000000000000100ull, 0x7FFFFFFFFFFFFF00ull, -13);
+    }
+
+    SECTION("Empty loop")
+    {
+        checkDispatchedLoop<int32_t>(10, 0, 1);
+    }
+}
+}
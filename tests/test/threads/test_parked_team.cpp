@@ -0,0 +1,70 @@
+#include <catch2/catch.hpp>
+
+#include <threads/ParkedTeam.h>
+
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+using namespace threads;
+
+namespace tests {
+
+TEST_CASE("Test running jobs on a parked team", "[threads]")
+{
+    int nThreads = 4;
+    int nJobs = 20;
+    ParkedTeam team(nThreads);
+
+    std::mutex mx;
+    std::vector<std::set<std::thread::id>> threadIds(nThreads);
+    std::vector<int> counts(nThreads, 0);
+
+    for (int j = 0; j < nJobs; j++) {
+        std::atomic<int> nFinished = 0;
+        team.run([&](int threadNum) {
+            std::unique_lock<std::mutex> lock(mx);
+            threadIds.at(threadNum).insert(std::this_thread::get_id());
+            counts.at(threadNum)++;
+            nFinished++;
+        });
+
+        // All threads have finished by the time the job returns
+        REQUIRE(nFinished == nThreads);
+    }
+
+    // Every job runs on the same threads
+    std::set<std::thread::id> allIds;
+    for (int i = 0; i < nThreads; i++) {
+        REQUIRE(threadIds.at(i).size() == 1);
+        REQUIRE(counts.at(i) == nJobs);
+        allIds.insert(*threadIds.at(i).begin());
+    }
+
+    REQUIRE(allIds.size() == nThreads);
+    REQUIRE(allIds.count(std::this_thread::get_id()) == 0);
+}
+
+TEST_CASE("Test parked team errors", "[threads]")
+{
+    ParkedTeam team(3);
+
+    std::atomic<int> nFinished = 0;
+    REQUIRE_THROWS_AS(team.run([&nFinished](int threadNum) {
+        if (threadNum == 1) {
+            throw std::runtime_error("Job failed");
+        }
+
+        nFinished++;
+    }),
+                      std::runtime_error);
+
+    // Other threads still finish, and the team can carry on
+    REQUIRE(nFinished == 2);
+
+    team.run([&nFinished](int threadNum) { nFinished++; });
+    REQUIRE(nFinished == 5);
+}
+}
@@ -0,0 +1,84 @@
+#include <catch2/catch.hpp>
+
+#include <threads/ReductionTree.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace threads;
+
+namespace tests {
+
+TEST_CASE("Test tree reductions", "[threads]")
+{
+    int nThreads = 1;
+
+    SECTION("Power of two") { nThreads = 8; }
+
+    SECTION("Odd number") { nThreads = 7; }
+
+    SECTION("Two threads") { nThreads = 2; }
+
+    int nRounds = 50;
+    ReductionTree tree(nThreads);
+
+    // The data passed to the tree is the index of each thread's partial sum
+    std::vector<int64_t> sums(nThreads, 0);
+    std::atomic<int> nRoots = 0;
+    std::atomic<int> nCombines = 0;
+    std::vector<int64_t> results;
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < nThreads; t++) {
+        threads.emplace_back([&, t] {
+            for (int r = 0; r < nRounds; r++) {
+                sums.at(t) = t + r;
+
+                bool isRoot =
+                  tree.reduce(t, t, [&sums, &nCombines](int32_t a, int32_t b) {
+                      sums.at(a) += sums.at(b);
+                      nCombines++;
+                  });
+
+                if (isRoot) {
+                    nRoots++;
+                    results.push_back(sums.at(t));
+                    tree.release();
+                } else {
+                    tree.awaitRelease(t);
+                }
+            }
+        });
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    // Only thread zero finishes each round, having combined everyone's data
+    REQUIRE(nRoots == nRounds);
+    REQUIRE(nCombines == nRounds * (nThreads - 1));
+
+    std::vector<int64_t> expected;
+    for (int r = 0; r < nRounds; r++) {
+        expected.push_back((int64_t)nThreads * (nThreads - 1) / 2 +
+                           (int64_t)r * nThreads);
+    }
+
+    REQUIRE(results == expected);
+}
+
+TEST_CASE("Test reduction tree registry", "[threads]")
+{
+    int groupId = 567;
+
+    std::shared_ptr<ReductionTree> treeA = getOrCreateReductionTree(groupId, 4);
+    REQUIRE(getOrCreateReductionTree(groupId, 4) == treeA);
+    REQUIRE(getOrCreateReductionTree(groupId + 1, 4) != treeA);
+
+    // Tree is removed once nobody holds it
+    treeA.reset();
+    REQUIRE(getOrCreateReductionTree(groupId, 2)->nThreads == 2);
+}
+}
@@ -0,0 +1,132 @@
+#include <catch2/catch.hpp>
+
+#include <threads/TaskPool.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace threads;
+
+namespace tests {
+
+TEST_CASE("Test task deque order", "[threads]")
+{
+    TaskDeque deque;
+    REQUIRE(deque.pop() == nullptr);
+    REQUIRE(deque.steal() == nullptr);
+
+    for (int i = 1; i <= 4; i++) {
+        deque.push(std::make_shared<Task>(i, nullptr, nullptr));
+    }
+
+    // Owner takes the newest, thieves the oldest
+    REQUIRE(deque.pop()->taskPtr == 4);
+    REQUIRE(deque.steal()->taskPtr == 1);
+    REQUIRE(deque.pop()->taskPtr == 3);
+    REQUIRE(deque.steal()->taskPtr == 2);
+    REQUIRE(deque.pop() == nullptr);
+}
+
+TEST_CASE("Test task pool counts", "[threads]")
+{
+    TaskPool pool(3);
+
+    auto parent = std::make_shared<Task>(0, nullptr, nullptr);
+    auto group = std::make_shared<TaskGroup>(nullptr);
+
+    auto taskA = std::make_shared<Task>(1, parent, group);
+    auto taskB = std::make_shared<Task>(2, parent, nullptr);
+    pool.push(0, taskA);
+    pool.push(0, taskB);
+
+    REQUIRE(pool.getPendingCount() == 2);
+    REQUIRE(parent->nIncompleteChildren == 2);
+    REQUIRE(group->nIncomplete == 1);
+
+    // Other threads steal from thread zero
+    REQUIRE(pool.next(2) == taskA);
+    pool.complete(taskA);
+
+    REQUIRE(pool.getPendingCount() == 1);
+    REQUIRE(parent->nIncompleteChildren == 1);
+    REQUIRE(group->nIncomplete == 0);
+
+    REQUIRE(pool.next(0) == taskB);
+    REQUIRE(pool.next(1) == nullptr);
+    pool.complete(taskB);
+
+    REQUIRE(pool.getPendingCount() == 0);
+    REQUIRE(parent->nIncompleteChildren == 0);
+}
+
+TEST_CASE("Test executing nested tasks across threads", "[threads]")
+{
+    int nThreads = 4;
+    int n = 18;
+
+    // Each task is a fib call, whose argument is its task pointer. Tasks
+    // spawn two children and wait for them, much like an OpenMP fib.
+    TaskPool pool(nThreads);
+    std::atomic<int> nLeaves = 0;
+
+    std::function<void(int, std::shared_ptr<Task>)> exec =
+      [&pool, &nLeaves, &exec](int threadNum, std::shared_ptr<Task> task) {
+          if (task->taskPtr < 2) {
+              nLeaves++;
+          } else {
+              int fibN = task->taskPtr;
+              pool.push(threadNum,
+                        std::make_shared<Task>(fibN - 1, task, nullptr));
+              pool.push(threadNum,
+                        std::make_shared<Task>(fibN - 2, task, nullptr));
+
+              pool.executeUntil(
+                threadNum,
+                [&task] { return task->nIncompleteChildren == 0; },
+                [threadNum, &exec](std::shared_ptr<Task> t) {
+                    exec(threadNum, t);
+                });
+          }
+
+          pool.complete(task);
+      };
+
+    pool.push(0, std::make_shared<Task>(n, nullptr, nullptr));
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < nThreads; i++) {
+        threads.emplace_back([i, &pool, &exec] {
+            pool.executeUntil(
+              i,
+              [&pool] { return pool.getPendingCount() == 0; },
+              [i, &exec](std::shared_ptr<Task> t) { exec(i, t); });
+        });
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    // Number of leaves of the call tree is fib(n + 1)
+    REQUIRE(nLeaves == 4181);
+    REQUIRE(pool.getPendingCount() == 0);
+}
+
+TEST_CASE("Test task pool registry", "[threads]")
+{
+    int groupId = 345;
+
+    std::shared_ptr<TaskPool> poolA = getOrCreateTaskPool(groupId, 2);
+    std::shared_ptr<TaskPool> poolB = getOrCreateTaskPool(groupId, 2);
+    REQUIRE(poolA == poolB);
+    REQUIRE(getOrCreateTaskPool(groupId + 1, 2) != poolA);
+
+    // Pool is removed once nobody holds it
+    poolA.reset();
+    poolB.reset();
+
+    std::shared_ptr<TaskPool> poolC = getOrCreateTaskPool(groupId, 3);
+    REQUIRE(poolC->nThreads == 3);
+}
+}
@@ -67,4 +67,24 @@ TEST_CASE_METHOD(FunctionExecTestFixture,
 {
     executeWithWamrPool("demo", "chain", 10000);
 }
+
+TEST_CASE_METHOD(FunctionExecTestFixture, "Test WAMR memory base", "[wamr]")
+{
+    auto req = setUpContext("demo", "echo");
+    faabric::Message& call = req->mutable_messages()->at(0);
+
+    wasm::WAMRWasmModule module;
+    module.bindToFunction(call);
+
+    REQUIRE(module.getMemoryBase() != nullptr);
+    REQUIRE(module.getMemoryBase() == module.wasmPointerToNative(0));
+    REQUIRE(module.getMemoryView().size() == module.getMemorySizeBytes());
+}
+
+TEST_CASE_METHOD(FunctionExecTestFixture,
+                 "Test executing pthreads with WAMR",
+                 "[wamr]")
+{
+    executeWithWamrPool("demo", "threads_check", 10000);
+}
 }
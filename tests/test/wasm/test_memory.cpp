@@ -4,16 +4,22 @@
 #include "utils.h"
 
 #include <wamr/WAMRWasmModule.h>
+#include <wasm/WasmExecutionContext.h>
 #include <wavm/WAVMWasmModule.h>
+#include <wavm/syscalls.h>
 
 #include <faabric/util/bytes.h>
 #include <faabric/util/config.h>
 #include <faabric/util/files.h>
 #include <faabric/util/func.h>
 
+#include <boost/filesystem.hpp>
 #include <fcntl.h>
+#include <set>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
 
 using namespace WAVM;
 
@@ -56,6 +62,187 @@ TEST_CASE_METHOD(FunctionExecTestFixture, "Test mmapping a file", "[wasm]")
     REQUIRE(expected == actual);
 }
 
+TEST_CASE_METHOD(FunctionExecTestFixture,
+                 "Test mmapping file windows",
+                 "[wasm]")
+{
+    auto req = setUpContext("demo", "echo");
+    faabric::Message& call = req->mutable_messages()->at(0);
+
+    std::shared_ptr<wasm::WasmModule> module = nullptr;
+    SECTION("WAVM") { module = std::make_shared<wasm::WAVMWasmModule>(); }
+
+    SECTION("WAMR") { module = std::make_shared<wasm::WAMRWasmModule>(); }
+
+    module->bindToFunction(call);
+
+    // Two pages of data, each filled with a different byte
+    size_t pageSize = faabric::util::HOST_PAGE_SIZE;
+    std::string fileName = "/tmp/faasm_mmap_windows";
+    std::vector<uint8_t> fileData(2 * pageSize, 1);
+    std::fill(fileData.begin() + pageSize, fileData.end(), 2);
+    faabric::util::writeBytesToFile(fileName, fileData);
+
+    int fd = open(fileName.c_str(), O_RDWR);
+    REQUIRE(fd > 0);
+
+    // Offsets must be page-aligned
+    REQUIRE((int32_t)module->mmapFile(fd, pageSize, PROT_READ, MAP_SHARED, 1) ==
+            -EINVAL);
+
+    // Map the second page, past the end of the file is zeroed
+    uint32_t wasmPtr = module->mmapFile(
+      fd, 2 * pageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, pageSize);
+    uint8_t* hostPtr = module->wasmPointerToNative(wasmPtr);
+    REQUIRE(hostPtr[0] == 2);
+    REQUIRE(hostPtr[pageSize - 1] == 2);
+    REQUIRE(hostPtr[pageSize] == 0);
+
+    // Private writes do not reach the file
+    hostPtr[0] = 3;
+    REQUIRE(faabric::util::readFileToBytes(fileName).at(pageSize) == 2);
+
+    // Shared writes do, mapped over the existing region
+    uint32_t sharedPtr = module->mmapFile(
+      fd, pageSize, PROT_READ | PROT_WRITE, MAP_SHARED, 0, wasmPtr);
+    REQUIRE(sharedPtr == wasmPtr);
+    REQUIRE(hostPtr[0] == 1);
+
+    hostPtr[0] = 4;
+    REQUIRE(module->syncMappedFile(wasmPtr, pageSize, MS_SYNC) == 0);
+    REQUIRE(faabric::util::readFileToBytes(fileName).at(0) == 4);
+
+    // Unmapping replaces the file with zeroed memory
+    module->unmapMemory(wasmPtr, 2 * pageSize);
+    REQUIRE(hostPtr[0] == 0);
+    hostPtr[1] = 5;
+    REQUIRE(faabric::util::readFileToBytes(fileName).at(1) == 1);
+
+    close(fd);
+    unlink(fileName.c_str());
+}
+
+TEST_CASE_METHOD(FunctionExecTestFixture,
+                 "Test mmap syscall offsets",
+                 "[wasm]")
+{
+    faabric::Message call = faabric::util::messageFactory("demo", "echo");
+    wasm::WAVMWasmModule module;
+    module.bindToFunction(call);
+
+    // Three pages of data, each filled with a different byte
+    size_t pageSize = faabric::util::HOST_PAGE_SIZE;
+    int fd = module.getFileSystem().openScratchAnonymous("mmap_offsets");
+    REQUIRE(fd > 0);
+
+    int linuxFd = module.getFileSystem().getFileDescriptor(fd).getLinuxFd();
+    for (int i = 0; i < 3; i++) {
+        std::vector<uint8_t> page(pageSize, i + 1);
+        REQUIRE(::pwrite(linuxFd, page.data(), pageSize, i * pageSize) ==
+                (ssize_t)pageSize);
+    }
+
+    int syscallNumber = 0;
+    int offset = 0;
+
+    // Legacy mmap takes the offset in bytes
+    SECTION("mmap")
+    {
+        syscallNumber = 90;
+        offset = 2 * pageSize;
+    }
+
+    // mmap2 takes the offset in pages
+    SECTION("mmap2")
+    {
+        syscallNumber = 192;
+        offset = 2;
+    }
+
+    wasm::WasmExecutionContext ctx(&module);
+    int32_t wasmPtr = wasm::executeSyscall(
+      syscallNumber, 0, pageSize, PROT_READ, MAP_PRIVATE, fd, offset, 0);
+    REQUIRE(wasmPtr > 0);
+
+    uint8_t* hostPtr = module.wasmPointerToNative(wasmPtr);
+    REQUIRE(hostPtr[0] == 3);
+    REQUIRE(hostPtr[pageSize - 1] == 3);
+}
+
+TEST_CASE_METHOD(FunctionExecTestFixture,
+                 "Test shared mappings of scratch files",
+                 "[wasm]")
+{
+    faabric::Message call = faabric::util::messageFactory("demo", "echo");
+    wasm::WAVMWasmModule module;
+    module.bindToFunction(call);
+
+    size_t pageSize = faabric::util::HOST_PAGE_SIZE;
+    int fd = module.getFileSystem().openScratchAnonymous("mmap_shared");
+    REQUIRE(fd > 0);
+
+    wasm::WasmExecutionContext ctx(&module);
+
+    // Writable shared mappings could grow the file past the scratch limit
+    int32_t res = wasm::executeSyscall(
+      192, 0, pageSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0, 0);
+    REQUIRE(res == -EACCES);
+
+    // Read-only and private mappings are fine
+    REQUIRE(wasm::executeSyscall(
+              192, 0, pageSize, PROT_READ, MAP_SHARED, fd, 0, 0) > 0);
+    REQUIRE(wasm::executeSyscall(192,
+                                 0,
+                                 pageSize,
+                                 PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE,
+                                 fd,
+                                 0,
+                                 0) > 0);
+}
+
+TEST_CASE_METHOD(FunctionExecTestFixture,
+                 "Test fixed anonymous mappings",
+                 "[wasm]")
+{
+    auto req = setUpContext("demo", "echo");
+    faabric::Message& call = req->mutable_messages()->at(0);
+
+    std::shared_ptr<wasm::WasmModule> module = nullptr;
+    SECTION("WAVM") { module = std::make_shared<wasm::WAVMWasmModule>(); }
+
+    SECTION("WAMR") { module = std::make_shared<wasm::WAMRWasmModule>(); }
+
+    module->bindToFunction(call);
+
+    size_t pageSize = faabric::util::HOST_PAGE_SIZE;
+    uint32_t wasmPtr = module->mmapMemory(4 * pageSize);
+    uint8_t* hostPtr = module->wasmPointerToNative(wasmPtr);
+    std::fill(hostPtr, hostPtr + 4 * pageSize, 7);
+
+    // Mapping over existing memory zeroes just that region
+    uint32_t fixedPtr = wasmPtr + pageSize;
+    REQUIRE(module->mmapFixedMemory(fixedPtr, pageSize) == fixedPtr);
+    REQUIRE(hostPtr[pageSize - 1] == 7);
+    REQUIRE(hostPtr[pageSize] == 0);
+    REQUIRE(hostPtr[2 * pageSize - 1] == 0);
+    REQUIRE(hostPtr[2 * pageSize] == 7);
+
+    // Unaligned addresses and memory past the end are rejected
+    REQUIRE((int32_t)module->mmapFixedMemory(fixedPtr + 1, pageSize) ==
+            -EINVAL);
+    uint32_t brk = module->getCurrentBrk();
+    REQUIRE((int32_t)module->mmapFixedMemory(brk, pageSize) == -EINVAL);
+
+    // Unmapped memory that's mapped over again must not be handed out
+    uint32_t otherPtr = module->mmapMemory(pageSize);
+    module->unmapMemory(wasmPtr, 4 * pageSize);
+    REQUIRE(module->mmapFixedMemory(wasmPtr, 4 * pageSize) == wasmPtr);
+
+    uint32_t newPtr = module->mmapMemory(4 * pageSize);
+    REQUIRE(newPtr > otherPtr);
+}
+
 TEST_CASE_METHOD(FunctionExecTestFixture,
                  "Test memory growth and shrinkage",
                  "[wasm]")
@@ -145,6 +332,28 @@ TEST_CASE_METHOD(FunctionExecTestFixture,
 
     REQUIRE(newMemSize == oldMemSize);
     REQUIRE(newBrk == oldBrk);
+
+    // Check the part of the region below the brk is kept for reuse
+    size_t freedC = oldBrk - unmapOffset;
+    wasm::MemoryStats stats = module.getMemoryStats();
+    REQUIRE(stats.freeBytes == freedC);
+    REQUIRE(stats.freeRegionCount == 1);
+    REQUIRE(stats.unmapCount == 2);
+    REQUIRE(stats.releasedBytes >= shrinkB + freedC);
+
+    uint32_t reusedOffset = module.mmapMemory(WASM_BYTES_PER_PAGE);
+    REQUIRE(reusedOffset == unmapOffset);
+    REQUIRE(module.getCurrentBrk() == oldBrk);
+
+    stats = module.getMemoryStats();
+    REQUIRE(stats.reuseCount == 1);
+    REQUIRE(stats.freeBytes == freedC - WASM_BYTES_PER_PAGE);
+
+    // Check unmapping the rest of the top of memory gives it back to the brk
+    module.unmapMemory(unmapOffset + WASM_BYTES_PER_PAGE,
+                       oldBrk - unmapOffset - WASM_BYTES_PER_PAGE);
+    REQUIRE(module.getCurrentBrk() == unmapOffset + WASM_BYTES_PER_PAGE);
+    REQUIRE(module.getMemoryStats().freeBytes == 0);
 }
 
 TEST_CASE_METHOD(FunctionExecTestFixture, "Test mmap/munmap", "[faaslet]")
@@ -199,4 +408,129 @@ TEST_CASE_METHOD(FunctionExecTestFixture,
 
     REQUIRE(failed);
 }
+
+TEST_CASE_METHOD(MultiRuntimeFunctionExecTestFixture,
+                 "Test huge pages for linear memory",
+                 "[wasm]")
+{
+    faabric::Message call = faabric::util::messageFactory("demo", "echo");
+
+    bool expectAdvised = false;
+    SECTION("Off") { conf.hugePages = "off"; }
+
+    SECTION("Other function") { conf.hugePages = "demo/hello,demo/x2"; }
+
+    SECTION("This function")
+    {
+        conf.hugePages = "demo/hello,demo/echo";
+        expectAdvised = true;
+    }
+
+    SECTION("On")
+    {
+        conf.hugePages = "on";
+        expectAdvised = true;
+    }
+
+    // Kernels without transparent huge pages just ignore the setting
+    if (!boost::filesystem::exists(
+          "/sys/kernel/mm/transparent_hugepage/enabled")) {
+        expectAdvised = false;
+    }
+
+    wasm::WAVMWasmModule module;
+    module.bindToFunction(call);
+
+    // Grow by more than a huge page, unaligned to huge pages
+    size_t growBy = HUGE_PAGE_SIZE + 3 * WASM_BYTES_PER_PAGE;
+    uint32_t offset = module.growMemory(growBy);
+
+    size_t advisedBytes = module.getMemoryStats().hugePageBytes;
+    if (expectAdvised) {
+        REQUIRE(advisedBytes >= HUGE_PAGE_SIZE);
+    } else {
+        REQUIRE(advisedBytes == 0);
+    }
+
+    // Snapshot and restore must work on host pages within huge pages
+    uint8_t* data = module.wasmPointerToNative(offset);
+    data[0] = 1;
+    data[HUGE_PAGE_SIZE + 1] = 2;
+
+    std::string snapKey = module.snapshot();
+
+    data[0] = 3;
+    data[faabric::util::HOST_PAGE_SIZE] = 4;
+    data[HUGE_PAGE_SIZE + 1] = 5;
+
+    module.restore(snapKey);
+    data = module.wasmPointerToNative(offset);
+    REQUIRE(data[0] == 1);
+    REQUIRE(data[faabric::util::HOST_PAGE_SIZE] == 0);
+    REQUIRE(data[HUGE_PAGE_SIZE + 1] == 2);
+}
+
+TEST_CASE_METHOD(FunctionExecTestFixture,
+                 "Test concurrent memory growth",
+                 "[wasm]")
+{
+    faabric::Message call = faabric::util::messageFactory("demo", "echo");
+    wasm::WAVMWasmModule module;
+    module.bindToFunction(call);
+
+    int nThreads = 8;
+    int nGrowths = 50;
+    size_t growBy = WASM_BYTES_PER_PAGE;
+    size_t totalBytes = nThreads * nGrowths * growBy;
+
+    uint32_t startBrk = module.getCurrentBrk();
+
+    // Provision part of the memory up front, so that growth both bumps the
+    // break within provisioned memory and adds new pages
+    SECTION("Nothing provisioned") {}
+
+    SECTION("Some provisioned")
+    {
+        module.growMemory(totalBytes / 2);
+        module.shrinkMemory(totalBytes / 2);
+    }
+
+    SECTION("All provisioned")
+    {
+        module.growMemory(totalBytes);
+        module.shrinkMemory(totalBytes);
+    }
+
+    REQUIRE(module.getCurrentBrk() == startBrk);
+
+    std::vector<std::vector<uint32_t>> offsets(nThreads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < nThreads; t++) {
+        threads.emplace_back([&module, &offsets, t, nGrowths, growBy] {
+            for (int i = 0; i < nGrowths; i++) {
+                offsets.at(t).push_back(module.growMemory(growBy));
+            }
+        });
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    // Every growth must have got its own region
+    std::set<uint32_t> allOffsets;
+    for (const auto& o : offsets) {
+        allOffsets.insert(o.begin(), o.end());
+    }
+    REQUIRE(allOffsets.size() == (size_t)(nThreads * nGrowths));
+
+    uint32_t expected = startBrk;
+    for (uint32_t offset : allOffsets) {
+        REQUIRE(offset == expected);
+        expected += growBy;
+    }
+
+    REQUIRE(module.getCurrentBrk() == startBrk + totalBytes);
+    REQUIRE(module.getMemorySizeBytes() == startBrk + totalBytes);
+}
 }
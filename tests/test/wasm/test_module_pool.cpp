@@ -0,0 +1,82 @@
+#include <catch2/catch.hpp>
+
+#include "faasm_fixtures.h"
+#include "utils.h"
+
+#include <faaslet/Faaslet.h>
+#include <wasm/ModulePool.h>
+
+#include <faabric/util/func.h>
+
+namespace tests {
+
+TEST_CASE_METHOD(MultiRuntimeFunctionExecTestFixture,
+                 "Test reusing pooled modules across Faaslets",
+                 "[wasm]")
+{
+    wasm::ModulePool& pool = wasm::getModulePool();
+    pool.clear();
+
+    conf.wasmVm = "wavm";
+    conf.modulePoolSize = 1;
+
+    auto req = setUpContext("demo", "echo");
+    faabric::Message& msg = req->mutable_messages()->at(0);
+
+    // Execute and reset, then shut down, which should pool the module
+    wasm::WasmModule* pooledModule = nullptr;
+    {
+        faaslet::Faaslet f(msg);
+        pooledModule = f.module.get();
+
+        REQUIRE(f.executeTask(0, 0, req) == 0);
+        f.reset(msg);
+        f.shutdown();
+    }
+
+    REQUIRE(pool.getPooledModuleCount() == 1);
+
+    // The next Faaslet should take it over
+    {
+        faaslet::Faaslet f(msg);
+        REQUIRE(f.module.get() == pooledModule);
+        REQUIRE(pool.getPooledModuleCount() == 0);
+
+        REQUIRE(f.executeTask(0, 0, req) == 0);
+
+        // Not reset since executing, so must not be pooled
+        f.shutdown();
+    }
+
+    REQUIRE(pool.getPooledModuleCount() == 0);
+
+    // Pool is full after one module
+    {
+        faaslet::Faaslet fA(msg);
+        faaslet::Faaslet fB(msg);
+        fA.shutdown();
+        fB.shutdown();
+    }
+
+    REQUIRE(pool.getPooledModuleCount() == 1);
+
+    // Modules can't be claimed for another function
+    faabric::Message otherMsg = faabric::util::messageFactory("demo", "hello");
+    REQUIRE(pool.claim(otherMsg, 1) == nullptr);
+
+    // The module pooled without executing still works once its memory has
+    // been released
+    {
+        faaslet::Faaslet f(msg);
+        REQUIRE(pool.getPooledModuleCount() == 0);
+        REQUIRE(f.executeTask(0, 0, req) == 0);
+        f.reset(msg);
+        f.shutdown();
+    }
+
+    REQUIRE(pool.getPooledModuleCount() == 1);
+
+    pool.clear();
+    REQUIRE(pool.getPooledModuleCount() == 0);
+}
+}
@@ -4,6 +4,8 @@
 #include "fixtures.h"
 #include "utils.h"
 
+#include <conf/FaasmConfig.h>
+
 #include <faabric/proto/faabric.pb.h>
 #include <faabric/scheduler/Scheduler.h>
 #include <faabric/snapshot/SnapshotRegistry.h>
@@ -38,6 +40,25 @@ class OpenMPTestFixture
     }
 };
 
+/**
+ * The OpenMP fixture's conf is the faabric system config, so the Faasm config
+ * is added under another name. It's reset after each test.
+ */
+class OpenMPConfTestFixture
+  : public OpenMPTestFixture
+  , public FaasmConfTestFixture
+{
+  public:
+    OpenMPConfTestFixture()
+      : faasmConf(FaasmConfTestFixture::conf)
+    {}
+
+    ~OpenMPConfTestFixture() {}
+
+  protected:
+    conf::FaasmConfig& faasmConf;
+};
+
 TEST_CASE_METHOD(OpenMPTestFixture,
                  "Test OpenMP static for scheduling",
                  "[wasm][openmp]")
@@ -168,6 +189,27 @@ TEST_CASE_METHOD(OpenMPTestFixture,
     doOmpTestLocal("default_shared");
 }
 
+TEST_CASE_METHOD(OpenMPConfTestFixture,
+                 "Test OpenMP with persistent teams",
+                 "[wasm][openmp]")
+{
+    faasmConf.ompTeams = "persistent";
+
+    std::string function;
+
+    SECTION("Barrier") { function = "simple_barrier"; }
+
+    SECTION("For") { function = "simple_for"; }
+
+    SECTION("Critical") { function = "simple_critical"; }
+
+    SECTION("Repeated reductions") { function = "repeated_reduce"; }
+
+    SECTION("Mix of constructs") { function = "reduction_integral"; }
+
+    doOmpTestLocal(function);
+}
+
 TEST_CASE_METHOD(OpenMPTestFixture,
                  "Run openmp memory stress test",
                  "[wasm][openmp]")
@@ -188,8 +230,8 @@ TEST_CASE_METHOD(OpenMPTestFixture,
     execFuncWithPool(msg, false, OMP_TEST_TIMEOUT_MS);
 }
 
-TEST_CASE_METHOD(OpenMPTestFixture,
-                 "Test nested openmp explicitly disabled",
+TEST_CASE_METHOD(OpenMPConfTestFixture,
+                 "Test nested OpenMP",
                  "[wasm][openmp]")
 {
     faabric::scheduler::Scheduler& sch = faabric::scheduler::getScheduler();
@@ -200,16 +242,23 @@ TEST_CASE_METHOD(OpenMPTestFixture,
     res.set_slots(nSlots);
     sch.setThisHostResources(res);
 
-    faabric::Message msg =
-      faabric::util::messageFactory("omp", "nested_parallel");
-    faabric::Message result = execErrorFunction(msg);
+    // Nested regions get their own teams up to the limit, and are serialised
+    // beyond it
+    SECTION("Nesting limit above the depth")
+    {
+        faasmConf.ompMaxActiveLevels = 4;
+    }
+
+    SECTION("At the nesting limit") { faasmConf.ompMaxActiveLevels = 2; }
 
-    // Get result
-    REQUIRE(result.returnvalue() > 0);
+    SECTION("Above the nesting limit") { faasmConf.ompMaxActiveLevels = 1; }
+
+    SECTION("Persistent teams")
+    {
+        faasmConf.ompTeams = "persistent";
+        faasmConf.ompMaxActiveLevels = 2;
+    }
 
-    std::string expectedOutput = fmt::format(
-      "Task {} threw exception. What: OpenMP threads failed", msg.id());
-    const std::string actualOutput = result.outputdata();
-    REQUIRE(actualOutput == expectedOutput);
+    doOmpTestLocal("nested_parallel");
 }
 }
@@ -0,0 +1,84 @@
+#include <catch2/catch.hpp>
+
+#include <wasm/PageAllocator.h>
+
+using namespace wasm;
+
+namespace tests {
+
+TEST_CASE("Test page allocator reuse and coalescing", "[wasm]")
+{
+    PageAllocator allocator;
+    REQUIRE(allocator.allocate(10) == 0);
+
+    allocator.free(100, 50);
+    allocator.free(200, 30);
+    REQUIRE(allocator.getFreeRegionCount() == 2);
+    REQUIRE(allocator.getFreeBytes() == 80);
+
+    // Best fit takes the smaller region
+    REQUIRE(allocator.allocate(30) == 200);
+    REQUIRE(allocator.getFreeRegionCount() == 1);
+    REQUIRE(allocator.getFreeBytes() == 50);
+
+    // Partial allocations take from the bottom
+    REQUIRE(allocator.allocate(20) == 100);
+    REQUIRE(allocator.allocate(40) == 0);
+    allocator.free(100, 20);
+
+    // Adjacent and overlapping regions are merged
+    allocator.free(150, 50);
+    REQUIRE(allocator.getFreeRegionCount() == 1);
+    REQUIRE(allocator.getFreeBytes() == 100);
+
+    allocator.free(120, 100);
+    REQUIRE(allocator.getFreeRegionCount() == 1);
+    REQUIRE(allocator.getFreeBytes() == 120);
+}
+
+TEST_CASE("Test page allocator reserving", "[wasm]")
+{
+    PageAllocator allocator;
+    allocator.free(100, 100);
+    allocator.free(300, 100);
+
+    // Reserving splits a region, keeping the parts either side
+    allocator.reserve(120, 30);
+    REQUIRE(allocator.getFreeRegionCount() == 3);
+    REQUIRE(allocator.getFreeBytes() == 170);
+    REQUIRE(allocator.allocate(20) == 100);
+    REQUIRE(allocator.allocate(50) == 150);
+
+    // Ranges can span several regions and gaps
+    allocator.free(100, 100);
+    allocator.reserve(180, 140);
+    REQUIRE(allocator.getFreeRegionCount() == 2);
+    REQUIRE(allocator.getFreeBytes() == 160);
+
+    // Reserving memory that isn't free does nothing
+    allocator.reserve(500, 100);
+    REQUIRE(allocator.getFreeBytes() == 160);
+}
+
+TEST_CASE("Test page allocator trimming", "[wasm]")
+{
+    PageAllocator allocator;
+    allocator.free(100, 100);
+
+    // Only a region ending at the break is trimmed
+    REQUIRE(allocator.trimTop(300) == 300);
+    REQUIRE(allocator.trimTop(200) == 100);
+    REQUIRE(allocator.getFreeBytes() == 0);
+
+    // Truncating drops everything above the new top
+    allocator.free(100, 100);
+    allocator.free(250, 50);
+    allocator.truncate(150);
+    REQUIRE(allocator.getFreeRegionCount() == 1);
+    REQUIRE(allocator.getFreeBytes() == 50);
+
+    allocator.clear();
+    REQUIRE(allocator.getFreeRegionCount() == 0);
+    REQUIRE(allocator.getFreeBytes() == 0);
+}
+}
@@ -19,6 +19,8 @@
 #include <faaslet/Faaslet.h>
 #include <wavm/WAVMWasmModule.h>
 
+#include <set>
+
 using namespace wasm;
 
 namespace tests {
@@ -213,4 +215,191 @@ TEST_CASE_METHOD(WasmSnapTestFixture,
         f.shutdown();
     }
 }
+
+TEST_CASE_METHOD(WasmSnapTestFixture,
+                 "Test thread stacks are allocated lazily",
+                 "[wasm][snapshot]")
+{
+    faabric::Message m = faabric::util::messageFactory("demo", "echo");
+
+    int threadPoolSize = 4;
+    wasm::WAVMWasmModule module(threadPoolSize);
+    module.bindToFunction(m);
+
+    // No stacks to begin with
+    std::vector<uint32_t> expectedStacks(threadPoolSize, 0);
+    REQUIRE(module.getThreadStacks() == expectedStacks);
+    std::string noStacksSnapKey = module.snapshot();
+
+    // Allocating a stack grows memory by the stack and its guard regions
+    uint32_t brkBefore = module.getCurrentBrk();
+    uint32_t stackTop = module.getThreadStack(2);
+    uint32_t stackRegionSize = THREAD_STACK_SIZE + 2 * GUARD_REGION_SIZE;
+    REQUIRE(module.getCurrentBrk() == brkBefore + stackRegionSize);
+    REQUIRE(stackTop == brkBefore + GUARD_REGION_SIZE + THREAD_STACK_SIZE - 16);
+
+    // Stacks are only allocated once
+    REQUIRE(module.getThreadStack(2) == stackTop);
+    REQUIRE_THROWS(module.getThreadStack(threadPoolSize));
+
+    // Provisioning allocates the missing stacks in order
+    module.provisionThreadStacks(3);
+    std::vector<uint32_t> stacks = module.getThreadStacks();
+    REQUIRE(stacks.at(0) == brkBefore + stackRegionSize + stackRegionSize -
+                              GUARD_REGION_SIZE - 16);
+    REQUIRE(stacks.at(1) == stacks.at(0) + stackRegionSize);
+    REQUIRE(stacks.at(2) == stackTop);
+    REQUIRE(stacks.at(3) == 0);
+
+    // Snapshots only contain the stacks allocated so far
+    std::string snapKey = module.snapshot();
+    REQUIRE(reg.getSnapshot(snapKey)->getSize() ==
+            brkBefore + 3 * stackRegionSize);
+
+    // Copies keep the stacks
+    wasm::WAVMWasmModule moduleCopy = module;
+    REQUIRE(moduleCopy.getThreadStacks() == stacks);
+
+    // Other hosts restoring the snapshot use the same stacks, rather than
+    // allocating their own on top of it
+    wasm::WAVMWasmModule remoteModule(threadPoolSize);
+    remoteModule.bindToFunction(m);
+    remoteModule.restore(snapKey);
+    REQUIRE(remoteModule.getThreadStacks() == stacks);
+
+    uint32_t remoteBrk = remoteModule.getCurrentBrk();
+    REQUIRE(remoteModule.getThreadStack(1) == stacks.at(1));
+    REQUIRE(remoteModule.getCurrentBrk() == remoteBrk);
+
+    // Restoring a snapshot taken before the stacks existed forgets them
+    module.restore(noStacksSnapKey);
+    REQUIRE(module.getThreadStacks() == expectedStacks);
+}
+
+TEST_CASE_METHOD(WasmSnapTestFixture,
+                 "Test nested thread stacks are reused",
+                 "[wasm][snapshot]")
+{
+    faabric::Message m = faabric::util::messageFactory("demo", "echo");
+
+    int threadPoolSize = 4;
+    wasm::WAVMWasmModule module(threadPoolSize);
+    module.bindToFunction(m);
+
+    uint32_t stackRegionSize = THREAD_STACK_SIZE + 2 * GUARD_REGION_SIZE;
+    uint32_t brkBefore = module.getCurrentBrk();
+
+    // Claiming stacks allocates new ones while none are free
+    uint32_t stackA = module.claimNestedThreadStack();
+    uint32_t stackB = module.claimNestedThreadStack();
+    REQUIRE(stackA != stackB);
+    REQUIRE(module.getCurrentBrk() == brkBefore + 2 * stackRegionSize);
+
+    // Released stacks are reused, so repeated nested teams of the same size
+    // don't grow memory
+    for (int i = 0; i < 10; i++) {
+        module.releaseNestedThreadStack(stackA);
+        module.releaseNestedThreadStack(stackB);
+
+        std::set<uint32_t> claimed = { module.claimNestedThreadStack(),
+                                       module.claimNestedThreadStack() };
+        REQUIRE(claimed == std::set<uint32_t>({ stackA, stackB }));
+    }
+
+    REQUIRE(module.getCurrentBrk() == brkBefore + 2 * stackRegionSize);
+
+    // Nested stacks don't take thread pool slots
+    std::vector<uint32_t> expectedStacks(threadPoolSize, 0);
+    REQUIRE(module.getThreadStacks() == expectedStacks);
+}
+
+TEST_CASE_METHOD(WasmSnapTestFixture,
+                 "Test task memory is reused",
+                 "[wasm][snapshot]")
+{
+    faabric::Message m = faabric::util::messageFactory("demo", "echo");
+    wasm::WAVMWasmModule module;
+    module.bindToFunction(m);
+
+    uint32_t brkBefore = module.getCurrentBrk();
+
+    // Small blocks are aligned and share a chunk
+    uint32_t taskA = module.allocateTaskMemory(40);
+    uint32_t taskB = module.allocateTaskMemory(33);
+    REQUIRE(taskA % TASK_MEMORY_ALIGNMENT == 0);
+    REQUIRE(taskB == taskA + 48);
+    REQUIRE(module.getCurrentBrk() == brkBefore + TASK_MEMORY_CHUNK_SIZE);
+
+    // Freed blocks are reused for tasks of the same size
+    module.freeTaskMemory(taskA);
+    module.freeTaskMemory(taskB);
+    REQUIRE(module.allocateTaskMemory(33) == taskB);
+    REQUIRE(module.allocateTaskMemory(48) == taskA);
+
+    uint32_t taskC = module.allocateTaskMemory(16);
+    REQUIRE(taskC == taskB + 48);
+
+    // Blocks bigger than a chunk get their own mapping
+    uint32_t brkBeforeLarge = module.getCurrentBrk();
+    uint32_t taskD = module.allocateTaskMemory(TASK_MEMORY_CHUNK_SIZE + 1);
+    REQUIRE(module.getCurrentBrk() > brkBeforeLarge + TASK_MEMORY_CHUNK_SIZE);
+    module.freeTaskMemory(taskD);
+
+    REQUIRE_THROWS(module.freeTaskMemory(taskC + 8));
+}
+
+TEST_CASE_METHOD(WasmSnapTestFixture,
+                 "Test snapshot hints are applied to merge regions",
+                 "[wasm][snapshot]")
+{
+    faabric::Message m = faabric::util::messageFactory("demo", "echo");
+    wasm::WAVMWasmModule module;
+    module.bindToFunction(m);
+
+    uint32_t scratchPtr = module.mmapMemory(2 * WASM_BYTES_PER_PAGE);
+    uint32_t tablePtr = module.mmapMemory(WASM_BYTES_PER_PAGE);
+    uint32_t memSize = module.getMemorySizeBytes();
+
+    // Invalid hints
+    REQUIRE_THROWS(
+      module.setSnapshotHint(scratchPtr, 0, SnapshotHint::SCRATCH));
+    REQUIRE_THROWS(
+      module.setSnapshotHint(memSize - 10, 20, SnapshotHint::SCRATCH));
+    REQUIRE_THROWS(
+      module.setSnapshotHint(scratchPtr, 10, static_cast<SnapshotHint>(5)));
+
+    module.setSnapshotHint(
+      scratchPtr, 2 * WASM_BYTES_PER_PAGE, SnapshotHint::SCRATCH);
+    module.setSnapshotHint(tablePtr, 100, SnapshotHint::READ_ONLY);
+    REQUIRE(module.getSnapshotHints().size() == 2);
+
+    // Hints are added to merge regions alongside any others
+    module.addMergeRegionForNextThreads(
+      0,
+      sizeof(int32_t),
+      faabric::util::SnapshotDataType::Int,
+      faabric::util::SnapshotMergeOperation::Sum);
+
+    std::vector<faabric::util::SnapshotMergeRegion> regions =
+      module.getMergeRegions();
+    REQUIRE(regions.size() == 3);
+    REQUIRE(regions.at(1).offset == scratchPtr);
+    REQUIRE(regions.at(1).length == 2 * WASM_BYTES_PER_PAGE);
+    REQUIRE(regions.at(1).operation ==
+            faabric::util::SnapshotMergeOperation::Ignore);
+    REQUIRE(regions.at(2).offset == tablePtr);
+    REQUIRE(regions.at(2).length == 100);
+
+    // Hints persist when merge regions are cleared, and carry over to copies
+    module.clearMergeRegions();
+    REQUIRE(module.getMergeRegions().size() == 2);
+
+    wasm::WAVMWasmModule moduleCopy = module;
+    REQUIRE(moduleCopy.getSnapshotHints() == module.getSnapshotHints());
+
+    // Hints can be removed
+    module.setSnapshotHint(scratchPtr, 0, SnapshotHint::NONE);
+    REQUIRE(module.getSnapshotHints().size() == 1);
+    REQUIRE(module.getMergeRegions().size() == 1);
+}
 }
@@ -0,0 +1,107 @@
+#include <catch2/catch.hpp>
+
+#include <wasm/StdoutCapture.h>
+
+#include <faabric/util/files.h>
+
+#include <boost/filesystem.hpp>
+
+using namespace wasm;
+
+namespace tests {
+
+TEST_CASE("Test stdout capture policies", "[wasm]")
+{
+    REQUIRE_THROWS(StdoutCapture(10, "blah"));
+
+    std::string expected;
+    std::string policy;
+    size_t expectedDropped = 0;
+
+    SECTION("Fits in buffer")
+    {
+        policy = STDOUT_POLICY_TAIL;
+        expected = "abcdefgh";
+    }
+
+    SECTION("Head")
+    {
+        policy = STDOUT_POLICY_HEAD;
+        expectedDropped = 7;
+        expected = "abcdefghij\n[7 bytes of output dropped]";
+    }
+
+    SECTION("Tail")
+    {
+        policy = STDOUT_POLICY_TAIL;
+        expectedDropped = 7;
+        expected = "[7 bytes of output dropped]\nhijklmnopq";
+    }
+
+    size_t capacity = 10;
+    if (expectedDropped == 0) {
+        StdoutCapture capture(capacity, policy);
+        capture.write("abcd", 4);
+        capture.write("efgh", 4);
+        REQUIRE(capture.read() == expected);
+        REQUIRE(capture.getDroppedBytes() == 0);
+        return;
+    }
+
+    // Write across the end of the ring in several pieces
+    StdoutCapture capture(capacity, policy);
+    std::string partA = "abcdefg";
+    std::string partB = "hijklmn";
+    ::iovec iovecs[2] = {
+        { .iov_base = partA.data(), .iov_len = partA.size() },
+        { .iov_base = partB.data(), .iov_len = partB.size() },
+    };
+    REQUIRE(capture.write(iovecs, 2) == 14);
+    REQUIRE(capture.write("opq", 3) == 3);
+
+    REQUIRE(capture.getSize() == capacity);
+    REQUIRE(capture.getDroppedBytes() == expectedDropped);
+    REQUIRE(capture.read() == expected);
+
+    // Clearing starts again
+    capture.clear();
+    REQUIRE(capture.read().empty());
+    capture.write("xyz", 3);
+    REQUIRE(capture.read() == "xyz");
+}
+
+TEST_CASE("Test stdout capture with large writes", "[wasm]")
+{
+    StdoutCapture capture(4, STDOUT_POLICY_TAIL);
+    capture.write("ab", 2);
+    capture.write("cdefghij", 8);
+
+    REQUIRE(capture.getDroppedBytes() == 6);
+    REQUIRE(capture.read() == "[6 bytes of output dropped]\nghij");
+}
+
+TEST_CASE("Test stdout capture streaming to a directory", "[wasm]")
+{
+    std::string sinkDir = "/tmp/faasm_stdout_sink";
+    boost::filesystem::remove_all(sinkDir);
+    boost::filesystem::create_directories(sinkDir);
+
+    StdoutCapture capture(4, STDOUT_POLICY_HEAD, sinkDir);
+
+    // The sink gets everything, one file per call
+    capture.beginCall("callA");
+    capture.write("first call", 10);
+
+    capture.beginCall("callB");
+    capture.write("second call", 11);
+
+    REQUIRE(faabric::util::readFileToString(sinkDir + "/callA.stdout") ==
+            "first call");
+    REQUIRE(faabric::util::readFileToString(sinkDir + "/callB.stdout") ==
+            "second call");
+
+    REQUIRE(capture.getSize() == 4);
+
+    boost::filesystem::remove_all(sinkDir);
+}
+}